@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <iostream>
 #include <string>
 #include "store/store.hpp"
 #include "file_server/file_server.hpp"
@@ -15,6 +17,17 @@ public:
   // ---- STARTUP ----
   void run();
 
+  // ---- BATCH MODE ----
+  // Runs the commands of script without prompts or pagers, one per line,
+  // skipping blank lines and # comments. store, read and delete run on up to
+  // concurrency workers, in script order for any one file; any other command
+  // waits for them first, and store -r / fetch -r use concurrency workers
+  // themselves. read writes the raw file content to output. One tab separated
+  // timing line per command and a summary go to report. Returns false if any
+  // command failed
+  bool run_batch(std::istream& script, std::ostream& output, std::ostream& report,
+                 std::size_t concurrency = 1);
+
 private:
   // ---- PARAMETERS ----
   bool running_;
@@ -23,14 +36,47 @@ private:
   network::FileServer& file_server_;
 
 
+  // Outcome of one batch command
+  struct CommandResult {
+    bool ok{false};
+    std::uintmax_t bytes{0};
+    std::string error;
+  };
+
+
   // ---- COMMAND PROCESSING ----
   void process_command(const std::string& command, const std::string& filename);
   void handle_read_command(const std::string& filename);
   void handle_store_command(const std::string& filename);
+  // Routes store and fetch, which take -r <dir> for a whole directory tree
+  void handle_transfer_command(const std::string& command, const std::string& arguments);
   void handle_connect_command(const std::string& connection_string);
   void handle_delete_command(const std::string& filename);
+  void handle_profile_command(const std::string& arguments);
+  // create, delete, list and export store snapshots, returns false on errors
+  bool handle_snapshot_command(const std::string& arguments);
+  void handle_peers_command();
   void handle_help_command();
   void log_and_display_error(const std::string& message, const std::string& error);
+
+
+  // ---- BATCH MODE ----
+  CommandResult execute_batch_command(const std::string& command, const std::string& argument,
+                                      std::ostream& output, std::size_t concurrency);
+
+
+  // ---- RECURSIVE TRANSFER ----
+  // Stores one local file under key; files up to 1 MiB are read before the
+  // file server lock is taken
+  CommandResult store_local_file(const std::string& path, const std::string& key);
+  // Stores every regular file below directory under <directory>/<relative path>,
+  // then a manifest of the relative paths under <directory> itself. Progress
+  // with throughput and ETA goes to progress
+  CommandResult store_tree(const std::string& directory, std::size_t concurrency, std::ostream& progress);
+  // Fetches the manifest stored under directory and every file it lists into
+  // destination, or into directory when destination is empty
+  CommandResult fetch_tree(const std::string& directory, const std::string& destination,
+                           std::size_t concurrency, std::ostream& progress);
 };
 
 } // namespace cli
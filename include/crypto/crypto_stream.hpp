@@ -42,6 +42,19 @@ public:
   std::ostream& encrypt(std::istream& input, std::ostream& output);
   std::ostream& decrypt(std::istream& input, std::ostream& output);
 
+
+  // ---- INCREMENTAL ENCRYPTION/DECRYPTION OPERATIONS ----
+  // Starts a cipher stream in the current mode that is fed in several pieces
+  void begin_stream();
+  // Processes the whole input stream, carrying cipher state to the next call
+  void update_stream(std::istream& input, std::ostream& output);
+  // Writes the final padded block and ends the cipher stream
+  void finish_stream(std::ostream& output);
+  // Buffer variants, output must have room for size + BLOCK_SIZE bytes.
+  // Both return the number of bytes written
+  size_t update_stream(const uint8_t* input, size_t size, uint8_t* output);
+  size_t finish_stream(uint8_t* output);
+
   
   // ---- GETTERS/SETTERS ----
   void setMode(Mode mode) { mode_ = mode; }
@@ -53,6 +66,7 @@ private:
   std::vector<uint8_t> iv_;
   std::unique_ptr<CipherContext> context_;
   bool is_initialized_ = false;
+  bool is_streaming_ = false;
   Mode mode_ = Mode::Encrypt;  // Default to encryption mode
   std::istream* pending_input_ = nullptr;  
   static constexpr size_t BUFFER_SIZE = 8192; 
@@ -71,6 +85,8 @@ private:
                                    const std::function<void()>& operation);
   // Performs the main encryption/decryption loop on the input stream
   void processStreamData(std::istream& input, std::ostream& output, bool encrypting);
+  // Runs every block of the input through the cipher without finalizing, returns bytes written
+  size_t processBlocks(std::istream& input, std::ostream& output, bool encrypting, size_t& block_count);
   // Encrypts or decrypts a single block of data using the configured cipher
   size_t processDataBlock(const uint8_t* inbuf, size_t bytes_read, uint8_t* outbuf, 
                         bool encrypting);
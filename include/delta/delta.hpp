@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfs {
+namespace delta {
+
+// rsync style delta transfer. The side holding an old version of a file
+// describes it as per-block signatures; the side holding the new version
+// slides a window over it, byte by byte, and turns every window matching an
+// old block into a copy instruction and everything else into literal bytes.
+// Applying the instructions to the old version rebuilds the new one
+
+// ---- CONSTANTS ----
+// Bytes of the truncated SHA-256 kept per block
+constexpr std::size_t STRONG_HASH_SIZE = 16;
+constexpr std::size_t MIN_BLOCK_SIZE = 2 * 1024;
+constexpr std::size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+
+// ---- ROLLING CHECKSUM ----
+// The rsync weak checksum: a is the byte sum and b the position weighted sum
+// of a window, both mod 2^16. Sliding the window by one byte is O(1)
+class RollingChecksum {
+public:
+  void reset(const uint8_t* data, std::size_t length);
+  // Drops out from the front of the window and appends in at its end
+  void roll(uint8_t out, uint8_t in) {
+    a_ += in - out;
+    b_ += a_ - static_cast<uint32_t>(length_) * out;
+  }
+  uint32_t digest() const { return (a_ & 0xffff) | (b_ << 16); }
+
+private:
+  uint32_t a_{0};
+  uint32_t b_{0};
+  std::size_t length_{0};
+};
+
+
+// ---- SIGNATURES ----
+struct BlockSignature {
+  uint32_t weak;
+  std::array<uint8_t, STRONG_HASH_SIZE> strong;
+};
+
+// Signatures of every block of a file, the last block may be short
+struct Signatures {
+  uint32_t block_size{0};
+  uint64_t file_size{0};
+  std::vector<BlockSignature> blocks;
+
+  // Layout: block size u32, file size u64, block count u32, then per block
+  // the weak checksum u32 and the strong hash, integers big endian
+  void write(std::string& output) const;
+  // Throws std::invalid_argument for malformed input
+  static Signatures parse(std::string_view input);
+};
+
+// Block size growing with the square root of the file, within the limits
+std::size_t choose_block_size(uint64_t file_size);
+// Reads input to the end
+Signatures compute_signatures(std::istream& input, uint64_t file_size);
+std::array<uint8_t, STRONG_HASH_SIZE> strong_hash(const uint8_t* data, std::size_t length);
+
+
+// ---- DELTAS ----
+// Delta layout: block size u32, then instructions
+//   'C' first block u32, block count u32 - copy blocks of the old version
+//   'L' length u32, bytes                - literal bytes
+//   'E' new size u64                     - end
+struct DeltaStats {
+  uint64_t copied_bytes{0};
+  uint64_t literal_bytes{0};
+};
+
+// Writes the instructions turning the version behind basis into input
+DeltaStats generate(const Signatures& basis, std::istream& input, std::ostream& delta);
+// Rebuilds the new version from the old one. Throws std::invalid_argument
+// when the delta is malformed or does not fit basis
+void apply(std::istream& basis, std::istream& delta, std::ostream& output);
+
+
+// ---- DIGESTS ----
+// Hex SHA-256, the form Store records content digests in
+std::string sha256_hex(std::string_view data);
+
+} // namespace delta
+} // namespace dfs
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dfs {
+namespace erasure {
+namespace gf256 {
+
+// Arithmetic in GF(2^8) with the Reed-Solomon polynomial x^8 + x^4 + x^3 + x^2 + 1.
+// Addition is XOR; multiplication goes through log/exp tables
+
+// ---- ELEMENT OPERATIONS ----
+uint8_t mul(uint8_t a, uint8_t b);
+uint8_t div(uint8_t a, uint8_t b);
+uint8_t inv(uint8_t a);
+
+
+// ---- REGION KERNELS ----
+// Region multiplies split every byte into nibbles and look both up in two
+// 16 entry tables of products, which SSSE3 and AVX2 do 16 or 32 bytes at a
+// time with one shuffle per nibble
+enum class Kernel {
+  Scalar,
+  Ssse3,
+  Avx2
+};
+
+// Fastest kernel the CPU supports, Scalar when SIMD is compiled out
+Kernel best_kernel();
+bool kernel_supported(Kernel kernel);
+const char* kernel_name(Kernel kernel);
+
+// dst[i] ^= c * src[i] for length bytes
+void mul_add_region(uint8_t c, const uint8_t* src, uint8_t* dst, std::size_t length);
+void mul_add_region(uint8_t c, const uint8_t* src, uint8_t* dst, std::size_t length, Kernel kernel);
+
+} // namespace gf256
+} // namespace erasure
+} // namespace dfs
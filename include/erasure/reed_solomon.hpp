@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+namespace dfs {
+namespace erasure {
+
+// Systematic Reed-Solomon code over GF(2^8): an object is cut into k data
+// fragments of equal length, and m parity fragments are computed from them
+// with a Cauchy matrix. Any k of the k + m fragments rebuild the object
+class ReedSolomon {
+public:
+  // ---- CONSTANTS ----
+  // Distinct evaluation points GF(2^8) offers for data and parity rows
+  static constexpr std::size_t MAX_FRAGMENTS = 256;
+
+
+  // ---- CONSTRUCTOR ----
+  // Throws std::invalid_argument unless k >= 1, m >= 1 and k + m <= MAX_FRAGMENTS
+  ReedSolomon(std::size_t data_fragments, std::size_t parity_fragments);
+
+
+  // ---- CODING ----
+  // Fills the m parity buffers from the k data buffers, each length bytes
+  void encode(const std::vector<const uint8_t*>& data, const std::vector<uint8_t*>& parity,
+              std::size_t length) const;
+  // Fills parity fragment index alone. Every byte only depends on the data
+  // bytes at the same offset, so fragments can be encoded stripe by stripe
+  void encode_parity(std::size_t index, const std::vector<const uint8_t*>& data, uint8_t* parity,
+                     std::size_t length) const;
+  // Rebuilds the k data fragments into data from fragments, which holds one
+  // entry per fragment index with nullptr for the missing ones. Returns
+  // false when fewer than k fragments are present
+  bool decode(const std::vector<const uint8_t*>& fragments, const std::vector<uint8_t*>& data,
+              std::size_t length) const;
+
+
+  // ---- GETTERS ----
+  std::size_t data_fragments() const { return data_fragments_; }
+  std::size_t parity_fragments() const { return parity_fragments_; }
+  std::size_t total_fragments() const { return data_fragments_ + parity_fragments_; }
+  // Length of each fragment for an object of object_size bytes
+  std::size_t fragment_size(std::uint64_t object_size) const;
+
+private:
+  // ---- PARAMETERS ----
+  std::size_t data_fragments_;
+  std::size_t parity_fragments_;
+  // m x k coefficients, parity[i] = sum over j of parity_matrix_[i * k + j] * data[j]
+  std::vector<uint8_t> parity_matrix_;
+
+
+  // ---- MATRIX SUPPORT ----
+  // Row of the full (k + m) x k encoding matrix for fragment index
+  std::vector<uint8_t> encoding_row(std::size_t index) const;
+  // Inverts the k x k matrix in place, returns false if it is singular
+  bool invert(std::vector<uint8_t>& matrix) const;
+};
+
+// Header in front of every stored fragment, so a fragment is self-describing.
+// The generation tells versions of an object apart, so fragments of two
+// different stores are never decoded together
+struct FragmentHeader {
+  // ---- CONSTANTS ----
+  static constexpr std::size_t SIZE = 24;
+  static constexpr uint8_t VERSION = 2;
+
+  // ---- PARAMETERS ----
+  uint8_t data_fragments{0};
+  uint8_t parity_fragments{0};
+  uint8_t index{0};
+  uint64_t object_size{0};
+  uint64_t generation{0};
+
+  // ---- SERIALIZATION ----
+  // Layout: "DFRS", version, k, m, index, object size, generation (8 bytes
+  // each, big endian)
+  void write(std::ostream& output) const;
+  // Returns nothing when the bytes are not a fragment header of this version
+  static std::optional<FragmentHeader> parse(const uint8_t* data, std::size_t length);
+};
+
+} // namespace erasure
+} // namespace dfs
@@ -1,21 +1,28 @@
 #ifndef DFS_NETWORK_FILE_SERVER_HPP
 #define DFS_NETWORK_FILE_SERVER_HPP
 
+#include <chrono>
 #include <cstdint>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <string>
 #include <sstream>
 #include <optional>
+#include <deque>
+#include <map>
+#include <set>
 #include "store/store.hpp"
+#include "erasure/reed_solomon.hpp"
 #include "network/codec.hpp"
 #include "network/message_frame.hpp"
 #include "network/channel.hpp"
 #include "crypto/crypto_stream.hpp"
 #include "utils/pipeliner.hpp"
 #include "network/tcp_server.hpp" 
+#include "file_server/replication_journal.hpp"
 
 namespace dfs {
 namespace network {
@@ -38,12 +45,112 @@ public:
   // ---- PROCESSING OF USER REQUESTS ----
   bool store_file(const std::string& filename, std::istream& input);
   bool get_file(const std::string& filename);
+  // Like get_file, but writes the content to output instead of paging it
+  bool fetch_file(const std::string& filename, std::ostream& output);
+
+
+  // ---- BACKGROUND REPLICATION ----
+  // With full replication, store_file stores the file locally, queues it for
+  // every connected peer in a ReplicationJournal kept next to the store and
+  // returns. REPLICATION_WORKERS background threads drain the journal, each
+  // peer's sends in order, retrying failed ones with backoff and right away
+  // once a peer that was gone connects again
+  // Waits until no sends are pending, false when timeout passes first
+  bool wait_for_replication(std::chrono::milliseconds timeout);
+  std::size_t pending_replications() const { return replication_->pending(); }
+
+
+  // ---- WRITE QUORUM ----
+  // Peers answer every file they are sent with a STORE_ACK once it is on
+  // their disk, and journal entries only leave on that acknowledgement.
+  // With write_quorum > 0, store_file also syncs the local copy and returns
+  // once write_quorum peers acknowledged the new content, false when fewer
+  // peers are connected or they do not answer within WRITE_QUORUM_TIMEOUT.
+  // The other peers are sent the file in the background either way. 0, the
+  // default, returns once the file is stored locally and queued
+  void set_write_quorum(std::size_t write_quorum);
+
+
+  // ---- ERASURE CODING ----
+  // With parity_fragments > 0, store_file splits new files into k data and m
+  // parity fragments on k + m distinct nodes instead of sending a full copy
+  // to every peer, and reads rebuild files from any k fragments. Every node
+  // should use the same k and m. 0 parity fragments restores full replication
+  void set_erasure_coding(std::size_t data_fragments, std::size_t parity_fragments);
+  // Key fragment index of filename is stored under
+  static std::string fragment_key(const std::string& filename, std::size_t index);
+
+
+  // ---- ANTI-ENTROPY ----
+  // Every interval the server compares its store's Merkle tree with each
+  // peer's, descending only into ranges whose hashes differ. Of two versions
+  // of a key the one with the higher generation wins, and a deletion is a
+  // version too. Changes at the same generation are counted as conflicts and
+  // settled by the higher digest. 0 stops the background exchange
+  void set_anti_entropy_interval(std::chrono::milliseconds interval);
+  // Starts one exchange with every connected peer right away
+  void sync_with_peers();
+
+
+  // ---- READ-THROUGH CACHING ----
+  // With full replication, a file this node does not hold is fetched from
+  // a peer and kept as a cached copy along with its version, the content
+  // digest and generation on the peer. Later reads send that version in a
+  // GET_IF_NONE_MATCH to one peer at a time, and peers holding the same
+  // content answer with a NOT_MODIFIED header instead of the file, peers
+  // holding none with NOT_HELD. Cached copies are swept like
+  // the copies of hot erasure coded files below
+  // Version the cached copy of filename was fetched at, empty when there is none
+  store::Store::ObjectVersion cached_version(const std::string& filename);
+
+
+  // ---- HOT KEY CACHING ----
+  // Erasure coded reads fetch k fragments from k nodes every time, so a key
+  // read often keeps loading the same nodes. Once this node has read a key
+  // hot_reads times, older reads weighing half as much every half_life, it
+  // keeps the rebuilt file as a cached copy and reads it locally. A sweep
+  // every CACHE_SWEEP_INTERVAL drops copies whose reads fell below a quarter
+  // of hot_reads. 0 hot_reads stops caching and drops every copy
+  void set_hot_key_policy(double hot_reads, std::chrono::milliseconds half_life);
+  // Drops the cached copies that went cold and returns how many
+  std::size_t sweep_cached_copies();
+  // Key the cached copy of filename is stored under
+  static std::string cache_key(const std::string& filename);
 
   
   // ---- GETTERS ----
   dfs::store::Store& get_store() { return *store_; }
+  PeerManager& get_peer_manager() { return peer_manager_; }
   
 private:
+  // ---- CONSTANTS ----
+  // Chunk size used when streaming files through the send pipeline
+  static constexpr std::size_t PIPELINE_CHUNK_SIZE = 64 * 1024;
+  static constexpr std::chrono::milliseconds DEFAULT_ANTI_ENTROPY_INTERVAL{60000};
+  // Smaller files are sent without asking first, the question would cost about as much
+  static constexpr std::uintmax_t HAVE_QUERY_MIN_SIZE = 64 * 1024;
+  static constexpr std::chrono::milliseconds HAVE_QUERY_TIMEOUT{2000};
+  // Bytes of each fragment erasure coded at a time, which bounds the memory
+  // a store takes however large the file
+  static constexpr std::size_t ERASURE_STRIPE_SIZE = 64 * 1024;
+  // A delta is only sent when it is at most this share of the file, in percent
+  static constexpr std::uintmax_t DELTA_MAX_PERCENT = 90;
+  static constexpr double DEFAULT_HOT_READS = 3.0;
+  static constexpr std::chrono::milliseconds DEFAULT_READ_HALF_LIFE{300000};
+  static constexpr std::chrono::milliseconds CACHE_SWEEP_INTERVAL{30000};
+  // Cached copies are dropped below this share of the hot threshold, so a
+  // key near the threshold is not cached and dropped over and over
+  static constexpr double COLD_READ_FRACTION = 0.25;
+  static constexpr std::chrono::milliseconds NETWORK_GET_TIMEOUT{5000};
+  // A cached copy is read as is when no peer confirms or replaces it in time
+  static constexpr std::chrono::milliseconds REVALIDATE_TIMEOUT{2000};
+  static constexpr std::size_t REPLICATION_WORKERS = 2;
+  // Workers look for peers that connected again at least this often
+  static constexpr std::chrono::milliseconds REPLICATION_POLL_INTERVAL{1000};
+  // A sent file not acknowledged in time is sent again after the journal's backoff
+  static constexpr std::chrono::milliseconds STORE_ACK_TIMEOUT{5000};
+  static constexpr std::chrono::milliseconds WRITE_QUORUM_TIMEOUT{10000};
+
   // ---- PARAMETERS ----
   uint32_t ID_;
   std::vector<uint8_t> key_;
@@ -56,20 +163,109 @@ private:
   std::atomic<bool> running_{true};
   std::unique_ptr<std::thread> listener_thread_;
 
+  // Fragment layout for erasure coded stores, null with full replication
+  std::unique_ptr<erasure::ReedSolomon> erasure_;
+  // Peer acknowledgements store_file waits for, guarded by mutex_
+  std::size_t write_quorum_{0};
+
+  // Signalled whenever an incoming file is stored, wakes network retrievals
+  std::mutex arrival_mutex_;
+  std::condition_variable arrival_cv_;
+  // Outstanding conditional gets by filename, with the type of the first
+  // answer once it arrived. Guarded by arrival_mutex_
+  std::map<std::string, std::optional<MessageType>> conditional_gets_;
+  // Fragments a finished read asked for but did not get, by key, with when
+  // the read gave up on them. Guarded by arrival_mutex_
+  std::map<std::string, std::chrono::steady_clock::time_point> abandoned_fragments_;
+  // Generation given to the last erasure coded store. Guarded by mutex_
+  uint64_t last_fragment_generation_{0};
+
+  // Sends still to be made to peers, and the workers making them. Woken by
+  // new entries, finished sends and shutdown
+  std::unique_ptr<ReplicationJournal> replication_;
+  std::vector<std::thread> replication_threads_;
+  std::mutex replication_mutex_;
+  std::condition_variable replication_cv_;
+
+  // STORE_ACKs of the contents being waited for, by filename and digest,
+  // with the peers that acknowledged and the number of callers waiting
+  struct AckWait {
+    std::set<uint8_t> peers;
+    std::size_t waiters{0};
+  };
+  std::mutex ack_mutex_;
+  std::condition_variable ack_cv_;
+  std::map<std::pair<std::string, std::string>, AckWait> acks_;
+
+  // Background anti-entropy exchange, woken early by interval changes and shutdown
+  std::unique_ptr<std::thread> anti_entropy_thread_;
+  std::mutex anti_entropy_mutex_;
+  std::condition_variable anti_entropy_cv_;
+  std::chrono::milliseconds anti_entropy_interval_{DEFAULT_ANTI_ENTROPY_INTERVAL};
+
+  // Answers to the outstanding HAVE_QUERY of each file, by peer. A peer
+  // holding an older version answers with the block signatures of it
+  struct HaveReply {
+    bool have;
+    std::string signatures;
+  };
+  struct HaveQuery {
+    std::string digest;
+    std::map<uint8_t, HaveReply> replies;
+  };
+  std::mutex have_mutex_;
+  std::condition_variable have_cv_;
+  std::map<std::string, HaveQuery> have_queries_;
+
+  // HAVE_QUERYs from peers the index cannot answer, because they need a
+  // local copy or the signatures of an older version. Answered by
+  // inventory_thread_, so the listener goes on reading frames meanwhile
+  struct InventoryWork {
+    uint8_t peer_id;
+    std::string key;
+    std::string digest;
+    uint64_t size;
+  };
+  std::unique_ptr<std::thread> inventory_thread_;
+  std::mutex inventory_mutex_;
+  std::condition_variable inventory_cv_;
+  std::deque<InventoryWork> inventory_work_;
+
+  // Decayed read counts of files read from other nodes, and the files with
+  // a cached copy and its version, guarded by popularity_mutex_. Copies of
+  // erasure coded files are rebuilt here and have no version
+  struct ReadRate {
+    double reads;
+    std::chrono::steady_clock::time_point last;
+  };
+  std::mutex popularity_mutex_;
+  std::condition_variable popularity_cv_;
+  std::unique_ptr<std::thread> popularity_thread_;
+  double hot_reads_{DEFAULT_HOT_READS};
+  std::chrono::milliseconds read_half_life_{DEFAULT_READ_HALF_LIFE};
+  std::map<std::string, ReadRate> read_rates_;
+  std::map<std::string, store::Store::ObjectVersion> cached_copies_;
+
   
   // ---- PROCESSING OF OUTGOING DATA ----
-  // Prepare and send file to peers with specified message type
-  bool prepare_and_send(const std::string& filename, MessageType message_type, std::optional<uint8_t> peer_id = std::nullopt);
+  // Prepare and send file to peers with specified message type. A non-empty
+  // name is sent in the filename field in place of filename
+  bool prepare_and_send(const std::string& filename, MessageType message_type, std::optional<uint8_t> peer_id = std::nullopt,
+                        const std::string& name = {});
   // Creates MessageFrame with appropriate metadata and IV
-  MessageFrame create_message_frame(const std::string& filename, MessageType message_type);
-  // Creates producer function to handle file content streaming based on message type
-  std::function<bool(std::stringstream&)> create_producer(const std::string& filename, MessageType message_type);
-  // Creates transform function to serialize message frame data
-  std::function<bool(std::stringstream&, std::stringstream&)> create_transform(
-    MessageFrame& frame, 
-    utils::Pipeliner* pipeline);
+  MessageFrame create_message_frame(const std::string& filename, MessageType message_type,
+    const std::string& name = {});
+  // Creates producer function streaming the filename and then file content in chunks
+  utils::ProducerFn create_producer(const std::string& filename, MessageType message_type,
+    std::size_t chunk_size, const std::string& name = {});
+  // Adds a stage that writes the frame header and encrypts the payload as it streams through
+  void create_transform(const MessageFrame& frame, utils::Pipeliner& pipeline);
   // Handles sending pipeline data to specific peer or broadcasting
   bool send_pipeline(dfs::utils::Pipeliner* const& pipeline, std::optional<uint8_t> peer_id);
+  // Adds the finished pipeline's per-stage accounting to the process metrics
+  void record_pipeline_stats(const utils::Pipeliner& pipeline);
+  // Sends a message that carries no file, whose body travels in the filename field
+  bool send_control(MessageType message_type, const std::string& body, uint8_t peer_id);
 
   
   // ---- PROCESSING OF INCOMING DATA ----
@@ -86,7 +282,121 @@ private:
   
   // Called by get_file to retrieve file from store/network
   bool read_from_local_store(const std::string& filename);
-  bool retrieve_from_network(const std::string& filename);
+  // Fetches or revalidates the cached copy of filename and sets source to
+  // the key holding the content, the cached copy unless a full copy arrived
+  bool retrieve_from_network(const std::string& filename, std::string& source);
+
+
+  // ---- READ-THROUGH CACHING ----
+  // Sends the file, or NOT_MODIFIED when the sender's cached version matches,
+  // or NOT_HELD without a full copy
+  bool handle_get_if_none_match(const MessageFrame& frame);
+  bool handle_not_modified(const MessageFrame& frame);
+  // Lets the pending conditional get move on to the next peer
+  bool handle_not_held(const MessageFrame& frame);
+  // Keeps the file as a cached copy when it answers this node's conditional get
+  bool handle_cached_file(const MessageFrame& frame);
+
+
+  // ---- BACKGROUND REPLICATION ----
+  void replication_loop();
+  // Sends key to the peers of a claimed batch and finishes their entries.
+  // When every connected peer needs the whole file it is broadcast, so it is
+  // encrypted once for everyone
+  void replicate(const std::vector<ReplicationJournal::Entry>& batch);
+
+
+  // ---- WRITE QUORUM ----
+  // Collects the STORE_ACKs of filename's content with digest until the
+  // matching forget_acks. Acknowledgements nobody expects are dropped
+  void expect_acks(const std::string& filename, const std::string& digest);
+  void forget_acks(const std::string& filename, const std::string& digest);
+  // Counts peer_id as holding the content, when it is expected
+  void record_ack(const std::string& filename, const std::string& digest, uint8_t peer_id);
+  // Waits until count of peers acknowledged the content or timeout passes,
+  // and returns the ones that did
+  std::set<uint8_t> wait_for_acks(const std::string& filename, const std::string& digest,
+                                  const std::vector<uint8_t>& peers, std::size_t count,
+                                  std::chrono::milliseconds timeout);
+  // Syncs key to disk and acknowledges the version now stored to peer_id
+  bool send_store_ack(const std::string& key, uint8_t peer_id);
+  bool handle_store_ack(const MessageFrame& frame);
+
+
+  // ---- ERASURE CODING ----
+  // Encodes input stripe by stripe into fragments in the local store, then
+  // sends each fragment to its own node, keeping one locally. A failed send
+  // removes the fragments of this store again, here and on the nodes sent to
+  bool store_erasure_coded(const std::string& filename, std::istream& input);
+  // Asks peers for filename and its missing fragments at once, and waits until
+  // the full file or k fragments are local. requested collects the fragments asked for
+  bool retrieve_fragments(const std::string& filename, std::vector<std::size_t>& requested);
+  // Rebuilds filename from its local fragments into output
+  bool decode_fragments(const std::string& filename, std::ostream& output);
+  // Drops the requested fragments again, so reads do not pile up copies.
+  // Answers still on their way are dropped when they arrive
+  void discard_fragments(const std::string& filename, const std::vector<std::size_t>& requested);
+  // Header of a local fragment, nothing when it is missing or not a fragment
+  std::optional<erasure::FragmentHeader> fragment_header(const std::string& key);
+  // Removes the local fragments of filename older than generation or, with
+  // exact, those of that generation
+  void drop_fragments(const std::string& filename, uint64_t generation, bool exact);
+  bool handle_drop_fragments(const MessageFrame& frame);
+
+
+  // ---- ANTI-ENTROPY ----
+  void anti_entropy_loop();
+  // Answers differing inner nodes with their children and differing leaves with their keys
+  bool handle_sync_tree(const MessageFrame& frame);
+  // Pulls or deletes the keys the sender holds newer versions of. With the
+  // sender's whole leaves, a SYNC_KEYS, also answers with a SYNC_NEWER of the
+  // keys this node holds newer versions of
+  bool handle_sync_keys(const MessageFrame& frame, bool whole_leaves);
+
+
+  // ---- INVENTORY EXCHANGE ----
+  // Asks peers whether they already hold filename with the same content, and
+  // returns the ones that do not or did not answer in time, each with the
+  // serialized signatures of its older version or empty for a full send
+  std::map<uint8_t, std::string> peers_lacking(const std::string& filename, const std::vector<uint8_t>& peers);
+  // Answers from the index whether this node holds the content, and leaves
+  // queries that need a local copy or signatures to the inventory worker
+  bool handle_have_query(const MessageFrame& frame);
+  bool handle_have_reply(const MessageFrame& frame);
+  void inventory_loop();
+  // Copies the content from another local key when it can, or describes the
+  // version held instead, and answers the query
+  bool answer_have_query(const InventoryWork& query);
+  bool send_have_reply(uint8_t peer_id, uint8_t state, const std::string& digest, const std::string& key,
+                       const std::string& signatures);
+
+
+  // ---- DELTA TRANSFER ----
+  // Sends filename to peer_id as the changes against the older version behind
+  // signatures. Returns false when the delta would not be worth it or could
+  // not be sent, the caller then sends the whole file
+  bool send_delta(const std::string& filename, uint8_t peer_id, const std::string& signatures);
+  // Rebuilds the new version from the local one, asking the sender for the
+  // whole file when the result does not match its digest
+  bool handle_delta(const MessageFrame& frame);
+
+
+  // ---- HOT KEY CACHING ----
+  // Counts a read of filename and returns whether it is hot now
+  bool record_read(const std::string& filename);
+  // Reads weighed by age. Caller holds popularity_mutex_
+  double current_reads(const ReadRate& rate, std::chrono::steady_clock::time_point now) const;
+  // Stores content as the cached copy of filename
+  void add_cached_copy(const std::string& filename, std::istream& content,
+                       const store::Store::ObjectVersion& version = {});
+  // Drops the cached copy of filename, whose content changed
+  void drop_cached_copy(const std::string& filename);
+  // The cached files are listed in a store object, so copies left from before
+  // a restart are still swept
+  void load_cached_copies();
+  // Caller holds popularity_mutex_
+  void save_cached_copies();
+  void popularity_loop();
 };
 
 } // namespace network
@@ -0,0 +1,122 @@
+#ifndef DFS_NETWORK_REPLICATION_JOURNAL_HPP
+#define DFS_NETWORK_REPLICATION_JOURNAL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "tracing/tracer.hpp"
+
+namespace dfs {
+namespace network {
+
+// Durable queue of the files still to be sent to peers. Every entry is one
+// key for one peer. A peer's entries are sent in the order they were queued,
+// one at a time, and a failed send is retried after a backoff before the
+// peer's later entries go out. Entries only leave the journal once sent, and
+// the log is replayed on start, so sends cut short by a restart are made after it
+//
+// The log is append-only, one record per line:
+//   "A <seq> <peer> <length>:<key>"  key queued for peer as entry seq
+//   "C <seq>"                        entry seq sent
+// Opening the journal replays the log and rewrites it with the pending entries only
+class ReplicationJournal {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    uint64_t seq;
+    uint8_t peer_id;
+    std::string key;
+    // Trace of the store that queued the entry, not kept in the log
+    tracing::TraceContext trace;
+  };
+
+  // ---- CONSTANTS ----
+  static constexpr std::chrono::milliseconds DEFAULT_MIN_BACKOFF{250};
+  static constexpr std::chrono::milliseconds DEFAULT_MAX_BACKOFF{30000};
+  // The log is rewritten once it holds this many more records than pending entries
+  static constexpr std::size_t COMPACT_SLACK = 4096;
+
+  explicit ReplicationJournal(const std::filesystem::path& path,
+                              std::chrono::milliseconds min_backoff = DEFAULT_MIN_BACKOFF,
+                              std::chrono::milliseconds max_backoff = DEFAULT_MAX_BACKOFF);
+
+  ReplicationJournal(const ReplicationJournal&) = delete;
+  ReplicationJournal& operator=(const ReplicationJournal&) = delete;
+
+  // ---- QUEUEING ----
+  // Queues key for every peer in peers and returns the number of new entries.
+  // A peer that still has key queued gets no second entry, sends read the
+  // latest content anyway. An entry being sent does not count, the content
+  // may have changed after it was read
+  std::size_t append(const std::string& key, const std::vector<uint8_t>& peers,
+                     const tracing::TraceContext& trace = {});
+
+  // ---- SENDING ----
+  // Claims the next batch to send: the oldest entry that heads the queue of
+  // a connected peer, is due and whose key is not being sent already, along
+  // with the entries for the same key heading the queues of the other
+  // connected peers that are due. Peers with a claimed entry are skipped
+  // until it is finished. Empty when nothing is due. A peer that was missing
+  // from connected at an earlier claim is due again right away
+  std::vector<Entry> claim(const std::vector<uint8_t>& connected, Clock::time_point now = Clock::now());
+  // Ends a claimed entry. Sent entries leave the journal, failed ones stay at
+  // the head of their queue and are due again after a backoff that doubles
+  // with every failure in a row, from min_backoff up to max_backoff
+  void finish(const Entry& entry, bool sent, Clock::time_point now = Clock::now());
+
+  // ---- STATE ----
+  std::size_t pending() const;
+  std::size_t pending(uint8_t peer_id) const;
+  // Earliest time a connected peer's head entry can be claimed, nullopt
+  // when there is none or only ones waiting for their key to be sent
+  std::optional<Clock::time_point> next_due(const std::vector<uint8_t>& connected) const;
+
+private:
+  struct Queued {
+    uint64_t seq;
+    std::string key;
+    tracing::TraceContext trace;
+  };
+  struct PeerQueue {
+    std::deque<Queued> entries;
+    // The head entry is claimed
+    bool busy{false};
+    // Sends of the head entry that failed in a row
+    unsigned failures{0};
+    Clock::time_point due{};
+    // Missing from connected at the last claim
+    bool absent{false};
+  };
+
+  // Replays the log into peers_, a torn record at the end is what a crash mid-append leaves
+  void replay();
+  // Rewrites the log with the pending entries and reopens it for appending
+  void compact();
+  void write_append_record(std::ostream& log, uint64_t seq, uint8_t peer_id, const std::string& key);
+  std::chrono::milliseconds backoff(unsigned failures) const;
+
+  std::filesystem::path path_;
+  std::chrono::milliseconds min_backoff_;
+  std::chrono::milliseconds max_backoff_;
+  mutable std::mutex mutex_;
+  std::ofstream log_;
+  std::map<uint8_t, PeerQueue> peers_;
+  // Keys of the claimed entries, with the number of peers each is being sent to
+  std::map<std::string, std::size_t> in_flight_;
+  uint64_t next_seq_{1};
+  std::size_t pending_{0};
+  std::size_t records_{0};
+};
+
+} // namespace network
+} // namespace dfs
+
+#endif // DFS_NETWORK_REPLICATION_JOURNAL_HPP
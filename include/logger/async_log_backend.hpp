@@ -0,0 +1,72 @@
+#ifndef DFS_ASYNC_LOG_BACKEND_HPP
+#define DFS_ASYNC_LOG_BACKEND_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/frontend_requirements.hpp>
+#include "utils/bounded_ring.hpp"
+
+namespace dfs::crypto {
+
+// Boost.Log backend that never blocks the logging thread. Records are
+// formatted by the caller, moved into a lock-free bounded ring and written
+// by a single background thread. When the ring is full the record is
+// dropped and counted, and the writer reports the loss in the log itself.
+// Use behind an unlocked_sink so no frontend lock is taken either.
+class AsyncLogBackend
+  : public boost::log::sinks::basic_formatted_sink_backend<
+      char, boost::log::sinks::concurrent_feeding> {
+public:
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  // Writes to the given stream, which must outlive the backend when not owned
+  AsyncLogBackend(std::shared_ptr<std::ostream> output, std::size_t queue_capacity);
+  ~AsyncLogBackend();
+
+  AsyncLogBackend(const AsyncLogBackend&) = delete;
+  AsyncLogBackend& operator=(const AsyncLogBackend&) = delete;
+
+
+  // ---- SINK BACKEND INTERFACE ----
+  // Called on the logging thread, queues the formatted record
+  void consume(const boost::log::record_view& record, const string_type& message);
+  // Blocks until every record queued before the call has been written
+  void flush();
+
+
+  // ---- CONTROL METHODS ----
+  // Writes the remaining records and stops the writer thread
+  void stop();
+
+
+  // ---- GETTERS ----
+  std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  std::uint64_t written() const { return written_.load(std::memory_order_acquire); }
+
+private:
+  // ---- PARAMETERS ----
+  std::shared_ptr<std::ostream> output_;
+  utils::BoundedRing<std::string> ring_;
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<std::uint64_t> written_{0};
+  std::atomic<bool> running_{true};
+  std::uint64_t reported_drops_{0};
+  std::thread writer_;
+
+
+  // ---- WRITER THREAD ----
+  // Drains the ring in batches, flushing the stream once per batch
+  void writer_loop();
+  // Writes everything currently queued, returns the number of records written
+  std::size_t drain();
+  // Emits a notice when records were dropped since the last report
+  bool report_drops();
+};
+
+} // namespace dfs::crypto
+
+#endif // DFS_ASYNC_LOG_BACKEND_HPP
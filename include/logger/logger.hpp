@@ -1,61 +1,71 @@
 #ifndef DFS_LOGGER_HPP
 #define DFS_LOGGER_HPP
 
-#include <boost/log/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <boost/log/trivial.hpp>
-#include <boost/log/expressions.hpp>
-#include <boost/log/sinks/text_file_backend.hpp>
-#include <boost/log/utility/setup/file.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/sources/record_ostream.hpp>
-#include <boost/log/support/date_time.hpp>
-#include <boost/log/utility/setup/console.hpp>
+
+// Lowest severity compiled into the binary, 0 = trace ... 5 = fatal.
+// Statements below it are removed by the compiler, so trace and debug logging
+// in hot loops costs nothing in release builds
+#ifndef DFS_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define DFS_LOG_MIN_LEVEL 2
+#else
+#define DFS_LOG_MIN_LEVEL 0
+#endif
+#endif
 
 namespace dfs::crypto {
 
 class Logger {
 public:
-  static void init(const std::string& log_file = "dfs_crypto.log") {
-    namespace logging = boost::log;
-    namespace keywords = boost::log::keywords;
-    namespace expr = boost::log::expressions;
-
-    // Add common attributes
-    logging::add_common_attributes();
-
-    // Setup file sink
-    logging::add_file_log(
-      keywords::file_name = log_file,
-      keywords::auto_flush = true,
-      keywords::format = (
-        expr::stream
-          << "[" << expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S")
-          << "] [" << logging::trivial::severity
-          << "] " << expr::smessage
-      )
-    );
-
-    // Set the minimum severity level
-    logging::core::get()->set_filter(
-      logging::trivial::severity >= logging::trivial::trace
-    );
-  }
+  static constexpr std::size_t DEFAULT_QUEUE_CAPACITY = 8192;
+
+  // Installs an asynchronous sink writing to log_file, or to the console
+  // when log_file is empty. Records beyond queue_capacity waiting to be
+  // written are dropped and counted instead of blocking the caller
+  static void init(const std::string& log_file = "dfs_crypto.log",
+                   std::size_t queue_capacity = DEFAULT_QUEUE_CAPACITY);
+  // Blocks until every record logged so far has been written
+  static void flush();
+  // Writes pending records and removes the sink installed by init()
+  static void shutdown();
+  // Records lost because the queue was full since init()
+  static std::uint64_t dropped_records();
 
   static boost::log::sources::severity_logger<boost::log::trivial::severity_level>& get_logger() {
     static boost::log::sources::severity_logger<boost::log::trivial::severity_level> logger;
     return logger;
   }
+
+  // True when statements at this level survive compile-time elision
+  static constexpr bool compiled_in(boost::log::trivial::severity_level level) {
+    return static_cast<int>(level) >= DFS_LOG_MIN_LEVEL;
+  }
 };
 
 } // namespace dfs::crypto
 
+// Logging entry point, DFS_LOG(debug) << "..." behaves like BOOST_LOG_TRIVIAL
+// but compiles to nothing below DFS_LOG_MIN_LEVEL
+#define DFS_LOG(lvl) \
+  if constexpr (!::dfs::crypto::Logger::compiled_in(::boost::log::trivial::lvl)) {} \
+  else BOOST_LOG_TRIVIAL(lvl)
+
+#define DFS_LOG_SEV(lvl) \
+  if constexpr (!::dfs::crypto::Logger::compiled_in(::boost::log::trivial::lvl)) {} \
+  else BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), ::boost::log::trivial::lvl)
+
 // Convenience macros for logging
-#define DFS_LOG_TRACE BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), boost::log::trivial::trace)
-#define DFS_LOG_DEBUG BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), boost::log::trivial::debug)
-#define DFS_LOG_INFO BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), boost::log::trivial::info)
-#define DFS_LOG_WARN BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), boost::log::trivial::warning)
-#define DFS_LOG_ERROR BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), boost::log::trivial::error)
-#define DFS_LOG_FATAL BOOST_LOG_SEV(dfs::crypto::Logger::get_logger(), boost::log::trivial::fatal)
-
-#endif // DFS_LOGGER_HPP
\ No newline at end of file
+#define DFS_LOG_TRACE DFS_LOG_SEV(trace)
+#define DFS_LOG_DEBUG DFS_LOG_SEV(debug)
+#define DFS_LOG_INFO DFS_LOG_SEV(info)
+#define DFS_LOG_WARN DFS_LOG_SEV(warning)
+#define DFS_LOG_ERROR DFS_LOG_SEV(error)
+#define DFS_LOG_FATAL DFS_LOG_SEV(fatal)
+
+#endif // DFS_LOGGER_HPP
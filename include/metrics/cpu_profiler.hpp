@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace dfs {
+namespace metrics {
+
+// Statistical CPU profiler built on perf_event_open. A CPU clock event is
+// opened for every thread of the process on every CPU and inherited by
+// threads created while the profiler runs, so short lived pipeline and
+// connection threads are sampled too. Samples carry user space call chains,
+// which the kernel walks through frame pointers (see DFS_FRAME_POINTERS).
+// Needs kernel.perf_event_paranoid <= 2, start() fails cleanly otherwise
+class CpuProfiler {
+public:
+  static constexpr unsigned DEFAULT_FREQUENCY = 99;
+
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  // frequency is the sampling rate per thread in Hz
+  explicit CpuProfiler(unsigned frequency = DEFAULT_FREQUENCY);
+  ~CpuProfiler();
+
+  CpuProfiler(const CpuProfiler&) = delete;
+  CpuProfiler& operator=(const CpuProfiler&) = delete;
+
+
+  // ---- SAMPLING ----
+  // Opens the events and starts collecting, dropping stacks of an earlier
+  // session. Returns false if perf events are unavailable or already running
+  bool start();
+  // Stops sampling and collects the samples still in the ring buffers
+  void stop();
+  bool is_running() const { return running_; }
+
+  // Samples collected and samples the kernel dropped on full ring buffers
+  std::uint64_t samples() const;
+  std::uint64_t lost() const;
+
+
+  // ---- OUTPUT ----
+  // Writes one "outer;...;inner count" line per distinct stack, the folded
+  // format read by flamegraph.pl and speedscope. Returns the line count
+  std::size_t write_folded(std::ostream& output) const;
+
+private:
+  // Ring buffer shared by every event sampling on one CPU
+  struct Ring {
+    int fd;
+    void* base;
+    std::size_t length;
+  };
+
+  unsigned frequency_;
+  std::size_t page_size_;
+  std::vector<int> events_;
+  std::vector<Ring> rings_;
+  std::atomic<bool> running_{false};
+  std::thread reader_;
+
+  mutable std::mutex mutex_;
+  // Call chains innermost frame first, with their sample counts
+  std::map<std::vector<std::uint64_t>, std::uint64_t> stacks_;
+  std::uint64_t samples_{0};
+  std::uint64_t lost_{0};
+
+  void drain();
+  void drain_ring(Ring& ring);
+  void release();
+};
+
+} // namespace metrics
+} // namespace dfs
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "metrics/metrics.hpp"
+
+// Set to 0 to compile every DFS_SCOPED_TIMER out of the binary. Defaults to
+// on, configure with -DDFS_HOT_PATH_TIMERS=OFF to remove the clock reads
+#ifndef DFS_HOT_PATH_TIMERS
+#define DFS_HOT_PATH_TIMERS 1
+#endif
+
+namespace dfs {
+namespace metrics {
+
+// Latency histogram of one instrumented call site
+inline Histogram& hot_path_histogram(const char* site) {
+  return Registry::global().histogram("dfs_hot_path_duration_seconds",
+                                      "Time spent in instrumented hot paths",
+                                      HistogramUnit::Seconds, {{"site", site}});
+}
+
+} // namespace metrics
+} // namespace dfs
+
+#define DFS_HOT_PATH_CONCAT_INNER(a, b) a##b
+#define DFS_HOT_PATH_CONCAT(a, b) DFS_HOT_PATH_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope into
+// dfs_hot_path_duration_seconds{site="..."}. The histogram is looked up once
+// per call site, so site must be a string literal. Each call then costs two
+// steady clock reads
+#if DFS_HOT_PATH_TIMERS
+#define DFS_SCOPED_TIMER(site) \
+  static ::dfs::metrics::Histogram& DFS_HOT_PATH_CONCAT(dfs_hot_path_histogram_, __LINE__) = \
+    ::dfs::metrics::hot_path_histogram(site); \
+  ::dfs::metrics::ScopedTimer DFS_HOT_PATH_CONCAT(dfs_hot_path_timer_, __LINE__)( \
+    DFS_HOT_PATH_CONCAT(dfs_hot_path_histogram_, __LINE__))
+#else
+#define DFS_SCOPED_TIMER(site) static_cast<void>(0)
+#endif
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dfs {
+namespace metrics {
+
+// Label pairs attached to one series, e.g. {{"op", "store"}}
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+// Number of per-thread slots a hot metric is spread across
+constexpr std::size_t SHARD_COUNT = 16;
+
+// Slot used by the calling thread, threads are assigned round robin on first use
+inline std::size_t thread_shard() {
+  static std::atomic<std::size_t> next_shard{0};
+  thread_local const std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+  return shard;
+}
+
+
+// ---- COUNTER ----
+// Monotonic counter. Each thread increments its own cache line, the shards
+// are only summed when the value is read
+class Counter {
+public:
+  // Exposed values are multiplied by scale, e.g. 1e-9 for nanosecond counters
+  explicit Counter(double scale = 1.0) : scale_(scale) {}
+
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  void inc(std::uint64_t amount = 1) {
+    shards_[thread_shard()].value.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  std::uint64_t value() const;
+  double scale() const { return scale_; }
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<std::uint64_t> value{0};
+  };
+
+  std::array<Shard, SHARD_COUNT> shards_;
+  double scale_;
+};
+
+
+// ---- GAUGE ----
+// Value that goes up and down, such as a queue depth or a connection count
+class Gauge {
+public:
+  Gauge() = default;
+
+  Gauge(const Gauge&) = delete;
+  Gauge& operator=(const Gauge&) = delete;
+
+  void set(std::int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void add(std::int64_t amount = 1) { value_.fetch_add(amount, std::memory_order_relaxed); }
+  void sub(std::int64_t amount = 1) { value_.fetch_sub(amount, std::memory_order_relaxed); }
+  std::int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<std::int64_t> value_{0};
+};
+
+
+// ---- HISTOGRAM ----
+// What a histogram records, which fixes its exposed unit and bucket range
+enum class HistogramUnit {
+  Seconds,  // observations in nanoseconds, exposed in seconds from ~1us to ~34s
+  Bytes     // observations in bytes, exposed from 64B to 16GiB
+};
+
+// Log-linear histogram of non-negative integers. Every power of two is split
+// into SUB_BUCKETS linear buckets, so any recorded value is known to within
+// 12.5% while the whole 64-bit range fits in a few hundred buckets. Counts
+// are sharded per thread like Counter
+class Histogram {
+public:
+  static constexpr unsigned SUB_BITS = 3;
+  static constexpr std::size_t SUB_BUCKETS = std::size_t{1} << SUB_BITS;
+  // Values at or above 2^MAX_EXPONENT land in the last bucket
+  static constexpr unsigned MAX_EXPONENT = 48;
+  static constexpr std::size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BITS + 1) * SUB_BUCKETS;
+
+  // Merged view of every shard
+  struct Snapshot {
+    std::vector<std::uint64_t> buckets;
+    std::uint64_t count{0};
+    std::uint64_t sum{0};
+
+    // Upper bound of the bucket holding quantile q (0..1), in recorded units
+    std::uint64_t percentile(double q) const;
+  };
+
+  explicit Histogram(HistogramUnit unit);
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void observe(std::uint64_t value);
+  // Records the time elapsed since start in nanoseconds
+  void observe_since(std::chrono::steady_clock::time_point start);
+
+  Snapshot snapshot() const;
+  HistogramUnit unit() const { return unit_; }
+
+  // Bucket holding value, bucket i counts values in (upper_bound(i-1), upper_bound(i)]
+  static std::size_t bucket_index(std::uint64_t value);
+  static std::uint64_t upper_bound(std::size_t index);
+
+private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<std::uint64_t> sum{0};
+  };
+
+  HistogramUnit unit_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+// Records the lifetime of the timer into a latency histogram
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Histogram& histogram)
+    : histogram_(histogram)
+    , start_(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() { histogram_.observe_since(start_); }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+  Histogram& histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+
+// ---- REGISTRY ----
+// Owns every metric of the process. Lookups take a lock, so callers fetch a
+// metric once and keep the reference, which stays valid for the registry's
+// lifetime. Series sharing a name form a family with one HELP and TYPE line
+class Registry {
+public:
+  // Runs right before each exposition, used to refresh gauges from state
+  // that is cheaper to sample than to track
+  using Collector = std::function<void()>;
+
+  Registry() = default;
+
+  Registry(const Registry&) = delete;
+  Registry& operator=(const Registry&) = delete;
+
+  // Process wide registry served by the metrics endpoint
+  static Registry& global();
+
+  // ---- METRIC LOOKUP ----
+  // Return the series with these labels, creating it on first use. Throws
+  // std::invalid_argument when the name is already used by another type
+  Counter& counter(const std::string& name, const std::string& help,
+                   const Labels& labels = {}, double scale = 1.0);
+  Gauge& gauge(const std::string& name, const std::string& help, const Labels& labels = {});
+  Histogram& histogram(const std::string& name, const std::string& help,
+                       HistogramUnit unit, const Labels& labels = {});
+
+  // ---- COLLECTORS ----
+  std::size_t add_collector(Collector collector);
+  void remove_collector(std::size_t id);
+
+  // ---- EXPOSITION ----
+  // Writes every family in the Prometheus text format, version 0.0.4
+  void write_prometheus(std::ostream& output);
+  std::string expose();
+
+private:
+  enum class Type { Counter, Gauge, Histogram };
+
+  struct Family {
+    Type type;
+    std::string help;
+    // Keyed by the rendered label set so series print in a stable order
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+  };
+
+  std::mutex mutex_;
+  std::map<std::string, Family> families_;
+
+  std::mutex collectors_mutex_;
+  std::map<std::size_t, Collector> collectors_;
+  std::size_t next_collector_id_{0};
+
+  Family& family(const std::string& name, const std::string& help, Type type);
+  static void write_histogram(std::ostream& output, const std::string& name,
+                              const std::string& labels, const Histogram& histogram);
+};
+
+// Renders labels as {key="value",...}, escaping quotes, backslashes and newlines
+std::string format_labels(const Labels& labels);
+
+} // namespace metrics
+} // namespace dfs
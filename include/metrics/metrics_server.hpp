@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <boost/asio.hpp>
+#include "metrics/metrics.hpp"
+
+namespace dfs {
+namespace metrics {
+
+// Minimal HTTP endpoint serving a registry to Prometheus scrapers. Only
+// GET /metrics is answered, every connection is closed after one response.
+// Binds to localhost by default so node internals are not exposed remotely
+class MetricsServer {
+public:
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  // Port 0 picks a free port, see get_port() after start()
+  MetricsServer(Registry& registry, uint16_t port, const std::string& address = "127.0.0.1");
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+
+  // ---- INITIALIZATION AND TEARDOWN ----
+  bool start();
+  void shutdown();
+
+
+  // ---- GETTERS ----
+  uint16_t get_port() const { return port_; }
+  bool is_running() const { return is_running_; }
+
+private:
+  // ---- PARAMETERS ----
+  Registry& registry_;
+  uint16_t port_;
+  const std::string address_;
+
+  boost::asio::io_context io_context_;
+  std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+  std::unique_ptr<std::thread> io_thread_;
+  std::atomic<bool> is_running_{false};
+
+
+  // ---- CONNECTION HANDLING ----
+  void start_accept();
+  // Reads the request head and writes one response
+  void handle_connection(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+  // Builds the full HTTP response for a request line
+  std::string build_response(const std::string& request_line);
+};
+
+} // namespace metrics
+} // namespace dfs
@@ -11,7 +11,8 @@ class Channel {
 public:
   // ---- CONSTRUCTOR AND DESTRUCTOR
   Channel() = default;
-  ~Channel() = default;
+  // Removes undelivered frames from the depth gauge
+  ~Channel();
 
   
   // ---- CHANNEL CONTROL METHODS ----
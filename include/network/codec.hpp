@@ -19,6 +19,10 @@ public:
   // ---- SERIALIZATION AND DESERIALIZATION ----
   // Serializes a message frame to an output stream
   std::size_t serialize(const MessageFrame& frame, std::ostream& output);
+  // Serializes only the frame header, the payload is encrypted by the caller
+  std::size_t serialize_header(const MessageFrame& frame, std::ostream& output);
+  // Returns the number of bytes serialize() will write for the frame
+  static std::size_t get_serialized_size(const MessageFrame& frame);
   // Deserializes a message frame from input stream and pushes to channel
   MessageFrame deserialize(std::istream& input);
 
@@ -57,7 +61,7 @@ private:
 
 
   // ---- UTILITY METHODS ----
-  // Returns size of data + padding bytes from encryption
+  // Returns size of data + PKCS#7 padding bytes from encryption
   static size_t get_padded_size(size_t original_size);
 };
 
@@ -1,6 +1,7 @@
 #ifndef DFS_NETWORK_MESSAGE_FRAME_HPP
 #define DFS_NETWORK_MESSAGE_FRAME_HPP
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
 #include <sstream>
@@ -14,7 +15,31 @@ namespace network {
 // Message type used to differentiate between requests
 enum class MessageType : uint8_t {
   STORE_FILE = 0,
-  GET_FILE = 1
+  GET_FILE = 1,
+  // Anti-entropy: Merkle node hashes to compare, and the keys of differing leaves
+  SYNC_TREE = 2,
+  SYNC_KEYS = 3,
+  // Asks whether the receiver already holds a file's content before it is sent
+  HAVE_QUERY = 4,
+  HAVE_REPLY = 5,
+  // Changes to a file the receiver holds an older version of
+  DELTA_FILE = 6,
+  // Conditional get: the file unless the receiver's version matches the
+  // sender's cached one, which is then confirmed without the content
+  GET_IF_NONE_MATCH = 7,
+  NOT_MODIFIED = 8,
+  // A file sent for the receiver to cache, with its version in the name field
+  CACHED_FILE = 9,
+  // A stored file is on the receiver's disk, with its version in the name field
+  STORE_ACK = 10,
+  // Anti-entropy keys the sender holds newer versions or deletions of, for
+  // the receiver to pull or delete
+  SYNC_NEWER = 11,
+  // Answers a conditional get when the receiver holds no full copy, with the
+  // sender's version in the name field, so it can ask the next peer at once
+  NOT_HELD = 12,
+  // Removes fragments of a file that an erasure coded store replaced or rolled back
+  DROP_FRAGMENTS = 13
 };
 
 // Data structure used to represent data locally
@@ -25,6 +50,11 @@ struct MessageFrame {
   uint64_t payload_size;
   uint32_t filename_length;
   std::shared_ptr<std::stringstream> payload_stream;
+  // Trace the frame belongs to and the sender's span, zero when untraced
+  uint64_t trace_id{0};
+  uint64_t span_id{0};
+  // Set locally when the frame enters a Channel, not sent over the wire
+  std::chrono::steady_clock::time_point enqueued_at{};
 };
 
 } // namespace network
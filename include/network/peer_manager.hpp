@@ -4,6 +4,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 #include <istream>
@@ -42,6 +43,8 @@ public:
   void remove_peer(uint8_t peer_id);
   bool has_peer(uint8_t peer_id);
   std::shared_ptr<TCP_Peer> get_peer(uint8_t peer_id);
+  // IDs of all registered peers in ascending order
+  std::vector<uint8_t> peer_ids() const;
 
   
   // ---- STREAM OPERATIONS ----
@@ -51,6 +54,11 @@ public:
   bool broadcast_stream(dfs::utils::Pipeliner& pipeline);
 
   
+  // ---- PEER STATISTICS ----
+  // Traffic totals, queue depths and TCP_INFO of every registered peer
+  std::vector<PeerStats> peer_stats() const;
+
+
   // ---- UTILITY METHODS ----
   std::size_t size() const;
   void shutdown();
@@ -67,6 +75,24 @@ private:
   // Peers map and access mutex
   std::map<uint8_t, std::shared_ptr<TCP_Peer>> peers_;
   mutable std::mutex mutex_;
+
+  // Metrics collector publishing per-peer socket state, and the peers it
+  // published last time. Collectors run one at a time, so no lock is needed
+  std::size_t collector_id_{0};
+  std::set<uint8_t> exported_peers_;
+
+
+  // ---- STREAM OPERATIONS ----
+  // Writes a size-prefixed frame from the pipeline to every target, callers
+  // hold the targets' send locks. Returns the number of bytes read
+  std::size_t send_chunks(dfs::utils::Pipeliner& pipeline,
+                          const std::vector<std::shared_ptr<TCP_Peer>>& targets,
+                          std::vector<bool>& healthy);
+
+
+  // ---- PEER STATISTICS ----
+  // Sets the per-peer RTT, retransmit and socket queue gauges
+  void export_link_state();
 };
 
 } // namespace network
@@ -5,18 +5,55 @@
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <utility>
 #include <boost/asio.hpp>
 #include <boost/log/trivial.hpp>
 #include "peer.hpp"
 #include "channel.hpp"
 #include "codec.hpp"
+#include "metrics/metrics.hpp"
 
 namespace dfs {
 namespace network {
 
+// Point in time view of one peer connection. Traffic totals are kept per
+// peer ID, so they survive a reconnect of the same peer
+struct PeerStats {
+  uint8_t peer_id{0};
+  std::string remote_endpoint;
+  bool connected{false};
+
+  std::uint64_t bytes_sent{0};
+  std::uint64_t bytes_received{0};
+  std::uint64_t frames_sent{0};
+  std::uint64_t frames_received{0};
+  std::uint64_t send_errors{0};
+  std::uint64_t receive_errors{0};
+
+  // Frames being written to the socket right now
+  std::int64_t in_flight{0};
+  // Senders waiting for the connection's send lock
+  std::int64_t send_waiters{0};
+  // Bytes in the kernel send queue, not yet acknowledged by the peer
+  std::uint64_t socket_send_queue{0};
+
+  // From TCP_INFO, only meaningful when tcp_info_valid is set
+  bool tcp_info_valid{false};
+  std::uint32_t rtt_us{0};
+  std::uint32_t rtt_var_us{0};
+  std::uint32_t retransmits{0};
+  std::uint32_t congestion_window{0};
+};
+
 
 class TCP_Peer : public Peer, public std::enable_shared_from_this<TCP_Peer> {
 public:
+  // Frames go out as one or more segments, each behind a size header. The
+  // top bit of the header means more segments of the frame follow, and a
+  // header of FRAME_ABORTED drops the segments of the frame received so far
+  static constexpr std::size_t SEGMENT_CONTINUES = std::size_t{1} << (sizeof(std::size_t) * 8 - 1);
+  static constexpr std::size_t FRAME_ABORTED = ~std::size_t{0};
+
   // Update the StreamProcessor type to include the source identifier
   using StreamProcessor = std::function<void(std::istream&)>;
 
@@ -53,11 +90,32 @@ public:
   // Sets callback function for processing received data streams
   void set_stream_processor(StreamProcessor processor) override;
 
+  // Traffic totals and kernel socket state of this connection
+  PeerStats stats() const;
+
 private:
+  // Traffic series labelled with the peer's ID
+  struct LinkMetrics {
+    metrics::Counter& bytes_sent;
+    metrics::Counter& bytes_received;
+    metrics::Counter& frames_sent;
+    metrics::Counter& frames_received;
+    metrics::Counter& send_errors;
+    metrics::Counter& receive_errors;
+    metrics::Gauge& in_flight;
+    metrics::Gauge& send_waiters;
+  };
+  static LinkMetrics link_metrics(uint8_t peer_id);
+
+
   // ---- PARAMETERS ----
   uint8_t peer_id_;
   StreamProcessor stream_processor_;
   std::size_t expected_size_;
+  // Set while the segment being read is followed by more of the same frame
+  bool frame_continues_{false};
+  // Bytes of the frame read so far, across its segments
+  std::size_t frame_size_{0};
 
   // Stream buffers
   std::unique_ptr<boost::asio::streambuf> input_buffer_;
@@ -76,6 +134,8 @@ private:
   // Codec for encryption/decryption
   std::unique_ptr<Codec> codec_;
 
+  LinkMetrics link_;
+
 
   // ---- STREAM CONTROL OPERATIONS ----
   void initialize_streams();
@@ -88,6 +148,8 @@ private:
   void handle_read_size(const boost::system::error_code& ec, std::size_t bytes_transferred);
   // Reads data from socket
   void handle_read_data(const boost::system::error_code& ec, std::size_t bytes_transferred);
+  // Reads on after a failed read, or closes the socket when the other end is gone
+  void handle_read_error(const boost::system::error_code& ec, const std::string& what);
   // Passes read data to stream processor
   void process_received_data();
   // Initiates an asynchronous read operation for the next message
@@ -95,8 +157,19 @@ private:
 
 
   // ---- OUTGOING DATA STREAM PROCESSING ----
-  // Sends total size of incoming data
-  bool send_size(std::size_t total_size);
+  // Sends one segment of a frame, the last one completes it. Caller holds io_mutex_
+  bool send_segment(const char* data, std::size_t size, bool last);
+  // Tells the receiver to drop the segments of the current frame
+  bool abort_frame();
+  // Writes a block of raw bytes to the socket, caller holds io_mutex_
+  bool send_buffer(const char* data, std::size_t size);
+  // Accounts one socket write, false if it failed or came up short
+  bool count_write(std::size_t bytes_written, std::size_t size, const boost::system::error_code& ec);
+  // Takes io_mutex_, counting the caller as a send waiter until it is held
+  std::unique_lock<std::mutex> lock_for_send();
+  // Bracket one outgoing frame for in-flight and frame accounting
+  void begin_frame();
+  void end_frame(bool sent);
   
 
   // ---- TEARDOWN ----
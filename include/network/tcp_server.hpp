@@ -1,5 +1,6 @@
 #pragma once
 
+#include <utility>
 #include <boost/asio.hpp>
 #include <boost/log/trivial.hpp>
 #include <memory>
@@ -78,6 +79,8 @@ private:
   void receive_handshake(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
   // Performs ID reading
   uint8_t read_ID(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+  // True if a peer with this ID may connect, dropping its entry when that connection was lost
+  bool admit_peer(uint8_t peer_id);
 
 };
 
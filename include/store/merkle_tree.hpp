@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dfs {
+namespace store {
+
+// Binary hash tree over the key-hash space. Leaf i covers the keys whose
+// SHA-256 starts with the DEPTH bits of i, and every node holds the XOR of
+// the 64 bit entry hashes below it. Because XOR is its own inverse, adding or
+// removing an entry only touches its leaf and that leaf's ancestors, and two
+// trees over the same entries are equal no matter the order they were built in
+class MerkleTree {
+public:
+  // ---- CONSTANTS ----
+  // 4096 leaves: a million keys put ~250 entries in each
+  static constexpr unsigned DEPTH = 12;
+  static constexpr std::size_t LEAVES = std::size_t{1} << DEPTH;
+  // Heap layout: the root is node 1, node i has children 2i and 2i + 1, and
+  // the leaves are nodes LEAVES to 2 * LEAVES - 1
+  static constexpr std::size_t ROOT = 1;
+  static constexpr std::size_t NODES = 2 * LEAVES;
+
+
+  // ---- CONSTRUCTOR ----
+  MerkleTree() : nodes_(NODES, 0) {}
+
+
+  // ---- TREE OPERATIONS ----
+  // Adds value to the leaf, or takes it out again when it was already added
+  void toggle(std::size_t leaf, uint64_t value) {
+    for (std::size_t node = LEAVES + leaf; node >= ROOT; node /= 2) {
+      nodes_[node] ^= value;
+    }
+  }
+
+  void clear() { nodes_.assign(NODES, 0); }
+
+
+  // ---- GETTERS ----
+  uint64_t root() const { return nodes_[ROOT]; }
+  uint64_t node(std::size_t index) const { return nodes_[index]; }
+
+  static bool valid_node(std::size_t index) { return index >= ROOT && index < NODES; }
+  static bool is_leaf_node(std::size_t index) { return index >= LEAVES && index < NODES; }
+  static std::size_t leaf_of_node(std::size_t index) { return index - LEAVES; }
+  // Leaf covering a key whose hex SHA-256 is hash
+  static std::size_t leaf_for_hash(const std::string& hash) {
+    return static_cast<std::size_t>(std::stoul(hash.substr(0, DEPTH / 4), nullptr, 16));
+  }
+
+private:
+  // ---- PARAMETERS ----
+  std::vector<uint64_t> nodes_;
+};
+
+} // namespace store
+} // namespace dfs
@@ -1,35 +1,113 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <string>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <memory>
 #include <vector>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 #include "../logger/logger.hpp"
+#include "merkle_tree.hpp"
 
 namespace dfs {
 namespace store {
 
 class Store {
 public:
+  // Decides which keys the anti-entropy index covers, true to index the key
+  using IndexFilter = std::function<bool(const std::string& key)>;
+
+  // Key and hex SHA-256 of its content, as recorded in the index. The digest
+  // is empty for a key deleted at generation
+  struct IndexEntry {
+    std::string key;
+    std::string digest;
+    uint64_t generation{0};
+  };
+
+  // Version of an indexed key, its ETag. The generation counts the content
+  // changes and deletions of the key, from 1, and survives restarts
+  struct ObjectVersion {
+    std::string digest;
+    uint64_t generation{0};
+  };
+
+  // A live snapshot, ids count up from 1 and are never reused
+  struct SnapshotInfo {
+    std::string name;
+    uint64_t id;
+  };
+
+  // Where an object lives, None when it does not exist
+  enum class Tier { None, Fast, Capacity };
+
+  // ---- CONSTANTS ----
+  static constexpr std::chrono::milliseconds DEFAULT_TIER_INTERVAL{30000};
+  // Reads count half as much after this long
+  static constexpr std::chrono::seconds ACCESS_HALF_LIFE{600};
+  // Capacity tier objects with at least this many decayed reads are promoted
+  static constexpr double PROMOTE_READS = 2.0;
+  // Demotion empties the fast tier down to this share of its size, in
+  // percent, leaving room for new objects and promotions
+  static constexpr std::uintmax_t FAST_TIER_LOW_WATERMARK = 90;
+
+  struct TierConfig {
+    // Directory of the capacity tier, base_path_ is the fast tier
+    std::filesystem::path capacity_path;
+    // Objects are demoted while the fast tier holds more than this
+    std::uintmax_t fast_tier_bytes{0};
+    // Time between mover passes, 0 leaves them to run_tier_migration
+    std::chrono::milliseconds interval{DEFAULT_TIER_INTERVAL};
+  };
+
+  // Outcome of one mover pass
+  struct TierMigration {
+    std::size_t promoted{0};
+    std::size_t demoted{0};
+    std::uintmax_t fast_bytes{0};
+    std::uintmax_t capacity_bytes{0};
+  };
+
 
   // ---- CONSTRUCTOR AND DESTRUCTOR ----
-  explicit Store(const std::string& base_path);
+  // Without a filter every key is indexed
+  explicit Store(const std::string& base_path, IndexFilter index_filter = nullptr);
+  // Waits for a running snapshot reclamation or tier migration
+  ~Store();
 
 
   // ---- CORE STORAGE OPERATIONS ----
   // stores data stream under given key
   void store(const std::string& key, std::istream& data);
+  // Stores what write puts into the stream under key, without holding it in
+  // memory. With an expected digest, content with another digest is dropped
+  // and false returned, leaving key as it was
+  bool store_output(const std::string& key, const std::function<void(std::ostream&)>& write,
+                    const std::string& expected_digest = "");
   // Retrieves data stream using given key
   void get(const std::string& key, std::stringstream& output);
+  // Opens a binary read stream on the data stored under given key
+  std::unique_ptr<std::istream> get_stream(const std::string& key) const;
   // Removes data associated with given key
   void remove(const std::string& key);
   // Removes all stored data and reset store
   void clear();
+  // Flushes the object of key and the directory entry naming it to disk, so
+  // the content survives a crash. Throws StoreError when the key is missing
+  void sync(const std::string& key) const;
 
 
   // ---- QUERY OPERATIONS ----
@@ -44,8 +122,75 @@ public:
   void print_working_dir() const;
   void list() const;
   void move_dir(const std::string& path);
+  // Leaves a tombstone in the index, so anti-entropy carries the deletion to
+  // replicas instead of restoring the file from them
   void delete_file(const std::string& filename);
 
+
+  // ---- ANTI-ENTROPY INDEX ----
+  // Every store and removal of an indexed key updates a Merkle tree over the
+  // key-hash space, so replicas compare contents by exchanging a few hashes.
+  // The index is logged to index.log in the store directory and compacted
+  // when the store opens, dropping entries whose files are gone. Deleted
+  // keys stay in the index as tombstones, one generation past their content.
+
+  // Values of the given Merkle nodes, read as one consistent snapshot
+  std::vector<uint64_t> merkle_nodes(const std::vector<std::size_t>& nodes) const;
+  // Indexed keys whose hash falls into the given leaf
+  std::vector<IndexEntry> leaf_entries(std::size_t leaf) const;
+  // Content digest recorded for key, empty when the key is not indexed
+  std::string content_digest(const std::string& key) const;
+  // Empty digest and generation 0 when the key is not indexed or deleted
+  ObjectVersion version(const std::string& key) const;
+  // Some indexed key whose content has digest, empty when there is none
+  std::string find_by_digest(const std::string& digest) const;
+  // Indexed keys that are not deleted
+  std::size_t indexed_keys() const;
+  // Removes key, if present, and leaves a tombstone at generation, for a
+  // deletion a replica made
+  void record_deletion(const std::string& key, uint64_t generation);
+  // Takes on a replica's generation for the version of key held here, when
+  // its digest matches and the generation is higher
+  void raise_generation(const std::string& key, const ObjectVersion& version);
+
+
+  // ---- SNAPSHOTS ----
+  // A snapshot freezes the store's contents without copying anything. Objects
+  // are only ever replaced by renaming a new file over them, and a version
+  // that a live snapshot still sees is moved aside under .snapshots instead
+  // of being overwritten or removed. Versions no live snapshot sees any more
+  // are reclaimed by a background thread after a snapshot is deleted.
+
+  // Throws StoreError when name is taken or is not a plain name
+  void create_snapshot(const std::string& name);
+  // Throws StoreError for unknown snapshots
+  void delete_snapshot(const std::string& name);
+  std::vector<SnapshotInfo> list_snapshots() const;
+  // Reads of key as it was when the snapshot was created. Throw StoreError
+  // for unknown snapshots
+  bool has_in_snapshot(const std::string& snapshot, const std::string& key) const;
+  std::unique_ptr<std::istream> get_snapshot_stream(const std::string& snapshot, const std::string& key) const;
+  // Writes every object of the snapshot into directory, laid out as a store
+  // directory, with hard links where the filesystem allows. Writes continue
+  // meanwhile. Returns the number of objects exported
+  std::size_t export_snapshot(const std::string& snapshot, const std::filesystem::path& directory) const;
+  // Versions kept aside for snapshots and not reclaimed yet
+  std::size_t preserved_versions() const;
+
+
+  // ---- TIERED STORAGE ----
+  // With a capacity tier, base_path_ is the fast tier. New objects are
+  // written to the fast tier, and a background mover demotes the least read
+  // objects to the capacity tier while the fast tier is over its size, and
+  // promotes capacity tier objects that are read often again. Reads look in
+  // both tiers.
+
+  // Call before the store is shared between threads
+  void set_tiering(const TierConfig& config);
+  // One mover pass, run by the background thread every interval
+  TierMigration run_tier_migration();
+  Tier tier_of(const std::string& key) const;
+
 private:
   // ---- PARAMETERS ----
   // Root path for all stored files
@@ -66,12 +211,138 @@ private:
 
   
   // ---- QUERY OPERATIONS ----
+  // Path of the object of hash in whichever tier holds it, the fast tier
+  // path when none does
+  Tier locate(const std::string& hash, std::filesystem::path& file_path) const;
+  // Opens the object of key, looking again if the mover moved it meanwhile
+  std::unique_ptr<std::ifstream> open_object(const std::string& key) const;
   // Ensures directory exists, create if needed
   void check_directory_exists(const std::filesystem::path& path) const;
   // Resolves a key to its corresponding filesystem path by generating hash and converting to path
   std::filesystem::path resolve_key_path(const std::string& key) const;
   // Verifies if a file exists at the given path, throws StoreError if not found
   void verify_file_exists(const std::filesystem::path& file_path) const;
+
+
+  // ---- ANTI-ENTROPY INDEX ----
+  struct IndexRecord {
+    // Empty for a tombstone
+    std::string digest;
+    // Hash of key, digest and generation that is XORed into the Merkle tree
+    uint64_t value;
+    uint64_t generation;
+  };
+
+  IndexFilter index_filter_;
+  mutable std::mutex index_mutex_;
+  MerkleTree merkle_;
+  // One map per Merkle leaf
+  std::vector<std::map<std::string, IndexRecord>> leaves_;
+  // Reverse index from content digest to the keys holding that content
+  std::map<std::string, std::set<std::string>> keys_by_digest_;
+  std::size_t indexed_keys_{0};
+  // Append-only record of index changes, "* <digest> <generation> <length>:<key>",
+  // tombstones "~ <generation> <length>:<key>" and "- <length>:<key>". Logs
+  // from before generations hold "+ <digest> <length>:<key>"
+  std::ofstream index_log_;
+
+  // Replays and compacts the index log of base_path_. Caller holds index_mutex_
+  void load_index();
+  // Records key under its hash, replacing an older digest. The index
+  // changes below are made together with the object change they describe,
+  // so the caller holds index_mutex_ and snapshot_mutex_
+  void index_put(const std::string& key, const std::string& hash, const std::string& digest);
+  void index_erase(const std::string& key, const std::string& hash);
+  // Leaves a tombstone for key at generation or, for 0, the next one
+  void index_delete(const std::string& key, const std::string& hash, uint64_t generation = 0);
+  // Caller holds index_mutex_
+  void append_index_record(const std::string& key, const std::string& digest, uint64_t generation);
+  // Applies a change to the tree and leaf maps only and returns the key's
+  // generation, which is the given one or, for 0, bumped when the digest
+  // changed. An empty digest records a tombstone. Caller holds index_mutex_
+  uint64_t apply_put(const std::string& key, const std::string& hash, const std::string& digest,
+                     uint64_t generation = 0);
+  void apply_erase(const std::string& key, const std::string& hash);
+  // Drops key from the reverse index entry of digest
+  void forget_digest(const std::string& key, const std::string& digest);
+  bool is_indexed(const std::string& key) const;
+  std::filesystem::path index_log_path() const;
+
+
+  // ---- SNAPSHOTS ----
+  mutable std::mutex snapshot_mutex_;
+  // Live snapshots by name
+  std::map<std::string, uint64_t> snapshots_;
+  uint64_t last_snapshot_id_{0};
+  // Newest snapshot id when an object was last written, by key hash. Only
+  // writes made while a snapshot was live are recorded; objects without an
+  // entry predate every live snapshot
+  std::unordered_map<std::string, uint64_t> write_epochs_;
+  // Append-only record of snapshots and write epochs, compacted when the store opens
+  std::ofstream snapshot_log_;
+  std::unique_ptr<std::thread> reclaim_thread_;
+  std::condition_variable reclaim_cv_;
+  bool reclaim_pending_{false};
+  std::atomic<bool> stopping_{false};
+
+  // Replays and compacts the snapshot log of base_path_. Caller holds snapshot_mutex_
+  void load_snapshots();
+  // Moves temp_path into place as the object of hash, keeping the version it
+  // replaces for the snapshots that see it, and indexes key with the digest
+  // of the installed content under the same locks
+  void install_object(const std::string& key, const std::string& hash,
+                      const std::filesystem::path& temp_path, const std::filesystem::path& file_path,
+                      const std::string& digest);
+  // Removes the object of hash, or moves it aside when a snapshot sees it.
+  // Returns false when there is no object. Caller holds snapshot_mutex_
+  bool retire_object(const std::string& hash);
+  // Keeps the current version of hash, in the tier under root, if a live
+  // snapshot sees it. Caller holds snapshot_mutex_
+  bool preserve_version(const std::string& hash, const std::filesystem::path& file_path,
+                        const std::filesystem::path& root);
+  void record_write(const std::string& hash);
+  // File holding the version of hash that snapshot id sees, empty when the
+  // key did not exist then. Caller holds snapshot_mutex_
+  std::filesystem::path snapshot_object(uint64_t id, const std::string& hash) const;
+  uint64_t snapshot_id(const std::string& name) const;
+  void append_snapshot_record(const std::string& record);
+  // Wakes the reclaim thread, starting it on first use. Caller holds snapshot_mutex_
+  void schedule_reclaim();
+  void reclaim_loop();
+  void reclaim_versions();
+  std::filesystem::path snapshot_dir() const;
+
+
+  // ---- TIERED STORAGE ----
+  struct Access {
+    // Exponentially decayed read count as of last
+    double reads;
+    std::chrono::steady_clock::time_point last;
+  };
+
+  TierConfig tiering_;
+  std::mutex tier_mutex_;
+  std::condition_variable tier_cv_;
+  std::unique_ptr<std::thread> tier_thread_;
+  // Serializes mover passes
+  std::mutex migration_mutex_;
+  mutable std::mutex access_mutex_;
+  mutable std::unordered_map<std::string, Access> access_;
+
+  // Counts a read of hash while tiering is on
+  void record_access(const std::string& hash) const;
+  double decayed_reads(const Access& access, std::chrono::steady_clock::time_point now) const;
+  // Moves the object of hash to the other tier unless it was replaced since
+  // it was listed. Returns whether it moved
+  bool move_object(const std::string& hash, const std::filesystem::path& from, const std::filesystem::path& to_root);
+  void tier_loop();
+  // Roots of the fast and, with tiering, capacity tier
+  std::vector<std::filesystem::path> tier_roots() const;
+  std::filesystem::path root_of(Tier tier) const;
+  // The capacity tier is recorded in the store directory, so objects on it
+  // stay readable after a restart before tiering is configured again
+  void load_tier_config();
+  void save_tier_config() const;
 };
 
 class StoreError : public std::runtime_error {
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace dfs {
+namespace tracing {
+
+// Identifies the span work is currently done for. A zero trace ID means the
+// work is not being traced and spans started under it record nothing
+struct TraceContext {
+  std::uint64_t trace_id{0};
+  std::uint64_t span_id{0};
+
+  bool active() const { return trace_id != 0; }
+};
+
+// Process wide span recorder writing the Chrome trace event format (JSON
+// array of complete "X" events), which chrome://tracing and Perfetto load
+// directly. Timestamps are wall clock microseconds so files written by
+// different nodes can be concatenated into one timeline. Trace and span IDs
+// are carried in each event's args for correlation across nodes
+class Tracer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // ---- INITIALIZATION AND TEARDOWN ----
+  // Opens the trace file. Every sample_every-th root span starts a trace,
+  // the others run untraced. Returns false if the file cannot be opened
+  static bool start(const std::string& path, unsigned sample_every = 1);
+  // Writes buffered events to the file
+  static void flush();
+  // Closes the JSON array and the file, later spans record nothing
+  static void shutdown();
+
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+
+  // ---- CONTEXT ----
+  // Context of the calling thread
+  static TraceContext current();
+  static void set_current(const TraceContext& context);
+  // Random non-zero ID for traces and spans
+  static std::uint64_t new_id();
+  // True when the next root span should be traced
+  static bool sample_root();
+
+
+  // ---- RECORDING ----
+  // Writes one finished span. detail is shown in the event's args
+  static void record(const char* name, std::uint64_t trace_id, std::uint64_t span_id,
+                     std::uint64_t parent_id, Clock::time_point start, Clock::time_point end,
+                     const std::string& detail = {});
+
+  // Events written since start()
+  static std::uint64_t recorded();
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+
+// ---- SPAN ----
+// Times a scope as a child of the thread's current span and makes itself
+// the current span until it ends. Costs one thread local read when the
+// thread is not inside a trace
+class Span {
+public:
+  // Child of the calling thread's current span
+  explicit Span(const char* name, std::string detail = {});
+  // Child of an explicit parent, such as the context carried by a frame
+  Span(const char* name, const TraceContext& parent, std::string detail = {});
+  ~Span();
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  // Starts a new trace when tracing is enabled and the root is sampled
+  static Span root(const char* name, std::string detail = {});
+
+  const TraceContext& context() const { return context_; }
+
+private:
+  struct RootTag {};
+  Span(const char* name, RootTag, std::string detail);
+
+  const char* name_;
+  std::string detail_;
+  TraceContext context_;
+  std::uint64_t parent_id_{0};
+  TraceContext previous_;
+  Tracer::Clock::time_point start_;
+
+  void begin(const TraceContext& parent);
+};
+
+
+// Installs a context on the calling thread for the scope's lifetime, used
+// to carry a trace into pipeline stages and other worker threads
+class ContextScope {
+public:
+  explicit ContextScope(const TraceContext& context)
+    : previous_(Tracer::current()) {
+    Tracer::set_current(context);
+  }
+  ~ContextScope() { Tracer::set_current(previous_); }
+
+  ContextScope(const ContextScope&) = delete;
+  ContextScope& operator=(const ContextScope&) = delete;
+
+private:
+  TraceContext previous_;
+};
+
+} // namespace tracing
+} // namespace dfs
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace dfs {
+namespace utils {
+
+// Blocking FIFO with a fixed capacity used to connect pipeline stages.
+// Producers block while the queue is full and consumers block while it is
+// empty, so a slow stage throttles the stages in front of it.
+template <typename T>
+class BoundedQueue {
+public:
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  explicit BoundedQueue(std::size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+
+  // ---- QUEUE CONTROL METHODS ----
+  // Appends an item, blocking while full. Returns false once the queue is closed
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    queue_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Removes the oldest item, blocking while empty. Returns false once the
+  // queue is closed and fully drained
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    item = std::move(queue_.front());
+    queue_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Rejects further pushes, consumers still drain the remaining items
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  // Closes the queue and discards everything still buffered
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    queue_.clear();
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+
+  // ---- QUERY METHODS ----
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+  }
+
+  std::size_t capacity() const { return capacity_; }
+
+private:
+  // ---- PARAMETERS ----
+  const std::size_t capacity_;
+  std::deque<T> queue_;
+  bool closed_{false};
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+};
+
+} // namespace utils
+} // namespace dfs
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace dfs {
+namespace utils {
+
+// Lock-free bounded multi-producer multi-consumer ring. Every slot carries a
+// sequence number telling producers and consumers whose turn it is, so
+// neither side ever blocks: a full ring rejects the push and an empty ring
+// rejects the pop. Capacity is rounded up to a power of two.
+template <typename T>
+class BoundedRing {
+public:
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  explicit BoundedRing(std::size_t capacity)
+    : mask_(round_up(capacity) - 1)
+    , slots_(new Slot[mask_ + 1]) {
+    for (std::size_t i = 0; i <= mask_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedRing(const BoundedRing&) = delete;
+  BoundedRing& operator=(const BoundedRing&) = delete;
+
+
+  // ---- RING OPERATIONS ----
+  // Moves the item into the ring, returns false without waiting when full
+  bool try_push(T&& item) {
+    std::size_t position = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[position & mask_];
+      std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          slot.value = std::move(item);
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Moves the oldest item out, returns false without waiting when empty
+  bool try_pop(T& item) {
+    std::size_t position = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[position & mask_];
+      std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          item = std::move(slot.value);
+          slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+
+  // ---- QUERY METHODS ----
+  std::size_t capacity() const { return mask_ + 1; }
+  // Number of pushes claimed so far
+  std::size_t pushed() const { return enqueue_pos_.load(std::memory_order_acquire); }
+  // Number of pops claimed so far
+  std::size_t popped() const { return dequeue_pos_.load(std::memory_order_acquire); }
+
+private:
+  struct Slot {
+    std::atomic<std::size_t> sequence{0};
+    T value{};
+  };
+
+  static std::size_t round_up(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  // ---- PARAMETERS ----
+  const std::size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  // Producers and consumers live on separate cache lines
+  alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<std::size_t> dequeue_pos_{0};
+};
+
+} // namespace utils
+} // namespace dfs
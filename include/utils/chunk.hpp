@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace dfs {
+namespace utils {
+
+// Move-only byte slab passed between pipeline stages. Ownership moves from
+// stage to stage so chunk data is never copied in transit, and a consumed
+// chunk can be cleared and refilled without giving its allocation back.
+class Chunk {
+public:
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  Chunk() = default;
+  explicit Chunk(std::size_t capacity) { reserve(capacity); }
+
+  Chunk(const Chunk&) = delete;
+  Chunk& operator=(const Chunk&) = delete;
+
+  Chunk(Chunk&& other) noexcept
+    : data_(std::move(other.data_))
+    , size_(std::exchange(other.size_, 0))
+    , capacity_(std::exchange(other.capacity_, 0)) {}
+
+  Chunk& operator=(Chunk&& other) noexcept {
+    data_ = std::move(other.data_);
+    size_ = std::exchange(other.size_, 0);
+    capacity_ = std::exchange(other.capacity_, 0);
+    return *this;
+  }
+
+
+  // ---- BUFFER MANAGEMENT ----
+  // Grows the allocation to at least `capacity` bytes, keeping the contents
+  void reserve(std::size_t capacity) {
+    if (capacity <= capacity_) {
+      return;
+    }
+    std::unique_ptr<char[]> grown(new char[capacity]);
+    if (size_ > 0) {
+      std::memcpy(grown.get(), data_.get(), size_);
+    }
+    data_ = std::move(grown);
+    capacity_ = capacity;
+  }
+
+  // Sets the size, new bytes are left uninitialized for the caller to fill
+  void resize(std::size_t size) {
+    if (size > capacity_) {
+      reserve(std::max(size, capacity_ * 2));
+    }
+    size_ = size;
+  }
+
+  void append(const void* data, std::size_t size) {
+    std::size_t offset = size_;
+    resize(size_ + size);
+    if (size > 0) {
+      std::memcpy(data_.get() + offset, data, size);
+    }
+  }
+
+  void append(std::string_view data) { append(data.data(), data.size()); }
+
+  // Empties the chunk but keeps its allocation for reuse
+  void clear() { size_ = 0; }
+
+
+  // ---- GETTERS ----
+  char* data() { return data_.get(); }
+  const char* data() const { return data_.get(); }
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view view() const { return std::string_view(data_.get(), size_); }
+
+private:
+  // ---- PARAMETERS ----
+  std::unique_ptr<char[]> data_;
+  std::size_t size_{0};
+  std::size_t capacity_{0};
+};
+
+} // namespace utils
+} // namespace dfs
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <istream>
 #include <memory>
-#include <sstream>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
 #include <boost/log/trivial.hpp>
+#include "utils/bounded_queue.hpp"
+#include "utils/chunk.hpp"
 
 namespace dfs {
 namespace utils {
@@ -15,60 +24,200 @@ namespace utils {
 class Pipeliner;
 
 // Type aliases for clarity
-using ProducerFn = std::function<bool(std::stringstream&)>;
-using TransformFn = std::function<bool(std::stringstream&, std::stringstream&)>;
+using ProducerFn = std::function<bool(Chunk&)>;
+using TransformFn = std::function<bool(Chunk&, Chunk&)>;
+// Called once after the last chunk so a stage can emit trailing bytes
+using FlushFn = std::function<bool(Chunk&)>;
 using PipelinerPtr = std::shared_ptr<Pipeliner>;
 
-class Pipeliner : public std::stringstream, 
+// Stream based signatures, wrapped by the adapters below at one copy per chunk
+using StreamProducerFn = std::function<bool(std::stringstream&)>;
+using StreamTransformFn = std::function<bool(std::stringstream&, std::stringstream&)>;
+using StreamFlushFn = std::function<bool(std::stringstream&)>;
+
+// Time and volume accounting for one pipeline stage. Parallel stages sum
+// their workers, so busy time can exceed wall time
+struct StageStats {
+  std::string name;
+  std::size_t workers{1};
+  std::chrono::nanoseconds busy{0};
+  std::chrono::nanoseconds input_wait{0};
+  std::chrono::nanoseconds output_wait{0};
+  std::uint64_t bytes_in{0};
+  std::uint64_t bytes_out{0};
+  std::uint64_t chunks{0};
+
+  // Busy time per worker, the stage with the highest value limits throughput
+  std::chrono::nanoseconds busy_per_worker() const { return busy / static_cast<int64_t>(workers ? workers : 1); }
+};
+
+// ---- STREAM ADAPTERS ----
+ProducerFn adapt_producer(StreamProducerFn producer);
+TransformFn adapt_transform(StreamTransformFn transform);
+FlushFn adapt_flush(StreamFlushFn flush);
+
+// Streaming pipeline exposed as an input stream. The producer and every
+// transform run on their own thread and hand chunks to the next stage through
+// bounded queues, while the reader pulls transformed chunks on demand. Memory
+// use is bounded by stages x queue capacity x chunk size.
+class Pipeliner : public std::istream,
          public std::enable_shared_from_this<Pipeliner> {
 public:
 
   // ---- CONSTRUCTOR AND DESTRUCTOR ----
   explicit Pipeliner(ProducerFn producer);
+  ~Pipeliner();
 
 
   // ---- PIPELINE CONSTRUCTION METHODS ----
   // Creates pipeline with a producer function
   static PipelinerPtr create(ProducerFn producer);
-  // Sets the transformer function used in method chaining
-  PipelinerPtr transform(TransformFn transform);
+  static PipelinerPtr create(StreamProducerFn producer);
+  // Appends a transform stage used in method chaining
+  PipelinerPtr transform(TransformFn transform, FlushFn flush = nullptr);
+  PipelinerPtr transform(StreamTransformFn transform, StreamFlushFn flush = nullptr);
+  // Appends a stage running the transform on up to `workers` chunks at once.
+  // Results leave in input order. The transform must not depend on earlier
+  // chunks since they are processed concurrently
+  PipelinerPtr transform_parallel(TransformFn transform, std::size_t workers);
+  PipelinerPtr transform_parallel(StreamTransformFn transform, std::size_t workers);
 
 
   // ---- PIPELINE EXECUTION AND CONTROL METHODS ----
-  // calls sync() to process remaining bytes in pipeline
-  void flush();
+  // Launches all stages, called implicitly on the first read
+  void start();
+  // Stops all stages and discards buffered chunks
+  void cancel();
+  // Hands the next output chunk to the caller without copying. Returns false
+  // at the end of the stream. May follow but not interleave with stream reads
+  bool read_chunk(Chunk& chunk);
+
+
+  // ---- INSTRUMENTATION ----
+  // Names the most recently added stage, or the producer if there is none
+  PipelinerPtr named(const std::string& name);
+  // Turns on per-stage timing, must be called before start()
+  void enable_stats(bool enabled = true) { stats_enabled_ = enabled; }
+  // Snapshot ordered producer, transforms, reader. The reader's busy time is
+  // spent by the caller between reads, e.g. writing to a socket
+  std::vector<StageStats> get_stats() const;
+  // Returns the name of the stage with the most busy time per worker
+  std::string bottleneck() const;
+  // Logs one line per stage and the bottleneck
+  void log_stats() const;
 
 
   // ---- GETTERS AND SETTERS ----
   std::size_t get_total_size() const { return total_size_; }
+  std::size_t get_buffer_size() const { return buffer_size_; }
+  // True if a stage failed, the stream then ends early
+  bool failed() const { return failed_; }
 
+  // Sets the chunk size producers are expected to emit
   void set_buffer_size(size_t size);
+  // Sets how many chunks may wait between two stages
+  void set_queue_capacity(size_t chunks);
   void set_total_size(std::size_t size) { total_size_ = size; }
 
-protected:
-  // ---- PIPELINE EXECUTION AND CONTROL METHODS ----
-  // Executes pipeline once
-  virtual int sync();
-
 private:
+  // Stream buffer handing out the pipeline's output one chunk at a time
+  class ChunkBuffer : public std::streambuf {
+  public:
+    explicit ChunkBuffer(Pipeliner& pipeline) : pipeline_(pipeline) {}
+  protected:
+    int_type underflow() override;
+  private:
+    friend class Pipeliner;
+    Pipeliner& pipeline_;
+    Chunk current_;
+  };
+
+  // Sequencing state restoring input order behind a parallel stage
+  struct Ordering {
+    std::mutex input_mutex;
+    std::mutex mutex;
+    std::condition_variable turn;
+    std::size_t next_input{0};
+    std::size_t next_output{0};
+    std::size_t active_workers{0};
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  // Counters updated by a stage's threads while the pipeline runs
+  struct StageCounters {
+    std::string name;
+    std::atomic<int64_t> busy_ns{0};
+    std::atomic<int64_t> input_wait_ns{0};
+    std::atomic<int64_t> output_wait_ns{0};
+    std::atomic<uint64_t> bytes_in{0};
+    std::atomic<uint64_t> bytes_out{0};
+    std::atomic<uint64_t> chunks{0};
+
+    explicit StageCounters(std::string stage_name) : name(std::move(stage_name)) {}
+    static void add(std::atomic<int64_t>& counter, Clock::time_point from, Clock::time_point to) {
+      counter.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count(),
+                        std::memory_order_relaxed);
+    }
+  };
+
+  // Transform stage and its optional end-of-stream hook
+  struct Stage {
+    TransformFn transform{};
+    FlushFn flush{};
+    std::size_t workers{1};
+    std::unique_ptr<Ordering> ordering{};
+    std::unique_ptr<StageCounters> counters{};
+  };
+
   // ---- PARAMETERS ----
   ProducerFn producer_;
-  std::vector<TransformFn> transforms_;
+  std::vector<Stage> stages_;
   size_t buffer_size_;
-  bool produced_;
-  bool eof_;
-  std::stringstream buffer_;
-  std::size_t total_size_{0}; 
+  size_t queue_capacity_;
+  std::size_t total_size_{0};
+  ChunkBuffer chunk_buffer_;
+
+  // queues_[i] feeds stage i, the last queue feeds the reader
+  std::vector<std::unique_ptr<BoundedQueue<Chunk>>> queues_;
+  // Slabs the reader has drained, refilled by the producer before it allocates
+  std::mutex spare_mutex_;
+  std::vector<Chunk> spare_chunks_;
+  std::vector<std::thread> workers_;
+  std::atomic<bool> started_{false};
+  std::atomic<bool> failed_{false};
+  std::atomic<bool> stopping_{false};
+
+  // Instrumentation, producer and reader are accounted like stages
+  bool stats_enabled_{false};
+  StageCounters producer_counters_{"producer"};
+  StageCounters reader_counters_{"reader"};
+  Clock::time_point reader_returned_{};
 
-  
-  // ---- PIPELINE EXECUTION AND CONTROL METHODS ----
-  // Processes chunks until buffer reaches target size or EOF
-  bool process_pipeline();
-  // Gets next chunk from producer, applies transform, 
-  // and writes to buffer
-  bool process_next_chunk();
 
+  // ---- PIPELINE EXECUTION AND CONTROL METHODS ----
+  // Runs the producer until it reports end of data
+  void run_producer();
+  // Runs one transform stage until its input queue is drained
+  void run_stage(std::size_t index);
+  // Runs one worker of a parallel stage, emitting results in input order
+  void run_parallel_worker(std::size_t index);
+  // Applies a stage's transform to one chunk, the timed hot path of every stage
+  static bool process_chunk(const Stage& stage, Chunk& input, Chunk& output);
+  // Marks the pipeline failed and unblocks every stage
+  void fail(const std::string& reason);
+  // Releases parallel workers waiting for their turn to emit
+  void wake_ordered_stages();
+  // Pops the next non-empty output chunk for the reader
+  bool next_chunk(Chunk& chunk);
+  // Returns a drained slab to the producer, kept up to queue capacity spares
+  void recycle_chunk(Chunk& chunk);
+  // Takes a spare slab for the producer, allocating only if none is left
+  Chunk take_chunk();
+  // Current time when instrumentation is on, otherwise a zero time point
+  Clock::time_point mark() const { return stats_enabled_ ? Clock::now() : Clock::time_point{}; }
+  static StageStats snapshot(const StageCounters& counters, std::size_t workers);
 };
 
 } // namespace utils
-} // namespace dfs
\ No newline at end of file
+} // namespace dfs
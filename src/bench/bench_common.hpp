@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Shared pieces of the benchmark executables: argument parsing, workload
+// generators, latency recording and the JSON report read by bench_compare
+namespace dfs {
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+// ---- ARGUMENTS ----
+// Parses "--flag value" pairs. Throws std::invalid_argument on flags not in
+// known and on a flag without a value
+inline std::map<std::string, std::string> parse_flags(int argc, char* argv[],
+                                                      const std::set<std::string>& known) {
+  std::map<std::string, std::string> flags;
+  for (int i = 1; i < argc; i += 2) {
+    std::string flag = argv[i];
+    if (!known.count(flag)) {
+      throw std::invalid_argument("Unknown argument: " + flag);
+    }
+    if (i + 1 >= argc) {
+      throw std::invalid_argument("Missing value for " + flag);
+    }
+    flags[flag] = argv[i + 1];
+  }
+  return flags;
+}
+
+// Parses a byte count with an optional K, M or G suffix (powers of 1024)
+inline std::uint64_t parse_size(const std::string& text) {
+  std::size_t end = 0;
+  double value = std::stod(text, &end);
+  std::string suffix = text.substr(end);
+  double scale = 1;
+  if (suffix == "K" || suffix == "k") {
+    scale = 1024.0;
+  } else if (suffix == "M" || suffix == "m") {
+    scale = 1024.0 * 1024;
+  } else if (suffix == "G" || suffix == "g") {
+    scale = 1024.0 * 1024 * 1024;
+  } else if (!suffix.empty() && suffix != "B") {
+    throw std::invalid_argument("Invalid size: " + text);
+  }
+  if (value < 0) {
+    throw std::invalid_argument("Negative size: " + text);
+  }
+  return static_cast<std::uint64_t>(value * scale);
+}
+
+// Splits a comma separated list, dropping empty entries
+inline std::vector<std::string> split_list(const std::string& text) {
+  std::vector<std::string> items;
+  std::istringstream input(text);
+  std::string item;
+  while (std::getline(input, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+
+// ---- WORKLOAD GENERATORS ----
+// Object size distribution, written as
+//   fixed:<size>                  every object has the same size
+//   uniform:<min>-<max>           sizes drawn uniformly in [min, max]
+//   lognormal:<median>:<sigma>    long tailed sizes around a median
+class SizeDistribution {
+public:
+  explicit SizeDistribution(const std::string& spec = "fixed:4K") : spec_(spec) {
+    auto colon = spec.find(':');
+    if (colon == std::string::npos) {
+      throw std::invalid_argument("Invalid size distribution: " + spec);
+    }
+    kind_ = spec.substr(0, colon);
+    std::string args = spec.substr(colon + 1);
+    if (kind_ == "fixed") {
+      min_ = max_ = parse_size(args);
+    } else if (kind_ == "uniform") {
+      auto dash = args.find('-');
+      if (dash == std::string::npos) {
+        throw std::invalid_argument("Invalid uniform distribution: " + spec);
+      }
+      min_ = parse_size(args.substr(0, dash));
+      max_ = parse_size(args.substr(dash + 1));
+      if (min_ > max_) {
+        throw std::invalid_argument("Uniform minimum above maximum: " + spec);
+      }
+    } else if (kind_ == "lognormal") {
+      auto sep = args.find(':');
+      if (sep == std::string::npos) {
+        throw std::invalid_argument("Invalid lognormal distribution: " + spec);
+      }
+      min_ = parse_size(args.substr(0, sep));
+      sigma_ = std::stod(args.substr(sep + 1));
+      max_ = 0;
+    } else {
+      throw std::invalid_argument("Unknown size distribution: " + kind_);
+    }
+  }
+
+  std::uint64_t sample(std::mt19937_64& rng) const {
+    if (kind_ == "fixed") {
+      return min_;
+    }
+    if (kind_ == "uniform") {
+      return std::uniform_int_distribution<std::uint64_t>(min_, max_)(rng);
+    }
+    std::lognormal_distribution<double> lognormal(std::log(std::max<double>(1.0, static_cast<double>(min_))), sigma_);
+    return std::min(static_cast<std::uint64_t>(lognormal(rng)), max_size());
+  }
+
+  // Largest size sample() can return, used to size payload buffers.
+  // Lognormal sizes are capped at 64x the median
+  std::uint64_t max_size() const { return kind_ == "lognormal" ? min_ * 64 : max_; }
+  const std::string& spec() const { return spec_; }
+
+private:
+  std::string spec_;
+  std::string kind_;
+  std::uint64_t min_{0};
+  std::uint64_t max_{0};
+  double sigma_{0};
+};
+
+// Draws ranks 0..n-1 with probability proportional to 1/(rank+1)^s. s = 0
+// is uniform, s around 1 is the usual hot key skew of caches and stores
+class ZipfGenerator {
+public:
+  ZipfGenerator(std::size_t n, double s) : cdf_(std::max<std::size_t>(n, 1)) {
+    double sum = 0;
+    for (std::size_t i = 0; i < cdf_.size(); ++i) {
+      sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+      cdf_[i] = sum;
+    }
+    for (double& value : cdf_) {
+      value /= sum;
+    }
+  }
+
+  std::size_t next(std::mt19937_64& rng) const {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    return std::min<std::size_t>(it - cdf_.begin(), cdf_.size() - 1);
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+// Incompressible payload bytes
+inline std::string random_payload(std::size_t size, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::string payload(size, '\0');
+  for (std::size_t i = 0; i < size; i += sizeof(std::uint64_t)) {
+    std::uint64_t word = rng();
+    std::copy_n(reinterpret_cast<const char*>(&word), std::min(sizeof(word), size - i), &payload[i]);
+  }
+  return payload;
+}
+
+// Read only stream buffer over bytes owned by someone else, so large
+// payloads can be stored from many threads without a copy each
+class PayloadView : public std::streambuf {
+public:
+  PayloadView(const char* data, std::size_t size) {
+    char* begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+  }
+
+protected:
+  pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+    char* target = (dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr()) + offset;
+    if (target < eback() || target > egptr()) {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), target, egptr());
+    return pos_type(target - eback());
+  }
+
+  pos_type seekpos(pos_type position, std::ios_base::openmode mode) override {
+    return seekoff(off_type(position), std::ios_base::beg, mode);
+  }
+};
+
+
+// ---- RESULTS ----
+// Exact latency samples of one operation type. Each worker thread keeps its
+// own recorder, merged once the run is over
+class LatencyRecorder {
+public:
+  void record(Clock::duration latency) {
+    samples_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    sorted_ = false;
+  }
+
+  void merge(const LatencyRecorder& other) {
+    samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    sorted_ = false;
+  }
+
+  std::size_t count() const { return samples_.size(); }
+
+  // Nearest rank percentile in microseconds, q in 0..1
+  double percentile_us(double q) {
+    if (samples_.empty()) {
+      return 0;
+    }
+    sort();
+    std::size_t rank = static_cast<std::size_t>(std::ceil(q * samples_.size()));
+    return samples_[std::clamp<std::size_t>(rank, 1, samples_.size()) - 1] / 1000.0;
+  }
+
+  double mean_us() const {
+    if (samples_.empty()) {
+      return 0;
+    }
+    long double sum = 0;
+    for (auto sample : samples_) {
+      sum += sample;
+    }
+    return static_cast<double>(sum / samples_.size() / 1000.0);
+  }
+
+  double max_us() {
+    sort();
+    return samples_.empty() ? 0 : samples_.back() / 1000.0;
+  }
+
+private:
+  std::vector<std::int64_t> samples_;
+  bool sorted_{true};
+
+  void sort() {
+    if (!sorted_) {
+      std::sort(samples_.begin(), samples_.end());
+      sorted_ = true;
+    }
+  }
+};
+
+// Totals of one operation type over a measured interval
+struct OpResult {
+  std::string name;
+  std::uint64_t ops{0};
+  std::uint64_t errors{0};
+  std::uint64_t bytes{0};
+  double seconds{0};
+  LatencyRecorder latency{};
+  // Extra per-operation figures such as syscalls/op, written as numbers
+  std::vector<std::pair<std::string, double>> extra{};
+
+  void merge(const OpResult& other) {
+    ops += other.ops;
+    errors += other.errors;
+    bytes += other.bytes;
+    latency.merge(other.latency);
+  }
+
+  double ops_per_sec() const { return seconds > 0 ? ops / seconds : 0; }
+  double mib_per_sec() const { return seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0; }
+};
+
+inline std::string json_escape(const std::string& text) {
+  std::string out;
+  for (char c : text) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char code[8];
+          std::snprintf(code, sizeof(code), "\\u%04x", c);
+          out += code;
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out;
+}
+
+// Writes the report shared by every benchmark:
+//   {"benchmark": name, "config": {...strings...},
+//    "results": [{"name", "ops", "errors", "bytes", "seconds", "ops_per_sec",
+//                 "mib_per_sec", "latency_us": {"mean","p50","p99","p999","max"}, ...extra}]}
+inline void write_json(std::ostream& output, const std::string& benchmark,
+                       const std::vector<std::pair<std::string, std::string>>& config,
+                       std::vector<OpResult>& results) {
+  output << std::setprecision(6) << std::fixed;
+  output << "{\n  \"benchmark\": \"" << json_escape(benchmark) << "\",\n  \"config\": {";
+  for (std::size_t i = 0; i < config.size(); ++i) {
+    output << (i ? ",\n    " : "\n    ") << "\"" << json_escape(config[i].first) << "\": \""
+           << json_escape(config[i].second) << "\"";
+  }
+  output << "\n  },\n  \"results\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    OpResult& result = results[i];
+    output << (i ? ",\n    {" : "\n    {")
+           << "\"name\": \"" << json_escape(result.name) << "\", "
+           << "\"ops\": " << result.ops << ", "
+           << "\"errors\": " << result.errors << ", "
+           << "\"bytes\": " << result.bytes << ", "
+           << "\"seconds\": " << result.seconds << ", "
+           << "\"ops_per_sec\": " << result.ops_per_sec() << ", "
+           << "\"mib_per_sec\": " << result.mib_per_sec() << ", "
+           << "\"latency_us\": {"
+           << "\"mean\": " << result.latency.mean_us() << ", "
+           << "\"p50\": " << result.latency.percentile_us(0.5) << ", "
+           << "\"p99\": " << result.latency.percentile_us(0.99) << ", "
+           << "\"p999\": " << result.latency.percentile_us(0.999) << ", "
+           << "\"max\": " << result.latency.max_us() << "}";
+    for (const auto& [key, value] : result.extra) {
+      output << ", \"" << json_escape(key) << "\": " << value;
+    }
+    output << "}";
+  }
+  output << "\n  ]\n}\n";
+  output.unsetf(std::ios::floatfield);
+}
+
+
+// ---- STATISTICS ----
+inline double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  std::size_t middle = values.size() / 2;
+  return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+struct MannWhitneyResult {
+  // U statistic of the first sample
+  double u{0};
+  // Two sided probability of a U at least this extreme if both samples
+  // come from the same distribution
+  double p_value{1};
+  // True when the exact distribution was used instead of the normal approximation
+  bool exact{false};
+};
+
+// Two sided Mann-Whitney U test. Small samples without ties use the exact
+// distribution of U, everything else the normal approximation with tie
+// and continuity correction
+inline MannWhitneyResult mann_whitney_u(const std::vector<double>& a, const std::vector<double>& b) {
+  MannWhitneyResult result;
+  const std::size_t n1 = a.size(), n2 = b.size();
+  if (n1 == 0 || n2 == 0) {
+    return result;
+  }
+
+  // Midranks over the pooled samples, remembering tie group sizes
+  std::vector<std::pair<double, bool>> pooled;
+  for (double value : a) {
+    pooled.emplace_back(value, true);
+  }
+  for (double value : b) {
+    pooled.emplace_back(value, false);
+  }
+  std::sort(pooled.begin(), pooled.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+
+  double rank_sum = 0;
+  double tie_term = 0;
+  bool ties = false;
+  for (std::size_t i = 0; i < pooled.size();) {
+    std::size_t j = i;
+    while (j < pooled.size() && pooled[j].first == pooled[i].first) {
+      ++j;
+    }
+    double rank = (i + 1 + j) / 2.0;
+    for (std::size_t k = i; k < j; ++k) {
+      if (pooled[k].second) {
+        rank_sum += rank;
+      }
+    }
+    double group = static_cast<double>(j - i);
+    tie_term += group * group * group - group;
+    ties = ties || group > 1;
+    i = j;
+  }
+  result.u = rank_sum - n1 * (n1 + 1) / 2.0;
+
+  const double mean = n1 * n2 / 2.0;
+  if (!ties && n1 + n2 <= 40) {
+    // counts[m][u]: orderings of m values of a and n values of b with U = u.
+    // The largest value either comes from a, beating all n values of b,
+    // or from b, adding nothing: f(m, n, u) = f(m-1, n, u-n) + f(m, n-1, u)
+    const std::size_t max_u = n1 * n2;
+    std::vector<std::vector<double>> counts(n1 + 1, std::vector<double>(max_u + 1, 0));
+    for (auto& row : counts) {
+      row[0] = 1;
+    }
+    for (std::size_t n = 1; n <= n2; ++n) {
+      for (std::size_t m = 1; m <= n1; ++m) {
+        for (std::size_t u = max_u + 1; u-- > 0;) {
+          counts[m][u] += u >= n ? counts[m - 1][u - n] : 0;
+        }
+      }
+    }
+    double total = 0, at_most = 0, at_least = 0;
+    for (std::size_t u = 0; u <= max_u; ++u) {
+      total += counts[n1][u];
+      if (u <= result.u) {
+        at_most += counts[n1][u];
+      }
+      if (u >= result.u) {
+        at_least += counts[n1][u];
+      }
+    }
+    result.p_value = std::min(1.0, 2 * std::min(at_most, at_least) / total);
+    result.exact = true;
+    return result;
+  }
+
+  const double n = static_cast<double>(n1 + n2);
+  const double variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)));
+  if (variance <= 0) {
+    return result;
+  }
+  double z = (std::abs(result.u - mean) - 0.5) / std::sqrt(variance);
+  result.p_value = std::min(1.0, std::erfc(std::max(z, 0.0) / std::sqrt(2.0)));
+  return result;
+}
+
+// Human readable summary of the same results
+inline void print_table(std::ostream& output, std::vector<OpResult>& results) {
+  output << std::left << std::setw(24) << "operation" << std::right
+         << std::setw(9) << "ops" << std::setw(8) << "errors"
+         << std::setw(12) << "ops/s" << std::setw(10) << "MiB/s"
+         << std::setw(11) << "p50 us" << std::setw(11) << "p99 us"
+         << std::setw(11) << "p999 us" << std::setw(11) << "max us" << "\n";
+  output << std::fixed << std::setprecision(1);
+  for (OpResult& result : results) {
+    output << std::left << std::setw(24) << result.name << std::right
+           << std::setw(9) << result.ops << std::setw(8) << result.errors
+           << std::setw(12) << result.ops_per_sec() << std::setw(10) << result.mib_per_sec()
+           << std::setw(11) << result.latency.percentile_us(0.5)
+           << std::setw(11) << result.latency.percentile_us(0.99)
+           << std::setw(11) << result.latency.percentile_us(0.999)
+           << std::setw(11) << result.latency.max_us();
+    for (const auto& [key, value] : result.extra) {
+      output << "  " << key << "=" << value;
+    }
+    output << "\n";
+  }
+  output.unsetf(std::ios::floatfield);
+  output << std::setprecision(6);
+}
+
+} // namespace bench
+} // namespace dfs
@@ -0,0 +1,354 @@
+#include "bench/bench_common.hpp"
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Keeps benchmark JSON reports in a results directory, one subdirectory per
+// named result set with one file per repetition, and compares two sets with
+// a Mann-Whitney U test per result and metric
+
+using namespace dfs::bench;
+namespace fs = std::filesystem;
+namespace pt = boost::property_tree;
+
+namespace {
+
+const std::string DEFAULT_DIR = "bench_results";
+
+// Metrics compared for every result, and whether a higher value is better
+struct Metric {
+  const char* name;
+  const char* path;
+  bool higher_is_better;
+};
+
+const std::vector<Metric> METRICS = {
+  {"ops/s", "ops_per_sec", true},
+  {"MiB/s", "mib_per_sec", true},
+  {"p50 us", "latency_us.p50", false},
+  {"p99 us", "latency_us.p99", false},
+};
+
+void print_usage(const std::string& program_name) {
+  std::cerr << "Usage:\n"
+            << "  " << program_name << " record [--dir DIR] --name NAME [--repeat N] -- <benchmark> [args...]\n"
+            << "      Runs the benchmark N times (default 5), adding --json <file>, and keeps every report\n"
+            << "  " << program_name << " save [--dir DIR] --name NAME <report.json>...\n"
+            << "      Copies existing reports into the result set NAME\n"
+            << "  " << program_name << " list [--dir DIR]\n"
+            << "      Lists the result sets and their repetitions\n"
+            << "  " << program_name << " compare [--dir DIR] --baseline NAME --candidate NAME\n"
+            << "          [--alpha A] [--threshold T]\n"
+            << "      Compares every result and metric of two sets. A change is reported when\n"
+            << "      p < A (default 0.05) and the medians differ by at least T (default 0.05)\n"
+            << "The results directory defaults to " << DEFAULT_DIR << ". compare exits with status 1\n"
+            << "when any metric regressed.\n";
+}
+
+// Splits "--flag value" pairs up to the end or a "--" separator, leaving
+// other arguments as positionals
+struct Arguments {
+  std::map<std::string, std::string> flags;
+  std::vector<std::string> positionals;
+  std::vector<std::string> command;
+};
+
+Arguments parse_arguments(int argc, char* argv[], const std::set<std::string>& known) {
+  Arguments arguments;
+  for (int i = 2; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--") {
+      arguments.command.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (argument.rfind("--", 0) == 0) {
+      if (!known.count(argument)) {
+        throw std::invalid_argument("Unknown argument: " + argument);
+      }
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("Missing value for " + argument);
+      }
+      arguments.flags[argument] = argv[++i];
+    } else {
+      arguments.positionals.push_back(argument);
+    }
+  }
+  return arguments;
+}
+
+std::string flag_or(const Arguments& arguments, const std::string& flag, const std::string& fallback) {
+  auto it = arguments.flags.find(flag);
+  return it == arguments.flags.end() ? fallback : it->second;
+}
+
+std::string required_flag(const Arguments& arguments, const std::string& flag) {
+  auto it = arguments.flags.find(flag);
+  if (it == arguments.flags.end() || it->second.empty()) {
+    throw std::invalid_argument(flag + " is required");
+  }
+  return it->second;
+}
+
+// Result set names become directory names, so keep them to one path component
+fs::path set_path(const std::string& dir, const std::string& name) {
+  if (name.find('/') != std::string::npos || name == "." || name == "..") {
+    throw std::invalid_argument("Invalid result set name: " + name);
+  }
+  return fs::path(dir) / name;
+}
+
+// Reports of a set in the order they were recorded
+std::vector<fs::path> list_runs(const fs::path& set) {
+  std::vector<fs::path> runs;
+  if (fs::is_directory(set)) {
+    for (const auto& entry : fs::directory_iterator(set)) {
+      if (entry.path().extension() == ".json") {
+        runs.push_back(entry.path());
+      }
+    }
+  }
+  std::sort(runs.begin(), runs.end());
+  return runs;
+}
+
+fs::path next_run_path(const fs::path& set) {
+  fs::create_directories(set);
+  std::size_t index = list_runs(set).size();
+  fs::path path;
+  do {
+    char name[32];
+    std::snprintf(name, sizeof(name), "run_%04zu.json", index++);
+    path = set / name;
+  } while (fs::exists(path));
+  return path;
+}
+
+// Throws if the file is not a benchmark report
+void validate_report(const fs::path& path) {
+  pt::ptree root;
+  pt::read_json(path.string(), root);
+  if (!root.get_child_optional("results")) {
+    throw std::runtime_error(path.string() + " has no results");
+  }
+}
+
+
+// ---- COMMANDS ----
+int record(const Arguments& arguments) {
+  fs::path set = set_path(flag_or(arguments, "--dir", DEFAULT_DIR), required_flag(arguments, "--name"));
+  int repeat = std::stoi(flag_or(arguments, "--repeat", "5"));
+  if (arguments.command.empty() || repeat < 1) {
+    throw std::invalid_argument("record needs --repeat >= 1 and a benchmark command after --");
+  }
+
+  for (int run = 0; run < repeat; ++run) {
+    fs::path path = next_run_path(set);
+    std::vector<std::string> command = arguments.command;
+    command.push_back("--json");
+    command.push_back(path.string());
+    std::vector<char*> exec_args;
+    for (auto& argument : command) {
+      exec_args.push_back(argument.data());
+    }
+    exec_args.push_back(nullptr);
+
+    std::cout << "Run " << (run + 1) << "/" << repeat << ": " << command.front() << std::endl;
+    pid_t child = ::fork();
+    if (child < 0) {
+      throw std::runtime_error("fork failed");
+    }
+    if (child == 0) {
+      ::execvp(exec_args[0], exec_args.data());
+      std::perror("execvp");
+      ::_exit(127);
+    }
+    int status = 0;
+    ::waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !fs::exists(path)) {
+      fs::remove(path);
+      std::cerr << "Error: Benchmark run " << (run + 1) << " failed, its report was not kept\n";
+      return 1;
+    }
+    validate_report(path);
+  }
+  std::cout << "Recorded " << repeat << " runs in " << set.string() << "\n";
+  return 0;
+}
+
+int save(const Arguments& arguments) {
+  fs::path set = set_path(flag_or(arguments, "--dir", DEFAULT_DIR), required_flag(arguments, "--name"));
+  if (arguments.positionals.empty()) {
+    throw std::invalid_argument("save needs at least one report");
+  }
+  for (const auto& report : arguments.positionals) {
+    validate_report(report);
+    fs::path path = next_run_path(set);
+    fs::copy_file(report, path);
+    std::cout << report << " -> " << path.string() << "\n";
+  }
+  return 0;
+}
+
+int list(const Arguments& arguments) {
+  fs::path dir = flag_or(arguments, "--dir", DEFAULT_DIR);
+  if (!fs::is_directory(dir)) {
+    std::cout << "No results in " << dir.string() << "\n";
+    return 0;
+  }
+  std::vector<fs::path> sets;
+  for (const auto& entry : fs::directory_iterator(dir)) {
+    if (entry.is_directory()) {
+      sets.push_back(entry.path());
+    }
+  }
+  std::sort(sets.begin(), sets.end());
+  for (const auto& set : sets) {
+    auto runs = list_runs(set);
+    std::string benchmark = "?";
+    if (!runs.empty()) {
+      pt::ptree root;
+      pt::read_json(runs.front().string(), root);
+      benchmark = root.get<std::string>("benchmark", "?");
+    }
+    std::cout << std::left << std::setw(24) << set.filename().string() << std::setw(14) << benchmark
+              << runs.size() << " runs\n";
+  }
+  return 0;
+}
+
+// Samples of one metric of one result, one value per repetition
+using Samples = std::map<std::string, std::map<std::string, std::vector<double>>>;
+
+Samples load_set(const fs::path& set, std::string& benchmark) {
+  Samples samples;
+  auto runs = list_runs(set);
+  if (runs.empty()) {
+    throw std::runtime_error("No reports in " + set.string());
+  }
+  for (const auto& run : runs) {
+    pt::ptree root;
+    pt::read_json(run.string(), root);
+    benchmark = root.get<std::string>("benchmark", "");
+    for (const auto& [unused, result] : root.get_child("results")) {
+      std::string name = result.get<std::string>("name");
+      for (const auto& metric : METRICS) {
+        if (auto value = result.get_optional<double>(metric.path)) {
+          samples[name][metric.name].push_back(*value);
+        }
+      }
+    }
+  }
+  return samples;
+}
+
+int compare(const Arguments& arguments) {
+  std::string dir = flag_or(arguments, "--dir", DEFAULT_DIR);
+  std::string baseline_name = required_flag(arguments, "--baseline");
+  std::string candidate_name = required_flag(arguments, "--candidate");
+  double alpha = std::stod(flag_or(arguments, "--alpha", "0.05"));
+  double threshold = std::stod(flag_or(arguments, "--threshold", "0.05"));
+
+  std::string baseline_benchmark, candidate_benchmark;
+  Samples baseline = load_set(set_path(dir, baseline_name), baseline_benchmark);
+  Samples candidate = load_set(set_path(dir, candidate_name), candidate_benchmark);
+  if (baseline_benchmark != candidate_benchmark) {
+    std::cerr << "Warning: Comparing " << baseline_benchmark << " against " << candidate_benchmark << "\n";
+  }
+
+  std::size_t regressions = 0, improvements = 0, unchanged = 0;
+  std::cout << std::left << std::setw(32) << "result" << std::setw(8) << "metric" << std::right
+            << std::setw(14) << "baseline" << std::setw(14) << "candidate" << std::setw(10) << "change"
+            << std::setw(10) << "p" << "  verdict\n";
+  std::cout << std::fixed;
+
+  for (const auto& [name, base_metrics] : baseline) {
+    auto other = candidate.find(name);
+    if (other == candidate.end()) {
+      std::cout << std::left << std::setw(32) << name << "missing from " << candidate_name << "\n";
+      continue;
+    }
+    for (const auto& metric : METRICS) {
+      auto base_samples = base_metrics.find(metric.name);
+      auto candidate_samples = other->second.find(metric.name);
+      if (base_samples == base_metrics.end() || candidate_samples == other->second.end()) {
+        continue;
+      }
+      double base_median = median(base_samples->second);
+      double candidate_median = median(candidate_samples->second);
+      // MiB/s of operations that move no bytes
+      if (base_median == 0 && candidate_median == 0) {
+        continue;
+      }
+
+      double change = base_median != 0 ? (candidate_median - base_median) / base_median : 1.0;
+      MannWhitneyResult test = mann_whitney_u(base_samples->second, candidate_samples->second);
+      std::string verdict = "unchanged";
+      if (test.p_value < alpha && std::abs(change) >= threshold) {
+        bool better = (change > 0) == metric.higher_is_better;
+        verdict = better ? "improvement" : "REGRESSION";
+        ++(better ? improvements : regressions);
+      } else {
+        ++unchanged;
+      }
+
+      std::cout << std::left << std::setw(32) << name << std::setw(8) << metric.name << std::right
+                << std::setprecision(1) << std::setw(14) << base_median << std::setw(14) << candidate_median
+                << std::showpos << std::setw(9) << change * 100 << "%" << std::noshowpos
+                << std::setprecision(3) << std::setw(10) << test.p_value << "  " << verdict << "\n";
+    }
+  }
+  for (const auto& [name, unused] : candidate) {
+    if (!baseline.count(name)) {
+      std::cout << std::left << std::setw(32) << name << "new in " << candidate_name << "\n";
+    }
+  }
+
+  std::size_t base_runs = list_runs(set_path(dir, baseline_name)).size();
+  std::size_t candidate_runs = list_runs(set_path(dir, candidate_name)).size();
+  std::cout << "\n" << regressions << " regressions, " << improvements << " improvements, "
+            << unchanged << " unchanged (" << base_runs << " vs " << candidate_runs << " runs, alpha "
+            << std::setprecision(2) << alpha << ", threshold " << threshold * 100 << "%)\n";
+  // The most extreme ordering of the runs has p = 2 / C(n1 + n2, n1)
+  double orderings = 1;
+  for (std::size_t i = 1; i <= base_runs; ++i) {
+    orderings = orderings * (candidate_runs + i) / i;
+  }
+  if (2 / orderings >= alpha) {
+    std::cout << "Note: " << base_runs << " vs " << candidate_runs << " runs cannot reach p < "
+              << alpha << ", record more repetitions\n";
+  }
+  return regressions == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h") {
+    print_usage(argv[0]);
+    return argc < 2 ? 1 : 0;
+  }
+
+  std::string command = argv[1];
+  try {
+    if (command == "record") {
+      return record(parse_arguments(argc, argv, {"--dir", "--name", "--repeat"}));
+    }
+    if (command == "save") {
+      return save(parse_arguments(argc, argv, {"--dir", "--name"}));
+    }
+    if (command == "list") {
+      return list(parse_arguments(argc, argv, {"--dir"}));
+    }
+    if (command == "compare") {
+      return compare(parse_arguments(argc, argv, {"--dir", "--baseline", "--candidate", "--alpha", "--threshold"}));
+    }
+    std::cerr << "Error: Unknown command: " << command << '\n';
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+  }
+  print_usage(argv[0]);
+  return 1;
+}
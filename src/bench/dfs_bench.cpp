@@ -0,0 +1,371 @@
+#include "bench/bench_common.hpp"
+#include "network/bootstrap.hpp"
+#include "logger/logger.hpp"
+#include <array>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+// End to end benchmark: starts a cluster of in-process nodes on loopback,
+// preloads a key set through the file servers and then drives a mixed
+// store/get workload from several client threads. Every node runs the full
+// network stack, so remote gets cross real TCP connections
+
+using namespace dfs::bench;
+using dfs::network::Bootstrap;
+using dfs::network::FileServer;
+
+namespace {
+
+const std::string ADDRESS = "127.0.0.1";
+const std::vector<uint8_t> KEY(32, 0x42);
+// Key striped locks that keep remote gets and stores of one key apart from
+// every other operation on that key, local gets share them
+constexpr std::size_t KEY_STRIPES = 64;
+
+struct Options {
+  std::size_t nodes{3};
+  uint16_t base_port{4100};
+  std::size_t keys{100};
+  std::size_t ops{1000};
+  std::size_t concurrency{4};
+  double read_ratio{0.9};
+  double remote_ratio{0.5};
+  double zipf{0.99};
+  std::string sizes{"fixed:64K"};
+  std::size_t write_quorum{0};
+  std::uint64_t seed{1};
+  std::string json_file;
+  std::string log_file{"dfs_bench.log"};
+};
+
+void print_usage(const std::string& program_name) {
+  std::cerr << "Usage: " << program_name << " [--flag value]...\n"
+            << "  --nodes N          Nodes in the cluster (default 3)\n"
+            << "  --base-port P      Node i listens on P + i (default 4100)\n"
+            << "  --keys N           Keys preloaded before the run (default 100)\n"
+            << "  --ops N            Operations over all clients (default 1000)\n"
+            << "  --concurrency N    Client threads (default 4)\n"
+            << "  --read-ratio R     Share of gets, the rest are stores (default 0.9)\n"
+            << "  --remote-ratio R   Share of gets served by another node (default 0.5)\n"
+            << "  --zipf S           Key popularity skew, 0 is uniform (default 0.99)\n"
+            << "  --sizes SPEC       fixed:<size>, uniform:<min>-<max> or lognormal:<median>:<sigma>\n"
+            << "                     with K/M/G suffixes (default fixed:64K)\n"
+            << "  --write-quorum W   Peer acknowledgements each store waits for (default 0)\n"
+            << "  --seed N           Workload seed (default 1)\n"
+            << "  --json FILE        Write results as JSON, - for stdout\n"
+            << "  --log FILE         Log file (default dfs_bench.log)\n"
+            << "Example: " << program_name << " --nodes 3 --ops 5000 --zipf 1.1 --sizes lognormal:32K:1.0\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+  auto flags = parse_flags(argc, argv, {
+    "--nodes", "--base-port", "--keys", "--ops", "--concurrency", "--read-ratio",
+    "--remote-ratio", "--zipf", "--sizes", "--write-quorum", "--seed", "--json", "--log"
+  });
+
+  Options options;
+  auto get = [&flags](const std::string& flag, auto& target, auto parse) {
+    auto it = flags.find(flag);
+    if (it != flags.end()) {
+      target = parse(it->second);
+    }
+  };
+  auto to_size = [](const std::string& value) { return static_cast<std::size_t>(std::stoull(value)); };
+  auto to_double = [](const std::string& value) { return std::stod(value); };
+  auto to_string = [](const std::string& value) { return value; };
+
+  get("--nodes", options.nodes, to_size);
+  get("--base-port", options.base_port, [](const std::string& value) { return static_cast<uint16_t>(std::stoi(value)); });
+  get("--keys", options.keys, to_size);
+  get("--ops", options.ops, to_size);
+  get("--concurrency", options.concurrency, to_size);
+  get("--read-ratio", options.read_ratio, to_double);
+  get("--remote-ratio", options.remote_ratio, to_double);
+  get("--zipf", options.zipf, to_double);
+  get("--sizes", options.sizes, to_string);
+  get("--write-quorum", options.write_quorum, to_size);
+  get("--seed", options.seed, [](const std::string& value) { return std::stoull(value); });
+  get("--json", options.json_file, to_string);
+  get("--log", options.log_file, to_string);
+
+  if (options.nodes < 2 || options.nodes > 255) {
+    throw std::invalid_argument("--nodes must be between 2 and 255");
+  }
+  if (options.keys == 0 || options.concurrency == 0) {
+    throw std::invalid_argument("--keys and --concurrency must be positive");
+  }
+  if (options.read_ratio < 0 || options.read_ratio > 1 || options.remote_ratio < 0 || options.remote_ratio > 1) {
+    throw std::invalid_argument("Ratios must be between 0 and 1");
+  }
+  if (options.write_quorum >= options.nodes) {
+    throw std::invalid_argument("--write-quorum must be below the node count");
+  }
+  if (options.base_port + options.nodes > 65535) {
+    throw std::invalid_argument("--base-port too high for the node count");
+  }
+  return options;
+}
+
+std::string key_name(std::size_t rank) {
+  return "bench_key_" + std::to_string(rank);
+}
+
+// Polls condition every 20ms until it holds or timeout passes
+bool wait_until(std::chrono::seconds timeout, const std::function<bool()>& condition) {
+  auto deadline = Clock::now() + timeout;
+  while (!condition()) {
+    if (Clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return true;
+}
+
+class Cluster {
+public:
+  explicit Cluster(const Options& options) : options_(options) {}
+
+  ~Cluster() {
+    for (auto& node : nodes_) {
+      try {
+        node->get_file_server().get_store().clear();
+      } catch (const std::exception& e) {
+        DFS_LOG(warning) << "Benchmark: Failed to clear store: " << e.what();
+      }
+    }
+    // Later nodes connected to earlier ones, so take them down first
+    while (!nodes_.empty()) {
+      nodes_.pop_back();
+    }
+  }
+
+  // Starts every node, each bootstrapping to all nodes started before it,
+  // and waits until the mesh is complete
+  bool start() {
+    std::vector<std::string> started;
+    for (std::size_t i = 1; i <= options_.nodes; ++i) {
+      uint16_t port = static_cast<uint16_t>(options_.base_port + i);
+      auto node = std::make_unique<Bootstrap>(ADDRESS, port, KEY, static_cast<uint8_t>(i), started);
+      if (!node->start()) {
+        std::cerr << "Error: Failed to start node " << i << " on port " << port << '\n';
+        return false;
+      }
+      node->get_file_server().set_write_quorum(options_.write_quorum);
+      nodes_.push_back(std::move(node));
+      started.push_back(ADDRESS + ":" + std::to_string(port));
+    }
+
+    return wait_until(std::chrono::seconds(10), [this] {
+      for (std::size_t i = 0; i < nodes_.size(); ++i) {
+        for (std::size_t j = 0; j < nodes_.size(); ++j) {
+          if (i != j && !nodes_[i]->get_peer_manager().has_peer(static_cast<uint8_t>(j + 1))) {
+            return false;
+          }
+        }
+      }
+      return true;
+    });
+  }
+
+  // Stores every key once, spread over the nodes, and waits until the
+  // broadcast has replicated each key to every node
+  bool preload(const std::string& payload, const SizeDistribution& sizes, std::mt19937_64& rng) {
+    for (std::size_t rank = 0; rank < options_.keys; ++rank) {
+      std::istringstream input(payload.substr(0, sizes.sample(rng)));
+      if (!node(rank).store_file(key_name(rank), input)) {
+        std::cerr << "Error: Failed to preload " << key_name(rank) << '\n';
+        return false;
+      }
+    }
+
+    return wait_until(std::chrono::seconds(60), [this] {
+      for (auto& node : nodes_) {
+        for (std::size_t rank = 0; rank < options_.keys; ++rank) {
+          if (!node->get_file_server().get_store().has(key_name(rank))) {
+            return false;
+          }
+        }
+      }
+      return true;
+    });
+  }
+
+  FileServer& node(std::size_t index) { return nodes_[index % nodes_.size()]->get_file_server(); }
+  std::shared_mutex& key_lock(std::size_t rank) { return key_locks_[rank % KEY_STRIPES]; }
+
+private:
+  const Options& options_;
+  std::vector<std::unique_ptr<Bootstrap>> nodes_;
+  std::array<std::shared_mutex, KEY_STRIPES> key_locks_;
+};
+
+// Results of one client thread
+struct ClientResults {
+  OpResult store{"store"};
+  OpResult get_local{"get_local"};
+  OpResult get_remote{"get_remote"};
+};
+
+// Runs ops operations against one node. A remote get first drops the node's
+// own and cached copies, outside the timed section, so the file server has
+// to fetch the key from a peer, and puts the fetched content back as the
+// node's own copy afterwards. Stores and remote gets of one key hold its
+// stripe lock exclusively so no other client can drop a copy they depend on,
+// and local gets hold it shared so the copy they read is not dropped under them
+void run_client(Cluster& cluster, const Options& options, std::size_t client, std::size_t ops,
+                const std::string& payload, const SizeDistribution& sizes,
+                const ZipfGenerator& zipf, ClientResults& results) {
+  std::mt19937_64 rng(options.seed * 7919 + client + 1);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  FileServer& server = cluster.node(client);
+
+  for (std::size_t op = 0; op < ops; ++op) {
+    std::size_t rank = zipf.next(rng);
+    std::string key = key_name(rank);
+
+    if (coin(rng) < options.read_ratio) {
+      bool remote = coin(rng) < options.remote_ratio;
+      OpResult& result = remote ? results.get_remote : results.get_local;
+      std::unique_lock<std::shared_mutex> exclusive(cluster.key_lock(rank), std::defer_lock);
+      std::shared_lock<std::shared_mutex> shared(cluster.key_lock(rank), std::defer_lock);
+      if (remote) {
+        exclusive.lock();
+        for (const std::string& copy : {key, FileServer::cache_key(key)}) {
+          if (server.get_store().has(copy)) {
+            server.get_store().remove(copy);
+          }
+        }
+      } else {
+        shared.lock();
+      }
+
+      std::ostringstream output;
+      auto start = Clock::now();
+      bool ok = server.fetch_file(key, output);
+      result.latency.record(Clock::now() - start);
+      if (remote && ok) {
+        std::istringstream fetched(output.str());
+        server.get_store().store(key, fetched);
+      }
+      ++result.ops;
+      result.bytes += output.str().size();
+      result.errors += ok ? 0 : 1;
+    } else {
+      std::istringstream input(payload.substr(0, sizes.sample(rng)));
+      std::lock_guard<std::shared_mutex> lock(cluster.key_lock(rank));
+      auto start = Clock::now();
+      bool ok = server.store_file(key, input);
+      results.store.latency.record(Clock::now() - start);
+      ++results.store.ops;
+      results.store.bytes += input.str().size();
+      results.store.errors += ok ? 0 : 1;
+    }
+  }
+}
+
+int run(const Options& options) {
+  SizeDistribution sizes(options.sizes);
+  ZipfGenerator zipf(options.keys, options.zipf);
+  std::string payload = random_payload(sizes.max_size(), options.seed);
+  std::mt19937_64 rng(options.seed);
+
+  Cluster cluster(options);
+  if (!cluster.start()) {
+    std::cerr << "Error: Nodes did not connect, see " << options.log_file << '\n';
+    return 1;
+  }
+  std::cout << "Started " << options.nodes << " nodes, preloading " << options.keys << " keys\n";
+  if (!cluster.preload(payload, sizes, rng)) {
+    std::cerr << "Error: Preload did not replicate to every node\n";
+    return 1;
+  }
+
+  std::vector<ClientResults> clients(options.concurrency);
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (std::size_t client = 0; client < options.concurrency; ++client) {
+    std::size_t ops = options.ops / options.concurrency + (client < options.ops % options.concurrency ? 1 : 0);
+    threads.emplace_back(run_client, std::ref(cluster), std::cref(options), client, ops,
+                         std::cref(payload), std::cref(sizes), std::cref(zipf), std::ref(clients[client]));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  // Each operation type is reported against the wall time of the whole run
+  std::vector<OpResult> results{OpResult{"store"}, OpResult{"get_local"}, OpResult{"get_remote"}, OpResult{"all"}};
+  for (const auto& client : clients) {
+    results[0].merge(client.store);
+    results[1].merge(client.get_local);
+    results[2].merge(client.get_remote);
+    for (const OpResult* result : {&client.store, &client.get_local, &client.get_remote}) {
+      results[3].merge(*result);
+    }
+  }
+  for (auto& result : results) {
+    result.seconds = seconds;
+  }
+
+  print_table(std::cout, results);
+
+  if (!options.json_file.empty()) {
+    std::vector<std::pair<std::string, std::string>> config{
+      {"nodes", std::to_string(options.nodes)},
+      {"keys", std::to_string(options.keys)},
+      {"ops", std::to_string(options.ops)},
+      {"concurrency", std::to_string(options.concurrency)},
+      {"read_ratio", std::to_string(options.read_ratio)},
+      {"remote_ratio", std::to_string(options.remote_ratio)},
+      {"zipf", std::to_string(options.zipf)},
+      {"sizes", options.sizes},
+      {"write_quorum", std::to_string(options.write_quorum)},
+      {"seed", std::to_string(options.seed)}
+    };
+    if (options.json_file == "-") {
+      write_json(std::cout, "dfs_bench", config, results);
+    } else {
+      std::ofstream file(options.json_file);
+      if (!file) {
+        std::cerr << "Error: Failed to open " << options.json_file << '\n';
+        return 1;
+      }
+      write_json(file, "dfs_bench", config, results);
+    }
+  }
+
+  return results[3].errors == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc == 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h")) {
+    print_usage(argv[0]);
+    return 0;
+  }
+
+  Options options;
+  try {
+    options = parse_options(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  dfs::crypto::Logger::init(options.log_file);
+  int status = 1;
+  try {
+    status = run(options);
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+  }
+  dfs::crypto::Logger::shutdown();
+  return status;
+}
@@ -0,0 +1,467 @@
+#include "bench/bench_common.hpp"
+#include "store/store.hpp"
+#include "logger/logger.hpp"
+#include <filesystem>
+#include <fstream>
+#include <latch>
+#include <memory>
+#include <thread>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Microbenchmark of the local Store: store, get, has, remove and delete_file
+// over a grid of object sizes, thread counts and page cache states. Each
+// cell writes a fresh key set, reads it back, probes it and deletes it, and
+// reports latency, throughput and kernel work per operation
+
+using namespace dfs::bench;
+using dfs::store::Store;
+
+namespace {
+
+struct Options {
+  std::string dir{"store_bench_data"};
+  std::vector<std::uint64_t> sizes{0, 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024,
+                                   256 * 1024 * 1024, 1024ULL * 1024 * 1024};
+  std::vector<std::size_t> threads{1, 4, 16, 64};
+  std::vector<std::string> caches{"warm", "cold"};
+  std::vector<std::string> ops{"store", "get", "has", "remove", "delete_file"};
+  std::size_t ops_per_cell{1000};
+  std::uint64_t max_bytes{4ULL * 1024 * 1024 * 1024};
+  std::uint64_t max_memory{2ULL * 1024 * 1024 * 1024};
+  std::uint64_t seed{1};
+  std::string json_file;
+  std::string log_file{"store_bench.log"};
+};
+
+void print_usage(const std::string& program_name) {
+  std::cerr << "Usage: " << program_name << " [--flag value]...\n"
+            << "  --dir PATH         Store directory, cleared before and after (default store_bench_data)\n"
+            << "  --sizes LIST       Object sizes with K/M/G suffixes (default 0,4K,64K,1M,16M,256M,1G)\n"
+            << "  --threads LIST     Concurrent threads (default 1,4,16,64)\n"
+            << "  --cache LIST       warm and/or cold page cache for reads (default warm,cold)\n"
+            << "  --ops LIST         Operations to report (default store,get,has,remove,delete_file)\n"
+            << "  --count N          Objects per cell, lowered for large sizes (default 1000)\n"
+            << "  --max-bytes SIZE   Bytes written per cell (default 4G)\n"
+            << "  --max-memory SIZE  Cells whose concurrent reads need more memory are skipped (default 2G)\n"
+            << "  --seed N           Payload seed (default 1)\n"
+            << "  --json FILE        Write results as JSON, - for stdout\n"
+            << "  --log FILE         Log file (default store_bench.log)\n"
+            << "Example: " << program_name << " --sizes 4K,1M --threads 1,16 --cache cold --json store.json\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+  auto flags = parse_flags(argc, argv, {
+    "--dir", "--sizes", "--threads", "--cache", "--ops", "--count", "--max-bytes",
+    "--max-memory", "--seed", "--json", "--log"
+  });
+
+  Options options;
+  for (const auto& [flag, value] : flags) {
+    if (flag == "--dir") {
+      options.dir = value;
+    } else if (flag == "--sizes") {
+      options.sizes.clear();
+      for (const auto& item : split_list(value)) {
+        options.sizes.push_back(parse_size(item));
+      }
+    } else if (flag == "--threads") {
+      options.threads.clear();
+      for (const auto& item : split_list(value)) {
+        options.threads.push_back(static_cast<std::size_t>(std::stoull(item)));
+      }
+    } else if (flag == "--cache") {
+      options.caches = split_list(value);
+    } else if (flag == "--ops") {
+      options.ops = split_list(value);
+    } else if (flag == "--count") {
+      options.ops_per_cell = static_cast<std::size_t>(std::stoull(value));
+    } else if (flag == "--max-bytes") {
+      options.max_bytes = parse_size(value);
+    } else if (flag == "--max-memory") {
+      options.max_memory = parse_size(value);
+    } else if (flag == "--seed") {
+      options.seed = std::stoull(value);
+    } else if (flag == "--json") {
+      options.json_file = value;
+    } else if (flag == "--log") {
+      options.log_file = value;
+    }
+  }
+
+  for (const auto& cache : options.caches) {
+    if (cache != "warm" && cache != "cold") {
+      throw std::invalid_argument("Unknown cache state: " + cache);
+    }
+  }
+  for (const auto& op : options.ops) {
+    if (op != "store" && op != "get" && op != "has" && op != "remove" && op != "delete_file") {
+      throw std::invalid_argument("Unknown operation: " + op);
+    }
+  }
+  for (auto threads : options.threads) {
+    if (threads == 0 || threads > 1024) {
+      throw std::invalid_argument("Thread counts must be between 1 and 1024");
+    }
+  }
+  if (options.sizes.empty() || options.threads.empty() || options.caches.empty() || options.ops_per_cell == 0) {
+    throw std::invalid_argument("--sizes, --threads, --cache and --count must not be empty");
+  }
+  return options;
+}
+
+std::string size_label(std::uint64_t size) {
+  if (size >= 1024ULL * 1024 * 1024 && size % (1024ULL * 1024 * 1024) == 0) {
+    return std::to_string(size / (1024ULL * 1024 * 1024)) + "G";
+  }
+  if (size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+    return std::to_string(size / (1024 * 1024)) + "M";
+  }
+  if (size >= 1024 && size % 1024 == 0) {
+    return std::to_string(size / 1024) + "K";
+  }
+  return std::to_string(size) + "B";
+}
+
+
+// ---- KERNEL WORK COUNTERS ----
+// Id of the raw_syscalls:sys_enter tracepoint, empty when tracefs is not
+// mounted
+std::string syscall_tracepoint_id() {
+  for (const char* root : {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+    std::ifstream id(std::string(root) + "/events/raw_syscalls/sys_enter/id");
+    std::string value;
+    if (id >> value) {
+      return value;
+    }
+  }
+  return {};
+}
+
+// Per thread kernel work. Syscalls are counted with a perf tracepoint on
+// sys_enter when the kernel allows it, otherwise only the read and write
+// syscalls of /proc/thread-self/io are seen
+class ThreadCounters {
+public:
+  struct Sample {
+    std::uint64_t syscalls{0};
+    std::uint64_t context_switches{0};
+    std::uint64_t major_faults{0};
+    std::uint64_t block_io{0};
+  };
+
+  explicit ThreadCounters(const std::string& tracepoint_id) {
+    if (tracepoint_id.empty()) {
+      return;
+    }
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.config = std::stoull(tracepoint_id);
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+  }
+
+  ~ThreadCounters() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  ThreadCounters(const ThreadCounters&) = delete;
+  ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+  bool exact_syscalls() const { return fd_ >= 0; }
+
+  // Reads the rusage before the syscall count, so a later read() minus an
+  // earlier one includes exactly the two syscalls of the later read
+  Sample read() const {
+    Sample sample;
+    rusage usage{};
+    ::getrusage(RUSAGE_THREAD, &usage);
+    sample.context_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+    sample.major_faults = usage.ru_majflt;
+    sample.block_io = usage.ru_inblock + usage.ru_oublock;
+
+    if (fd_ >= 0) {
+      std::uint64_t count = 0;
+      if (::read(fd_, &count, sizeof(count)) == sizeof(count)) {
+        sample.syscalls = count;
+      }
+    } else {
+      std::ifstream io("/proc/thread-self/io");
+      std::string name;
+      std::uint64_t value;
+      while (io >> name >> value) {
+        if (name == "syscr:" || name == "syscw:") {
+          sample.syscalls += value;
+        }
+      }
+    }
+    return sample;
+  }
+
+private:
+  int fd_{-1};
+};
+
+// Adds the kernel work of one thread between two samples
+void add_delta(ThreadCounters::Sample& total, const ThreadCounters::Sample& before,
+               const ThreadCounters::Sample& after, bool exact) {
+  total.syscalls += after.syscalls - before.syscalls - (exact ? 2 : 0);
+  total.context_switches += after.context_switches - before.context_switches;
+  total.major_faults += after.major_faults - before.major_faults;
+  total.block_io += after.block_io - before.block_io;
+}
+
+
+// ---- CELLS ----
+struct Cell {
+  std::uint64_t size;
+  std::size_t threads;
+  std::string cache;
+  std::size_t count;
+};
+
+// Flushes and drops the page cache of every file under dir. Directory
+// entries and inodes stay cached, so has() is only partly cold
+void drop_page_cache(const std::filesystem::path& dir) {
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(dir)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    int fd = ::open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+class CellRunner {
+public:
+  CellRunner(Store& store, const Options& options, const std::string& payload, const std::string& tracepoint_id)
+    : store_(store), options_(options), payload_(payload), tracepoint_id_(tracepoint_id) {}
+
+  // Runs every phase of one cell and appends the reported operations
+  void run(const Cell& cell, std::vector<OpResult>& results) {
+    cell_ = cell;
+    std::string prefix = "/" + size_label(cell.size) + "/t" + std::to_string(cell.threads) + "/" + cell.cache;
+
+    OpResult store = phase("store" + prefix, [this](std::size_t thread, std::size_t index) {
+      PayloadView view(payload_.data(), cell_.size);
+      std::istream input(&view);
+      store_.store(key(thread, index), input);
+      return cell_.size;
+    });
+
+    auto prepare_reads = [this] {
+      if (cell_.cache == "cold") {
+        drop_page_cache(options_.dir);
+      }
+    };
+
+    prepare_reads();
+    OpResult get = phase("get" + prefix, [this](std::size_t thread, std::size_t index) {
+      std::stringstream output;
+      store_.get(key(thread, index), output);
+      return static_cast<std::uint64_t>(output.tellp());
+    });
+
+    prepare_reads();
+    OpResult has = phase("has" + prefix, [this](std::size_t thread, std::size_t index) {
+      if (!store_.has(key(thread, index))) {
+        throw std::runtime_error("missing key");
+      }
+      return std::uint64_t{0};
+    });
+
+    // Even objects go through remove, odd ones through delete_file, which
+    // also prunes the emptied fan-out directories
+    OpResult remove = phase("remove" + prefix, [this](std::size_t thread, std::size_t index) {
+      store_.remove(key(thread, index));
+      return std::uint64_t{0};
+    }, 2, 0);
+    OpResult delete_file = phase("delete_file" + prefix, [this](std::size_t thread, std::size_t index) {
+      store_.delete_file(key(thread, index));
+      return std::uint64_t{0};
+    }, 2, 1);
+
+    for (OpResult* result : {&store, &get, &has, &remove, &delete_file}) {
+      std::string op = result->name.substr(0, result->name.find('/'));
+      if (std::find(options_.ops.begin(), options_.ops.end(), op) != options_.ops.end()) {
+        results.push_back(std::move(*result));
+      }
+    }
+  }
+
+  bool exact_syscalls() const { return exact_syscalls_; }
+
+private:
+  Store& store_;
+  const Options& options_;
+  const std::string& payload_;
+  std::string tracepoint_id_;
+  Cell cell_{};
+  bool exact_syscalls_{false};
+
+  std::string key(std::size_t thread, std::size_t index) const {
+    return "store_bench_" + std::to_string(thread) + "_" + std::to_string(index);
+  }
+
+  // Runs op on the objects of every thread, all threads released together.
+  // Only indexes with index % stride == offset are timed and counted
+  template <typename Op>
+  OpResult phase(const std::string& name, Op op, std::size_t stride = 1, std::size_t offset = 0) {
+    std::size_t threads = cell_.threads;
+    std::vector<OpResult> partial(threads);
+    std::vector<ThreadCounters::Sample> work(threads);
+    std::vector<Clock::time_point> starts(threads), ends(threads);
+    std::vector<char> exact(threads, 0);
+    std::latch ready(static_cast<std::ptrdiff_t>(threads));
+
+    std::vector<std::thread> workers;
+    for (std::size_t thread = 0; thread < threads; ++thread) {
+      workers.emplace_back([&, thread] {
+        std::size_t count = cell_.count / threads + (thread < cell_.count % threads ? 1 : 0);
+        ThreadCounters counters(tracepoint_id_);
+        exact[thread] = counters.exact_syscalls();
+        OpResult& result = partial[thread];
+        ready.arrive_and_wait();
+
+        starts[thread] = Clock::now();
+        auto before = counters.read();
+        for (std::size_t index = offset; index < count; index += stride) {
+          auto start = Clock::now();
+          try {
+            result.bytes += op(thread, index);
+          } catch (const std::exception&) {
+            ++result.errors;
+          }
+          result.latency.record(Clock::now() - start);
+          ++result.ops;
+        }
+        add_delta(work[thread], before, counters.read(), counters.exact_syscalls());
+        ends[thread] = Clock::now();
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    OpResult total{name};
+    ThreadCounters::Sample sum;
+    for (std::size_t thread = 0; thread < threads; ++thread) {
+      total.merge(partial[thread]);
+      sum.syscalls += work[thread].syscalls;
+      sum.context_switches += work[thread].context_switches;
+      sum.major_faults += work[thread].major_faults;
+      sum.block_io += work[thread].block_io;
+    }
+    exact_syscalls_ = std::all_of(exact.begin(), exact.end(), [](char value) { return value != 0; });
+    total.seconds = std::chrono::duration<double>(*std::max_element(ends.begin(), ends.end()) -
+                                                  *std::min_element(starts.begin(), starts.end())).count();
+    double ops = static_cast<double>(std::max<std::uint64_t>(total.ops, 1));
+    total.extra = {
+      {"syscalls_per_op", sum.syscalls / ops},
+      {"context_switches_per_op", sum.context_switches / ops},
+      {"major_faults_per_op", sum.major_faults / ops},
+      {"block_io_per_op", sum.block_io / ops}
+    };
+    return total;
+  }
+};
+
+int run(const Options& options) {
+  std::uint64_t largest = *std::max_element(options.sizes.begin(), options.sizes.end());
+  std::string payload = random_payload(largest, options.seed);
+  std::string tracepoint_id = syscall_tracepoint_id();
+
+  Store store(options.dir);
+  store.clear();
+  CellRunner runner(store, options, payload, tracepoint_id);
+  std::vector<OpResult> results;
+
+  for (auto size : options.sizes) {
+    for (auto threads : options.threads) {
+      // Each get holds a whole object, and a stringstream may reserve up to twice that
+      if (size * 2 * threads > options.max_memory) {
+        std::cout << "Skipping " << size_label(size) << " x " << threads
+                  << " threads, reads need more than --max-memory\n";
+        continue;
+      }
+      std::size_t count = options.ops_per_cell;
+      if (size > 0) {
+        count = std::min<std::size_t>(count, std::max<std::uint64_t>(options.max_bytes / size, threads));
+      }
+      for (const auto& cache : options.caches) {
+        std::cout << "Running " << size_label(size) << " x " << count << " objects, "
+                  << threads << " threads, " << cache << " cache" << std::endl;
+        runner.run(Cell{size, threads, cache, count}, results);
+        store.clear();
+      }
+    }
+  }
+
+  print_table(std::cout, results);
+  std::string source = runner.exact_syscalls() ? "perf raw_syscalls:sys_enter" : "/proc read and write syscalls";
+  std::cout << "Syscalls counted from " << source << "\n";
+
+  if (!options.json_file.empty()) {
+    std::vector<std::pair<std::string, std::string>> config{
+      {"dir", options.dir},
+      {"count", std::to_string(options.ops_per_cell)},
+      {"max_bytes", std::to_string(options.max_bytes)},
+      {"seed", std::to_string(options.seed)},
+      {"syscall_source", source}
+    };
+    if (options.json_file == "-") {
+      write_json(std::cout, "store_bench", config, results);
+    } else {
+      std::ofstream file(options.json_file);
+      if (!file) {
+        std::cerr << "Error: Failed to open " << options.json_file << '\n';
+        return 1;
+      }
+      write_json(file, "store_bench", config, results);
+    }
+  }
+
+  store.clear();
+  bool failed = std::any_of(results.begin(), results.end(), [](const OpResult& result) { return result.errors > 0; });
+  return failed ? 1 : 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc == 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h")) {
+    print_usage(argv[0]);
+    return 0;
+  }
+
+  Options options;
+  try {
+    options = parse_options(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  dfs::crypto::Logger::init(options.log_file);
+  int status = 1;
+  try {
+    status = run(options);
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+  }
+  dfs::crypto::Logger::shutdown();
+  return status;
+}
@@ -1,11 +1,208 @@
 #include "cli/cli.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <sstream>
-#include <boost/log/trivial.hpp>
+#include <thread>
+#include <vector>
+#include "logger/logger.hpp"
+#include "metrics/cpu_profiler.hpp"
+#include "network/peer_manager.hpp"
 
 namespace dfs {
 namespace cli {
 
+namespace {
+
+// Files up to this size are read into memory by the worker before store_file
+// takes the file server lock, so disk reads overlap with other workers' sends
+constexpr std::uintmax_t SMALL_FILE_SIZE = 1024 * 1024;
+// Workers used by store -r and fetch -r in the interactive shell
+constexpr std::size_t TREE_CONCURRENCY = 4;
+// Minimum time between two progress lines of a recursive transfer
+constexpr std::chrono::seconds PROGRESS_INTERVAL{1};
+
+// Runs jobs on a fixed set of threads through a queue of at most twice as many
+// jobs. submit blocks while the queue is full or a job with the same key is
+// queued or running, so jobs on one key run in submission order
+class WorkerPool {
+public:
+  explicit WorkerPool(std::size_t threads) : queue_limit_(threads * 2) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      threads_.emplace_back([this] { work(); });
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+    }
+    work_ready_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void submit(const std::string& key, std::function<void()> job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [&] { return queue_.size() < queue_limit_ && !pending_.count(key); });
+    pending_.insert(key);
+    queue_.emplace_back(key, std::move(job));
+    work_ready_.notify_one();
+  }
+
+  // Waits until every submitted job has finished
+  void drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [&] { return queue_.empty() && in_flight_ == 0; });
+  }
+
+private:
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      work_ready_.wait(lock, [&] { return closing_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      auto [key, job] = std::move(queue_.front());
+      queue_.pop_front();
+      ++in_flight_;
+      work_done_.notify_all();
+      lock.unlock();
+      job();
+      lock.lock();
+      --in_flight_;
+      pending_.erase(pending_.find(key));
+      work_done_.notify_all();
+    }
+  }
+
+  std::size_t queue_limit_;
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+  std::deque<std::pair<std::string, std::function<void()>>> queue_;
+  std::multiset<std::string> pending_;
+  std::size_t in_flight_ = 0;
+  bool closing_ = false;
+  std::vector<std::thread> threads_;
+};
+
+std::string format_duration(double seconds) {
+  auto total = static_cast<long long>(seconds + 0.5);
+  std::ostringstream out;
+  out << total / 3600 << ':' << std::setfill('0') << std::setw(2) << total / 60 % 60 << ':'
+      << std::setw(2) << total % 60;
+  return out.str();
+}
+
+// Counts the finished files of a recursive transfer and prints throughput and
+// an ETA at most once per PROGRESS_INTERVAL. The ETA follows bytes when the
+// total size is known up front, and files otherwise
+class TransferProgress {
+public:
+  TransferProgress(std::ostream& output, std::string verb, std::size_t total_files,
+                   std::uintmax_t total_bytes)
+    : output_(output), verb_(std::move(verb)), total_files_(total_files), total_bytes_(total_bytes),
+      start_(std::chrono::steady_clock::now()), last_print_(start_) {}
+
+  void add(std::uintmax_t bytes, bool ok) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++files_;
+    failed_ += ok ? 0 : 1;
+    bytes_ += bytes;
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_print_ >= PROGRESS_INTERVAL) {
+      last_print_ = now;
+      print(false);
+    }
+  }
+
+  void finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    print(true);
+  }
+
+  std::size_t failed() const { return failed_; }
+  std::uintmax_t bytes() const { return bytes_; }
+
+private:
+  void print(bool final) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    double mib = bytes_ / (1024.0 * 1024.0);
+    double mib_per_sec = seconds > 0 ? mib / seconds : 0;
+    double files_per_sec = seconds > 0 ? files_ / seconds : 0;
+
+    output_ << verb_ << ' ' << files_ << '/' << total_files_ << " files";
+    if (failed_ > 0) {
+      output_ << " (" << failed_ << " failed)";
+    }
+    output_ << std::fixed << std::setprecision(1) << ", " << mib;
+    if (total_bytes_ > 0) {
+      output_ << '/' << total_bytes_ / (1024.0 * 1024.0);
+    }
+    output_ << " MiB, " << mib_per_sec << " MiB/s, " << files_per_sec << " files/s";
+    if (final) {
+      output_ << ", " << format_duration(seconds) << " elapsed" << std::endl;
+      return;
+    }
+    double eta = 0;
+    if (total_bytes_ > 0 && bytes_ > 0) {
+      eta = (total_bytes_ - std::min(bytes_, total_bytes_)) * seconds / bytes_;
+    } else if (files_ > 0) {
+      eta = (total_files_ - files_) * seconds / files_;
+    }
+    output_ << ", ETA " << format_duration(eta) << std::endl;
+  }
+
+  std::ostream& output_;
+  std::string verb_;
+  std::size_t total_files_;
+  std::uintmax_t total_bytes_;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point last_print_;
+  std::mutex mutex_;
+  std::size_t files_ = 0;
+  std::size_t failed_ = 0;
+  std::uintmax_t bytes_ = 0;
+};
+
+// Manifest paths come from the network, so only plain relative paths that stay
+// below the destination directory are accepted
+bool is_safe_relative_path(const std::filesystem::path& path) {
+  if (path.empty() || path.is_absolute() || path.has_root_name()) {
+    return false;
+  }
+  for (const auto& part : path) {
+    if (part == ".." || part == ".") {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Key a directory tree and its manifest are stored under: the path as typed,
+// normalized and without a trailing separator
+std::string tree_key(const std::string& directory) {
+  std::string key = std::filesystem::path(directory).lexically_normal().generic_string();
+  while (key.size() > 1 && key.back() == '/') {
+    key.pop_back();
+  }
+  return key;
+}
+
+} // namespace
+
 //==============================================
 // CONSTRUCTOR AND DESTRUCTOR
 //==============================================
@@ -14,7 +211,7 @@ CLI::CLI(store::Store& store, network::FileServer& file_server)
   : store_(store)
   , file_server_(file_server)
   , running_(false) {
-  BOOST_LOG_TRIVIAL(info) << "CLI initialized";
+  DFS_LOG(info) << "CLI initialized";
 }
 
 
@@ -25,7 +222,7 @@ void CLI::run() {
   running_ = true;
   std::string line;
   
-  BOOST_LOG_TRIVIAL(info) << "Starting CLI loop";
+  DFS_LOG(info) << "Starting CLI loop";
   std::cout << "DFS_Shell> " << std::flush;
   
   while (running_ && std::getline(std::cin, line)) {
@@ -38,8 +235,20 @@ void CLI::run() {
   std::string command, filename;
 
   iss >> command;
-  if (command == "pwd" || command == "ls" || command == "help") {
+  if (command == "pwd" || command == "ls" || command == "help" || command == "peers") {
   process_command(command, "");
+  } else if (command == "profile") {
+  std::string arguments;
+  std::getline(iss >> std::ws, arguments);
+  handle_profile_command(arguments);
+  } else if (command == "snapshot") {
+  std::string arguments;
+  std::getline(iss >> std::ws, arguments);
+  handle_snapshot_command(arguments);
+  } else if (command == "store" || command == "fetch") {
+  std::string arguments;
+  std::getline(iss >> std::ws, arguments);
+  handle_transfer_command(command, arguments);
   } else if (iss >> filename) {
   process_command(command, filename);
   } else {
@@ -51,7 +260,332 @@ void CLI::run() {
   }
   }
   
-  BOOST_LOG_TRIVIAL(info) << "CLI loop ended";
+  DFS_LOG(info) << "CLI loop ended";
+}
+
+
+//==============================================
+// BATCH MODE
+//==============================================
+
+bool CLI::run_batch(std::istream& script, std::ostream& output, std::ostream& report,
+                    std::size_t concurrency) {
+  using Clock = std::chrono::steady_clock;
+  concurrency = std::max<std::size_t>(concurrency, 1);
+  DFS_LOG(info) << "CLI: Starting batch with concurrency " << concurrency;
+
+  std::mutex output_mutex;
+  std::size_t commands = 0;
+  std::atomic<std::size_t> failed{0};
+  std::atomic<std::uintmax_t> total_bytes{0};
+
+  // Times one command and writes its report line
+  auto execute = [&](std::size_t sequence, const std::string& command, const std::string& argument) {
+    auto start = Clock::now();
+    CommandResult result;
+    if (concurrency == 1 || command != "read") {
+      result = execute_batch_command(command, argument, output, concurrency);
+    } else {
+      // Parallel reads are buffered so their content reaches output unmixed
+      std::ostringstream buffer;
+      result = execute_batch_command(command, argument, buffer, concurrency);
+      std::lock_guard<std::mutex> lock(output_mutex);
+      output << buffer.str();
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    failed += result.ok ? 0 : 1;
+    total_bytes += result.bytes;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    report << sequence << '\t' << command << '\t' << argument << '\t'
+           << (result.ok ? "ok" : "error") << '\t' << std::fixed << std::setprecision(3) << ms << '\t'
+           << result.bytes;
+    if (!result.ok) {
+      report << '\t' << result.error;
+    }
+    report << '\n' << std::flush;
+  };
+
+  std::unique_ptr<WorkerPool> pool;
+  if (concurrency > 1) {
+    pool = std::make_unique<WorkerPool>(concurrency);
+  }
+
+  auto start = Clock::now();
+  std::string line;
+  while (std::getline(script, line)) {
+    std::istringstream iss(line);
+    std::string command, argument;
+    iss >> command;
+    std::getline(iss >> std::ws, argument);
+    if (command.empty() || command[0] == '#') {
+      continue;
+    }
+    if (command == "quit") {
+      break;
+    }
+    std::size_t sequence = ++commands;
+
+    bool parallel = (command == "store" || command == "read" || command == "delete") &&
+                    argument.rfind("-r ", 0) != 0;
+    if (!parallel || !pool) {
+      // Commands that change or show shared state see every earlier command finished
+      if (pool) {
+        pool->drain();
+      }
+      execute(sequence, command, argument);
+      continue;
+    }
+    pool->submit(argument, [&execute, sequence, command, argument] { execute(sequence, command, argument); });
+  }
+  pool.reset();
+  output << std::flush;
+
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  report << "# " << commands << " commands, " << failed.load() << " failed, " << std::fixed << std::setprecision(3)
+         << seconds << " s, " << std::setprecision(1) << (seconds > 0 ? commands / seconds : 0.0)
+         << " commands/s, " << (seconds > 0 ? total_bytes.load() / seconds / (1024 * 1024) : 0.0) << " MiB/s"
+         << std::endl;
+  DFS_LOG(info) << "CLI: Batch finished, " << commands << " commands, " << failed.load() << " failed";
+  return failed == 0;
+}
+
+CLI::CommandResult CLI::execute_batch_command(const std::string& command, const std::string& argument,
+                                              std::ostream& output, std::size_t concurrency) {
+  CommandResult result;
+  try {
+    if ((command == "store" || command == "fetch") && argument.rfind("-r ", 0) == 0) {
+      // Per file progress has no place in the report, only the outcome does
+      std::ostream discard(nullptr);
+      std::istringstream iss(argument.substr(3));
+      std::string directory, destination;
+      iss >> directory >> destination;
+      return command == "store" ? store_tree(directory, concurrency, discard)
+                                : fetch_tree(directory, destination, concurrency, discard);
+    } else if (command == "store") {
+      return store_local_file(argument, argument);
+    } else if (command == "read") {
+      result.ok = file_server_.fetch_file(argument, output);
+      result.bytes = result.ok ? store_.get_file_size(argument) : 0;
+    } else if (command == "delete") {
+      store_.delete_file(argument);
+      result.ok = true;
+    } else if (command == "connect") {
+      size_t colon_pos = argument.find(':');
+      if (colon_pos == std::string::npos) {
+        result.error = "expected ip:port";
+        return result;
+      }
+      result.ok = file_server_.connect(argument.substr(0, colon_pos),
+                                       static_cast<uint16_t>(std::stoi(argument.substr(colon_pos + 1))));
+    } else if (command == "cd") {
+      store_.move_dir(argument);
+      result.ok = true;
+    } else if (command == "pwd" || command == "ls" || command == "help" || command == "peers") {
+      process_command(command, "");
+      result.ok = true;
+    } else if (command == "profile") {
+      handle_profile_command(argument);
+      result.ok = true;
+    } else if (command == "snapshot") {
+      result.ok = handle_snapshot_command(argument);
+    } else {
+      result.error = "unknown command";
+      return result;
+    }
+    if (!result.ok && result.error.empty()) {
+      result.error = command == "read" ? "not found" : "failed";
+    }
+  } catch (const std::exception& e) {
+    result.ok = false;
+    result.error = e.what();
+  }
+  return result;
+}
+
+
+//==============================================
+// RECURSIVE TRANSFER
+//==============================================
+
+CLI::CommandResult CLI::store_local_file(const std::string& path, const std::string& key) {
+  CommandResult result;
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    result.error = "cannot open local file";
+    return result;
+  }
+  result.bytes = std::filesystem::file_size(path);
+  if (result.bytes <= SMALL_FILE_SIZE) {
+    std::string content(result.bytes, '\0');
+    file.read(content.data(), static_cast<std::streamsize>(content.size()));
+    content.resize(static_cast<std::size_t>(std::max<std::streamsize>(file.gcount(), 0)));
+    std::istringstream input(std::move(content));
+    result.ok = file_server_.store_file(key, input);
+  } else {
+    result.ok = file_server_.store_file(key, file);
+  }
+  if (!result.ok) {
+    result.error = store_.has(key) ? "stored locally but not sent to peers" : "failed";
+  }
+  return result;
+}
+
+CLI::CommandResult CLI::store_tree(const std::string& directory, std::size_t concurrency, std::ostream& progress) {
+  namespace fs = std::filesystem;
+  CommandResult result;
+  if (directory.empty() || !fs::is_directory(directory)) {
+    result.error = "not a directory: " + directory;
+    return result;
+  }
+
+  // Walk the whole tree first, so progress has totals to report an ETA against
+  struct Entry {
+    fs::path path;
+    std::string relative;
+    std::uintmax_t size;
+  };
+  std::vector<Entry> entries;
+  std::uintmax_t total_bytes = 0;
+  for (const auto& entry : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    std::string relative = entry.path().lexically_relative(directory).generic_string();
+    if (relative.find('\n') != std::string::npos) {
+      progress << "Skipping file with a newline in its name: " << entry.path() << std::endl;
+      continue;
+    }
+    entries.push_back({entry.path(), std::move(relative), entry.file_size()});
+    total_bytes += entries.back().size;
+  }
+  std::string root = tree_key(directory);
+  DFS_LOG(info) << "CLI: Storing " << entries.size() << " files (" << total_bytes << " bytes) from " << root;
+
+  TransferProgress tracker(progress, "Stored", entries.size(), total_bytes);
+  std::vector<char> stored(entries.size(), 0);
+  std::mutex error_mutex;
+  std::string first_error;
+  {
+    WorkerPool pool(std::max<std::size_t>(concurrency, 1));
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      pool.submit(entries[i].relative, [&, i] {
+        const Entry& entry = entries[i];
+        std::string key = root + "/" + entry.relative;
+        CommandResult file_result;
+        try {
+          file_result = store_local_file(entry.path.string(), key);
+        } catch (const std::exception& e) {
+          file_result.error = e.what();
+        }
+        stored[i] = file_result.ok ? 1 : 0;
+        if (!file_result.ok) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          progress << "Error storing " << key << ": " << file_result.error << std::endl;
+          if (first_error.empty()) {
+            first_error = key + ": " + file_result.error;
+          }
+        }
+        tracker.add(file_result.ok ? entry.size : 0, file_result.ok);
+      });
+    }
+  }
+  tracker.finish();
+
+  // The manifest lists every stored file, so fetch -r can find the tree on any node
+  std::ostringstream manifest;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    if (stored[i]) {
+      manifest << entries[i].relative << '\n';
+    }
+  }
+  std::istringstream manifest_input(manifest.str());
+  bool manifest_stored = file_server_.store_file(root, manifest_input);
+
+  result.bytes = tracker.bytes();
+  result.ok = tracker.failed() == 0 && manifest_stored;
+  if (tracker.failed() > 0) {
+    result.error = std::to_string(tracker.failed()) + " of " + std::to_string(entries.size()) +
+                   " files failed, first " + first_error;
+  } else if (!manifest_stored) {
+    result.error = "failed to store manifest " + root;
+  }
+  return result;
+}
+
+CLI::CommandResult CLI::fetch_tree(const std::string& directory, const std::string& destination,
+                                   std::size_t concurrency, std::ostream& progress) {
+  namespace fs = std::filesystem;
+  CommandResult result;
+  std::string root = tree_key(directory);
+  fs::path target = destination.empty() ? fs::path(directory) : fs::path(destination);
+
+  std::ostringstream manifest;
+  if (root.empty() || !file_server_.fetch_file(root, manifest)) {
+    result.error = "no manifest for " + root + ", was it stored with store -r?";
+    return result;
+  }
+  std::vector<std::string> files;
+  std::istringstream lines(manifest.str());
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    if (!is_safe_relative_path(line)) {
+      progress << "Skipping unsafe manifest entry: " << line << std::endl;
+      continue;
+    }
+    files.push_back(line);
+  }
+  DFS_LOG(info) << "CLI: Fetching " << files.size() << " files of " << root << " into " << target;
+
+  TransferProgress tracker(progress, "Fetched", files.size(), 0);
+  std::mutex error_mutex;
+  std::string first_error;
+  {
+    WorkerPool pool(std::max<std::size_t>(concurrency, 1));
+    for (const auto& relative : files) {
+      pool.submit(relative, [&, relative] {
+        std::string key = root + "/" + relative;
+        fs::path path = target / relative;
+        std::uintmax_t bytes = 0;
+        std::string error;
+        try {
+          fs::create_directories(path.parent_path());
+          std::ofstream output(path, std::ios::binary | std::ios::trunc);
+          if (!output) {
+            error = "cannot open local file";
+          } else if (!file_server_.fetch_file(key, output) || !output.flush()) {
+            error = "not found";
+          } else {
+            bytes = static_cast<std::uintmax_t>(output.tellp());
+          }
+        } catch (const std::exception& e) {
+          error = e.what();
+        }
+        if (!error.empty()) {
+          std::error_code ignored;
+          fs::remove(path, ignored);
+          std::lock_guard<std::mutex> lock(error_mutex);
+          progress << "Error fetching " << key << ": " << error << std::endl;
+          if (first_error.empty()) {
+            first_error = key + ": " + error;
+          }
+        }
+        tracker.add(bytes, error.empty());
+      });
+    }
+  }
+  tracker.finish();
+
+  result.bytes = tracker.bytes();
+  result.ok = tracker.failed() == 0;
+  if (!result.ok) {
+    result.error = std::to_string(tracker.failed()) + " of " + std::to_string(files.size()) +
+                   " files failed, first " + first_error;
+  }
+  return result;
 }
 
 
@@ -60,7 +594,7 @@ void CLI::run() {
 //==============================================
 
 void CLI::process_command(const std::string& command, const std::string& filename) {
-  BOOST_LOG_TRIVIAL(debug) << "Processing command: " << command << " with filename: " << filename;
+  DFS_LOG(debug) << "Processing command: " << command << " with filename: " << filename;
 
   if (command == "read") {
     handle_read_command(filename);
@@ -74,6 +608,9 @@ void CLI::process_command(const std::string& command, const std::string& filenam
   else if (command == "help" && filename.empty()) {
     handle_help_command();
   }
+  else if (command == "peers" && filename.empty()) {
+    handle_peers_command();
+  }
   else if (command == "store") {
     handle_store_command(filename);
   }
@@ -103,7 +640,7 @@ void CLI::handle_read_command(const std::string& filename) {
 }
 
 void CLI::handle_store_command(const std::string& filename) {
-  std::ifstream file(filename);
+  std::ifstream file(filename, std::ios::binary);
   if (!file) {
     std::cout << "Error opening file: " << filename << std::endl;
     return;
@@ -111,6 +648,36 @@ void CLI::handle_store_command(const std::string& filename) {
   file_server_.store_file(filename, file);
 }
 
+void CLI::handle_transfer_command(const std::string& command, const std::string& arguments) {
+  std::istringstream iss(arguments);
+  std::string flag, directory, destination;
+  iss >> flag;
+  if (flag != "-r") {
+    if (command == "store" && !flag.empty()) {
+      handle_store_command(flag);
+    } else {
+      std::cout << "Usage: store <file> | store -r <dir> | fetch -r <dir> [<local dir>]" << std::endl;
+    }
+    return;
+  }
+  if (!(iss >> directory)) {
+    std::cout << "Usage: " << command << " -r <dir>" << (command == "fetch" ? " [<local dir>]" : "") << std::endl;
+    return;
+  }
+  iss >> destination;
+
+  try {
+    CommandResult result = command == "store" ? store_tree(directory, TREE_CONCURRENCY, std::cout)
+                                              : fetch_tree(directory, destination, TREE_CONCURRENCY, std::cout);
+    if (!result.ok) {
+      log_and_display_error(command == "store" ? "Error storing directory" : "Error fetching directory",
+                            result.error);
+    }
+  } catch (const std::exception& e) {
+    log_and_display_error(command == "store" ? "Error storing directory" : "Error fetching directory", e.what());
+  }
+}
+
 void CLI::handle_connect_command(const std::string& connection_string) {
   size_t colon_pos = connection_string.find(':');
   if (colon_pos == std::string::npos) {
@@ -140,6 +707,104 @@ void CLI::handle_delete_command(const std::string& filename) {
   }
 }
 
+void CLI::handle_profile_command(const std::string& arguments) {
+  constexpr int MAX_PROFILE_SECONDS = 3600;
+
+  std::istringstream iss(arguments);
+  int seconds = 0;
+  std::string output_path;
+  if (!(iss >> seconds >> output_path) || seconds <= 0 || seconds > MAX_PROFILE_SECONDS) {
+    std::cout << "Usage: profile <seconds> <file> (1 to " << MAX_PROFILE_SECONDS << " seconds)" << std::endl;
+    return;
+  }
+
+  std::ofstream output(output_path, std::ios::trunc);
+  if (!output) {
+    std::cout << "Error opening file: " << output_path << std::endl;
+    return;
+  }
+
+  metrics::CpuProfiler profiler;
+  if (!profiler.start()) {
+    std::cout << "CPU profiling is not available (check /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+    return;
+  }
+  std::cout << "Profiling for " << seconds << " seconds..." << std::endl;
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  profiler.stop();
+
+  std::size_t stacks = profiler.write_folded(output);
+  std::cout << "Wrote " << stacks << " stacks from " << profiler.samples() << " samples to "
+            << output_path;
+  if (profiler.lost() > 0) {
+    std::cout << " (" << profiler.lost() << " samples lost)";
+  }
+  std::cout << std::endl;
+}
+
+bool CLI::handle_snapshot_command(const std::string& arguments) {
+  std::istringstream iss(arguments);
+  std::string action, name, directory;
+  iss >> action >> name >> directory;
+  try {
+    if (action == "list" && name.empty()) {
+      for (const auto& snapshot : store_.list_snapshots()) {
+        std::cout << "  " << snapshot.id << "  " << snapshot.name << std::endl;
+      }
+      std::cout << store_.preserved_versions() << " versions kept for snapshots" << std::endl;
+      return true;
+    } else if (action == "create" && !name.empty() && directory.empty()) {
+      store_.create_snapshot(name);
+      std::cout << "Snapshot " << name << " created" << std::endl;
+      return true;
+    } else if (action == "delete" && !name.empty() && directory.empty()) {
+      store_.delete_snapshot(name);
+      std::cout << "Snapshot " << name << " deleted" << std::endl;
+      return true;
+    } else if (action == "export" && !name.empty() && !directory.empty()) {
+      std::size_t objects = store_.export_snapshot(name, directory);
+      std::cout << "Exported " << objects << " objects of snapshot " << name << " to " << directory << std::endl;
+      return true;
+    }
+    std::cout << "Usage: snapshot create <name> | delete <name> | list | export <name> <dir>" << std::endl;
+  } catch (const std::exception& e) {
+    log_and_display_error("Error in snapshot command", e.what());
+  }
+  return false;
+}
+
+void CLI::handle_peers_command() {
+  auto stats = file_server_.get_peer_manager().peer_stats();
+  if (stats.empty()) {
+    std::cout << "No peers connected" << std::endl;
+    return;
+  }
+
+  std::cout << std::left << std::setw(5) << "ID" << std::setw(22) << "Endpoint"
+            << std::right << std::setw(12) << "Sent" << std::setw(12) << "Received"
+            << std::setw(14) << "Frames tx/rx" << std::setw(14) << "Errors tx/rx"
+            << std::setw(10) << "In-flight" << std::setw(9) << "Waiting"
+            << std::setw(10) << "Sock-Q" << std::setw(10) << "RTT ms" << std::setw(9) << "Retrans"
+            << std::endl;
+  for (const auto& peer : stats) {
+    std::ostringstream frames, errors, rtt;
+    frames << peer.frames_sent << "/" << peer.frames_received;
+    errors << peer.send_errors << "/" << peer.receive_errors;
+    if (peer.tcp_info_valid) {
+      rtt << std::fixed << std::setprecision(3) << peer.rtt_us / 1000.0;
+    } else {
+      rtt << "-";
+    }
+    std::cout << std::left << std::setw(5) << static_cast<int>(peer.peer_id)
+              << std::setw(22) << (peer.connected ? peer.remote_endpoint : "disconnected")
+              << std::right << std::setw(12) << peer.bytes_sent << std::setw(12) << peer.bytes_received
+              << std::setw(14) << frames.str() << std::setw(14) << errors.str()
+              << std::setw(10) << peer.in_flight << std::setw(9) << peer.send_waiters
+              << std::setw(10) << peer.socket_send_queue << std::setw(10) << rtt.str()
+              << std::setw(9) << peer.retransmits << std::endl;
+  }
+}
+
 void CLI::handle_help_command() {
   std::cout << "Available commands:" << std::endl;
   std::cout << "  help              Display this help message" << std::endl;
@@ -148,13 +813,20 @@ void CLI::handle_help_command() {
   std::cout << "  cd <dir>          Change to directory <dir>" << std::endl;
   std::cout << "  read <file>       Read contents of <file>" << std::endl;
   std::cout << "  store <file>      Store local <file> in DFS" << std::endl;
+  std::cout << "  store -r <dir>    Store every file below local <dir> in DFS" << std::endl;
+  std::cout << "  fetch -r <dir> [<local dir>] Fetch a tree stored with store -r" << std::endl;
   std::cout << "  delete <file>     Delete <file> from DFS" << std::endl;
   std::cout << "  connect <ip:port> Connect to DFS server at <ip:port>" << std::endl;
+  std::cout << "  peers             Show traffic, queues and RTT per peer" << std::endl;
+  std::cout << "  profile <s> <file> Sample CPU stacks for <s> seconds into <file>" << std::endl;
+  std::cout << "  snapshot create|delete <name>, snapshot list, snapshot export <name> <dir>" << std::endl;
+  std::cout << "                    Point-in-time copies of the local store" << std::endl;
+  std::cout << "  (dfs_main -b <script|-> runs the same commands non-interactively)" << std::endl;
   std::cout << "  quit              Exit the DFS shell" << std::endl << std::endl;
 }
 
 void CLI::log_and_display_error(const std::string& message, const std::string& error) {
-  BOOST_LOG_TRIVIAL(error) << message << ": " << error;
+  DFS_LOG(error) << message << ": " << error;
   std::cout << message << ": " << error << std::endl;
 }
 
@@ -5,7 +5,8 @@
 #include <openssl/rand.h>
 #include <array>
 #include <stdexcept>
-#include <boost/log/trivial.hpp>
+#include "logger/logger.hpp"
+#include "metrics/hot_path.hpp"
 
 namespace dfs::crypto {
 
@@ -40,14 +41,14 @@ struct CipherContext {
 //==============================================
 
 CryptoStream::CryptoStream() {
-  BOOST_LOG_TRIVIAL(info) << "Crypto stream: Initializing CryptoStream";
+  DFS_LOG(info) << "Crypto stream: Initializing CryptoStream";
   OpenSSL_add_all_algorithms();
   context_ = std::make_unique<CipherContext>();
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: initialization complete";
+  DFS_LOG(debug) << "Crypto stream: initialization complete";
 }
 
 CryptoStream::~CryptoStream() {
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Cleaning up CryptoStream resources";
+  DFS_LOG(debug) << "Crypto stream: Cleaning up CryptoStream resources";
   EVP_cleanup();
 }
 
@@ -56,10 +57,10 @@ CryptoStream::~CryptoStream() {
 //==============================================
 
 void CryptoStream::initialize(const std::vector<uint8_t>& key, const std::vector<uint8_t>& iv) {
-  BOOST_LOG_TRIVIAL(info) << "Crypto stream: Initializing crypto parameters";
+  DFS_LOG(info) << "Crypto stream: Initializing crypto parameters";
 
   if (key.size() != KEY_SIZE) {
-    BOOST_LOG_TRIVIAL(error) << "Crypto stream: Invalid key size: " << key.size() << " bytes (expected " << KEY_SIZE << " bytes)";
+    DFS_LOG(error) << "Crypto stream: Invalid key size: " << key.size() << " bytes (expected " << KEY_SIZE << " bytes)";
     throw InitializationError("Invalid key size");
   }
 
@@ -67,11 +68,11 @@ void CryptoStream::initialize(const std::vector<uint8_t>& key, const std::vector
   key_ = key;
   iv_ = iv;
   is_initialized_ = true;
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Crypto parameters initialized successfully";
+  DFS_LOG(debug) << "Crypto stream: Crypto parameters initialized successfully";
 }
 
 void CryptoStream::initializeCipher(bool encrypting) {
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Initializing cipher for " << (encrypting ? "encryption" : "decryption");
+  DFS_LOG(debug) << "Crypto stream: Initializing cipher for " << (encrypting ? "encryption" : "decryption");
 
   if (!is_initialized_) {
     throw InitializationError("Crypto stream: CryptoStream not initialized");
@@ -92,7 +93,7 @@ void CryptoStream::initializeCipher(bool encrypting) {
     }
   }
 
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Cipher initialization complete";
+  DFS_LOG(debug) << "Crypto stream: Cipher initialization complete";
 }
 
 //==============================================
@@ -100,7 +101,7 @@ void CryptoStream::initializeCipher(bool encrypting) {
 //==============================================
 
 void CryptoStream::processStream(std::istream& input, std::ostream& output, bool encrypting) {
-  BOOST_LOG_TRIVIAL(info) << "Crypto stream: Starting stream " << (encrypting ? "encryption" : "decryption");
+  DFS_LOG(info) << "Crypto stream: Starting stream " << (encrypting ? "encryption" : "decryption");
 
   if (!input.good() || !output.good()) {
     throw std::runtime_error("Crypto stream: Invalid stream state");
@@ -122,7 +123,7 @@ void CryptoStream::saveStreamPos(std::istream& input, std::ostream& output,
       operation();
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Crypto stream: Stream processing failed: " << e.what();
+    DFS_LOG(error) << "Crypto stream: Stream processing failed: " << e.what();
     // Restore stream positions on error
     input.clear();
     input.seekg(input_pos);
@@ -140,9 +141,26 @@ void CryptoStream::saveStreamPos(std::istream& input, std::ostream& output,
 }
 
 void CryptoStream::processStreamData(std::istream& input, std::ostream& output, bool encrypting) {
-  std::array<uint8_t, BUFFER_SIZE> inbuf;
+  DFS_SCOPED_TIMER("crypto.process_stream");
   std::array<uint8_t, BUFFER_SIZE + EVP_MAX_BLOCK_LENGTH> outbuf;
   size_t block_count = 0;
+  size_t total_bytes_processed = processBlocks(input, output, encrypting, block_count);
+
+  // Process final block with padding
+  int final_outlen = 0;
+  processFinalBlock(outbuf.data(), final_outlen, encrypting);
+  writeOutputBlock(output, outbuf.data(), final_outlen);
+  total_bytes_processed += final_outlen;
+
+  DFS_LOG(info) << "Crypto stream: Completed " << (encrypting ? "encryption" : "decryption")
+                          << ": Processed " << total_bytes_processed 
+                          << " bytes in " << block_count << " blocks";
+}
+
+size_t CryptoStream::processBlocks(std::istream& input, std::ostream& output, bool encrypting,
+                                   size_t& block_count) {
+  std::array<uint8_t, BUFFER_SIZE> inbuf;
+  std::array<uint8_t, BUFFER_SIZE + EVP_MAX_BLOCK_LENGTH> outbuf;
   size_t total_bytes_processed = 0;
 
   // Process the input stream in chunks
@@ -150,7 +168,7 @@ void CryptoStream::processStreamData(std::istream& input, std::ostream& output,
     input.read(reinterpret_cast<char*>(inbuf.data()), inbuf.size());
     auto bytes_read = input.gcount();
 
-    BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Processing block " << block_count 
+    DFS_LOG(debug) << "Crypto stream: Processing block " << block_count 
                              << ": Read " << bytes_read << " bytes"
                              << " (total processed so far: " << total_bytes_processed << ")";
 
@@ -170,29 +188,21 @@ void CryptoStream::processStreamData(std::istream& input, std::ostream& output,
     block_count++;
   }
 
-  // Process final block with padding
-  int final_outlen = 0;
-  processFinalBlock(outbuf.data(), final_outlen, encrypting);
-  writeOutputBlock(output, outbuf.data(), final_outlen);
-  total_bytes_processed += final_outlen;
-
-  BOOST_LOG_TRIVIAL(info) << "Crypto stream: Completed " << (encrypting ? "encryption" : "decryption")
-                          << ": Processed " << total_bytes_processed 
-                          << " bytes in " << block_count << " blocks";
+  return total_bytes_processed;
 }
 
 size_t CryptoStream::processDataBlock(const uint8_t* inbuf, size_t bytes_read, uint8_t* outbuf, 
                                   bool encrypting) {
   int outlen;
   if (encrypting) {
-      BOOST_LOG_TRIVIAL(trace) << "Crypto stream: Encrypting block of size " << bytes_read;
+      DFS_LOG(trace) << "Crypto stream: Encrypting block of size " << bytes_read;
      // Process encryption block
       if (!EVP_EncryptUpdate(context_->get(), outbuf, &outlen,
                             inbuf, static_cast<int>(bytes_read))) {
         throw EncryptionError("Crypto stream: Failed to encrypt data block");
       }
   } else {
-      BOOST_LOG_TRIVIAL(trace) << "Crypto stream: Decrypting block of size " << bytes_read;
+      DFS_LOG(trace) << "Crypto stream: Decrypting block of size " << bytes_read;
       // Process decryption block
       if (!EVP_DecryptUpdate(context_->get(), outbuf, &outlen,
                            inbuf, static_cast<int>(bytes_read))) {
@@ -213,7 +223,7 @@ void CryptoStream::writeOutputBlock(std::ostream& output, const uint8_t* data, s
 }
 
 void CryptoStream::processFinalBlock(uint8_t* outbuf, int& outlen, bool encrypting) {
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Finalizing " << (encrypting ? "encryption" : "decryption");
+  DFS_LOG(debug) << "Crypto stream: Finalizing " << (encrypting ? "encryption" : "decryption");
 
   // Finalize encryption and write to output buffer
   if (encrypting) {
@@ -242,12 +252,58 @@ std::ostream& CryptoStream::decrypt(std::istream& input, std::ostream& output) {
   return output;
 }
 
+//==============================================
+// INCREMENTAL ENCRYPTION/DECRYPTION OPERATIONS
+//==============================================
+
+void CryptoStream::begin_stream() {
+  initializeCipher(mode_ == Mode::Encrypt);
+  is_streaming_ = true;
+}
+
+void CryptoStream::update_stream(std::istream& input, std::ostream& output) {
+  if (!is_streaming_) {
+    throw InitializationError("Crypto stream: Cipher stream not started");
+  }
+  size_t block_count = 0;
+  processBlocks(input, output, mode_ == Mode::Encrypt, block_count);
+}
+
+void CryptoStream::finish_stream(std::ostream& output) {
+  if (!is_streaming_) {
+    throw InitializationError("Crypto stream: Cipher stream not started");
+  }
+  std::array<uint8_t, EVP_MAX_BLOCK_LENGTH> outbuf;
+  int final_outlen = 0;
+  processFinalBlock(outbuf.data(), final_outlen, mode_ == Mode::Encrypt);
+  writeOutputBlock(output, outbuf.data(), final_outlen);
+  is_streaming_ = false;
+}
+
+size_t CryptoStream::update_stream(const uint8_t* input, size_t size, uint8_t* output) {
+  DFS_SCOPED_TIMER("crypto.update_stream");
+  if (!is_streaming_) {
+    throw InitializationError("Crypto stream: Cipher stream not started");
+  }
+  return processDataBlock(input, size, output, mode_ == Mode::Encrypt);
+}
+
+size_t CryptoStream::finish_stream(uint8_t* output) {
+  if (!is_streaming_) {
+    throw InitializationError("Crypto stream: Cipher stream not started");
+  }
+  int final_outlen = 0;
+  processFinalBlock(output, final_outlen, mode_ == Mode::Encrypt);
+  is_streaming_ = false;
+  return final_outlen;
+}
+
 //==============================================
 // PUBLIC IV GENERATION METHOD
 //==============================================
 
 std::array<uint8_t, CryptoStream::IV_SIZE> CryptoStream::generate_IV() const {
-  BOOST_LOG_TRIVIAL(debug) << "Crypto stream: Generating initialization vector";
+  DFS_LOG(debug) << "Crypto stream: Generating initialization vector";
 
   // generate IV
   std::array<uint8_t, IV_SIZE> iv;
@@ -255,7 +311,7 @@ std::array<uint8_t, CryptoStream::IV_SIZE> CryptoStream::generate_IV() const {
     throw std::runtime_error("Crypto stream: Failed to generate  random IV");
   }
 
-  BOOST_LOG_TRIVIAL(debug) << "Successfully generated initialization vector";
+  DFS_LOG(debug) << "Successfully generated initialization vector";
   return iv;
 }
 
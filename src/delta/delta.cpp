@@ -0,0 +1,410 @@
+#include "delta/delta.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <boost/endian/conversion.hpp>
+#include <openssl/evp.h>
+
+namespace dfs {
+namespace delta {
+
+namespace {
+
+// Input is read this much at a time while generating a delta
+constexpr std::size_t READ_SIZE = 64 * 1024;
+// Literal runs are flushed at this length, which bounds the window buffer
+constexpr std::size_t MAX_LITERAL = 256 * 1024;
+
+struct DigestContext {
+  DigestContext() : ctx(EVP_MD_CTX_new()) {
+    if (!ctx || !EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr)) {
+      EVP_MD_CTX_free(ctx);
+      throw std::runtime_error("delta: Failed to initialize SHA-256");
+    }
+  }
+  ~DigestContext() { EVP_MD_CTX_free(ctx); }
+
+  std::array<uint8_t, 32> digest(const void* data, std::size_t length) {
+    std::array<uint8_t, 32> result{};
+    unsigned int result_length = 0;
+    if (!EVP_DigestUpdate(ctx, data, length) || !EVP_DigestFinal_ex(ctx, result.data(), &result_length)) {
+      throw std::runtime_error("delta: Failed to compute SHA-256");
+    }
+    return result;
+  }
+
+  EVP_MD_CTX* ctx;
+};
+
+void write_u32(std::ostream& output, uint32_t value) {
+  unsigned char bytes[4];
+  boost::endian::store_big_u32(bytes, value);
+  output.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+void write_u64(std::ostream& output, uint64_t value) {
+  unsigned char bytes[8];
+  boost::endian::store_big_u64(bytes, value);
+  output.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+uint32_t read_u32(std::istream& input) {
+  unsigned char bytes[4];
+  if (!input.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+    throw std::invalid_argument("delta: Truncated delta");
+  }
+  return boost::endian::load_big_u32(bytes);
+}
+
+uint64_t read_u64(std::istream& input) {
+  unsigned char bytes[8];
+  if (!input.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+    throw std::invalid_argument("delta: Truncated delta");
+  }
+  return boost::endian::load_big_u64(bytes);
+}
+
+// Collects instructions, merging adjacent copies into one
+class DeltaWriter {
+public:
+  DeltaWriter(std::ostream& output, DeltaStats& stats) : output_(output), stats_(stats) {}
+
+  void copy(uint32_t block, uint64_t length) {
+    if (copy_count_ > 0 && copy_first_ + copy_count_ == block) {
+      ++copy_count_;
+    } else {
+      flush_copy();
+      copy_first_ = block;
+      copy_count_ = 1;
+    }
+    stats_.copied_bytes += length;
+  }
+
+  void literal(const uint8_t* data, std::size_t length) {
+    if (length == 0) {
+      return;
+    }
+    flush_copy();
+    output_.put('L');
+    write_u32(output_, static_cast<uint32_t>(length));
+    output_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+    stats_.literal_bytes += length;
+  }
+
+  void finish() {
+    flush_copy();
+    output_.put('E');
+    write_u64(output_, stats_.copied_bytes + stats_.literal_bytes);
+  }
+
+private:
+  void flush_copy() {
+    if (copy_count_ == 0) {
+      return;
+    }
+    output_.put('C');
+    write_u32(output_, copy_first_);
+    write_u32(output_, copy_count_);
+    copy_count_ = 0;
+  }
+
+  std::ostream& output_;
+  DeltaStats& stats_;
+  uint32_t copy_first_{0};
+  uint32_t copy_count_{0};
+};
+
+} // namespace
+
+//==============================================
+// ROLLING CHECKSUM
+//==============================================
+
+void RollingChecksum::reset(const uint8_t* data, std::size_t length) {
+  a_ = 0;
+  b_ = 0;
+  length_ = length;
+  for (std::size_t i = 0; i < length; ++i) {
+    a_ += data[i];
+    b_ += static_cast<uint32_t>(length - i) * data[i];
+  }
+}
+
+//==============================================
+// SIGNATURES
+//==============================================
+
+void Signatures::write(std::string& output) const {
+  std::ostringstream stream;
+  write_u32(stream, block_size);
+  write_u64(stream, file_size);
+  write_u32(stream, static_cast<uint32_t>(blocks.size()));
+  for (const auto& block : blocks) {
+    write_u32(stream, block.weak);
+    stream.write(reinterpret_cast<const char*>(block.strong.data()), STRONG_HASH_SIZE);
+  }
+  output += stream.str();
+}
+
+Signatures Signatures::parse(std::string_view input) {
+  constexpr std::size_t HEADER_SIZE = 16;
+  constexpr std::size_t ENTRY_SIZE = 4 + STRONG_HASH_SIZE;
+  if (input.size() < HEADER_SIZE) {
+    throw std::invalid_argument("delta: Truncated signatures");
+  }
+  const auto* bytes = reinterpret_cast<const uint8_t*>(input.data());
+  Signatures signatures;
+  signatures.block_size = boost::endian::load_big_u32(bytes);
+  signatures.file_size = boost::endian::load_big_u64(bytes + 4);
+  uint32_t count = boost::endian::load_big_u32(bytes + 12);
+  if (signatures.block_size == 0 || input.size() != HEADER_SIZE + count * ENTRY_SIZE ||
+      count != (signatures.file_size + signatures.block_size - 1) / signatures.block_size) {
+    throw std::invalid_argument("delta: Malformed signatures");
+  }
+
+  signatures.blocks.resize(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint8_t* entry = bytes + HEADER_SIZE + i * ENTRY_SIZE;
+    signatures.blocks[i].weak = boost::endian::load_big_u32(entry);
+    std::memcpy(signatures.blocks[i].strong.data(), entry + 4, STRONG_HASH_SIZE);
+  }
+  return signatures;
+}
+
+std::size_t choose_block_size(uint64_t file_size) {
+  std::size_t root = static_cast<std::size_t>(std::sqrt(static_cast<double>(file_size)));
+  std::size_t block_size = MIN_BLOCK_SIZE;
+  while (block_size < root && block_size < MAX_BLOCK_SIZE) {
+    block_size *= 2;
+  }
+  return block_size;
+}
+
+std::array<uint8_t, STRONG_HASH_SIZE> strong_hash(const uint8_t* data, std::size_t length) {
+  DigestContext context;
+  auto digest = context.digest(data, length);
+  std::array<uint8_t, STRONG_HASH_SIZE> strong;
+  std::copy_n(digest.begin(), STRONG_HASH_SIZE, strong.begin());
+  return strong;
+}
+
+Signatures compute_signatures(std::istream& input, uint64_t file_size) {
+  Signatures signatures;
+  signatures.block_size = static_cast<uint32_t>(choose_block_size(file_size));
+  signatures.file_size = file_size;
+
+  std::vector<uint8_t> block(signatures.block_size);
+  uint64_t total = 0;
+  while (input.read(reinterpret_cast<char*>(block.data()), signatures.block_size) || input.gcount() > 0) {
+    std::size_t length = static_cast<std::size_t>(input.gcount());
+    RollingChecksum weak;
+    weak.reset(block.data(), length);
+    signatures.blocks.push_back(BlockSignature{weak.digest(), strong_hash(block.data(), length)});
+    total += length;
+  }
+  if (total != file_size) {
+    throw std::invalid_argument("delta: File size changed while computing signatures");
+  }
+  return signatures;
+}
+
+//==============================================
+// DELTAS
+//==============================================
+
+DeltaStats generate(const Signatures& basis, std::istream& input, std::ostream& delta) {
+  DeltaStats stats;
+  DeltaWriter writer(delta, stats);
+  write_u32(delta, basis.block_size);
+
+  const std::size_t block_size = basis.block_size;
+  const std::size_t block_count = basis.blocks.size();
+  const std::size_t last_length = block_count == 0 ? 0 : basis.file_size - (block_count - 1) * block_size;
+
+  // Nothing to match against, the whole input is literal
+  if (block_count == 0) {
+    std::vector<uint8_t> chunk(READ_SIZE);
+    while (input.read(reinterpret_cast<char*>(chunk.data()), READ_SIZE) || input.gcount() > 0) {
+      writer.literal(chunk.data(), static_cast<std::size_t>(input.gcount()));
+    }
+    writer.finish();
+    return stats;
+  }
+
+  // Full size blocks by weak checksum. A 16 bit tag table rejects most
+  // windows before the hash map is consulted
+  std::unordered_map<uint32_t, std::vector<uint32_t>> by_weak;
+  std::vector<bool> tags(1 << 16, false);
+  for (std::size_t i = 0; i < block_count; ++i) {
+    if (i + 1 == block_count && last_length != block_size) {
+      break;
+    }
+    uint32_t weak = basis.blocks[i].weak;
+    by_weak[weak].push_back(static_cast<uint32_t>(i));
+    tags[(weak ^ (weak >> 16)) & 0xffff] = true;
+  }
+
+  auto find_block = [&](uint32_t weak, const uint8_t* window) -> int64_t {
+    if (!tags[(weak ^ (weak >> 16)) & 0xffff]) {
+      return -1;
+    }
+    auto candidates = by_weak.find(weak);
+    if (candidates == by_weak.end()) {
+      return -1;
+    }
+    auto strong = strong_hash(window, block_size);
+    for (uint32_t block : candidates->second) {
+      if (basis.blocks[block].strong == strong) {
+        return block;
+      }
+    }
+    return -1;
+  };
+
+  // buffer holds the pending literal, then the window, then read ahead
+  std::vector<uint8_t> buffer;
+  std::size_t literal_start = 0;
+  std::size_t start = 0;
+  bool at_end = false;
+  auto fill = [&](std::size_t needed) {
+    while (!at_end && buffer.size() - start < needed) {
+      std::size_t offset = buffer.size();
+      buffer.resize(offset + READ_SIZE);
+      input.read(reinterpret_cast<char*>(buffer.data() + offset), READ_SIZE);
+      buffer.resize(offset + static_cast<std::size_t>(input.gcount()));
+      at_end = input.gcount() == 0;
+    }
+  };
+
+  RollingChecksum checksum;
+  bool rolling = false;
+  while (true) {
+    fill(block_size + 1);
+    std::size_t available = buffer.size() - start;
+    if (available == 0) {
+      break;
+    }
+
+    if (available < block_size) {
+      // Only the old version's short last block can match a short tail
+      if (available == last_length && last_length < block_size && last_length > 0) {
+        RollingChecksum tail;
+        tail.reset(buffer.data() + start, available);
+        const auto& last = basis.blocks.back();
+        if (tail.digest() == last.weak && strong_hash(buffer.data() + start, available) == last.strong) {
+          writer.literal(buffer.data() + literal_start, start - literal_start);
+          writer.copy(static_cast<uint32_t>(block_count - 1), available);
+          literal_start = start = buffer.size();
+          break;
+        }
+      }
+      start = buffer.size();
+      break;
+    }
+
+    if (!rolling) {
+      checksum.reset(buffer.data() + start, block_size);
+      rolling = true;
+    }
+    int64_t block = find_block(checksum.digest(), buffer.data() + start);
+    if (block >= 0) {
+      writer.literal(buffer.data() + literal_start, start - literal_start);
+      writer.copy(static_cast<uint32_t>(block), block_size);
+      start += block_size;
+      literal_start = start;
+      rolling = false;
+    } else {
+      if (available > block_size) {
+        checksum.roll(buffer[start], buffer[start + block_size]);
+      } else {
+        rolling = false;
+      }
+      ++start;
+      if (start - literal_start >= MAX_LITERAL) {
+        writer.literal(buffer.data() + literal_start, start - literal_start);
+        literal_start = start;
+      }
+    }
+
+    // Drop what has been written out, so the buffer stays bounded
+    if (literal_start >= MAX_LITERAL) {
+      buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(literal_start));
+      start -= literal_start;
+      literal_start = 0;
+    }
+  }
+
+  writer.literal(buffer.data() + literal_start, start - literal_start);
+  writer.finish();
+  return stats;
+}
+
+void apply(std::istream& basis, std::istream& delta, std::ostream& output) {
+  const uint32_t block_size = read_u32(delta);
+  if (block_size == 0) {
+    throw std::invalid_argument("delta: Invalid block size");
+  }
+
+  std::vector<char> buffer;
+  uint64_t written = 0;
+  while (true) {
+    int op = delta.get();
+    if (op == 'C') {
+      uint64_t first = read_u32(delta);
+      uint64_t length = static_cast<uint64_t>(read_u32(delta)) * block_size;
+      basis.clear();
+      basis.seekg(static_cast<std::streamoff>(first * block_size));
+      // Copies are done a block at a time, only the last block may be short
+      while (length > 0) {
+        std::size_t chunk = static_cast<std::size_t>(std::min<uint64_t>(length, block_size));
+        buffer.resize(chunk);
+        basis.read(buffer.data(), static_cast<std::streamsize>(chunk));
+        std::size_t got = static_cast<std::size_t>(basis.gcount());
+        if (got == 0) {
+          throw std::invalid_argument("delta: Copy past the end of the old version");
+        }
+        output.write(buffer.data(), static_cast<std::streamsize>(got));
+        written += got;
+        length = got < chunk ? 0 : length - chunk;
+      }
+    } else if (op == 'L') {
+      uint32_t length = read_u32(delta);
+      buffer.resize(length);
+      if (!delta.read(buffer.data(), length)) {
+        throw std::invalid_argument("delta: Truncated literal");
+      }
+      output.write(buffer.data(), length);
+      written += length;
+    } else if (op == 'E') {
+      if (read_u64(delta) != written) {
+        throw std::invalid_argument("delta: Rebuilt size does not match");
+      }
+      return;
+    } else {
+      throw std::invalid_argument("delta: Unknown instruction");
+    }
+  }
+}
+
+//==============================================
+// DIGESTS
+//==============================================
+
+std::string sha256_hex(std::string_view data) {
+  DigestContext context;
+  std::ostringstream hex;
+  for (uint8_t byte : context.digest(data.data(), data.size())) {
+    hex << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+  }
+  return hex.str();
+}
+
+} // namespace delta
+} // namespace dfs
@@ -0,0 +1,206 @@
+#include "erasure/gf256.hpp"
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef DFS_ERASURE_SIMD
+#define DFS_ERASURE_SIMD 1
+#endif
+
+#if DFS_ERASURE_SIMD && (defined(__x86_64__) || defined(__i386__))
+#define DFS_ERASURE_X86 1
+#include <immintrin.h>
+#else
+#define DFS_ERASURE_X86 0
+#endif
+
+namespace dfs {
+namespace erasure {
+namespace gf256 {
+
+namespace {
+
+constexpr unsigned POLYNOMIAL = 0x11d;
+
+struct Tables {
+  // exp is doubled so exp[log a + log b] needs no modulo
+  std::array<uint8_t, 512> exp{};
+  std::array<uint8_t, 256> log{};
+};
+
+constexpr Tables make_tables() {
+  Tables tables;
+  unsigned value = 1;
+  for (unsigned i = 0; i < 255; ++i) {
+    tables.exp[i] = static_cast<uint8_t>(value);
+    tables.exp[i + 255] = static_cast<uint8_t>(value);
+    tables.log[value] = static_cast<uint8_t>(i);
+    value <<= 1;
+    if (value & 0x100) {
+      value ^= POLYNOMIAL;
+    }
+  }
+  return tables;
+}
+
+constexpr Tables TABLES = make_tables();
+
+// Products of c with every low nibble, then with every high nibble
+struct NibbleTables {
+  alignas(16) uint8_t low[16];
+  alignas(16) uint8_t high[16];
+};
+
+NibbleTables make_nibble_tables(uint8_t c) {
+  NibbleTables tables;
+  for (unsigned i = 0; i < 16; ++i) {
+    tables.low[i] = mul(c, static_cast<uint8_t>(i));
+    tables.high[i] = mul(c, static_cast<uint8_t>(i << 4));
+  }
+  return tables;
+}
+
+void mul_add_scalar(const NibbleTables& tables, const uint8_t* src, uint8_t* dst, std::size_t length) {
+  for (std::size_t i = 0; i < length; ++i) {
+    dst[i] ^= tables.low[src[i] & 0x0f] ^ tables.high[src[i] >> 4];
+  }
+}
+
+#if DFS_ERASURE_X86
+__attribute__((target("ssse3")))
+void mul_add_ssse3(const NibbleTables& tables, const uint8_t* src, uint8_t* dst, std::size_t length) {
+  const __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.low));
+  const __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.high));
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  std::size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i product = _mm_xor_si128(
+      _mm_shuffle_epi8(low, _mm_and_si128(input, mask)),
+      _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(input, 4), mask)));
+    __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+    _mm_storeu_si128(out, _mm_xor_si128(_mm_loadu_si128(out), product));
+  }
+  mul_add_scalar(tables, src + i, dst + i, length - i);
+}
+
+__attribute__((target("avx2")))
+void mul_add_avx2(const NibbleTables& tables, const uint8_t* src, uint8_t* dst, std::size_t length) {
+  // vpshufb looks up within each 128 bit lane, so both lanes get the tables
+  const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(tables.low)));
+  const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(tables.high)));
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  std::size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i product = _mm256_xor_si256(
+      _mm256_shuffle_epi8(low, _mm256_and_si256(input, mask)),
+      _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(input, 4), mask)));
+    __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+    _mm256_storeu_si256(out, _mm256_xor_si256(_mm256_loadu_si256(out), product));
+  }
+  mul_add_scalar(tables, src + i, dst + i, length - i);
+}
+#endif
+
+} // namespace
+
+//==============================================
+// ELEMENT OPERATIONS
+//==============================================
+
+uint8_t mul(uint8_t a, uint8_t b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  return TABLES.exp[TABLES.log[a] + TABLES.log[b]];
+}
+
+uint8_t div(uint8_t a, uint8_t b) {
+  if (b == 0) {
+    throw std::domain_error("gf256: Division by zero");
+  }
+  if (a == 0) {
+    return 0;
+  }
+  return TABLES.exp[TABLES.log[a] + 255 - TABLES.log[b]];
+}
+
+uint8_t inv(uint8_t a) {
+  return div(1, a);
+}
+
+//==============================================
+// REGION KERNELS
+//==============================================
+
+bool kernel_supported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Scalar:
+      return true;
+#if DFS_ERASURE_X86
+    case Kernel::Ssse3:
+      return __builtin_cpu_supports("ssse3");
+    case Kernel::Avx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+Kernel best_kernel() {
+  static const Kernel best = kernel_supported(Kernel::Avx2) ? Kernel::Avx2
+                           : kernel_supported(Kernel::Ssse3) ? Kernel::Ssse3
+                           : Kernel::Scalar;
+  return best;
+}
+
+const char* kernel_name(Kernel kernel) {
+  switch (kernel) {
+    case Kernel::Ssse3:
+      return "ssse3";
+    case Kernel::Avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+void mul_add_region(uint8_t c, const uint8_t* src, uint8_t* dst, std::size_t length) {
+  mul_add_region(c, src, dst, length, best_kernel());
+}
+
+void mul_add_region(uint8_t c, const uint8_t* src, uint8_t* dst, std::size_t length, Kernel kernel) {
+  if (c == 0 || length == 0) {
+    return;
+  }
+  if (c == 1) {
+    for (std::size_t i = 0; i < length; ++i) {
+      dst[i] ^= src[i];
+    }
+    return;
+  }
+  if (!kernel_supported(kernel)) {
+    throw std::invalid_argument(std::string("gf256: Kernel not supported: ") + kernel_name(kernel));
+  }
+
+  NibbleTables tables = make_nibble_tables(c);
+  switch (kernel) {
+#if DFS_ERASURE_X86
+    case Kernel::Ssse3:
+      mul_add_ssse3(tables, src, dst, length);
+      return;
+    case Kernel::Avx2:
+      mul_add_avx2(tables, src, dst, length);
+      return;
+#endif
+    default:
+      mul_add_scalar(tables, src, dst, length);
+      return;
+  }
+}
+
+} // namespace gf256
+} // namespace erasure
+} // namespace dfs
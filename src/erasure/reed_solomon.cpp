@@ -0,0 +1,212 @@
+#include "erasure/reed_solomon.hpp"
+#include "erasure/gf256.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <boost/endian/conversion.hpp>
+
+namespace dfs {
+namespace erasure {
+
+namespace {
+
+constexpr char FRAGMENT_MAGIC[4] = {'D', 'F', 'R', 'S'};
+
+} // namespace
+
+//==============================================
+// CONSTRUCTOR
+//==============================================
+
+ReedSolomon::ReedSolomon(std::size_t data_fragments, std::size_t parity_fragments)
+  : data_fragments_(data_fragments)
+  , parity_fragments_(parity_fragments) {
+  if (data_fragments == 0 || parity_fragments == 0 || data_fragments + parity_fragments > MAX_FRAGMENTS) {
+    throw std::invalid_argument("ReedSolomon: Need 1 to " + std::to_string(MAX_FRAGMENTS - 1) +
+                                " data and parity fragments, at most " + std::to_string(MAX_FRAGMENTS) +
+                                " in total");
+  }
+
+  // Cauchy matrix 1 / (x_i + y_j) with x_i = k + i and y_j = j. All points are
+  // distinct, so every square submatrix of [I; C] is invertible
+  parity_matrix_.resize(parity_fragments_ * data_fragments_);
+  for (std::size_t i = 0; i < parity_fragments_; ++i) {
+    for (std::size_t j = 0; j < data_fragments_; ++j) {
+      parity_matrix_[i * data_fragments_ + j] =
+        gf256::inv(static_cast<uint8_t>((data_fragments_ + i) ^ j));
+    }
+  }
+}
+
+//==============================================
+// CODING
+//==============================================
+
+std::size_t ReedSolomon::fragment_size(std::uint64_t object_size) const {
+  return static_cast<std::size_t>((object_size + data_fragments_ - 1) / data_fragments_);
+}
+
+void ReedSolomon::encode(const std::vector<const uint8_t*>& data, const std::vector<uint8_t*>& parity,
+                         std::size_t length) const {
+  if (data.size() != data_fragments_ || parity.size() != parity_fragments_) {
+    throw std::invalid_argument("ReedSolomon: Wrong number of fragments to encode");
+  }
+  for (std::size_t i = 0; i < parity_fragments_; ++i) {
+    encode_parity(i, data, parity[i], length);
+  }
+}
+
+void ReedSolomon::encode_parity(std::size_t index, const std::vector<const uint8_t*>& data, uint8_t* parity,
+                                std::size_t length) const {
+  if (data.size() != data_fragments_ || index >= parity_fragments_) {
+    throw std::invalid_argument("ReedSolomon: Wrong fragments to encode");
+  }
+  std::memset(parity, 0, length);
+  for (std::size_t j = 0; j < data_fragments_; ++j) {
+    gf256::mul_add_region(parity_matrix_[index * data_fragments_ + j], data[j], parity, length);
+  }
+}
+
+bool ReedSolomon::decode(const std::vector<const uint8_t*>& fragments, const std::vector<uint8_t*>& data,
+                         std::size_t length) const {
+  if (fragments.size() != total_fragments() || data.size() != data_fragments_) {
+    throw std::invalid_argument("ReedSolomon: Wrong number of fragments to decode");
+  }
+
+  // Present data fragments first, so that with no losses nothing is solved
+  std::vector<std::size_t> rows;
+  for (std::size_t index = 0; index < total_fragments() && rows.size() < data_fragments_; ++index) {
+    if (fragments[index]) {
+      rows.push_back(index);
+    }
+  }
+  if (rows.size() < data_fragments_) {
+    return false;
+  }
+
+  bool missing_data = false;
+  for (std::size_t j = 0; j < data_fragments_; ++j) {
+    if (fragments[j]) {
+      std::memcpy(data[j], fragments[j], length);
+    } else {
+      missing_data = true;
+    }
+  }
+  if (!missing_data) {
+    return true;
+  }
+
+  // The chosen rows of [I; C] times the data give the chosen fragments, so
+  // the inverse of that k x k matrix maps the fragments back to the data
+  std::vector<uint8_t> matrix;
+  matrix.reserve(data_fragments_ * data_fragments_);
+  for (std::size_t index : rows) {
+    auto row = encoding_row(index);
+    matrix.insert(matrix.end(), row.begin(), row.end());
+  }
+  if (!invert(matrix)) {
+    return false;
+  }
+  for (std::size_t j = 0; j < data_fragments_; ++j) {
+    if (fragments[j]) {
+      continue;
+    }
+    std::memset(data[j], 0, length);
+    for (std::size_t r = 0; r < data_fragments_; ++r) {
+      gf256::mul_add_region(matrix[j * data_fragments_ + r], fragments[rows[r]], data[j], length);
+    }
+  }
+  return true;
+}
+
+//==============================================
+// MATRIX SUPPORT
+//==============================================
+
+std::vector<uint8_t> ReedSolomon::encoding_row(std::size_t index) const {
+  if (index < data_fragments_) {
+    std::vector<uint8_t> row(data_fragments_, 0);
+    row[index] = 1;
+    return row;
+  }
+  auto begin = parity_matrix_.begin() + static_cast<std::ptrdiff_t>((index - data_fragments_) * data_fragments_);
+  return std::vector<uint8_t>(begin, begin + static_cast<std::ptrdiff_t>(data_fragments_));
+}
+
+bool ReedSolomon::invert(std::vector<uint8_t>& matrix) const {
+  const std::size_t n = data_fragments_;
+  std::vector<uint8_t> inverse(n * n, 0);
+  for (std::size_t i = 0; i < n; ++i) {
+    inverse[i * n + i] = 1;
+  }
+
+  // Gauss-Jordan elimination; subtraction is XOR in GF(2^8)
+  for (std::size_t col = 0; col < n; ++col) {
+    std::size_t pivot = col;
+    while (pivot < n && matrix[pivot * n + col] == 0) {
+      ++pivot;
+    }
+    if (pivot == n) {
+      return false;
+    }
+    if (pivot != col) {
+      std::swap_ranges(matrix.begin() + pivot * n, matrix.begin() + (pivot + 1) * n, matrix.begin() + col * n);
+      std::swap_ranges(inverse.begin() + pivot * n, inverse.begin() + (pivot + 1) * n, inverse.begin() + col * n);
+    }
+
+    uint8_t scale = gf256::inv(matrix[col * n + col]);
+    for (std::size_t k = 0; k < n; ++k) {
+      matrix[col * n + k] = gf256::mul(matrix[col * n + k], scale);
+      inverse[col * n + k] = gf256::mul(inverse[col * n + k], scale);
+    }
+    for (std::size_t row = 0; row < n; ++row) {
+      uint8_t factor = matrix[row * n + col];
+      if (row == col || factor == 0) {
+        continue;
+      }
+      for (std::size_t k = 0; k < n; ++k) {
+        matrix[row * n + k] ^= gf256::mul(factor, matrix[col * n + k]);
+        inverse[row * n + k] ^= gf256::mul(factor, inverse[col * n + k]);
+      }
+    }
+  }
+  matrix.swap(inverse);
+  return true;
+}
+
+//==============================================
+// FRAGMENT HEADER
+//==============================================
+
+void FragmentHeader::write(std::ostream& output) const {
+  uint8_t bytes[SIZE];
+  std::memcpy(bytes, FRAGMENT_MAGIC, sizeof(FRAGMENT_MAGIC));
+  bytes[4] = VERSION;
+  bytes[5] = data_fragments;
+  bytes[6] = parity_fragments;
+  bytes[7] = index;
+  boost::endian::store_big_u64(bytes + 8, object_size);
+  boost::endian::store_big_u64(bytes + 16, generation);
+  output.write(reinterpret_cast<const char*>(bytes), SIZE);
+}
+
+std::optional<FragmentHeader> FragmentHeader::parse(const uint8_t* data, std::size_t length) {
+  if (length < SIZE || std::memcmp(data, FRAGMENT_MAGIC, sizeof(FRAGMENT_MAGIC)) != 0 || data[4] != VERSION) {
+    return std::nullopt;
+  }
+  FragmentHeader header;
+  header.data_fragments = data[5];
+  header.parity_fragments = data[6];
+  header.index = data[7];
+  header.object_size = boost::endian::load_big_u64(data + 8);
+  header.generation = boost::endian::load_big_u64(data + 16);
+  if (header.data_fragments == 0 || header.index >= header.data_fragments + header.parity_fragments) {
+    return std::nullopt;
+  }
+  return header;
+}
+
+} // namespace erasure
+} // namespace dfs
@@ -1,6 +1,12 @@
 #include "file_server/file_server.hpp"
-#include <boost/log/trivial.hpp>
+#include "logger/logger.hpp"
+#include "delta/delta.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <filesystem>
+#include <iterator>
+#include <map>
 #include <optional>
 #include <thread>
 #include <chrono>
@@ -8,10 +14,363 @@
 #include <memory>
 #include <functional>
 #include "utils/pipeliner.hpp"
+#include "metrics/metrics.hpp"
+#include "tracing/tracer.hpp"
+#include <boost/endian/conversion.hpp>
 
 namespace dfs {
 namespace network {
 
+namespace {
+
+struct FileOpMetrics {
+  metrics::Histogram& latency;
+  metrics::Counter& failures;
+};
+
+FileOpMetrics make_file_op_metrics(const std::string& op) {
+  auto& registry = metrics::Registry::global();
+  return FileOpMetrics{
+    registry.histogram("dfs_file_op_duration_seconds", "End to end latency of file server operations",
+                       metrics::HistogramUnit::Seconds, {{"op", op}}),
+    registry.counter("dfs_file_op_failures_total", "File server operations that failed", {{"op", op}})
+  };
+}
+
+// User requests and the handlers serving remote peers
+struct FileServerMetrics {
+  FileOpMetrics store = make_file_op_metrics("store");
+  FileOpMetrics get = make_file_op_metrics("get");
+  FileOpMetrics handle_store = make_file_op_metrics("handle_store");
+  FileOpMetrics handle_get = make_file_op_metrics("handle_get");
+  metrics::Counter& local_hits = metrics::Registry::global().counter(
+    "dfs_file_get_source_total", "Where get requests were answered from", {{"source", "local"}});
+  metrics::Counter& network_hits = metrics::Registry::global().counter(
+    "dfs_file_get_source_total", "Where get requests were answered from", {{"source", "network"}});
+  metrics::Counter& misses = metrics::Registry::global().counter(
+    "dfs_file_get_source_total", "Where get requests were answered from", {{"source", "miss"}});
+  metrics::Counter& cache_hits = metrics::Registry::global().counter(
+    "dfs_file_get_source_total", "Where get requests were answered from", {{"source", "cache"}});
+  metrics::Counter& copies_cached = metrics::Registry::global().counter(
+    "dfs_hot_key_copies_total", "Cached copies of files held by other nodes", {{"event", "cached"}});
+  metrics::Counter& copies_dropped = metrics::Registry::global().counter(
+    "dfs_hot_key_copies_total", "Cached copies of files held by other nodes", {{"event", "dropped"}});
+  metrics::Counter& copies_invalidated = metrics::Registry::global().counter(
+    "dfs_hot_key_copies_total", "Cached copies of files held by other nodes", {{"event", "invalidated"}});
+  metrics::Counter& not_modified = metrics::Registry::global().counter(
+    "dfs_cache_revalidations_total", "Conditional gets of cached copies", {{"result", "not_modified"}});
+  metrics::Counter& modified = metrics::Registry::global().counter(
+    "dfs_cache_revalidations_total", "Conditional gets of cached copies", {{"result", "modified"}});
+  metrics::Counter& stale = metrics::Registry::global().counter(
+    "dfs_cache_revalidations_total", "Conditional gets of cached copies", {{"result", "stale"}});
+  metrics::Counter& degraded_reads = metrics::Registry::global().counter(
+    "dfs_erasure_degraded_reads_total", "Erasure coded reads that rebuilt lost data fragments from parity");
+  metrics::Counter& sync_rounds = metrics::Registry::global().counter(
+    "dfs_anti_entropy_rounds_total", "Anti-entropy exchanges started with a peer");
+  metrics::Counter& sync_nodes = metrics::Registry::global().counter(
+    "dfs_anti_entropy_tree_nodes_total", "Merkle node hashes sent to peers during anti-entropy");
+  metrics::Counter& sync_leaves = metrics::Registry::global().counter(
+    "dfs_anti_entropy_leaves_total", "Differing Merkle leaves whose keys were sent to a peer");
+  metrics::Counter& repaired_pull = metrics::Registry::global().counter(
+    "dfs_anti_entropy_repairs_total", "Keys copied between replicas by anti-entropy", {{"direction", "pull"}});
+  metrics::Counter& repaired_push = metrics::Registry::global().counter(
+    "dfs_anti_entropy_repairs_total", "Keys copied between replicas by anti-entropy", {{"direction", "push"}});
+  metrics::Counter& repaired_delete = metrics::Registry::global().counter(
+    "dfs_anti_entropy_repairs_total", "Keys copied between replicas by anti-entropy", {{"direction", "delete"}});
+  metrics::Counter& conflicts = metrics::Registry::global().counter(
+    "dfs_anti_entropy_conflicts_total", "Keys a peer changed at the same generation as this node, settled by digest");
+  metrics::Counter& have_hits = metrics::Registry::global().counter(
+    "dfs_have_queries_total", "Peers asked whether they hold a file before it is sent", {{"result", "have"}});
+  metrics::Counter& have_misses = metrics::Registry::global().counter(
+    "dfs_have_queries_total", "Peers asked whether they hold a file before it is sent", {{"result", "missing"}});
+  metrics::Counter& have_timeouts = metrics::Registry::global().counter(
+    "dfs_have_queries_total", "Peers asked whether they hold a file before it is sent", {{"result", "timeout"}});
+  metrics::Counter& have_bytes_skipped = metrics::Registry::global().counter(
+    "dfs_have_bytes_skipped_total", "File bytes not sent because the peer already held the content");
+  metrics::Counter& have_local_copies = metrics::Registry::global().counter(
+    "dfs_have_local_copies_total", "Queried files this node copied from a local key with the same content");
+  metrics::Counter& delta_sent = metrics::Registry::global().counter(
+    "dfs_delta_transfers_total", "Files sent or received as changes against an older version", {{"result", "sent"}});
+  metrics::Counter& delta_too_large = metrics::Registry::global().counter(
+    "dfs_delta_transfers_total", "Files sent or received as changes against an older version", {{"result", "too_large"}});
+  metrics::Counter& delta_applied = metrics::Registry::global().counter(
+    "dfs_delta_transfers_total", "Files sent or received as changes against an older version", {{"result", "applied"}});
+  metrics::Counter& delta_rejected = metrics::Registry::global().counter(
+    "dfs_delta_transfers_total", "Files sent or received as changes against an older version", {{"result", "rejected"}});
+  metrics::Counter& delta_bytes_saved = metrics::Registry::global().counter(
+    "dfs_delta_bytes_saved_total", "File bytes not sent because the peer rebuilt them from its older version");
+  metrics::Counter& replication_queued = metrics::Registry::global().counter(
+    "dfs_replication_queued_total", "Files queued in the replication journal for a peer");
+  metrics::Counter& replication_sent = metrics::Registry::global().counter(
+    "dfs_replication_sends_total", "Queued files sent to a peer by the background replicator", {{"result", "sent"}});
+  metrics::Counter& replication_failed = metrics::Registry::global().counter(
+    "dfs_replication_sends_total", "Queued files sent to a peer by the background replicator", {{"result", "failed"}});
+  metrics::Counter& replication_dropped = metrics::Registry::global().counter(
+    "dfs_replication_sends_total", "Queued files sent to a peer by the background replicator", {{"result", "dropped"}});
+  metrics::Counter& replication_unacknowledged = metrics::Registry::global().counter(
+    "dfs_replication_sends_total", "Queued files sent to a peer by the background replicator",
+    {{"result", "unacknowledged"}});
+  metrics::Counter& store_acks = metrics::Registry::global().counter(
+    "dfs_store_acks_sent_total", "Received files acknowledged to their sender once on disk");
+  metrics::Counter& quorum_met = metrics::Registry::global().counter(
+    "dfs_write_quorum_total", "Stores that waited for a write quorum of peer acknowledgements", {{"result", "met"}});
+  metrics::Counter& quorum_failed = metrics::Registry::global().counter(
+    "dfs_write_quorum_total", "Stores that waited for a write quorum of peer acknowledgements", {{"result", "failed"}});
+  metrics::Histogram& quorum_wait = metrics::Registry::global().histogram(
+    "dfs_write_quorum_wait_seconds", "Time stores waited for a write quorum of peer acknowledgements",
+    metrics::HistogramUnit::Seconds);
+  metrics::Gauge& replication_pending = metrics::Registry::global().gauge(
+    "dfs_replication_pending", "Sends waiting in the replication journals of this process");
+};
+
+FileServerMetrics& file_server_metrics() {
+  static FileServerMetrics instance;
+  return instance;
+}
+
+// Times one operation and counts it as failed unless succeed() is reached
+class OpRecorder {
+public:
+  explicit OpRecorder(FileOpMetrics& metrics)
+    : metrics_(metrics)
+    , start_(std::chrono::steady_clock::now()) {}
+  ~OpRecorder() {
+    metrics_.latency.observe_since(start_);
+    if (!succeeded_) {
+      metrics_.failures.inc();
+    }
+  }
+
+  bool succeed() {
+    succeeded_ = true;
+    return true;
+  }
+
+private:
+  FileOpMetrics& metrics_;
+  std::chrono::steady_clock::time_point start_;
+  bool succeeded_{false};
+};
+
+// Fragments live on one node by design, so anti-entropy must not copy them
+bool is_fragment_key(const std::string& key) {
+  std::size_t marker = key.rfind("#frag");
+  if (marker == std::string::npos || marker + 5 == key.size()) {
+    return false;
+  }
+  return std::all_of(key.begin() + static_cast<std::ptrdiff_t>(marker + 5), key.end(),
+                     [](unsigned char c) { return std::isdigit(c); });
+}
+
+// Cached copies of hot files and their list only concern this node too
+constexpr const char* CACHE_SUFFIX = "#cache";
+constexpr const char* CACHE_MANIFEST_KEY = "#cached-copies";
+// Kept in the store directory, next to the store's own logs
+constexpr const char* REPLICATION_LOG = "replication.log";
+// Read counts that decayed below this are forgotten
+constexpr double FORGOTTEN_READS = 0.01;
+
+bool is_cache_key(const std::string& key) {
+  return key.ends_with(CACHE_SUFFIX) || key == CACHE_MANIFEST_KEY;
+}
+
+// Scratch objects written out before they are streamed to a peer, such as
+// deltas, so they never sit in memory whole
+constexpr const char* SPOOL_MARKER = "#spool-";
+
+bool is_spool_key(const std::string& key) {
+  return key.find(SPOOL_MARKER) != std::string::npos;
+}
+
+std::string spool_key(const std::string& filename, const std::string& purpose) {
+  return filename + SPOOL_MARKER + purpose;
+}
+
+// Frames whose payload continues with the file content after the name field
+bool carries_file(MessageType message_type) {
+  return message_type == MessageType::STORE_FILE || message_type == MessageType::CACHED_FILE ||
+         message_type == MessageType::DELTA_FILE;
+}
+
+// Reads the fragment header at the front of input and rewinds it
+std::optional<erasure::FragmentHeader> peek_fragment_header(std::istream& input) {
+  uint8_t bytes[erasure::FragmentHeader::SIZE];
+  std::istream::pos_type start = input.tellg();
+  input.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+  std::size_t read = static_cast<std::size_t>(std::max<std::streamsize>(input.gcount(), 0));
+  input.clear();
+  input.seekg(start);
+  return erasure::FragmentHeader::parse(bytes, read);
+}
+
+// ---- Control message bodies ----
+// SYNC_TREE: repeated (node index u32, node hash u64)
+// SYNC_KEYS, SYNC_NEWER: repeated (leaf u32, key count u32, then per key:
+//             length u32, key, generation u64, 64 digit hex digest or 64
+//             zeros for a deleted key)
+// HAVE_QUERY: 64 digit hex digest, size u64, key
+// HAVE_REPLY: state u8, 64 digit hex digest, key length u32, key, then for
+//             HAVE_OLDER the block signatures of the version held
+// DELTA_FILE: 64 digit hex digest of the new version, key length u32, key in
+//             the name field, then the delta as the file content
+// GET_IF_NONE_MATCH, NOT_MODIFIED, NOT_HELD, STORE_ACK and the name field of CACHED_FILE:
+//             generation u64, 64 digit hex digest, key. A conditional get
+//             without a cached copy sends generation 0 and 64 zeros
+// DROP_FRAGMENTS: exact u8, fragment generation u64, filename. Drops the
+//             fragments older than the generation, or with exact set those of it
+// All integers big endian
+
+enum HaveState : uint8_t {
+  HAVE_MISSING = 0,
+  HAVE_CONTENT = 1,
+  HAVE_OLDER = 2
+};
+
+struct TreeNode {
+  std::size_t index;
+  uint64_t hash;
+};
+
+void append_u32(std::string& body, uint32_t value) {
+  char bytes[4];
+  boost::endian::store_big_u32(reinterpret_cast<unsigned char*>(bytes), value);
+  body.append(bytes, sizeof(bytes));
+}
+
+void append_u64(std::string& body, uint64_t value) {
+  char bytes[8];
+  boost::endian::store_big_u64(reinterpret_cast<unsigned char*>(bytes), value);
+  body.append(bytes, sizeof(bytes));
+}
+
+// Reads big endian integers off a body, throwing when it runs short
+class BodyReader {
+public:
+  explicit BodyReader(const std::string& body) : body_(body) {}
+
+  bool done() const { return offset_ == body_.size(); }
+
+  uint32_t u32() {
+    return boost::endian::load_big_u32(take(4));
+  }
+
+  uint64_t u64() {
+    return boost::endian::load_big_u64(take(8));
+  }
+
+  std::string bytes(std::size_t length) {
+    const unsigned char* start = take(length);
+    return std::string(reinterpret_cast<const char*>(start), length);
+  }
+
+  std::string rest() {
+    return bytes(body_.size() - offset_);
+  }
+
+private:
+  const unsigned char* take(std::size_t length) {
+    if (body_.size() - offset_ < length) {
+      throw std::runtime_error("File server: Truncated sync message");
+    }
+    const unsigned char* start = reinterpret_cast<const unsigned char*>(body_.data()) + offset_;
+    offset_ += length;
+    return start;
+  }
+
+  const std::string& body_;
+  std::size_t offset_{0};
+};
+
+std::string encode_version(const std::string& key, const store::Store::ObjectVersion& version) {
+  std::string body;
+  append_u64(body, version.generation);
+  body += version.digest.empty() ? std::string(64, '0') : version.digest;
+  body += key;
+  return body;
+}
+
+// Returns the key, the version read goes to version
+std::string decode_version(const std::string& body, store::Store::ObjectVersion& version) {
+  BodyReader reader(body);
+  version.generation = reader.u64();
+  version.digest = reader.bytes(64);
+  std::string key = reader.rest();
+  if (key.empty()) {
+    throw std::runtime_error("File server: Version without a key");
+  }
+  return key;
+}
+
+std::string encode_tree(const std::vector<TreeNode>& nodes) {
+  std::string body;
+  body.reserve(nodes.size() * 12);
+  for (const auto& node : nodes) {
+    append_u32(body, static_cast<uint32_t>(node.index));
+    append_u64(body, node.hash);
+  }
+  return body;
+}
+
+std::vector<TreeNode> decode_tree(const std::string& body) {
+  std::vector<TreeNode> nodes;
+  BodyReader reader(body);
+  while (!reader.done()) {
+    std::size_t index = reader.u32();
+    if (!store::MerkleTree::valid_node(index)) {
+      throw std::runtime_error("File server: Invalid Merkle node " + std::to_string(index));
+    }
+    nodes.push_back(TreeNode{index, reader.u64()});
+  }
+  return nodes;
+}
+
+void append_leaf(std::string& body, std::size_t leaf, const std::vector<store::Store::IndexEntry>& entries) {
+  append_u32(body, static_cast<uint32_t>(leaf));
+  append_u32(body, static_cast<uint32_t>(entries.size()));
+  for (const auto& entry : entries) {
+    append_u32(body, static_cast<uint32_t>(entry.key.size()));
+    body += entry.key;
+    append_u64(body, entry.generation);
+    body += entry.digest.empty() ? std::string(64, '0') : entry.digest;
+  }
+}
+
+// Leaf number to the sender's key to version map of that leaf, deleted keys
+// with an empty digest
+std::map<std::size_t, std::map<std::string, store::Store::ObjectVersion>> decode_leaves(const std::string& body) {
+  std::map<std::size_t, std::map<std::string, store::Store::ObjectVersion>> leaves;
+  BodyReader reader(body);
+  while (!reader.done()) {
+    std::size_t leaf = reader.u32();
+    if (leaf >= store::MerkleTree::LEAVES) {
+      throw std::runtime_error("File server: Invalid Merkle leaf " + std::to_string(leaf));
+    }
+    auto& keys = leaves[leaf];
+    for (uint32_t count = reader.u32(); count > 0; --count) {
+      std::string key = reader.bytes(reader.u32());
+      auto& version = keys[key];
+      version.generation = reader.u64();
+      version.digest = reader.bytes(64);
+      if (version.digest == std::string(64, '0')) {
+        version.digest.clear();
+      }
+    }
+  }
+  return leaves;
+}
+
+// Whether a replica's version of a key replaces the one held here, a missing
+// key having generation 0. The higher generation wins, and the higher digest
+// settles changes made at the same generation on both sides
+bool newer_version(const store::Store::ObjectVersion& remote, const store::Store::ObjectVersion& local) {
+  if (remote.generation != local.generation) {
+    return remote.generation > local.generation;
+  }
+  return remote.digest > local.digest;
+}
+
+} // namespace
+
 //==============================================
 // Constructor and destructor
 //==============================================
@@ -25,55 +384,102 @@ FileServer::FileServer(uint32_t ID, const std::vector<uint8_t>& key, PeerManager
 
   // Validate key size (32 bytes for AES-256)
   if (key_.empty() || key_.size() != 32) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Invalid key size: " << key_.size() << " bytes. Expected 32 bytes.";
+    DFS_LOG(error) << "File server: Invalid key size: " << key_.size() << " bytes. Expected 32 bytes.";
     throw std::invalid_argument("File server: Invalid cryptographic key size");
   }
 
-  BOOST_LOG_TRIVIAL(info) << "File server: Initializing FileServer with ID: " << ID_;
+  DFS_LOG(info) << "File server: Initializing FileServer with ID: " << ID_;
 
   try {
     // Create store directory based on server ID
     std::string store_path = "File server: fileserver_" + std::to_string(ID_);
 
-    // Initialize store with the server-specific directory
-    store_ = std::make_unique<dfs::store::Store>(store_path);
+    // Initialize store with the server-specific directory, keeping fragments
+    // and cached copies out of anti-entropy
+    store_ = std::make_unique<dfs::store::Store>(
+      store_path, [](const std::string& key) { return !is_fragment_key(key) && !is_cache_key(key) && !is_spool_key(key); });
+    load_cached_copies();
+    replication_ = std::make_unique<ReplicationJournal>(std::filesystem::path(store_path) / REPLICATION_LOG);
+    file_server_metrics().replication_pending.add(static_cast<int64_t>(replication_->pending()));
 
     // Initialize codec with the provided cryptographic key and channel reference
     codec_ = std::make_unique<Codec>(key_, channel);
 
     // Start the channel listener thread
     listener_thread_ = std::make_unique<std::thread>(&FileServer::channel_listener, this);
+    anti_entropy_thread_ = std::make_unique<std::thread>(&FileServer::anti_entropy_loop, this);
+    popularity_thread_ = std::make_unique<std::thread>(&FileServer::popularity_loop, this);
+    inventory_thread_ = std::make_unique<std::thread>(&FileServer::inventory_loop, this);
+    for (std::size_t i = 0; i < REPLICATION_WORKERS; ++i) {
+      replication_threads_.emplace_back(&FileServer::replication_loop, this);
+    }
 
-    BOOST_LOG_TRIVIAL(info) << "File server: FileServer initialization complete";
+    DFS_LOG(info) << "File server: FileServer initialization complete";
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Failed to initialize FileServer: " << e.what();
+    DFS_LOG(error) << "File server: Failed to initialize FileServer: " << e.what();
     throw;
   }
 }
 
 FileServer::~FileServer() {
   running_ = false;
+  {
+    std::lock_guard<std::mutex> lock(anti_entropy_mutex_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(popularity_mutex_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(replication_mutex_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(ack_mutex_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(inventory_mutex_);
+  }
+  anti_entropy_cv_.notify_all();
+  popularity_cv_.notify_all();
+  replication_cv_.notify_all();
+  ack_cv_.notify_all();
+  inventory_cv_.notify_all();
+  if (anti_entropy_thread_ && anti_entropy_thread_->joinable()) {
+    anti_entropy_thread_->join();
+  }
+  if (popularity_thread_ && popularity_thread_->joinable()) {
+    popularity_thread_->join();
+  }
+  if (inventory_thread_ && inventory_thread_->joinable()) {
+    inventory_thread_->join();
+  }
+  for (auto& thread : replication_threads_) {
+    thread.join();
+  }
+  if (replication_) {
+    // Left in the journal for the next start
+    file_server_metrics().replication_pending.sub(static_cast<int64_t>(replication_->pending()));
+  }
   if (listener_thread_ && listener_thread_->joinable()) {
     listener_thread_->join();
   }
 }
 
 bool FileServer::connect(const std::string& remote_address, uint16_t remote_port) {
-  BOOST_LOG_TRIVIAL(info) << "File server: Initiating connection to " << remote_address << ":" << remote_port;
+  DFS_LOG(info) << "File server: Initiating connection to " << remote_address << ":" << remote_port;
 
   // Try connecting to remote endpoint
   try {
     if (!tcp_server_.connect(remote_address, remote_port)) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to connect to " << remote_address << ":" << remote_port;
+      DFS_LOG(error) << "File server: Failed to connect to " << remote_address << ":" << remote_port;
       return false;
     }
 
-    BOOST_LOG_TRIVIAL(info) << "File server: Successfully connected to " << remote_address << ":" << remote_port;
+    DFS_LOG(info) << "File server: Successfully connected to " << remote_address << ":" << remote_port;
     return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Connection error: " << e.what();
+    DFS_LOG(error) << "File server: Connection error: " << e.what();
     return false;
   }
 }
@@ -83,327 +489,2151 @@ bool FileServer::connect(const std::string& remote_address, uint16_t remote_port
 //==============================================
 
 bool FileServer::prepare_and_send(const std::string& filename, MessageType message_type, 
-                                  std::optional<uint8_t> peer_id) {
+                                  std::optional<uint8_t> peer_id, const std::string& name) {
+  tracing::Span span("send file", filename);
   try {
-      BOOST_LOG_TRIVIAL(info) << "File server: Preparing file: " << filename 
+      DFS_LOG(info) << "File server: Preparing file: " << filename 
                               << " for " << (peer_id ? "peer " + std::to_string(*peer_id) : "broadcast")
                               << " with message type: " << static_cast<int>(message_type);
 
       // Create pipeline and components
-      auto frame = create_message_frame(filename, message_type);
-      auto producer = create_producer(filename, message_type);
-      auto pipeline = utils::Pipeliner::create(producer);
-      auto transform = create_transform(frame, pipeline.get());
+      auto frame = create_message_frame(filename, message_type, name);
+      auto producer = create_producer(filename, message_type, PIPELINE_CHUNK_SIZE, name);
+      auto pipeline = utils::Pipeliner::create(producer)->named("disk read");
+      create_transform(frame, *pipeline);
 
-      // Configure pipeline with 1MB buffer
-      pipeline->transform(transform);
-      pipeline->set_buffer_size(1024 * 1024);  // 1MB buffer for efficient streaming
-      pipeline->flush();  // Ensure all data is processed
+      // Chunks stream through bounded queues while they are being sent
+      pipeline->set_buffer_size(PIPELINE_CHUNK_SIZE);
+      pipeline->set_total_size(Codec::get_serialized_size(frame));
+      pipeline->enable_stats();
+      pipeline->start();
 
       // Send data and handle any failures
-      if (!send_pipeline(pipeline.get(), peer_id)) {
-        BOOST_LOG_TRIVIAL(error) << "File server: Failed to send file: " << filename;
+      bool sent = send_pipeline(pipeline.get(), peer_id) && !pipeline->failed();
+      // The reader stage is the socket send, so the report shows whether disk, crypto or network limits
+      pipeline->log_stats();
+      record_pipeline_stats(*pipeline);
+      if (!sent) {
+        DFS_LOG(error) << "File server: Failed to send file: " << filename;
         return false;
       }
 
-      BOOST_LOG_TRIVIAL(info) << "File server: Successfully sent file: " << filename;
+      DFS_LOG(info) << "File server: Successfully sent file: " << filename;
       return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Error in prepare_and_send: " << e.what();
+    DFS_LOG(error) << "File server: Error in prepare_and_send: " << e.what();
     return false;
   }
 }
 
-MessageFrame FileServer::create_message_frame(const std::string& filename, MessageType message_type) {
+MessageFrame FileServer::create_message_frame(const std::string& filename, MessageType message_type,
+                                              const std::string& name) {
   // Initialize basic frame 
   MessageFrame frame;
   frame.message_type = message_type;
   frame.source_id = ID_;
-  frame.filename_length = filename.length();
+  frame.filename_length = name.empty() ? filename.length() : name.length();
+
+  // Payload is the filename, followed by the file content for STORE_FILE and CACHED_FILE
+  frame.payload_size = frame.filename_length;
+  if (carries_file(message_type)) {
+    frame.payload_size += store_->get_file_size(filename);
+  }
 
   // Generate cryptographic IV for this message
   crypto::CryptoStream crypto_stream;
   auto iv = crypto_stream.generate_IV();
   frame.iv_.assign(iv.begin(), iv.end());
 
+  // The receiver continues the sender's trace
+  tracing::TraceContext context = tracing::Tracer::current();
+  frame.trace_id = context.trace_id;
+  frame.span_id = context.span_id;
+
   return frame;
 }
 
-std::function<bool(std::stringstream&)> FileServer::create_producer(
-  const std::string& filename, MessageType message_type) {
+utils::ProducerFn FileServer::create_producer(
+  const std::string& filename, MessageType message_type, std::size_t chunk_size, const std::string& name) {
 
-  if (message_type == MessageType::GET_FILE) {
-    // For GET_FILE, producer only writes filename (no file content needed)
-    return [filename, first_read = true](std::stringstream& output) mutable -> bool {
+  if (!carries_file(message_type)) {
+    // For GET_FILE and sync messages, producer only writes filename (no file content needed)
+    return [filename, first_read = true](utils::Chunk& output) mutable -> bool {
       if (!first_read) return false;  // Only write once
-      output.write(filename.c_str(), filename.length());
+      output.append(filename);
       first_read = false;
-      return output.good();
+      return true;
     };
   }
 
-  // For other types (e.g., STORE_FILE), producer writes both filename and file content
-  return [this, filename, first_read = true](std::stringstream& output) mutable -> bool {
-    if (!first_read) return false; 
-    output.write(filename.c_str(), filename.length());  // Write filename first
-    store_->get(filename, output);   // Then append file content
-    first_read = false;
-    return output.good();
+  // For STORE_FILE, producer writes the filename first and
+  // then one chunk of file content per call
+  std::shared_ptr<std::istream> file = store_->get_stream(filename);
+  // Stages run on their own threads, so the caller's trace is carried explicitly
+  tracing::TraceContext trace = tracing::Tracer::current();
+  std::string field = name.empty() ? filename : name;
+  return [field, file, chunk_size, trace, first_read = true](utils::Chunk& output) mutable -> bool {
+    if (first_read) {
+      output.append(field);
+      first_read = false;
+      return true;
+    }
+
+    // Read straight into the chunk that travels down the pipeline
+    tracing::Span span("disk read", trace);
+    output.resize(chunk_size);
+    file->read(output.data(), chunk_size);
+    output.resize(static_cast<std::size_t>(std::max<std::streamsize>(file->gcount(), 0)));
+    return !output.empty();
   };
 }
 
-std::function<bool(std::stringstream&, std::stringstream&)> FileServer::create_transform(
-  MessageFrame& frame,
-  utils::Pipeliner* pipeline) {
-  // Capture pipeline by value since it's a pointer
-  return [this, &frame, pipeline](std::stringstream& input, std::stringstream& output) -> bool {
-    frame.payload_stream = std::make_shared<std::stringstream>();
-    *frame.payload_stream << input.rdbuf();
-
-    // Calculate payload size by seeking to end, then reset read position
-    frame.payload_stream->seekp(0, std::ios::end);
-    frame.payload_size = frame.payload_stream->tellp();
-    frame.payload_stream->seekg(0);
+void FileServer::create_transform(const MessageFrame& frame, utils::Pipeliner& pipeline) {
+  // Payload cipher keeps its CBC state across chunks
+  auto payload_crypto = std::make_shared<crypto::CryptoStream>();
+  payload_crypto->initialize(key_, frame.iv_);
+  payload_crypto->setMode(crypto::CryptoStream::Mode::Encrypt);
+  auto header_written = std::make_shared<bool>(false);
+  tracing::TraceContext trace = tracing::Tracer::current();
+
+  auto transform = [this, frame, payload_crypto, header_written, trace](
+    utils::Chunk& input, utils::Chunk& output) -> bool {
+    tracing::Span span("encrypt", trace);
+    // Header goes in front of the first chunk
+    if (!*header_written) {
+      std::stringstream header;
+      codec_->serialize_header(frame, header);
+      output.append(header.view());
+      payload_crypto->begin_stream();
+      *header_written = true;
+    }
 
-    // Serialize frame and update pipeline size
-    std::size_t total_serialized_size = codec_->serialize(frame, output);
-    pipeline->set_total_size(total_serialized_size);
+    // Encrypt directly into the tail of the output chunk
+    std::size_t offset = output.size();
+    output.resize(offset + input.size() + crypto::CryptoStream::BLOCK_SIZE);
+    std::size_t written = payload_crypto->update_stream(
+      reinterpret_cast<const uint8_t*>(input.data()), input.size(),
+      reinterpret_cast<uint8_t*>(output.data() + offset));
+    output.resize(offset + written);
+    return true;
+  };
 
+  auto flush = [payload_crypto, header_written](utils::Chunk& output) -> bool {
+    if (*header_written) {
+      output.resize(crypto::CryptoStream::BLOCK_SIZE);
+      output.resize(payload_crypto->finish_stream(reinterpret_cast<uint8_t*>(output.data())));
+    }
     return true;
   };
+
+  pipeline.transform(transform, flush)->named("encrypt");
 }
   
 bool FileServer::send_pipeline(dfs::utils::Pipeliner* const& pipeline, std::optional<uint8_t> peer_id) {
   // Send to single peer or broadcast to all depending on presence of peer ID
   if (peer_id) {
-    BOOST_LOG_TRIVIAL(debug) << "File server: Sending to peer: " << static_cast<int>(*peer_id);
+    DFS_LOG(debug) << "File server: Sending to peer: " << static_cast<int>(*peer_id);
     return peer_manager_.send_to_peer(*peer_id, *pipeline);
   }
 
-  BOOST_LOG_TRIVIAL(debug) << "File server: Broadcasting to all peers";
+  DFS_LOG(debug) << "File server: Broadcasting to all peers";
   return peer_manager_.broadcast_stream(*pipeline);
 }
 
+void FileServer::record_pipeline_stats(const utils::Pipeliner& pipeline) {
+  auto& registry = metrics::Registry::global();
+  for (const auto& stage : pipeline.get_stats()) {
+    metrics::Labels labels{{"stage", stage.name}};
+    registry.counter("dfs_pipeline_stage_busy_seconds_total", "Time pipeline stages spent working",
+                     labels, 1e-9).inc(stage.busy.count());
+    registry.counter("dfs_pipeline_stage_input_wait_seconds_total", "Time pipeline stages waited for input",
+                     labels, 1e-9).inc(stage.input_wait.count());
+    registry.counter("dfs_pipeline_stage_output_wait_seconds_total", "Time pipeline stages waited on a full queue",
+                     labels, 1e-9).inc(stage.output_wait.count());
+    registry.counter("dfs_pipeline_stage_bytes_total", "Bytes produced by pipeline stages",
+                     labels).inc(stage.bytes_out);
+    registry.counter("dfs_pipeline_stage_chunks_total", "Chunks handled by pipeline stages",
+                     labels).inc(stage.chunks);
+  }
+  registry.counter("dfs_pipeline_bottleneck_total", "Send pipelines limited by each stage",
+                   {{"stage", pipeline.bottleneck()}}).inc();
+}
+
+bool FileServer::send_control(MessageType message_type, const std::string& body, uint8_t peer_id) {
+  try {
+    auto frame = create_message_frame(body, message_type);
+    auto pipeline = utils::Pipeliner::create(create_producer(body, message_type, PIPELINE_CHUNK_SIZE))->named("sync");
+    create_transform(frame, *pipeline);
+    pipeline->set_total_size(Codec::get_serialized_size(frame));
+    pipeline->start();
+    return send_pipeline(pipeline.get(), peer_id) && !pipeline->failed();
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error sending sync message: " << e.what();
+    return false;
+  }
+}
+
 //==============================================
 // Process user get and store requests
 //==============================================
 
 bool FileServer::store_file(const std::string& filename, std::istream& input) {
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  OpRecorder op(file_server_metrics().store);
+  auto span = tracing::Span::root("store_file", filename);
   try {
-    BOOST_LOG_TRIVIAL(info) << "File server: Storing file with filename: " << filename;
+    DFS_LOG(info) << "File server: Storing file with filename: " << filename;
     // Validate input stream
     if (!input.good()) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Invalid input stream for file: " << filename;
+      DFS_LOG(error) << "File server: Invalid input stream for file: " << filename;
       return false;
     }
     
+    // This node's cached copy, if any, is of the old version
+    drop_cached_copy(filename);
+    if (erasure_) {
+      return store_erasure_coded(filename, input) && op.succeed();
+    }
+
+    auto& stats = file_server_metrics();
+    const std::size_t quorum = write_quorum_;
+    std::vector<uint8_t> peers = peer_manager_.peer_ids();
+    if (peers.size() < quorum) {
+      stats.quorum_failed.inc();
+      DFS_LOG(error) << "File server: Write quorum of " << quorum << " cannot be met by "
+                     << peers.size() << " connected peers, not storing " << filename;
+      return false;
+    }
+
     // Store file locally
     try {
       store_->store(filename, input);
     } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to store file locally: " << e.what();
+      DFS_LOG(error) << "File server: Failed to store file locally: " << e.what();
       return false;
     }
-    
-    // Reset stream position after store operation
-    input.clear();
-    input.seekg(0);
-    
-    // Broadcast the stored file to all peers with STORE_FILE message type
-    if (!prepare_and_send(filename, MessageType::STORE_FILE)) {
-      BOOST_LOG_TRIVIAL(error) << "Failed to broadcast file: " << filename;
-      return false;
+
+    // Acknowledgements are collected from before the file is queued, a peer may answer right away
+    std::string digest;
+    if (quorum > 0) {
+      store_->sync(filename);
+      digest = store_->content_digest(filename);
+      expect_acks(filename, digest);
     }
     
-    BOOST_LOG_TRIVIAL(info) << "File server: Successfully stored and broadcasted file: " << filename;
-    return true;
+    // Peers are sent the file in the background, once it is in the journal
+    // it reaches them even across restarts and disconnects
+    std::size_t queued = 0;
+    {
+      std::lock_guard<std::mutex> replication_lock(replication_mutex_);
+      queued = replication_->append(filename, peers, tracing::Tracer::current());
+    }
+    replication_cv_.notify_all();
+    stats.replication_queued.inc(queued);
+    stats.replication_pending.add(static_cast<int64_t>(queued));
+
+    // The file is stored and journaled, so other requests need not wait for the peers too
+    lock.unlock();
+    if (quorum > 0) {
+      auto start = std::chrono::steady_clock::now();
+      std::size_t acked = wait_for_acks(filename, digest, peers, quorum, WRITE_QUORUM_TIMEOUT).size();
+      forget_acks(filename, digest);
+      stats.quorum_wait.observe_since(start);
+      if (acked < quorum) {
+        stats.quorum_failed.inc();
+        DFS_LOG(error) << "File server: Only " << acked << " of " << quorum << " peers acknowledged "
+                       << filename << ", the rest is still sent in the background";
+        return false;
+      }
+      stats.quorum_met.inc();
+    }
+
+    DFS_LOG(info) << "File server: Stored file: " << filename << ", queued for " << peers.size() << " peers";
+    return op.succeed();
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Error in store_file: " << e.what();
+    DFS_LOG(error) << "File server: Error in store_file: " << e.what();
     return false;
   }
 }
 
 bool FileServer::get_file(const std::string& filename) {
   std::lock_guard<std::mutex> lock(mutex_);
-  BOOST_LOG_TRIVIAL(info) << "File server: Attempting to get file: " << filename;
+  DFS_LOG(info) << "File server: Attempting to get file: " << filename;
+  FileServerMetrics& stats = file_server_metrics();
+  OpRecorder op(stats.get);
+  auto span = tracing::Span::root("get_file", filename);
 
   // Try reading from local store first
   if (read_from_local_store(filename)) {
-    return true;  
+    stats.local_hits.inc();
+    return op.succeed();
+  }
+
+  // Erasure coded files are rebuilt into a temporary local copy for paging,
+  // which hot files keep as their cached copy
+  if (erasure_) {
+    bool hot = record_read(filename);
+    if (read_from_local_store(cache_key(filename))) {
+      stats.cache_hits.inc();
+      return op.succeed();
+    }
+    std::vector<std::size_t> requested;
+    bool found = retrieve_fragments(filename, requested);
+    bool read = false;
+    if (store_->has(filename)) {
+      read = read_from_local_store(filename);
+    } else if (found) {
+      std::stringstream content;
+      if (decode_fragments(filename, content)) {
+        if (hot) {
+          add_cached_copy(filename, content);
+          read = read_from_local_store(cache_key(filename));
+        } else {
+          store_->store(filename, content);
+          read = read_from_local_store(filename);
+          store_->remove(filename);
+        }
+      }
+    }
+    discard_fragments(filename, requested);
+    if (read) {
+      stats.network_hits.inc();
+      return op.succeed();
+    }
+    stats.misses.inc();
+    return false;
   }
 
   // If local read failed, try network retrieval
-  return retrieve_from_network(filename);
+  std::string source;
+  if (retrieve_from_network(filename, source) && read_from_local_store(source)) {
+    return op.succeed();
+  }
+  stats.misses.inc();
+  return false;
+}
+
+bool FileServer::fetch_file(const std::string& filename, std::ostream& output) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DFS_LOG(info) << "File server: Fetching file: " << filename;
+  FileServerMetrics& stats = file_server_metrics();
+  OpRecorder op(stats.get);
+  auto span = tracing::Span::root("fetch_file", filename);
+
+  // Key the content is streamed from once it is local
+  std::string source = filename;
+  bool hot = erasure_ && record_read(filename);
+  if (store_->has(filename)) {
+    stats.local_hits.inc();
+  } else if (erasure_ && store_->has(cache_key(filename))) {
+    source = cache_key(filename);
+    stats.cache_hits.inc();
+  } else if (erasure_) {
+    std::vector<std::size_t> requested;
+    bool found = retrieve_fragments(filename, requested);
+    if (!store_->has(filename) && hot) {
+      std::stringstream content;
+      bool decoded = found && decode_fragments(filename, content);
+      discard_fragments(filename, requested);
+      if (!decoded) {
+        stats.misses.inc();
+        return false;
+      }
+      add_cached_copy(filename, content);
+      source = cache_key(filename);
+    } else if (!store_->has(filename)) {
+      // Rebuilt straight into output, no full copy is kept
+      bool decoded = found && decode_fragments(filename, output);
+      discard_fragments(filename, requested);
+      if (!decoded) {
+        stats.misses.inc();
+        return false;
+      }
+      stats.network_hits.inc();
+      return op.succeed();
+    } else {
+      discard_fragments(filename, requested);
+    }
+    stats.network_hits.inc();
+  } else if (!retrieve_from_network(filename, source)) {
+    stats.misses.inc();
+    return false;
+  }
+
+  try {
+    tracing::Span read_span("local read");
+    auto input = store_->get_stream(source);
+    // Streaming an empty buffer would set failbit on output
+    if (store_->get_file_size(source) > 0) {
+      output << input->rdbuf();
+    }
+    if (!output.good()) {
+      DFS_LOG(error) << "File server: Failed to write fetched file: " << filename;
+      return false;
+    }
+    return op.succeed();
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error reading fetched file: " << e.what();
+    return false;
+  }
 }
 
 bool FileServer::read_from_local_store(const std::string& filename) {
+  tracing::Span span("local read");
   try {
     // Check if file exists locally
     if (!store_->has(filename)) {
-      BOOST_LOG_TRIVIAL(debug) << "File server: File not found in local store";
+      DFS_LOG(debug) << "File server: File not found in local store";
       return false;
     }
 
     // Read file 20 lines at a time
     if (store_->read_file(filename, 20)) {
-      BOOST_LOG_TRIVIAL(info) << "File server: File successfully read from local store: " << filename;
+      DFS_LOG(info) << "File server: File successfully read from local store: " << filename;
       return true;
     }
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(debug) << "File server: Error reading from local store: " << e.what();
+    DFS_LOG(debug) << "File server: Error reading from local store: " << e.what();
   }
   return false;
 }
 
-bool FileServer::retrieve_from_network(const std::string& filename) {
+bool FileServer::retrieve_from_network(const std::string& filename, std::string& source) {
+  tracing::Span span("network get");
+  FileServerMetrics& stats = file_server_metrics();
+  // Reads keep the cached copy from being swept
+  record_read(filename);
+  store::Store::ObjectVersion cached = cached_version(filename);
+  bool has_copy = !cached.digest.empty() && store_->has(cache_key(filename));
+  if (!has_copy) {
+    // The copy is gone, so a matching version must not be confirmed
+    cached = store::Store::ObjectVersion{};
+  }
+  std::optional<MessageType> answer;
   try {
-    // Send GET_FILE request to network peers
-    if (!prepare_and_send(filename, MessageType::GET_FILE)) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to send GET_FILE request for: " << filename;
-      return false;
+    // Ask one peer at a time, sending the cached version so a holder of the
+    // same content answers with a header only, and only one holder sends the
+    // file otherwise. Peers without a full copy answer NOT_HELD, which moves
+    // on to the next. Each file starts at its own peer to spread the reads
+    std::string body = encode_version(filename, cached);
+    std::vector<uint8_t> peers = peer_manager_.peer_ids();
+    std::size_t first = peers.empty() ? 0 : (std::hash<std::string>{}(filename) + ID_) % peers.size();
+    auto deadline = std::chrono::steady_clock::now() + (has_copy ? REVALIDATE_TIMEOUT : NETWORK_GET_TIMEOUT);
+    bool sent = false;
+    for (std::size_t i = 0; i < peers.size() && std::chrono::steady_clock::now() < deadline; ++i) {
+      uint8_t peer_id = peers[(first + i) % peers.size()];
+      {
+        std::lock_guard<std::mutex> lock(arrival_mutex_);
+        conditional_gets_[filename].reset();
+      }
+      if (!send_control(MessageType::GET_IF_NONE_MATCH, body, peer_id)) {
+        continue;
+      }
+      sent = true;
+
+      // Wait for the answer, returning as soon as it arrives
+      DFS_LOG(debug) << "File server: Waiting for peer " << static_cast<int>(peer_id) << " to answer for " << filename;
+      std::unique_lock<std::mutex> lock(arrival_mutex_);
+      arrival_cv_.wait_until(lock, deadline, [this, &filename] {
+        return conditional_gets_[filename].has_value() || store_->has(filename);
+      });
+      answer = conditional_gets_[filename];
+      if (answer != MessageType::NOT_HELD) {
+        break;
+      }
     }
-
-    // Wait for potential network response    
-    BOOST_LOG_TRIVIAL(debug) << "File server: Waiting for network retrieval of file: " << filename;
-    std::this_thread::sleep_for(std::chrono::seconds(5));
-
-    // Check if file was received and stored locally
-    if (store_->has(filename)) { 
-      BOOST_LOG_TRIVIAL(info) << "File server: File successfully retrieved from network: " << filename;
-      return true;  
+    if (!sent) {
+      DFS_LOG(error) << "File server: Failed to send conditional get for: " << filename;
     }
+    std::lock_guard<std::mutex> lock(arrival_mutex_);
+    conditional_gets_.erase(filename);
   } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Error in network retrieval: " << e.what();
+      DFS_LOG(error) << "File server: Error in network retrieval: " << e.what();
+  }
+
+  // A full copy may have arrived meanwhile, by replication or anti-entropy
+  if (store_->has(filename)) {
+    source = filename;
+    stats.network_hits.inc();
+    DFS_LOG(info) << "File server: File successfully retrieved from network: " << filename;
+    return true;
+  }
+  if (answer == MessageType::CACHED_FILE && store_->has(cache_key(filename))) {
+    source = cache_key(filename);
+    stats.network_hits.inc();
+    DFS_LOG(info) << "File server: File successfully retrieved from network: " << filename;
+    return true;
+  }
+  if (has_copy && store_->has(cache_key(filename))) {
+    source = cache_key(filename);
+    stats.cache_hits.inc();
+    if (answer != MessageType::NOT_MODIFIED) {
+      stats.stale.inc();
+      DFS_LOG(warning) << "File server: No peer confirmed the cached copy of " << filename << ", reading it as is";
+    }
+    return true;
   }
 
-  BOOST_LOG_TRIVIAL(info) << "File server: File not found: " << filename;
+  DFS_LOG(info) << "File server: File not found: " << filename;
   return false;
 }
 
 //==============================================
-// Handling of incoming frames
+// Background replication
 //==============================================
 
-void FileServer::channel_listener() {
-  BOOST_LOG_TRIVIAL(info) << "File server: Starting channel listener";
+bool FileServer::wait_for_replication(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(replication_mutex_);
+  return replication_cv_.wait_for(lock, timeout, [this] { return replication_->pending() == 0; });
+}
 
+void FileServer::replication_loop() {
+  std::unique_lock<std::mutex> lock(replication_mutex_);
   while (running_) {
-    try {
-      MessageFrame frame;
-      // Try to consume a message from the channel
-      if (channel_.consume(frame)) {
-        BOOST_LOG_TRIVIAL(debug) << "File server: Retrieved message from channel, type: " 
-                                 << static_cast<int>(frame.message_type);
+    // A peer whose connection was lost counts as absent, so its entries are
+    // retried as soon as it reconnects rather than after their backoff
+    std::vector<uint8_t> connected = peer_manager_.peer_ids();
+    connected.erase(std::remove_if(connected.begin(), connected.end(),
+                                   [this](uint8_t peer_id) { return !peer_manager_.is_connected(peer_id); }),
+                    connected.end());
+    std::vector<ReplicationJournal::Entry> batch = replication_->claim(connected);
+    if (batch.empty()) {
+      // Peers connecting again are only noticed by polling
+      auto wake = std::chrono::steady_clock::now() + REPLICATION_POLL_INTERVAL;
+      auto due = replication_->next_due(connected);
+      replication_cv_.wait_until(lock, due ? std::min(*due, wake) : wake);
+      continue;
+    }
+    lock.unlock();
+    replicate(batch);
+    lock.lock();
+    // Wakes waiters and the other workers, the key may be claimed again now
+    replication_cv_.notify_all();
+  }
+}
 
-        // Handle the message
-        message_handler(frame);
+void FileServer::replicate(const std::vector<ReplicationJournal::Entry>& batch) {
+  auto& stats = file_server_metrics();
+  const std::string& filename = batch.front().key;
+  tracing::Span span("replicate", batch.front().trace, filename);
+  std::map<uint8_t, bool> sent;
+  // Peers sent the content, whose entries wait for their STORE_ACK
+  std::vector<uint8_t> awaited;
+  std::string digest;
+  bool expecting = false;
+  try {
+    if (!store_->has(filename)) {
+      // Removed since it was queued, there is nothing left to send
+      for (const auto& entry : batch) {
+        replication_->finish(entry, true);
       }
+      stats.replication_dropped.inc(batch.size());
+      stats.replication_pending.sub(static_cast<int64_t>(batch.size()));
+      DFS_LOG(info) << "File server: Dropped replication of removed file " << filename;
+      return;
+    }
 
-      // Small sleep to prevent busy waiting
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // Peers already holding the same content are not sent it again, and ones
+    // holding an older version are sent the changes
+    std::vector<uint8_t> peers;
+    for (const auto& entry : batch) {
+      peers.push_back(entry.peer_id);
+      sent[entry.peer_id] = true;
     }
-    catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Error in channel listener: " << e.what();
+    digest = store_->content_digest(filename);
+    expect_acks(filename, digest);
+    expecting = true;
+    std::map<uint8_t, std::string> lacking = peers_lacking(filename, peers);
+    for (uint8_t peer_id : peers) {
+      // Holding the content already counts towards a waiting write quorum
+      if (!lacking.count(peer_id)) {
+        record_ack(filename, digest, peer_id);
+      }
+    }
+    std::vector<uint8_t> targets;
+    for (const auto& [peer_id, signatures] : lacking) {
+      if (signatures.empty() || !send_delta(filename, peer_id, signatures)) {
+        targets.push_back(peer_id);
+      }
+    }
+    std::vector<uint8_t> connected = peer_manager_.peer_ids();
+    if (!targets.empty() && targets.size() == connected.size() &&
+        std::is_permutation(targets.begin(), targets.end(), connected.begin())) {
+      bool broadcast = prepare_and_send(filename, MessageType::STORE_FILE);
+      for (uint8_t peer_id : targets) {
+        sent[peer_id] = broadcast;
+      }
+    } else {
+      for (uint8_t peer_id : targets) {
+        sent[peer_id] = prepare_and_send(filename, MessageType::STORE_FILE, peer_id);
+      }
+    }
+    for (const auto& [peer_id, signatures] : lacking) {
+      if (sent[peer_id]) {
+        awaited.push_back(peer_id);
+      }
+    }
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error replicating " << filename << ": " << e.what();
+    for (const auto& entry : batch) {
+      sent[entry.peer_id] = false;
+    }
+    awaited.clear();
+  }
+
+  // Written to the socket is not stored yet, the entry stays until the peer says so
+  std::set<uint8_t> acked;
+  if (expecting) {
+    acked = wait_for_acks(filename, digest, awaited, awaited.size(), STORE_ACK_TIMEOUT);
+    forget_acks(filename, digest);
+  }
+  for (const auto& entry : batch) {
+    bool unacknowledged = sent[entry.peer_id] && !acked.count(entry.peer_id) &&
+                          std::find(awaited.begin(), awaited.end(), entry.peer_id) != awaited.end();
+    replication_->finish(entry, sent[entry.peer_id] && !unacknowledged);
+    if (unacknowledged) {
+      stats.replication_unacknowledged.inc();
+      DFS_LOG(warning) << "File server: Peer " << static_cast<int>(entry.peer_id) << " did not acknowledge "
+                       << filename << ", sending it again later";
+    } else if (sent[entry.peer_id]) {
+      stats.replication_sent.inc();
+      stats.replication_pending.sub();
+    } else {
+      stats.replication_failed.inc();
+      DFS_LOG(warning) << "File server: Failed to send " << filename << " to peer "
+                       << static_cast<int>(entry.peer_id) << ", retrying later";
     }
   }
 }
 
-void FileServer::message_handler(const MessageFrame& frame) {
-  try {
-    BOOST_LOG_TRIVIAL(info) << "File server: Handling message of type: " << static_cast<int>(frame.message_type);
+//==============================================
+// Write quorum
+//==============================================
 
-    // Route message to appropriate handler based on type
-    switch (frame.message_type) {
-      case MessageType::STORE_FILE:
-        BOOST_LOG_TRIVIAL(debug) << "File server: Forwarding to handle_store";
-        if (!handle_store(frame)) {
-          BOOST_LOG_TRIVIAL(error) << "File server: Failed to handle store message";
-        }
-        break;
+void FileServer::set_write_quorum(std::size_t write_quorum) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  write_quorum_ = write_quorum;
+  DFS_LOG(info) << "File server: Write quorum of " << write_quorum << " peers";
+}
 
-      case MessageType::GET_FILE:
-        BOOST_LOG_TRIVIAL(debug) << "File server: Forwarding to handle_get";
-        if (!handle_get(frame)) {
-          BOOST_LOG_TRIVIAL(error) << "File server: Failed to handle get message";
-        }
-        break;
+void FileServer::expect_acks(const std::string& filename, const std::string& digest) {
+  std::lock_guard<std::mutex> lock(ack_mutex_);
+  ++acks_[{filename, digest}].waiters;
+}
 
-      default:
-        BOOST_LOG_TRIVIAL(warning) << "File server: Unknown message type: " << static_cast<int>(frame.message_type);
-        break;
-    }
-  }
-  catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Error in message handler: " << e.what();
+void FileServer::forget_acks(const std::string& filename, const std::string& digest) {
+  std::lock_guard<std::mutex> lock(ack_mutex_);
+  auto it = acks_.find({filename, digest});
+  if (it != acks_.end() && --it->second.waiters == 0) {
+    acks_.erase(it);
   }
 }
-  
-bool FileServer::handle_store(const MessageFrame& frame) {
-  try {
-    BOOST_LOG_TRIVIAL(info) << "File server: Handling store message frame";
 
-    // Validate payload stream
-    if (!frame.payload_stream || !frame.payload_stream->good()) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Invalid payload stream in message frame";
-      return false;
+void FileServer::record_ack(const std::string& filename, const std::string& digest, uint8_t peer_id) {
+  {
+    std::lock_guard<std::mutex> lock(ack_mutex_);
+    auto it = acks_.find({filename, digest});
+    if (it == acks_.end()) {
+      return;
     }
+    it->second.peers.insert(peer_id);
+  }
+  ack_cv_.notify_all();
+}
 
-    // Extract filename from frame
-    std::string filename;
-    try {
-      filename = extract_filename(frame);
-    } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to extract filename: " << e.what();
-      return false;
+std::set<uint8_t> FileServer::wait_for_acks(const std::string& filename, const std::string& digest,
+                                            const std::vector<uint8_t>& peers, std::size_t count,
+                                            std::chrono::milliseconds timeout) {
+  std::set<uint8_t> acked;
+  std::unique_lock<std::mutex> lock(ack_mutex_);
+  ack_cv_.wait_for(lock, timeout, [&] {
+    acked.clear();
+    const auto& received = acks_[{filename, digest}].peers;
+    for (uint8_t peer_id : peers) {
+      if (received.count(peer_id)) {
+        acked.insert(peer_id);
+      }
     }
+    return acked.size() >= count || !running_;
+  });
+  return acked;
+}
 
-    // Store the file using the Store class
-    try {
-      store_->store(filename, *frame.payload_stream);
-      BOOST_LOG_TRIVIAL(info) << "File server: Successfully stored file: " << filename;
-      return true;
-    } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to store file: " << e.what();
+bool FileServer::send_store_ack(const std::string& key, uint8_t peer_id) {
+  try {
+    store_->sync(key);
+    if (!send_control(MessageType::STORE_ACK, encode_version(key, store_->version(key)), peer_id)) {
       return false;
     }
-  } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Error in handle_store: " << e.what();
+    file_server_metrics().store_acks.inc();
+    return true;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Failed to acknowledge " << key << ": " << e.what();
     return false;
   }
 }
 
-bool FileServer::handle_get(const MessageFrame& frame) {
+bool FileServer::handle_store_ack(const MessageFrame& frame) {
   try {
-    BOOST_LOG_TRIVIAL(info) << "File server: Handling get message frame";
+    store::Store::ObjectVersion version;
+    std::string key = decode_version(extract_filename(frame), version);
+    record_ack(key, version.digest, frame.source_id);
+    return true;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_store_ack: " << e.what();
+    return false;
+  }
+}
+
+//==============================================
+// Erasure coding
+//==============================================
+
+void FileServer::set_erasure_coding(std::size_t data_fragments, std::size_t parity_fragments) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (parity_fragments == 0) {
+    erasure_.reset();
+    DFS_LOG(info) << "File server: Full replication";
+    return;
+  }
+  erasure_ = std::make_unique<erasure::ReedSolomon>(data_fragments, parity_fragments);
+  DFS_LOG(info) << "File server: Erasure coding with " << data_fragments << " data and "
+                << parity_fragments << " parity fragments";
+}
+
+std::string FileServer::fragment_key(const std::string& filename, std::size_t index) {
+  return filename + "#frag" + std::to_string(index);
+}
+
+bool FileServer::store_erasure_coded(const std::string& filename, std::istream& input) {
+  tracing::Span span("erasure encode", filename);
+  const std::size_t data_count = erasure_->data_fragments();
+  const std::size_t total = erasure_->total_fragments();
+
+  // This node and every peer, so no two fragments share a node. Sorted by
+  // ID, so every node computes the same placement for the same members
+  const uint8_t self = static_cast<uint8_t>(ID_);
+  std::vector<uint8_t> nodes = peer_manager_.peer_ids();
+  nodes.push_back(self);
+  std::sort(nodes.begin(), nodes.end());
+  if (nodes.size() < total) {
+    DFS_LOG(error) << "File server: Erasure coding " << data_count << "+" << total - data_count
+                   << " needs " << total << " nodes, only " << nodes.size() << " available for " << filename;
+    return false;
+  }
+
+  // Newer than this node's last store and than the fragments of the file it
+  // holds, so receivers and readers tell this version from earlier ones
+  uint64_t generation = std::max<uint64_t>(
+    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count()),
+    last_fragment_generation_ + 1);
+  for (std::size_t i = 0; i < total; ++i) {
+    if (auto held = fragment_header(fragment_key(filename, i))) {
+      generation = std::max(generation, held->generation + 1);
+    }
+  }
+  last_fragment_generation_ = generation;
+
+  // Fragments are written to the local store first and sent from there
+  auto write_header = [&](std::ostream& fragment, std::size_t index, uint64_t object_size) {
+    erasure::FragmentHeader header;
+    header.data_fragments = static_cast<uint8_t>(data_count);
+    header.parity_fragments = static_cast<uint8_t>(total - data_count);
+    header.index = static_cast<uint8_t>(index);
+    header.object_size = object_size;
+    header.generation = generation;
+    header.write(fragment);
+  };
+  const std::string spool = spool_key(filename, "input");
+  std::unique_ptr<std::istream> spooled;
+  std::size_t length = 0;
+  try {
+    // The fragment length follows from the file size, so input that cannot
+    // be measured, such as a pipe, is spooled to the local store first
+    std::istream* source = &input;
+    uint64_t object_size = 0;
+    std::istream::pos_type start = input.tellg();
+    if (start != std::istream::pos_type(-1) && input.seekg(0, std::ios::end)) {
+      object_size = static_cast<uint64_t>(input.tellg() - start);
+      input.seekg(start);
+    } else {
+      input.clear();
+      store_->store(spool, input);
+      spooled = store_->get_stream(spool);
+      source = spooled.get();
+      object_size = store_->get_file_size(spool);
+    }
+    length = erasure_->fragment_size(object_size);
+
+    // Data fragments are consecutive slices of the file, zero padded at the end
+    std::vector<char> buffer(ERASURE_STRIPE_SIZE);
+    for (std::size_t i = 0; i < data_count; ++i) {
+      store_->store_output(fragment_key(filename, i), [&](std::ostream& fragment) {
+        write_header(fragment, i, object_size);
+        for (std::size_t offset = 0; offset < length; offset += buffer.size()) {
+          std::size_t stripe = std::min(buffer.size(), length - offset);
+          source->read(buffer.data(), static_cast<std::streamsize>(stripe));
+          std::size_t read = static_cast<std::size_t>(std::max<std::streamsize>(source->gcount(), 0));
+          std::fill(buffer.begin() + static_cast<std::ptrdiff_t>(read),
+                    buffer.begin() + static_cast<std::ptrdiff_t>(stripe), '\0');
+          fragment.write(buffer.data(), static_cast<std::streamsize>(stripe));
+        }
+      });
+    }
+
+    // Parity is encoded a stripe at a time from the stored data fragments,
+    // so memory stays at k + 1 stripes however large the file
+    std::vector<std::vector<uint8_t>> stripes(data_count, std::vector<uint8_t>(ERASURE_STRIPE_SIZE));
+    std::vector<const uint8_t*> data_fragments;
+    for (const auto& stripe : stripes) {
+      data_fragments.push_back(stripe.data());
+    }
+    std::vector<uint8_t> parity(ERASURE_STRIPE_SIZE);
+    for (std::size_t p = 0; p < total - data_count; ++p) {
+      store_->store_output(fragment_key(filename, data_count + p), [&](std::ostream& fragment) {
+        write_header(fragment, data_count + p, object_size);
+        std::vector<std::unique_ptr<std::istream>> inputs;
+        for (std::size_t i = 0; i < data_count; ++i) {
+          inputs.push_back(store_->get_stream(fragment_key(filename, i)));
+          inputs.back()->seekg(static_cast<std::streamoff>(erasure::FragmentHeader::SIZE));
+        }
+        for (std::size_t offset = 0; offset < length; offset += ERASURE_STRIPE_SIZE) {
+          std::size_t stripe = std::min(ERASURE_STRIPE_SIZE, length - offset);
+          for (std::size_t i = 0; i < data_count; ++i) {
+            if (!inputs[i]->read(reinterpret_cast<char*>(stripes[i].data()), static_cast<std::streamsize>(stripe))) {
+              throw std::runtime_error("Data fragment " + std::to_string(i) + " is short");
+            }
+          }
+          erasure_->encode_parity(p, data_fragments, parity.data(), stripe);
+          fragment.write(reinterpret_cast<const char*>(parity.data()), static_cast<std::streamsize>(stripe));
+        }
+      });
+    }
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Failed to encode " << filename << ": " << e.what();
+    spooled.reset();
+    if (store_->has(spool)) {
+      store_->remove(spool);
+    }
+    for (std::size_t i = 0; i < total; ++i) {
+      if (store_->has(fragment_key(filename, i))) {
+        store_->remove(fragment_key(filename, i));
+      }
+    }
+    return false;
+  }
+  if (spooled) {
+    spooled.reset();
+    store_->remove(spool);
+  }
+
+  // Start each file at a different node, so fragments of many files spread
+  // evenly. The offset comes from the filename's SHA-256, the same on every node
+  const std::size_t offset =
+    static_cast<std::size_t>(std::stoull(delta::sha256_hex(filename).substr(0, 15), nullptr, 16) % nodes.size());
+  std::vector<uint8_t> placed;
+  for (std::size_t i = 0; i < total; ++i) {
+    // A fragment leaves the local store only once its node has it, and only
+    // this node's fragment stays
+    const std::string key = fragment_key(filename, i);
+    const uint8_t node = nodes[(offset + i) % nodes.size()];
+    if (node == self) {
+      continue;
+    }
+    if (!prepare_and_send(key, MessageType::STORE_FILE, node)) {
+      DFS_LOG(error) << "File server: Failed to send fragment " << key << " to peer " << static_cast<int>(node)
+                     << ", rolling back " << placed.size() << " placed fragments";
+      // Fewer than k + m fragments of this generation would leave the file
+      // with less redundancy than asked for, so the store is undone
+      std::string body(1, '\1');
+      append_u64(body, generation);
+      body += filename;
+      for (uint8_t holder : placed) {
+        if (!send_control(MessageType::DROP_FRAGMENTS, body, holder)) {
+          DFS_LOG(warning) << "File server: Failed to roll back fragment of " << filename
+                           << " on peer " << static_cast<int>(holder);
+        }
+      }
+      std::lock_guard<std::mutex> lock(arrival_mutex_);
+      drop_fragments(filename, generation, true);
+      return false;
+    }
+    placed.push_back(node);
+    store_->remove(key);
+  }
+
+  // Every fragment key is overwritten on the node it went to. Other nodes
+  // may still hold fragments of an earlier version, placed while the
+  // members differed, which they drop now
+  std::string body(1, '\0');
+  append_u64(body, generation);
+  body += filename;
+  for (uint8_t node : nodes) {
+    if (node != self && !send_control(MessageType::DROP_FRAGMENTS, body, node)) {
+      DFS_LOG(warning) << "File server: Failed to tell peer " << static_cast<int>(node)
+                       << " to drop old fragments of " << filename;
+    }
+  }
+  DFS_LOG(info) << "File server: Stored " << filename << " as " << total << " fragments of " << length << " bytes";
+  return true;
+}
+
+bool FileServer::retrieve_fragments(const std::string& filename, std::vector<std::size_t>& requested) {
+  tracing::Span span("network get fragments", filename);
+  const std::size_t data_count = erasure_->data_fragments();
+  auto local_fragments = [&] {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < erasure_->total_fragments(); ++i) {
+      count += store_->has(fragment_key(filename, i)) ? 1 : 0;
+    }
+    return count;
+  };
+  if (local_fragments() >= data_count) {
+    return true;
+  }
+
+  try {
+    // All requests go out before waiting, so the replies travel in parallel. A
+    // full copy is asked for too, for files stored before erasure coding
+    if (!prepare_and_send(filename, MessageType::GET_FILE)) {
+      DFS_LOG(error) << "File server: Failed to send GET_FILE request for: " << filename;
+      return false;
+    }
+    for (std::size_t i = 0; i < erasure_->total_fragments(); ++i) {
+      std::string key = fragment_key(filename, i);
+      if (!store_->has(key) && prepare_and_send(key, MessageType::GET_FILE)) {
+        requested.push_back(i);
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(arrival_mutex_);
+    return arrival_cv_.wait_for(lock, NETWORK_GET_TIMEOUT, [&] {
+      return store_->has(filename) || local_fragments() >= data_count;
+    });
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error retrieving fragments: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::decode_fragments(const std::string& filename, std::ostream& output) {
+  tracing::Span span("erasure decode", filename);
+  const std::size_t data_count = erasure_->data_fragments();
+  const std::size_t total = erasure_->total_fragments();
+
+  // Fragments of another layout are left out, and of the generations found
+  // the newest one with k fragments is rebuilt
+  std::vector<std::optional<erasure::FragmentHeader>> headers(total);
+  std::map<uint64_t, std::size_t> generations;
+  for (std::size_t i = 0; i < total; ++i) {
+    const std::string key = fragment_key(filename, i);
+    auto header = fragment_header(key);
+    if (!header) {
+      continue;
+    }
+    if (header->index != i || header->data_fragments != data_count ||
+        header->parity_fragments != total - data_count ||
+        store_->get_file_size(key) != erasure::FragmentHeader::SIZE + erasure_->fragment_size(header->object_size)) {
+      DFS_LOG(warning) << "File server: Ignoring fragment that does not match the layout: " << key;
+      continue;
+    }
+    headers[i] = header;
+    ++generations[header->generation];
+  }
+  auto newest = std::find_if(generations.rbegin(), generations.rend(),
+                             [&](const auto& generation) { return generation.second >= data_count; });
+  if (newest == generations.rend()) {
+    DFS_LOG(error) << "File server: Not enough fragments of one version to rebuild " << filename;
+    return false;
+  }
+
+  // The first k fragments of that generation, data fragments first, are
+  // read past their headers a stripe at a time
+  const uint64_t generation = newest->first;
+  const uint64_t object_size = (*std::find_if(headers.begin(), headers.end(), [&](const auto& header) {
+    return header && header->generation == generation;
+  }))->object_size;
+  const std::size_t length = erasure_->fragment_size(object_size);
+  std::vector<std::unique_ptr<std::istream>> inputs(total);
+  std::size_t chosen = 0;
+  for (std::size_t i = 0; i < total && chosen < data_count; ++i) {
+    if (headers[i] && headers[i]->generation == generation && headers[i]->object_size == object_size) {
+      inputs[i] = store_->get_stream(fragment_key(filename, i));
+      inputs[i]->seekg(static_cast<std::streamoff>(erasure::FragmentHeader::SIZE));
+      ++chosen;
+    }
+  }
+  if (chosen < data_count) {
+    DFS_LOG(error) << "File server: Fragments of " << filename << " disagree on the object size";
+    return false;
+  }
+  std::vector<std::size_t> missing;
+  for (std::size_t i = 0; i < data_count; ++i) {
+    if (!inputs[i]) {
+      missing.push_back(i);
+    }
+  }
+
+  // Data fragments are consecutive slices of the file, so the output needs
+  // each one whole before the next. Lost ones are rebuilt stripe by stripe
+  // into a spool, the stripes of all lost fragments side by side, so memory
+  // stays at 2k stripes however large the file
+  const std::string spool = spool_key(filename, "rebuild");
+  std::unique_ptr<std::istream> rebuilt;
+  if (!missing.empty()) {
+    std::vector<std::vector<uint8_t>> stripes(total);
+    std::vector<const uint8_t*> present(total, nullptr);
+    for (std::size_t i = 0; i < total; ++i) {
+      if (inputs[i]) {
+        stripes[i].resize(ERASURE_STRIPE_SIZE);
+        present[i] = stripes[i].data();
+      }
+    }
+    std::vector<std::vector<uint8_t>> data(data_count, std::vector<uint8_t>(ERASURE_STRIPE_SIZE));
+    std::vector<uint8_t*> data_fragments;
+    for (auto& stripe : data) {
+      data_fragments.push_back(stripe.data());
+    }
+    try {
+      store_->store_output(spool, [&](std::ostream& out) {
+        for (std::size_t offset = 0; offset < length; offset += ERASURE_STRIPE_SIZE) {
+          std::size_t stripe = std::min(ERASURE_STRIPE_SIZE, length - offset);
+          for (std::size_t i = 0; i < total; ++i) {
+            if (inputs[i] && !inputs[i]->read(reinterpret_cast<char*>(stripes[i].data()),
+                                              static_cast<std::streamsize>(stripe))) {
+              throw std::runtime_error("Fragment " + std::to_string(i) + " is short");
+            }
+          }
+          if (!erasure_->decode(present, data_fragments, stripe)) {
+            throw std::runtime_error("Not enough fragments");
+          }
+          for (std::size_t index : missing) {
+            out.write(reinterpret_cast<const char*>(data[index].data()), static_cast<std::streamsize>(stripe));
+          }
+        }
+      });
+      rebuilt = store_->get_stream(spool);
+    } catch (const std::exception& e) {
+      DFS_LOG(error) << "File server: Failed to rebuild " << filename << ": " << e.what();
+      if (store_->has(spool)) {
+        store_->remove(spool);
+      }
+      return false;
+    }
+    file_server_metrics().degraded_reads.inc();
+    DFS_LOG(info) << "File server: Rebuilt lost data fragments of " << filename << " from parity";
+  }
+
+  // Data fragments are written out in order, up to the object size, which
+  // leaves the padding of the last one behind
+  std::vector<char> buffer(ERASURE_STRIPE_SIZE);
+  uint64_t remaining = object_size;
+  bool intact = true;
+  for (std::size_t i = 0; i < data_count && remaining > 0 && intact; ++i) {
+    auto slot = std::find(missing.begin(), missing.end(), i);
+    if (slot == missing.end()) {
+      inputs[i]->clear();
+      inputs[i]->seekg(static_cast<std::streamoff>(erasure::FragmentHeader::SIZE));
+    }
+    for (std::size_t offset = 0; offset < length && remaining > 0; offset += ERASURE_STRIPE_SIZE) {
+      std::size_t stripe = std::min(ERASURE_STRIPE_SIZE, length - offset);
+      std::istream* input = inputs[i].get();
+      if (slot != missing.end()) {
+        // Stripe offset of this fragment within the spool
+        input = rebuilt.get();
+        input->seekg(static_cast<std::streamoff>(offset * missing.size() +
+                                                  static_cast<std::size_t>(slot - missing.begin()) * stripe));
+      }
+      if (!input->read(buffer.data(), static_cast<std::streamsize>(stripe))) {
+        DFS_LOG(error) << "File server: Fragment " << i << " of " << filename << " is short";
+        intact = false;
+        break;
+      }
+      std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(stripe, remaining));
+      output.write(buffer.data(), static_cast<std::streamsize>(count));
+      remaining -= count;
+    }
+  }
+  if (rebuilt) {
+    rebuilt.reset();
+    store_->remove(spool);
+  }
+  return intact && output.good();
+}
+
+void FileServer::discard_fragments(const std::string& filename, const std::vector<std::size_t>& requested) {
+  // Under the arrival lock, so a fragment is either removed here or dropped
+  // by handle_store when it comes in late
+  std::lock_guard<std::mutex> lock(arrival_mutex_);
+  const auto now = std::chrono::steady_clock::now();
+  for (auto it = abandoned_fragments_.begin(); it != abandoned_fragments_.end();) {
+    it = now - it->second < NETWORK_GET_TIMEOUT ? std::next(it) : abandoned_fragments_.erase(it);
+  }
+  for (std::size_t index : requested) {
+    std::string key = fragment_key(filename, index);
+    try {
+      if (store_->has(key)) {
+        store_->remove(key);
+      } else {
+        abandoned_fragments_[key] = now;
+      }
+    } catch (const std::exception& e) {
+      DFS_LOG(warning) << "File server: Failed to drop fetched fragment " << key << ": " << e.what();
+    }
+  }
+}
+
+std::optional<erasure::FragmentHeader> FileServer::fragment_header(const std::string& key) {
+  if (!store_->has(key)) {
+    return std::nullopt;
+  }
+  auto input = store_->get_stream(key);
+  return peek_fragment_header(*input);
+}
+
+void FileServer::drop_fragments(const std::string& filename, uint64_t generation, bool exact) {
+  const std::size_t total = erasure_ ? erasure_->total_fragments() : erasure::ReedSolomon::MAX_FRAGMENTS;
+  for (std::size_t i = 0; i < total; ++i) {
+    const std::string key = fragment_key(filename, i);
+    auto header = fragment_header(key);
+    if (header && (exact ? header->generation == generation : header->generation < generation)) {
+      store_->remove(key);
+      DFS_LOG(debug) << "File server: Dropped fragment " << key << " of generation " << header->generation;
+    }
+  }
+}
+
+bool FileServer::handle_drop_fragments(const MessageFrame& frame) {
+  try {
+    std::string body = extract_filename(frame);
+    BodyReader reader(body);
+    bool exact = reader.bytes(1)[0] != 0;
+    uint64_t generation = reader.u64();
+    std::string filename = reader.rest();
+    // Under the arrival lock, like fragments being stored
+    std::lock_guard<std::mutex> lock(arrival_mutex_);
+    drop_fragments(filename, generation, exact);
+    return true;
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_drop_fragments: " << e.what();
+    return false;
+  }
+}
+
+//==============================================
+// Anti-entropy
+//==============================================
+
+void FileServer::set_anti_entropy_interval(std::chrono::milliseconds interval) {
+  {
+    std::lock_guard<std::mutex> lock(anti_entropy_mutex_);
+    anti_entropy_interval_ = interval;
+  }
+  anti_entropy_cv_.notify_all();
+  DFS_LOG(info) << "File server: Anti-entropy interval " << interval.count() << " ms";
+}
+
+void FileServer::sync_with_peers() {
+  // Exchanges start at the root; equal trees end after this one hash
+  std::string body = encode_tree({TreeNode{store::MerkleTree::ROOT,
+                                           store_->merkle_nodes({store::MerkleTree::ROOT}).front()}});
+  for (uint8_t peer_id : peer_manager_.peer_ids()) {
+    file_server_metrics().sync_rounds.inc();
+    file_server_metrics().sync_nodes.inc();
+    if (!send_control(MessageType::SYNC_TREE, body, peer_id)) {
+      DFS_LOG(warning) << "File server: Failed to start anti-entropy with peer " << static_cast<int>(peer_id);
+    }
+  }
+}
+
+void FileServer::anti_entropy_loop() {
+  std::unique_lock<std::mutex> lock(anti_entropy_mutex_);
+  while (running_) {
+    if (anti_entropy_interval_.count() == 0) {
+      anti_entropy_cv_.wait(lock);
+      continue;
+    }
+    // Interval changes and shutdown wake the wait early and restart it
+    if (anti_entropy_cv_.wait_for(lock, anti_entropy_interval_) == std::cv_status::timeout && running_) {
+      lock.unlock();
+      try {
+        sync_with_peers();
+      } catch (const std::exception& e) {
+        DFS_LOG(error) << "File server: Anti-entropy round failed: " << e.what();
+      }
+      lock.lock();
+    }
+  }
+}
+
+bool FileServer::handle_sync_tree(const MessageFrame& frame) {
+  try {
+    std::vector<TreeNode> remote = decode_tree(extract_filename(frame));
+    std::vector<std::size_t> indices;
+    for (const auto& node : remote) {
+      indices.push_back(node.index);
+    }
+    std::vector<uint64_t> local = store_->merkle_nodes(indices);
+
+    // Only ranges whose hashes differ are looked into, one level per message
+    std::vector<std::size_t> children;
+    std::string leaves;
+    for (std::size_t i = 0; i < remote.size(); ++i) {
+      if (local[i] == remote[i].hash) {
+        continue;
+      }
+      if (store::MerkleTree::is_leaf_node(remote[i].index)) {
+        std::size_t leaf = store::MerkleTree::leaf_of_node(remote[i].index);
+        append_leaf(leaves, leaf, store_->leaf_entries(leaf));
+        file_server_metrics().sync_leaves.inc();
+      } else {
+        children.push_back(2 * remote[i].index);
+        children.push_back(2 * remote[i].index + 1);
+      }
+    }
+
+    bool sent = true;
+    if (!children.empty()) {
+      std::vector<uint64_t> hashes = store_->merkle_nodes(children);
+      std::vector<TreeNode> reply;
+      for (std::size_t i = 0; i < children.size(); ++i) {
+        reply.push_back(TreeNode{children[i], hashes[i]});
+      }
+      file_server_metrics().sync_nodes.inc(reply.size());
+      sent = send_control(MessageType::SYNC_TREE, encode_tree(reply), frame.source_id);
+    }
+    if (!leaves.empty()) {
+      sent = send_control(MessageType::SYNC_KEYS, leaves, frame.source_id) && sent;
+    }
+    return sent;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_sync_tree: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::handle_sync_keys(const MessageFrame& frame, bool whole_leaves) {
+  try {
+    auto& stats = file_server_metrics();
+    bool repaired = true;
+    std::string newer;
+    for (const auto& [leaf, remote] : decode_leaves(extract_filename(frame))) {
+      std::map<std::string, store::Store::ObjectVersion> local;
+      for (auto& entry : store_->leaf_entries(leaf)) {
+        local.emplace(std::move(entry.key), store::Store::ObjectVersion{std::move(entry.digest), entry.generation});
+      }
+
+      for (const auto& [key, version] : remote) {
+        auto it = local.find(key);
+        store::Store::ObjectVersion held = it == local.end() ? store::Store::ObjectVersion{} : it->second;
+        if (whole_leaves && held.generation == version.generation && held.digest != version.digest) {
+          DFS_LOG(warning) << "File server: Anti-entropy conflict on " << key << " with peer "
+                           << static_cast<int>(frame.source_id) << ", keeping the higher digest";
+          stats.conflicts.inc();
+        }
+        if (!newer_version(version, held)) {
+          continue;
+        }
+        if (version.digest == held.digest) {
+          // Same content, or deleted on both sides, only the generation lags
+          store_->raise_generation(key, version);
+        } else if (version.digest.empty()) {
+          DFS_LOG(info) << "File server: Anti-entropy deleting " << key;
+          if (whole_leaves) {
+            stats.repaired_delete.inc();
+          }
+          store_->record_deletion(key, version.generation);
+        } else {
+          // The sender answers with a STORE_FILE, handled like any other arrival
+          DFS_LOG(info) << "File server: Anti-entropy pulling " << key;
+          if (whole_leaves) {
+            stats.repaired_pull.inc();
+          }
+          repaired = prepare_and_send(key, MessageType::GET_FILE, frame.source_id) && repaired;
+        }
+      }
+      if (!whole_leaves) {
+        continue;
+      }
+
+      // Versions the sender lacks go back to it, so it pulls or deletes them
+      // the same way, and only newer versions ever replace older ones
+      std::vector<store::Store::IndexEntry> offered;
+      for (const auto& [key, version] : local) {
+        auto it = remote.find(key);
+        store::Store::ObjectVersion theirs = it == remote.end() ? store::Store::ObjectVersion{} : it->second;
+        if (!newer_version(version, theirs)) {
+          continue;
+        }
+        if (version.digest != theirs.digest) {
+          DFS_LOG(info) << "File server: Anti-entropy offering " << key;
+          (version.digest.empty() ? stats.repaired_delete : stats.repaired_push).inc();
+        }
+        offered.push_back(store::Store::IndexEntry{key, version.digest, version.generation});
+      }
+      if (!offered.empty()) {
+        append_leaf(newer, leaf, offered);
+      }
+    }
+    if (!newer.empty()) {
+      repaired = send_control(MessageType::SYNC_NEWER, newer, frame.source_id) && repaired;
+    }
+    return repaired;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_sync_keys: " << e.what();
+    return false;
+  }
+}
+
+//==============================================
+// Inventory exchange
+//==============================================
+
+std::map<uint8_t, std::string> FileServer::peers_lacking(const std::string& filename,
+                                                        const std::vector<uint8_t>& peers) {
+  std::map<uint8_t, std::string> lacking;
+  std::string digest = store_->content_digest(filename);
+  std::uintmax_t size = store_->get_file_size(filename);
+  if (peers.empty() || digest.empty() || size < HAVE_QUERY_MIN_SIZE) {
+    for (uint8_t peer_id : peers) {
+      lacking[peer_id];
+    }
+    return lacking;
+  }
+
+  tracing::Span span("have query", filename);
+  std::string body = digest;
+  append_u64(body, size);
+  body += filename;
+  {
+    std::lock_guard<std::mutex> lock(have_mutex_);
+    have_queries_[filename] = HaveQuery{digest, {}};
+  }
+  std::size_t asked = 0;
+  for (uint8_t peer_id : peers) {
+    asked += send_control(MessageType::HAVE_QUERY, body, peer_id) ? 1 : 0;
+  }
+
+  // Peers that do not answer in time, e.g. ones without inventory support, are sent the file
+  std::map<uint8_t, HaveReply> replies;
+  {
+    std::unique_lock<std::mutex> lock(have_mutex_);
+    have_cv_.wait_for(lock, HAVE_QUERY_TIMEOUT, [&] { return have_queries_[filename].replies.size() >= asked; });
+    replies = std::move(have_queries_[filename].replies);
+    have_queries_.erase(filename);
+  }
+
+  auto& stats = file_server_metrics();
+  for (uint8_t peer_id : peers) {
+    auto reply = replies.find(peer_id);
+    if (reply == replies.end()) {
+      stats.have_timeouts.inc();
+      lacking[peer_id];
+    } else if (!reply->second.have) {
+      stats.have_misses.inc();
+      lacking[peer_id] = std::move(reply->second.signatures);
+    } else {
+      stats.have_hits.inc();
+      stats.have_bytes_skipped.inc(size);
+    }
+  }
+  DFS_LOG(info) << "File server: " << peers.size() - lacking.size() << " of " << peers.size()
+                << " peers already hold " << filename;
+  return lacking;
+}
+
+bool FileServer::handle_have_query(const MessageFrame& frame) {
+  try {
+    std::string body = extract_filename(frame);
+    BodyReader reader(body);
+    InventoryWork query{frame.source_id, std::string(), reader.bytes(64), reader.u64()};
+    query.key = reader.rest();
+
+    if (store_->content_digest(query.key) == query.digest && store_->get_file_size(query.key) == query.size) {
+      return send_have_reply(query.peer_id, HAVE_CONTENT, query.digest, query.key, std::string());
+    }
+
+    // Copying from another local key and computing signatures read whole
+    // files, which the worker does instead of the listener
+    std::string source = store_->find_by_digest(query.digest);
+    bool copyable = !source.empty() && source != query.key && store_->get_file_size(source) == query.size;
+    bool older = store_->has(query.key) && store_->get_file_size(query.key) >= HAVE_QUERY_MIN_SIZE;
+    if (!copyable && !older) {
+      return send_have_reply(query.peer_id, HAVE_MISSING, query.digest, query.key, std::string());
+    }
+    {
+      std::lock_guard<std::mutex> lock(inventory_mutex_);
+      inventory_work_.push_back(std::move(query));
+    }
+    inventory_cv_.notify_one();
+    return true;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_have_query: " << e.what();
+    return false;
+  }
+}
+
+void FileServer::inventory_loop() {
+  std::unique_lock<std::mutex> lock(inventory_mutex_);
+  while (running_) {
+    if (inventory_work_.empty()) {
+      inventory_cv_.wait(lock);
+      continue;
+    }
+    InventoryWork query = std::move(inventory_work_.front());
+    inventory_work_.pop_front();
+    lock.unlock();
+    if (!answer_have_query(query)) {
+      DFS_LOG(error) << "File server: Failed to answer have query for " << query.key;
+    }
+    lock.lock();
+  }
+}
+
+bool FileServer::answer_have_query(const InventoryWork& query) {
+  try {
+    const std::string& key = query.key;
+    const std::string& digest = query.digest;
+    bool have = store_->content_digest(key) == digest && store_->get_file_size(key) == query.size;
+    if (!have) {
+      // Identical content under another key is copied locally instead of over the network
+      std::string source = store_->find_by_digest(digest);
+      if (!source.empty() && source != key && store_->get_file_size(source) == query.size) {
+        auto input = store_->get_stream(source);
+        {
+          std::lock_guard<std::mutex> lock(arrival_mutex_);
+          store_->store(key, *input);
+        }
+        arrival_cv_.notify_all();
+        have = store_->content_digest(key) == digest;
+        if (have) {
+          // The sender counts the answer as an acknowledgement
+          store_->sync(key);
+        }
+        file_server_metrics().have_local_copies.inc();
+        DFS_LOG(info) << "File server: Copied " << key << " from local " << source;
+      }
+    }
+
+    // An older version of the key lets the sender transfer just the changes
+    std::string signatures;
+    std::uintmax_t local_size = have || !store_->has(key) ? 0 : store_->get_file_size(key);
+    if (local_size >= HAVE_QUERY_MIN_SIZE) {
+      try {
+        auto input = store_->get_stream(key);
+        delta::compute_signatures(*input, local_size).write(signatures);
+      } catch (const std::exception& e) {
+        DFS_LOG(warning) << "File server: No signatures for " << key << ": " << e.what();
+        signatures.clear();
+      }
+    }
+
+    uint8_t state = have ? HAVE_CONTENT : signatures.empty() ? HAVE_MISSING : HAVE_OLDER;
+    return send_have_reply(query.peer_id, state, digest, key, signatures);
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in answer_have_query: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::send_have_reply(uint8_t peer_id, uint8_t state, const std::string& digest, const std::string& key,
+                                 const std::string& signatures) {
+  std::string reply(1, static_cast<char>(state));
+  reply += digest;
+  append_u32(reply, static_cast<uint32_t>(key.size()));
+  reply += key;
+  reply += signatures;
+  return send_control(MessageType::HAVE_REPLY, reply, peer_id);
+}
+
+bool FileServer::handle_have_reply(const MessageFrame& frame) {
+  try {
+    std::string body = extract_filename(frame);
+    BodyReader reader(body);
+    uint8_t state = static_cast<uint8_t>(reader.bytes(1)[0]);
+    std::string digest = reader.bytes(64);
+    std::string key = reader.bytes(reader.u32());
+    HaveReply reply{state == HAVE_CONTENT, state == HAVE_OLDER ? reader.rest() : std::string()};
+    {
+      std::lock_guard<std::mutex> lock(have_mutex_);
+      auto query = have_queries_.find(key);
+      // Late answers to a query that already timed out are dropped
+      if (query == have_queries_.end() || query->second.digest != digest) {
+        return true;
+      }
+      query->second.replies[frame.source_id] = std::move(reply);
+    }
+    have_cv_.notify_all();
+    return true;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_have_reply: " << e.what();
+    return false;
+  }
+}
+
+//==============================================
+// Delta transfer
+//==============================================
+
+bool FileServer::send_delta(const std::string& filename, uint8_t peer_id, const std::string& signatures) {
+  auto& stats = file_server_metrics();
+  try {
+    tracing::Span span("send delta", filename);
+    delta::Signatures basis = delta::Signatures::parse(signatures);
+    std::uintmax_t size = store_->get_file_size(filename);
+    std::string digest = store_->content_digest(filename);
+    auto input = store_->get_stream(filename);
+
+    // The delta is written to a spool object and streamed from there like a
+    // file, one per peer since workers send to several at once
+    std::string spool = spool_key(filename, "delta" + std::to_string(peer_id));
+    delta::DeltaStats result;
+    store_->store_output(spool, [&](std::ostream& changes) { result = delta::generate(basis, *input, changes); });
+    std::uintmax_t encoded = store_->get_file_size(spool);
+    if (encoded * 100 > size * DELTA_MAX_PERCENT) {
+      store_->remove(spool);
+      stats.delta_too_large.inc();
+      DFS_LOG(info) << "File server: Delta of " << filename << " for peer " << static_cast<int>(peer_id)
+                    << " is " << encoded << " bytes, sending the whole file";
+      return false;
+    }
+
+    std::string header = digest;
+    append_u32(header, static_cast<uint32_t>(filename.size()));
+    header += filename;
+    bool sent = prepare_and_send(spool, MessageType::DELTA_FILE, peer_id, header);
+    store_->remove(spool);
+    if (!sent) {
+      return false;
+    }
+    stats.delta_sent.inc();
+    stats.delta_bytes_saved.inc(size - encoded);
+    DFS_LOG(info) << "File server: Sent " << filename << " to peer " << static_cast<int>(peer_id) << " as a "
+                  << encoded << " byte delta, " << result.copied_bytes << " bytes reused";
+    return true;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in send_delta: " << e.what();
+    std::string spool = spool_key(filename, "delta" + std::to_string(peer_id));
+    if (store_->has(spool)) {
+      store_->remove(spool);
+    }
+    return false;
+  }
+}
+
+bool FileServer::handle_delta(const MessageFrame& frame) {
+  auto& stats = file_server_metrics();
+  try {
+    if (!frame.payload_stream || !frame.payload_stream->good()) {
+      DFS_LOG(error) << "File server: Invalid payload stream in message frame";
+      return false;
+    }
+    // Leaves the payload stream at the delta
+    std::string body = extract_filename(frame);
+    BodyReader reader(body);
+    std::string digest = reader.bytes(64);
+    std::string key = reader.bytes(reader.u32());
+
+    // The new version is rebuilt into the store's temporary file, and only
+    // installed when it has the digest, since the old version may have
+    // changed since its signatures were sent
+    bool rebuilt = false;
+    try {
+      auto basis = store_->get_stream(key);
+      rebuilt = store_->store_output(
+        key, [&](std::ostream& output) { delta::apply(*basis, *frame.payload_stream, output); }, digest);
+    } catch (const std::exception& e) {
+      DFS_LOG(warning) << "File server: Failed to apply delta of " << key << ": " << e.what();
+    }
+    if (!rebuilt) {
+      stats.delta_rejected.inc();
+      DFS_LOG(warning) << "File server: Delta of " << key << " did not rebuild it, requesting the whole file";
+      return prepare_and_send(key, MessageType::GET_FILE, frame.source_id);
+    }
+
+    // Readers waiting for the key check it under the lock before they sleep
+    {
+      std::lock_guard<std::mutex> lock(arrival_mutex_);
+    }
+    arrival_cv_.notify_all();
+    stats.delta_applied.inc();
+    DFS_LOG(info) << "File server: Rebuilt " << key << " from a delta";
+    return send_store_ack(key, frame.source_id);
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_delta: " << e.what();
+    return false;
+  }
+}
+
+//==============================================
+// Read-through caching
+//==============================================
+
+bool FileServer::handle_get_if_none_match(const MessageFrame& frame) {
+  OpRecorder op(file_server_metrics().handle_get);
+  try {
+    store::Store::ObjectVersion cached;
+    std::string filename = decode_version(extract_filename(frame), cached);
+
+    // Only full copies answer, cached ones may be stale themselves
+    if (!store_->has(filename)) {
+      DFS_LOG(info) << "File server: File not found locally: " << filename;
+      return send_control(MessageType::NOT_HELD, encode_version(filename, cached), frame.source_id) &&
+             op.succeed();
+    }
+
+    store::Store::ObjectVersion current = store_->version(filename);
+    if (!current.digest.empty() && current.digest == cached.digest) {
+      DFS_LOG(debug) << "File server: Cached copy of " << filename << " on peer "
+                     << static_cast<int>(frame.source_id) << " is current";
+      return send_control(MessageType::NOT_MODIFIED, encode_version(filename, current), frame.source_id) &&
+             op.succeed();
+    }
+
+    if (!prepare_and_send(filename, MessageType::CACHED_FILE, frame.source_id, encode_version(filename, current))) {
+      DFS_LOG(error) << "File server: Failed to prepare file: " << filename;
+      return false;
+    }
+    return op.succeed();
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_get_if_none_match: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::handle_not_modified(const MessageFrame& frame) {
+  try {
+    store::Store::ObjectVersion version;
+    std::string filename = decode_version(extract_filename(frame), version);
+    {
+      std::lock_guard<std::mutex> lock(arrival_mutex_);
+      auto pending = conditional_gets_.find(filename);
+      // Later answers to the same get are not needed
+      if (pending == conditional_gets_.end() || pending->second) {
+        return true;
+      }
+      {
+        std::lock_guard<std::mutex> copies_lock(popularity_mutex_);
+        auto copy = cached_copies_.find(filename);
+        if (copy == cached_copies_.end() || copy->second.digest != version.digest) {
+          DFS_LOG(debug) << "File server: Cached copy of " << filename << " changed during revalidation";
+          return true;
+        }
+        if (copy->second.generation != version.generation) {
+          copy->second.generation = version.generation;
+          save_cached_copies();
+        }
+      }
+      pending->second = MessageType::NOT_MODIFIED;
+    }
+    // Counted before the reader wakes, so the count is in place once it returns
+    file_server_metrics().not_modified.inc();
+    arrival_cv_.notify_all();
+    DFS_LOG(info) << "File server: Cached copy of " << filename << " is current";
+    return true;
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_not_modified: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::handle_not_held(const MessageFrame& frame) {
+  try {
+    store::Store::ObjectVersion version;
+    std::string filename = decode_version(extract_filename(frame), version);
+    {
+      std::lock_guard<std::mutex> lock(arrival_mutex_);
+      auto pending = conditional_gets_.find(filename);
+      if (pending == conditional_gets_.end() || pending->second) {
+        return true;
+      }
+      pending->second = MessageType::NOT_HELD;
+    }
+    arrival_cv_.notify_all();
+    DFS_LOG(debug) << "File server: Peer " << static_cast<int>(frame.source_id) << " holds no copy of " << filename;
+    return true;
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_not_held: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::handle_cached_file(const MessageFrame& frame) {
+  OpRecorder op(file_server_metrics().handle_store);
+  try {
+    if (!frame.payload_stream || !frame.payload_stream->good()) {
+      DFS_LOG(error) << "File server: Invalid payload stream in message frame";
+      return false;
+    }
+    // Leaves the payload stream at the file content
+    store::Store::ObjectVersion version;
+    std::string filename = decode_version(extract_filename(frame), version);
+
+    bool modified = false;
+    {
+      std::lock_guard<std::mutex> lock(arrival_mutex_);
+      auto pending = conditional_gets_.find(filename);
+      if (pending == conditional_gets_.end() || pending->second) {
+        DFS_LOG(debug) << "File server: Ignoring unrequested copy of " << filename;
+        return op.succeed();
+      }
+      store::Store::ObjectVersion cached = cached_version(filename);
+      if (cached.digest != version.digest || !store_->has(cache_key(filename))) {
+        modified = !cached.digest.empty();
+        add_cached_copy(filename, *frame.payload_stream, version);
+      }
+      pending->second = MessageType::CACHED_FILE;
+    }
+    if (modified) {
+      file_server_metrics().modified.inc();
+      DFS_LOG(info) << "File server: Replaced the cached copy of changed file " << filename;
+    }
+    arrival_cv_.notify_all();
+    return op.succeed();
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_cached_file: " << e.what();
+    return false;
+  }
+}
+
+//==============================================
+// Hot key caching
+//==============================================
+
+void FileServer::set_hot_key_policy(double hot_reads, std::chrono::milliseconds half_life) {
+  if (hot_reads < 0 || half_life.count() <= 0) {
+    throw std::invalid_argument("File server: Invalid hot key policy");
+  }
+  {
+    std::lock_guard<std::mutex> lock(popularity_mutex_);
+    hot_reads_ = hot_reads;
+    read_half_life_ = half_life;
+  }
+  DFS_LOG(info) << "File server: Caching files read " << hot_reads << " times per "
+                << half_life.count() << " ms half-life";
+}
+
+std::size_t FileServer::sweep_cached_copies() {
+  std::vector<std::string> cold;
+  {
+    std::lock_guard<std::mutex> lock(popularity_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = cached_copies_.begin(); it != cached_copies_.end();) {
+      auto rate = read_rates_.find(it->first);
+      double reads = rate == read_rates_.end() ? 0.0 : current_reads(rate->second, now);
+      if (hot_reads_ == 0 || reads < hot_reads_ * COLD_READ_FRACTION) {
+        cold.push_back(it->first);
+        it = cached_copies_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto it = read_rates_.begin(); it != read_rates_.end();) {
+      bool forgotten = current_reads(it->second, now) < FORGOTTEN_READS && cached_copies_.count(it->first) == 0;
+      it = forgotten ? read_rates_.erase(it) : std::next(it);
+    }
+    if (!cold.empty()) {
+      save_cached_copies();
+    }
+  }
+
+  for (const auto& filename : cold) {
+    try {
+      if (store_->has(cache_key(filename))) {
+        store_->remove(cache_key(filename));
+      }
+    } catch (const std::exception& e) {
+      DFS_LOG(warning) << "File server: Failed to drop cached copy of " << filename << ": " << e.what();
+    }
+  }
+  file_server_metrics().copies_dropped.inc(cold.size());
+  if (!cold.empty()) {
+    DFS_LOG(info) << "File server: Dropped " << cold.size() << " cached copies of files no longer read often";
+  }
+  return cold.size();
+}
+
+std::string FileServer::cache_key(const std::string& filename) {
+  return filename + CACHE_SUFFIX;
+}
+
+store::Store::ObjectVersion FileServer::cached_version(const std::string& filename) {
+  std::lock_guard<std::mutex> lock(popularity_mutex_);
+  auto it = cached_copies_.find(filename);
+  return it == cached_copies_.end() ? store::Store::ObjectVersion{} : it->second;
+}
+
+bool FileServer::record_read(const std::string& filename) {
+  std::lock_guard<std::mutex> lock(popularity_mutex_);
+  auto now = std::chrono::steady_clock::now();
+  auto [it, inserted] = read_rates_.try_emplace(filename, ReadRate{0.0, now});
+  it->second.reads = current_reads(it->second, now) + 1.0;
+  it->second.last = now;
+  return hot_reads_ > 0 && it->second.reads >= hot_reads_;
+}
+
+double FileServer::current_reads(const ReadRate& rate, std::chrono::steady_clock::time_point now) const {
+  std::chrono::duration<double> age = now - rate.last;
+  std::chrono::duration<double> half_life = read_half_life_;
+  return rate.reads * std::exp2(-age / half_life);
+}
+
+void FileServer::add_cached_copy(const std::string& filename, std::istream& content,
+                                 const store::Store::ObjectVersion& version) {
+  store_->store(cache_key(filename), content);
+  {
+    std::lock_guard<std::mutex> lock(popularity_mutex_);
+    cached_copies_[filename] = version;
+    save_cached_copies();
+  }
+  file_server_metrics().copies_cached.inc();
+  DFS_LOG(info) << "File server: Keeping a cached copy of " << filename;
+}
+
+void FileServer::drop_cached_copy(const std::string& filename) {
+  {
+    std::lock_guard<std::mutex> lock(popularity_mutex_);
+    if (cached_copies_.erase(filename) == 0) {
+      return;
+    }
+    save_cached_copies();
+  }
+  try {
+    if (store_->has(cache_key(filename))) {
+      store_->remove(cache_key(filename));
+    }
+  } catch (const std::exception& e) {
+    DFS_LOG(warning) << "File server: Failed to drop cached copy of " << filename << ": " << e.what();
+  }
+  file_server_metrics().copies_invalidated.inc();
+  DFS_LOG(info) << "File server: Dropped the cached copy of changed file " << filename;
+}
+
+void FileServer::load_cached_copies() {
+  if (!store_->has(CACHE_MANIFEST_KEY)) {
+    return;
+  }
+  // One "<length>:<filename> <generation> <digest>" line per cached file,
+  // "-" standing for the empty digest. Older lists end after the filename
+  auto manifest = store_->get_stream(CACHE_MANIFEST_KEY);
+  std::size_t length = 0;
+  std::lock_guard<std::mutex> lock(popularity_mutex_);
+  while (*manifest >> length && manifest->get() == ':') {
+    std::string filename(length, '\0');
+    store::Store::ObjectVersion version;
+    bool read = static_cast<bool>(manifest->read(filename.data(), static_cast<std::streamsize>(length)));
+    if (read && manifest->peek() == ' ') {
+      read = static_cast<bool>(*manifest >> version.generation >> version.digest);
+      if (version.digest == "-") {
+        version.digest.clear();
+      }
+    }
+    if (!read || manifest->get() != '\n') {
+      DFS_LOG(warning) << "File server: Ignoring damaged list of cached copies";
+      break;
+    }
+    cached_copies_[filename] = version;
+  }
+  DFS_LOG(info) << "File server: " << cached_copies_.size() << " cached copies from before the restart";
+}
+
+void FileServer::save_cached_copies() {
+  std::stringstream manifest;
+  for (const auto& [filename, version] : cached_copies_) {
+    manifest << filename.size() << ':' << filename << ' ' << version.generation << ' '
+             << (version.digest.empty() ? "-" : version.digest) << '\n';
+  }
+  try {
+    store_->store(CACHE_MANIFEST_KEY, manifest);
+  } catch (const std::exception& e) {
+    DFS_LOG(warning) << "File server: Failed to save the list of cached copies: " << e.what();
+  }
+}
+
+void FileServer::popularity_loop() {
+  std::unique_lock<std::mutex> lock(popularity_mutex_);
+  while (running_) {
+    if (popularity_cv_.wait_for(lock, CACHE_SWEEP_INTERVAL) == std::cv_status::timeout && running_) {
+      lock.unlock();
+      try {
+        sweep_cached_copies();
+      } catch (const std::exception& e) {
+        DFS_LOG(error) << "File server: Sweeping cached copies failed: " << e.what();
+      }
+      lock.lock();
+    }
+  }
+}
+
+//==============================================
+// Handling of incoming frames
+//==============================================
+
+void FileServer::channel_listener() {
+  DFS_LOG(info) << "File server: Starting channel listener";
+
+  while (running_) {
+    try {
+      MessageFrame frame;
+      // Try to consume a message from the channel
+      if (channel_.consume(frame)) {
+        DFS_LOG(debug) << "File server: Retrieved message from channel, type: " 
+                                 << static_cast<int>(frame.message_type);
+
+        // Handle the message
+        message_handler(frame);
+      }
+
+      // Small sleep to prevent busy waiting
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    catch (const std::exception& e) {
+      DFS_LOG(error) << "File server: Error in channel listener: " << e.what();
+    }
+  }
+}
+
+void FileServer::message_handler(const MessageFrame& frame) {
+  try {
+    DFS_LOG(info) << "File server: Handling message of type: " << static_cast<int>(frame.message_type);
+
+    // Handler work continues the trace the frame arrived with
+    tracing::TraceContext sender{frame.trace_id, frame.span_id};
+
+    // Route message to appropriate handler based on type
+    switch (frame.message_type) {
+      case MessageType::STORE_FILE: {
+        DFS_LOG(debug) << "File server: Forwarding to handle_store";
+        tracing::Span span("handle_store", sender);
+        if (!handle_store(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle store message";
+        }
+        break;
+      }
+
+      case MessageType::GET_FILE: {
+        DFS_LOG(debug) << "File server: Forwarding to handle_get";
+        tracing::Span span("handle_get", sender);
+        if (!handle_get(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle get message";
+        }
+        break;
+      }
+
+      case MessageType::SYNC_TREE: {
+        tracing::Span span("handle_sync_tree", sender);
+        if (!handle_sync_tree(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle sync tree message";
+        }
+        break;
+      }
+
+      case MessageType::SYNC_KEYS: {
+        tracing::Span span("handle_sync_keys", sender);
+        if (!handle_sync_keys(frame, true)) {
+          DFS_LOG(error) << "File server: Failed to handle sync keys message";
+        }
+        break;
+      }
+
+      case MessageType::SYNC_NEWER: {
+        tracing::Span span("handle_sync_newer", sender);
+        if (!handle_sync_keys(frame, false)) {
+          DFS_LOG(error) << "File server: Failed to handle sync newer message";
+        }
+        break;
+      }
+
+      case MessageType::HAVE_QUERY: {
+        tracing::Span span("handle_have_query", sender);
+        if (!handle_have_query(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle have query";
+        }
+        break;
+      }
+
+      case MessageType::HAVE_REPLY: {
+        if (!handle_have_reply(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle have reply";
+        }
+        break;
+      }
+
+      case MessageType::DELTA_FILE: {
+        tracing::Span span("handle_delta", sender);
+        if (!handle_delta(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle delta";
+        }
+        break;
+      }
+
+      case MessageType::GET_IF_NONE_MATCH: {
+        tracing::Span span("handle_get_if_none_match", sender);
+        if (!handle_get_if_none_match(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle conditional get";
+        }
+        break;
+      }
+
+      case MessageType::NOT_MODIFIED: {
+        if (!handle_not_modified(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle not modified reply";
+        }
+        break;
+      }
+
+      case MessageType::NOT_HELD: {
+        if (!handle_not_held(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle not held reply";
+        }
+        break;
+      }
+
+      case MessageType::CACHED_FILE: {
+        tracing::Span span("handle_cached_file", sender);
+        if (!handle_cached_file(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle cached file";
+        }
+        break;
+      }
+
+      case MessageType::STORE_ACK: {
+        if (!handle_store_ack(frame)) {
+          DFS_LOG(error) << "File server: Failed to handle store acknowledgement";
+        }
+        break;
+      }
+
+      case MessageType::DROP_FRAGMENTS: {
+        if (!handle_drop_fragments(frame)) {
+          DFS_LOG(error) << "File server: Failed to drop fragments";
+        }
+        break;
+      }
+
+      default:
+        DFS_LOG(warning) << "File server: Unknown message type: " << static_cast<int>(frame.message_type);
+        break;
+    }
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in message handler: " << e.what();
+  }
+}
+  
+bool FileServer::handle_store(const MessageFrame& frame) {
+  OpRecorder op(file_server_metrics().handle_store);
+  try {
+    DFS_LOG(info) << "File server: Handling store message frame";
+
+    // Validate payload stream
+    if (!frame.payload_stream || !frame.payload_stream->good()) {
+      DFS_LOG(error) << "File server: Invalid payload stream in message frame";
+      return false;
+    }
 
     // Extract filename from frame
     std::string filename;
     try {
       filename = extract_filename(frame);
     } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to extract filename: " << e.what();
+      DFS_LOG(error) << "File server: Failed to extract filename: " << e.what();
+      return false;
+    }
+
+    // Store the file using the Store class
+    try {
+      {
+        std::lock_guard<std::mutex> lock(arrival_mutex_);
+        // A late answer to a finished read would stay behind as a stray
+        // fragment, and be taken for part of a newer version by later reads
+        auto abandoned = abandoned_fragments_.find(filename);
+        if (abandoned != abandoned_fragments_.end()) {
+          bool late = std::chrono::steady_clock::now() - abandoned->second < NETWORK_GET_TIMEOUT;
+          abandoned_fragments_.erase(abandoned);
+          if (late) {
+            DFS_LOG(debug) << "File server: Dropping fragment that arrived after its read: " << filename;
+            return op.succeed();
+          }
+        }
+
+        // A fragment older than the one held is from a replaced version
+        if (is_fragment_key(filename)) {
+          auto held = fragment_header(filename);
+          auto incoming = peek_fragment_header(*frame.payload_stream);
+          if (held && incoming && incoming->generation < held->generation) {
+            DFS_LOG(info) << "File server: Dropping fragment of an older version: " << filename;
+            return op.succeed();
+          }
+        }
+
+        // A new fragment or copy means a new version, so a cached copy of the
+        // old one goes. Fragments this node asked for itself only arrive when
+        // it has no cached copy
+        drop_cached_copy(is_fragment_key(filename) ? filename.substr(0, filename.rfind("#frag")) : filename);
+        store_->store(filename, *frame.payload_stream);
+      }
+      arrival_cv_.notify_all();
+      DFS_LOG(info) << "File server: Successfully stored file: " << filename;
+    } catch (const std::exception& e) {
+      DFS_LOG(error) << "File server: Failed to store file: " << e.what();
+      return false;
+    }
+    // Fragments are not journaled, nobody waits for their acknowledgement
+    if (!is_fragment_key(filename) && !send_store_ack(filename, frame.source_id)) {
+      return false;
+    }
+    return op.succeed();
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "File server: Error in handle_store: " << e.what();
+    return false;
+  }
+}
+
+bool FileServer::handle_get(const MessageFrame& frame) {
+  OpRecorder op(file_server_metrics().handle_get);
+  try {
+    DFS_LOG(info) << "File server: Handling get message frame";
+
+    // Extract filename from frame
+    std::string filename;
+    try {
+      filename = extract_filename(frame);
+    } catch (const std::exception& e) {
+      DFS_LOG(error) << "File server: Failed to extract filename: " << e.what();
       return false;
     }
 
     // Check if file exists locally
     if (!store_->has(filename)) {
-      BOOST_LOG_TRIVIAL(info) << "File server: File not found locally: " << filename;
+      DFS_LOG(info) << "File server: File not found locally: " << filename;
       return false;
     }
 
     // Prepare file with GET_FILE message type and send to requesting peer
     if (!prepare_and_send(filename, MessageType::STORE_FILE, frame.source_id)) {
-      BOOST_LOG_TRIVIAL(error) << "File server: Failed to prepare file: " << filename;
+      DFS_LOG(error) << "File server: Failed to prepare file: " << filename;
       return false;
     }
 
-    BOOST_LOG_TRIVIAL(info) << "File server: Successfully handled get request for file: " << filename;
-    return true;
+    DFS_LOG(info) << "File server: Successfully handled get request for file: " << filename;
+    return op.succeed();
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "File server: Error in handle_get: " << e.what();
+    DFS_LOG(error) << "File server: Error in handle_get: " << e.what();
     return false;
   }
 }
@@ -430,7 +2660,7 @@ std::string FileServer::extract_filename(const MessageFrame& frame) {
     // Convert to string
     std::string filename(filename_buffer.begin(), filename_buffer.end());
 
-    BOOST_LOG_TRIVIAL(debug) << "File server: Successfully extracted filename: " << filename;
+    DFS_LOG(debug) << "File server: Successfully extracted filename: " << filename;
     return filename;
   }
   catch (const std::exception& e) {
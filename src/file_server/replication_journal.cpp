@@ -0,0 +1,291 @@
+#include "file_server/replication_journal.hpp"
+#include "logger/logger.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dfs {
+namespace network {
+
+namespace {
+
+// Flushes a file, or the entries of a directory, to disk the way Store::sync does
+bool sync_path(const std::filesystem::path& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  bool synced = fd >= 0 && ::fsync(fd) == 0;
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  return synced;
+}
+
+} // namespace
+
+//==============================================
+// Constructor
+//==============================================
+
+ReplicationJournal::ReplicationJournal(const std::filesystem::path& path,
+                                       std::chrono::milliseconds min_backoff,
+                                       std::chrono::milliseconds max_backoff)
+  : path_(path)
+  , min_backoff_(min_backoff)
+  , max_backoff_(max_backoff) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  replay();
+  compact();
+  if (pending_ > 0) {
+    DFS_LOG(info) << "Replication journal: " << pending_ << " sends pending from before the restart";
+  }
+}
+
+//==============================================
+// Queueing
+//==============================================
+
+std::size_t ReplicationJournal::append(const std::string& key, const std::vector<uint8_t>& peers,
+                                       const tracing::TraceContext& trace) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!log_.is_open()) {
+    log_.open(path_, std::ios::binary | std::ios::app);
+  }
+  std::size_t added = 0;
+  for (uint8_t peer_id : peers) {
+    auto& queue = peers_[peer_id];
+    auto first = queue.entries.begin() + (queue.busy ? 1 : 0);
+    bool queued = std::any_of(first, queue.entries.end(), [&](const Queued& entry) { return entry.key == key; });
+    if (queued) {
+      continue;
+    }
+    uint64_t seq = next_seq_++;
+    if (queue.entries.empty()) {
+      queue.failures = 0;
+      queue.due = Clock::time_point{};
+    }
+    queue.entries.push_back(Queued{seq, key, trace});
+    write_append_record(log_, seq, peer_id, key);
+    ++pending_;
+    ++records_;
+    ++added;
+  }
+  log_.flush();
+  // One sync per batch, the sends are on disk before the caller reports the store
+  if (added > 0 && !sync_path(path_)) {
+    DFS_LOG(error) << "Replication journal: Failed to sync " << path_.string();
+  }
+  return added;
+}
+
+//==============================================
+// Sending
+//==============================================
+
+std::vector<ReplicationJournal::Entry> ReplicationJournal::claim(const std::vector<uint8_t>& connected,
+                                                                 Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Peers that came back are retried right away instead of after their backoff
+  std::vector<uint8_t> ready;
+  for (auto& [peer_id, queue] : peers_) {
+    if (queue.entries.empty()) {
+      continue;
+    }
+    if (std::find(connected.begin(), connected.end(), peer_id) == connected.end()) {
+      queue.absent = true;
+      continue;
+    }
+    if (queue.absent) {
+      queue.absent = false;
+      queue.failures = 0;
+      queue.due = now;
+    }
+    if (!queue.busy && queue.due <= now && !in_flight_.count(queue.entries.front().key)) {
+      ready.push_back(peer_id);
+    }
+  }
+  if (ready.empty()) {
+    return {};
+  }
+
+  auto oldest = std::min_element(ready.begin(), ready.end(), [&](uint8_t a, uint8_t b) {
+    return peers_[a].entries.front().seq < peers_[b].entries.front().seq;
+  });
+  std::string key = peers_[*oldest].entries.front().key;
+  std::vector<Entry> batch;
+  for (uint8_t peer_id : ready) {
+    auto& queue = peers_[peer_id];
+    if (queue.entries.front().key == key) {
+      queue.busy = true;
+      batch.push_back(Entry{queue.entries.front().seq, peer_id, key, queue.entries.front().trace});
+    }
+  }
+  in_flight_[key] += batch.size();
+  return batch;
+}
+
+void ReplicationJournal::finish(const Entry& entry, bool sent, Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto in_flight = in_flight_.find(entry.key);
+  if (in_flight != in_flight_.end() && --in_flight->second == 0) {
+    in_flight_.erase(in_flight);
+  }
+  auto it = peers_.find(entry.peer_id);
+  if (it == peers_.end() || !it->second.busy || it->second.entries.front().seq != entry.seq) {
+    return;
+  }
+  auto& queue = it->second;
+  queue.busy = false;
+  if (!sent) {
+    ++queue.failures;
+    queue.due = now + backoff(queue.failures);
+    return;
+  }
+
+  queue.entries.pop_front();
+  queue.failures = 0;
+  queue.due = Clock::time_point{};
+  --pending_;
+  if (!log_.is_open()) {
+    log_.open(path_, std::ios::binary | std::ios::app);
+  }
+  log_ << "C " << entry.seq << '\n';
+  log_.flush();
+  if (!sync_path(path_)) {
+    DFS_LOG(warning) << "Replication journal: Failed to sync " << path_.string();
+  }
+  ++records_;
+  if (records_ > pending_ + COMPACT_SLACK) {
+    try {
+      compact();
+    } catch (const std::exception& e) {
+      DFS_LOG(warning) << "Replication journal: " << e.what();
+    }
+  }
+}
+
+//==============================================
+// State
+//==============================================
+
+std::size_t ReplicationJournal::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_;
+}
+
+std::size_t ReplicationJournal::pending(uint8_t peer_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = peers_.find(peer_id);
+  return it == peers_.end() ? 0 : it->second.entries.size();
+}
+
+std::optional<ReplicationJournal::Clock::time_point> ReplicationJournal::next_due(
+  const std::vector<uint8_t>& connected) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::optional<Clock::time_point> due;
+  for (uint8_t peer_id : connected) {
+    auto it = peers_.find(peer_id);
+    if (it == peers_.end() || it->second.entries.empty() || it->second.busy ||
+        in_flight_.count(it->second.entries.front().key)) {
+      continue;
+    }
+    // A peer that was missing is due as soon as it is claimed again
+    Clock::time_point at = it->second.absent ? Clock::time_point{} : it->second.due;
+    if (!due || at < *due) {
+      due = at;
+    }
+  }
+  return due;
+}
+
+//==============================================
+// Log
+//==============================================
+
+void ReplicationJournal::replay() {
+  std::map<uint64_t, std::pair<uint8_t, std::string>> live;
+  std::size_t records = 0;
+  std::ifstream log(path_, std::ios::binary);
+  char op;
+  while (log && log >> op) {
+    uint64_t seq = 0;
+    if (op == 'C' && log >> seq && log.get() == '\n') {
+      live.erase(seq);
+      ++records;
+      continue;
+    }
+    unsigned peer_id = 0;
+    std::size_t length = 0;
+    if (op != 'A' || !(log >> seq >> peer_id >> length) || log.get() != ':' || peer_id > 0xff) {
+      DFS_LOG(warning) << "Replication journal: Ignoring damaged log after " << records << " records";
+      break;
+    }
+    std::string key(length, '\0');
+    if (!log.read(key.data(), static_cast<std::streamsize>(length)) || log.get() != '\n') {
+      DFS_LOG(warning) << "Replication journal: Ignoring damaged log after " << records << " records";
+      break;
+    }
+    live[seq] = {static_cast<uint8_t>(peer_id), std::move(key)};
+    next_seq_ = std::max(next_seq_, seq + 1);
+    ++records;
+  }
+
+  for (auto& [seq, entry] : live) {
+    peers_[entry.first].entries.push_back(Queued{seq, std::move(entry.second), {}});
+  }
+  pending_ = live.size();
+}
+
+void ReplicationJournal::compact() {
+  std::vector<std::pair<uint64_t, uint8_t>> order;
+  std::map<uint64_t, const std::string*> keys;
+  for (const auto& [peer_id, queue] : peers_) {
+    for (const auto& entry : queue.entries) {
+      order.emplace_back(entry.seq, peer_id);
+      keys[entry.seq] = &entry.key;
+    }
+  }
+  std::sort(order.begin(), order.end());
+
+  log_.close();
+  std::filesystem::path compacted_path = path_;
+  compacted_path += ".tmp";
+  {
+    std::ofstream compacted(compacted_path, std::ios::binary | std::ios::trunc);
+    for (const auto& [seq, peer_id] : order) {
+      write_append_record(compacted, seq, peer_id, *keys[seq]);
+    }
+    compacted.flush();
+    if (!compacted) {
+      log_.open(path_, std::ios::binary | std::ios::app);
+      throw std::runtime_error("Failed to compact replication log: " + compacted_path.string());
+    }
+  }
+  // The new log is on disk before it replaces the old one, and the rename after it
+  if (!sync_path(compacted_path)) {
+    log_.open(path_, std::ios::binary | std::ios::app);
+    throw std::runtime_error("Failed to sync replication log: " + compacted_path.string());
+  }
+  std::filesystem::rename(compacted_path, path_);
+  log_.open(path_, std::ios::binary | std::ios::app);
+  records_ = order.size();
+  std::filesystem::path directory = path_.has_parent_path() ? path_.parent_path() : std::filesystem::path(".");
+  if (!sync_path(directory)) {
+    throw std::runtime_error("Failed to sync replication log directory: " + directory.string());
+  }
+}
+
+void ReplicationJournal::write_append_record(std::ostream& log, uint64_t seq, uint8_t peer_id,
+                                             const std::string& key) {
+  log << "A " << seq << ' ' << static_cast<unsigned>(peer_id) << ' ' << key.size() << ':' << key << '\n';
+}
+
+std::chrono::milliseconds ReplicationJournal::backoff(unsigned failures) const {
+  std::chrono::milliseconds delay = min_backoff_;
+  for (unsigned i = 1; i < failures && delay < max_backoff_; ++i) {
+    delay *= 2;
+  }
+  return std::min(delay, max_backoff_);
+}
+
+} // namespace network
+} // namespace dfs
@@ -0,0 +1,101 @@
+#include "logger/async_log_backend.hpp"
+#include <chrono>
+
+namespace dfs::crypto {
+
+//==============================================
+// CONSTRUCTOR AND DESTRUCTOR
+//==============================================
+
+AsyncLogBackend::AsyncLogBackend(std::shared_ptr<std::ostream> output, std::size_t queue_capacity)
+  : output_(std::move(output))
+  , ring_(queue_capacity) {
+  writer_ = std::thread(&AsyncLogBackend::writer_loop, this);
+}
+
+AsyncLogBackend::~AsyncLogBackend() {
+  stop();
+}
+
+
+//==============================================
+// SINK BACKEND INTERFACE
+//==============================================
+
+void AsyncLogBackend::consume(const boost::log::record_view&, const string_type& message) {
+  std::string line;
+  line.reserve(message.size() + 1);
+  line.append(message).push_back('\n');
+
+  // Never wait for the writer, a full ring costs the record instead
+  if (!running_.load(std::memory_order_relaxed) || !ring_.try_push(std::move(line))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void AsyncLogBackend::flush() {
+  std::uint64_t target = ring_.pushed();
+  while (written_.load(std::memory_order_acquire) < target && running_.load(std::memory_order_relaxed)) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+
+//==============================================
+// CONTROL METHODS
+//==============================================
+
+void AsyncLogBackend::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+
+//==============================================
+// WRITER THREAD
+//==============================================
+
+void AsyncLogBackend::writer_loop() {
+  while (running_.load(std::memory_order_relaxed)) {
+    if (drain() == 0) {
+      // Idle writer polls rather than making producers signal it
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  // Records queued before stop() are still written
+  drain();
+}
+
+std::size_t AsyncLogBackend::drain() {
+  std::size_t count = 0;
+  std::string line;
+  // Claimed slots may not be filled yet, so stop at the first empty one
+  while (ring_.try_pop(line)) {
+    output_->write(line.data(), static_cast<std::streamsize>(line.size()));
+    ++count;
+  }
+
+  if (report_drops() || count > 0) {
+    output_->flush();
+    written_.fetch_add(count, std::memory_order_release);
+  }
+  return count;
+}
+
+bool AsyncLogBackend::report_drops() {
+  std::uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  if (dropped == reported_drops_) {
+    return false;
+  }
+  *output_ << "[async log] " << (dropped - reported_drops_)
+           << " records dropped, queue full (" << dropped << " total)\n";
+  reported_drops_ = dropped;
+  return true;
+}
+
+} // namespace dfs::crypto
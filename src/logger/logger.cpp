@@ -0,0 +1,89 @@
+#include "logger/logger.hpp"
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
+#include <boost/log/support/date_time.hpp>
+#include <boost/log/utility/setup/common_attributes.hpp>
+#include "logger/async_log_backend.hpp"
+
+namespace dfs::crypto {
+
+namespace {
+
+using AsyncSink = boost::log::sinks::unlocked_sink<AsyncLogBackend>;
+
+// Sink installed by init(), guarded so init and shutdown can race safely
+std::mutex sink_mutex;
+boost::shared_ptr<AsyncSink> async_sink;
+
+} // namespace
+
+//==============================================
+// INITIALIZATION AND TEARDOWN
+//==============================================
+
+void Logger::init(const std::string& log_file, std::size_t queue_capacity) {
+  namespace logging = boost::log;
+  namespace expr = boost::log::expressions;
+
+  shutdown();
+
+  // Add common attributes
+  logging::add_common_attributes();
+
+  std::shared_ptr<std::ostream> output;
+  if (log_file.empty()) {
+    // Console output is shared, the backend must not close it
+    output = std::shared_ptr<std::ostream>(&std::clog, [](std::ostream*) {});
+  } else {
+    output = std::make_shared<std::ofstream>(log_file, std::ios::app);
+  }
+
+  auto backend = boost::make_shared<AsyncLogBackend>(output, queue_capacity);
+  auto sink = boost::make_shared<AsyncSink>(backend);
+  sink->set_formatter(
+    expr::stream
+      << "[" << expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S")
+      << "] [" << logging::trivial::severity
+      << "] " << expr::smessage
+  );
+
+  // Records below the compiled-in minimum never reach the core anyway
+  sink->set_filter(logging::trivial::severity >= static_cast<logging::trivial::severity_level>(DFS_LOG_MIN_LEVEL));
+
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  async_sink = sink;
+  logging::core::get()->add_sink(sink);
+}
+
+void Logger::flush() {
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  if (async_sink) {
+    async_sink->locked_backend()->flush();
+  }
+}
+
+void Logger::shutdown() {
+  boost::shared_ptr<AsyncSink> sink;
+  {
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    sink.swap(async_sink);
+  }
+  if (!sink) {
+    return;
+  }
+
+  // Removing the sink first stops new records, the backend then drains the rest
+  boost::log::core::get()->remove_sink(sink);
+  sink->locked_backend()->stop();
+}
+
+std::uint64_t Logger::dropped_records() {
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  return async_sink ? async_sink->locked_backend()->dropped() : 0;
+}
+
+} // namespace dfs::crypto
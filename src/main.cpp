@@ -1,5 +1,11 @@
 #include "network/bootstrap.hpp"
+#include "logger/logger.hpp"
+#include "metrics/metrics_server.hpp"
+#include "tracing/tracer.hpp"
+#include <cctype>
+#include <chrono>
 #include <vector>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <random>
@@ -8,6 +14,21 @@
 struct ProgramOptions {
   std::string host;
   uint16_t port{0};
+  std::string log_file;
+  uint16_t metrics_port{0};
+  std::string trace_file;
+  std::string batch_file;
+  std::size_t concurrency{1};
+  // Erasure coding layout, 0 parity fragments keeps full replication
+  std::size_t data_fragments{0};
+  std::size_t parity_fragments{0};
+  // Seconds between anti-entropy exchanges with peers, 0 turns them off
+  std::size_t sync_seconds{60};
+  // Peer acknowledgements a store waits for, 0 returns once stored locally
+  std::size_t write_quorum{0};
+  // Capacity tier directory, and the bytes the store directory keeps before demoting
+  std::string capacity_tier;
+  std::uintmax_t fast_tier_bytes{0};
   bool valid{false};
 };
 
@@ -18,11 +39,48 @@ uint32_t generate_random_peer_id() {
   return dis(gen);
 }
 
+// Byte count with an optional K, M or G suffix, 0 when malformed
+std::uintmax_t parse_size(const std::string& value) {
+  std::size_t end = 0;
+  std::uintmax_t size = 0;
+  try {
+    size = std::stoull(value, &end);
+  } catch (...) {
+    return 0;
+  }
+  std::string suffix = value.substr(end);
+  if (suffix.empty()) {
+    return size;
+  }
+  if (suffix.size() != 1) {
+    return 0;
+  }
+  switch (std::toupper(static_cast<unsigned char>(suffix[0]))) {
+    case 'K': return size << 10;
+    case 'M': return size << 20;
+    case 'G': return size << 30;
+    default: return 0;
+  }
+}
+
 void print_usage(const std::string& program_name) {
-  std::cerr << "Usage: " << program_name << " -h <host> -p <port>\n"
+  std::cerr << "Usage: " << program_name << " -h <host> -p <port> [-l <log file>] [-m <metrics port>] [-t <trace file>]\n"
+        << "       [-e <k>+<m>] [-s <seconds>] [-w <peers>] [-T <dir> -F <size>] [-b <script|-> [-c <concurrency>]]\n"
         << "Required arguments:\n"
         << "  -h, --host    Host address\n"
         << "  -p, --port    Port number\n"
+        << "Optional arguments:\n"
+        << "  -l, --log     Log file, logs go to the console when omitted\n"
+        << "  -m, --metrics Serve Prometheus metrics on 127.0.0.1:<port>/metrics\n"
+        << "  -t, --trace   Write request traces to a Chrome trace JSON file\n"
+        << "  -e, --erasure Store files as k data + m parity fragments on k+m nodes\n"
+        << "  -s, --sync    Seconds between anti-entropy repairs with peers, 0 disables (default 60)\n"
+        << "  -w, --write-quorum Peers that must acknowledge a store before it returns (default 0)\n"
+        << "  -T, --tier    Capacity tier directory cold objects are moved to\n"
+        << "  -F, --fast-size Bytes the store directory holds before demoting, with K, M or G suffix\n"
+        << "  -b, --batch   Run shell commands from a script, - for stdin, then exit.\n"
+        << "                read writes raw content to stdout, timings go to stderr\n"
+        << "  -c, --concurrency Commands run in parallel in batch mode (default 1)\n"
         << "Example: " << program_name << " -h 127.0.0.1 -p 3001\n";
 }
 
@@ -31,7 +89,27 @@ ProgramOptions parse_command_line(int argc, char* argv[]) {
     {"-h", nullptr},
     {"--host", nullptr},
     {"-p", nullptr},
-    {"--port", nullptr}
+    {"--port", nullptr},
+    {"-l", nullptr},
+    {"--log", nullptr},
+    {"-m", nullptr},
+    {"--metrics", nullptr},
+    {"-t", nullptr},
+    {"--trace", nullptr},
+    {"-e", nullptr},
+    {"--erasure", nullptr},
+    {"-s", nullptr},
+    {"--sync", nullptr},
+    {"-w", nullptr},
+    {"--write-quorum", nullptr},
+    {"-T", nullptr},
+    {"--tier", nullptr},
+    {"-F", nullptr},
+    {"--fast-size", nullptr},
+    {"-b", nullptr},
+    {"--batch", nullptr},
+    {"-c", nullptr},
+    {"--concurrency", nullptr}
   };
 
   ProgramOptions options;
@@ -50,6 +128,70 @@ ProgramOptions parse_command_line(int argc, char* argv[]) {
 
     if (flag == "-h" || flag == "--host") {
       options.host = value;
+    } else if (flag == "-l" || flag == "--log") {
+      options.log_file = value;
+    } else if (flag == "-t" || flag == "--trace") {
+      options.trace_file = value;
+    } else if (flag == "-e" || flag == "--erasure") {
+      std::size_t plus = value.find('+');
+      try {
+        options.data_fragments = static_cast<std::size_t>(std::stoul(value.substr(0, plus)));
+        options.parity_fragments = plus == std::string::npos ? 0 : static_cast<std::size_t>(std::stoul(value.substr(plus + 1)));
+      } catch (...) {
+        options.parity_fragments = 0;
+      }
+      if (options.data_fragments == 0 || options.parity_fragments == 0 ||
+          options.data_fragments + options.parity_fragments > 256) {
+        std::cerr << "Error: Erasure coding needs <k>+<m> with k, m >= 1 and k + m <= 256\n";
+        print_usage(argv[0]);
+        return options;
+      }
+    } else if (flag == "-s" || flag == "--sync") {
+      try {
+        options.sync_seconds = static_cast<std::size_t>(std::stoul(value));
+      } catch (...) {
+        std::cerr << "Error: Invalid anti-entropy interval\n";
+        print_usage(argv[0]);
+        return options;
+      }
+    } else if (flag == "-w" || flag == "--write-quorum") {
+      try {
+        options.write_quorum = static_cast<std::size_t>(std::stoul(value));
+      } catch (...) {
+        std::cerr << "Error: Invalid write quorum\n";
+        print_usage(argv[0]);
+        return options;
+      }
+    } else if (flag == "-T" || flag == "--tier") {
+      options.capacity_tier = value;
+    } else if (flag == "-F" || flag == "--fast-size") {
+      options.fast_tier_bytes = parse_size(value);
+      if (options.fast_tier_bytes == 0) {
+        std::cerr << "Error: Invalid fast tier size\n";
+        print_usage(argv[0]);
+        return options;
+      }
+    } else if (flag == "-b" || flag == "--batch") {
+      options.batch_file = value;
+    } else if (flag == "-c" || flag == "--concurrency") {
+      try {
+        options.concurrency = static_cast<std::size_t>(std::stoul(value));
+      } catch (...) {
+        options.concurrency = 0;
+      }
+      if (options.concurrency == 0 || options.concurrency > 256) {
+        std::cerr << "Error: Concurrency must be between 1 and 256\n";
+        print_usage(argv[0]);
+        return options;
+      }
+    } else if (flag == "-m" || flag == "--metrics") {
+      try {
+        options.metrics_port = static_cast<uint16_t>(std::stoi(value));
+      } catch (...) {
+        std::cerr << "Error: Invalid metrics port number\n";
+        print_usage(argv[0]);
+        return options;
+      }
     } else if (flag == "-p" || flag == "--port") {
       try {
         options.port = static_cast<uint16_t>(std::stoi(value));
@@ -67,24 +209,54 @@ ProgramOptions parse_command_line(int argc, char* argv[]) {
     return options;
   }
 
+  if (options.capacity_tier.empty() != (options.fast_tier_bytes == 0)) {
+    std::cerr << "Error: Tiering needs both a capacity tier directory and a fast tier size\n";
+    print_usage(argv[0]);
+    return options;
+  }
+
   options.valid = true;
   return options;
 }
 
-bool run_bootstrap(const std::string& host, uint16_t port) {
+bool run_bootstrap(const ProgramOptions& options) {
   try {
     std::vector<uint8_t> KEY(32, 0x42);
     uint32_t peer_id = generate_random_peer_id();
-    dfs::network::Bootstrap peer(host, port, KEY, peer_id, {});  // Using random peer_id instead of 1
+    dfs::network::Bootstrap peer(options.host, options.port, KEY, peer_id, {});  // Using random peer_id instead of 1
     dfs::cli::CLI cli(peer.get_file_server().get_store(), peer.get_file_server());
+    if (options.parity_fragments > 0) {
+      peer.get_file_server().set_erasure_coding(options.data_fragments, options.parity_fragments);
+    }
+    peer.get_file_server().set_anti_entropy_interval(std::chrono::seconds(options.sync_seconds));
+    peer.get_file_server().set_write_quorum(options.write_quorum);
+    if (!options.capacity_tier.empty()) {
+      dfs::store::Store::TierConfig tiering;
+      tiering.capacity_path = options.capacity_tier;
+      tiering.fast_tier_bytes = options.fast_tier_bytes;
+      peer.get_file_server().get_store().set_tiering(tiering);
+    }
 
     if (!peer.start()) {
       std::cerr << "Error: Failed to start bootstrap\n";
       return false;
     }
 
-    cli.run();
-    return true;
+    if (options.batch_file.empty()) {
+      cli.run();
+      return true;
+    }
+
+    // Batch mode keeps stdout for file content
+    if (options.batch_file == "-") {
+      return cli.run_batch(std::cin, std::cout, std::cerr, options.concurrency);
+    }
+    std::ifstream script(options.batch_file);
+    if (!script) {
+      std::cerr << "Error: Failed to open batch script " << options.batch_file << '\n';
+      return false;
+    }
+    return cli.run_batch(script, std::cout, std::cerr, options.concurrency);
   } catch (const std::exception& e) {
     std::cerr << "Error: Failed to start bootstrap: " << e.what() << '\n';
     return false;
@@ -92,10 +264,31 @@ bool run_bootstrap(const std::string& host, uint16_t port) {
 }
 
 int main(int argc, char* argv[]) {
-  if (const auto options = parse_command_line(argc, argv); !options.valid) {
-    return 1;
-  } else if (!run_bootstrap(options.host, options.port)) {
+  const auto options = parse_command_line(argc, argv);
+  if (!options.valid) {
     return 1;
   }
-  return 0;
+
+  // Logging goes through the asynchronous sink so it never blocks the data path
+  dfs::crypto::Logger::init(options.log_file);
+
+  // Metrics are always collected, the endpoint is only opened on request
+  std::unique_ptr<dfs::metrics::MetricsServer> metrics_server;
+  if (options.metrics_port != 0) {
+    metrics_server = std::make_unique<dfs::metrics::MetricsServer>(
+      dfs::metrics::Registry::global(), options.metrics_port);
+    if (!metrics_server->start()) {
+      std::cerr << "Error: Failed to start metrics endpoint on port " << options.metrics_port << '\n';
+    }
+  }
+
+  if (!options.trace_file.empty() && !dfs::tracing::Tracer::start(options.trace_file)) {
+    std::cerr << "Error: Failed to open trace file " << options.trace_file << '\n';
+  }
+
+  bool success = run_bootstrap(options);
+  dfs::tracing::Tracer::shutdown();
+  metrics_server.reset();
+  dfs::crypto::Logger::shutdown();
+  return success ? 0 : 1;
 }
\ No newline at end of file
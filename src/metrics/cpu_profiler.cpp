@@ -0,0 +1,299 @@
+#include "metrics/cpu_profiler.hpp"
+#include "logger/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dfs {
+namespace metrics {
+
+namespace {
+
+// Data pages per CPU ring buffer, must be a power of two
+constexpr std::size_t RING_PAGES = 64;
+// How often the reader empties the ring buffers
+constexpr auto DRAIN_INTERVAL = std::chrono::milliseconds(20);
+
+int open_event(perf_event_attr& attr, pid_t tid, int cpu) {
+  return static_cast<int>(::syscall(SYS_perf_event_open, &attr, tid, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::vector<pid_t> process_threads() {
+  std::vector<pid_t> threads;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator("/proc/self/task", ec)) {
+    threads.push_back(static_cast<pid_t>(std::stol(entry.path().filename().string())));
+  }
+  return threads;
+}
+
+// Copies len bytes starting at a free running ring offset, handling wrap around
+void copy_from_ring(const char* data, std::size_t size, std::uint64_t offset, void* dest, std::size_t len) {
+  std::size_t start = offset & (size - 1);
+  std::size_t first = std::min(len, size - start);
+  std::memcpy(dest, data + start, first);
+  std::memcpy(static_cast<char*>(dest) + first, data, len - first);
+}
+
+std::string symbolize(std::uint64_t address) {
+  Dl_info info{};
+  if (::dladdr(reinterpret_cast<void*>(address), &info) != 0) {
+    if (info.dli_sname) {
+      int status = 0;
+      char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+      std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+      std::free(demangled);
+      return name;
+    }
+    if (info.dli_fname) {
+      char offset[32];
+      std::snprintf(offset, sizeof(offset), "+0x%llx",
+                    static_cast<unsigned long long>(address - reinterpret_cast<std::uint64_t>(info.dli_fbase)));
+      return std::filesystem::path(info.dli_fname).filename().string() + offset;
+    }
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), "0x%llx", static_cast<unsigned long long>(address));
+  return text;
+}
+
+} // namespace
+
+//==============================================
+// CONSTRUCTOR AND DESTRUCTOR
+//==============================================
+
+CpuProfiler::CpuProfiler(unsigned frequency)
+  : frequency_(frequency == 0 ? DEFAULT_FREQUENCY : frequency)
+  , page_size_(static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))) {}
+
+CpuProfiler::~CpuProfiler() {
+  stop();
+}
+
+
+//==============================================
+// SAMPLING
+//==============================================
+
+bool CpuProfiler::start() {
+  if (running_) {
+    DFS_LOG(warning) << "CPU profiler: Already running";
+    return false;
+  }
+
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_CPU_CLOCK;
+  attr.sample_freq = frequency_;
+  attr.freq = 1;
+  attr.sample_type = PERF_SAMPLE_CALLCHAIN;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.exclude_callchain_kernel = 1;
+
+  // Inherited events can only be mapped per CPU, so every thread gets one
+  // event per CPU and all events of a CPU write into that CPU's ring
+  long cpus = ::sysconf(_SC_NPROCESSORS_CONF);
+  std::vector<int> ring_of_cpu(static_cast<std::size_t>(std::max(cpus, 1L)), -1);
+  int last_error = 0;
+  for (pid_t tid : process_threads()) {
+    for (int cpu = 0; cpu < static_cast<int>(ring_of_cpu.size()); ++cpu) {
+      int fd = open_event(attr, tid, cpu);
+      if (fd < 0) {
+        // Exited threads and offline CPUs are expected, other errors are reported below
+        last_error = errno;
+        continue;
+      }
+
+      int& ring = ring_of_cpu[cpu];
+      if (ring < 0) {
+        std::size_t length = (RING_PAGES + 1) * page_size_;
+        void* base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+          last_error = errno;
+          ::close(fd);
+          continue;
+        }
+        ring = static_cast<int>(rings_.size());
+        rings_.push_back(Ring{fd, base, length});
+      } else if (::ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, rings_[ring].fd) != 0) {
+        last_error = errno;
+        ::close(fd);
+        continue;
+      }
+      events_.push_back(fd);
+    }
+  }
+
+  if (rings_.empty()) {
+    DFS_LOG(error) << "CPU profiler: perf_event_open failed: " << std::strerror(last_error)
+                   << " (check /proc/sys/kernel/perf_event_paranoid)";
+    release();
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stacks_.clear();
+    samples_ = 0;
+    lost_ = 0;
+  }
+
+  running_ = true;
+  reader_ = std::thread([this]() {
+    while (running_) {
+      std::this_thread::sleep_for(DRAIN_INTERVAL);
+      drain();
+    }
+  });
+  for (int fd : events_) {
+    ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  DFS_LOG(info) << "CPU profiler: Sampling at " << frequency_ << " Hz with "
+                << events_.size() << " events on " << rings_.size() << " CPUs";
+  return true;
+}
+
+void CpuProfiler::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  for (int fd : events_) {
+    ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  if (reader_.joinable()) {
+    reader_.join();
+  }
+  drain();
+  release();
+  DFS_LOG(info) << "CPU profiler: Stopped after " << samples() << " samples, " << lost() << " lost";
+}
+
+std::uint64_t CpuProfiler::samples() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return samples_;
+}
+
+std::uint64_t CpuProfiler::lost() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lost_;
+}
+
+void CpuProfiler::drain() {
+  for (auto& ring : rings_) {
+    drain_ring(ring);
+  }
+}
+
+void CpuProfiler::drain_ring(Ring& ring) {
+  auto* meta = static_cast<perf_event_mmap_page*>(ring.base);
+  const char* data = static_cast<const char*>(ring.base) + page_size_;
+  const std::size_t size = RING_PAGES * page_size_;
+
+  std::uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+  std::uint64_t tail = meta->data_tail;
+  std::vector<char> record;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (tail < head) {
+    perf_event_header header;
+    copy_from_ring(data, size, tail, &header, sizeof(header));
+    if (header.size < sizeof(header)) {
+      break;
+    }
+    record.resize(header.size);
+    copy_from_ring(data, size, tail, record.data(), header.size);
+    const char* body = record.data() + sizeof(header);
+
+    if (header.type == PERF_RECORD_SAMPLE) {
+      std::uint64_t count;
+      std::memcpy(&count, body, sizeof(count));
+      std::vector<std::uint64_t> stack;
+      stack.reserve(count);
+      for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint64_t address;
+        std::memcpy(&address, body + sizeof(count) + i * sizeof(address), sizeof(address));
+        // Context markers separate kernel and user frames
+        if (address < static_cast<std::uint64_t>(PERF_CONTEXT_MAX)) {
+          stack.push_back(address);
+        }
+      }
+      if (!stack.empty()) {
+        ++stacks_[stack];
+        ++samples_;
+      }
+    } else if (header.type == PERF_RECORD_LOST) {
+      std::uint64_t dropped;
+      std::memcpy(&dropped, body + sizeof(std::uint64_t), sizeof(dropped));
+      lost_ += dropped;
+    }
+    tail += header.size;
+  }
+  __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void CpuProfiler::release() {
+  for (auto& ring : rings_) {
+    ::munmap(ring.base, ring.length);
+  }
+  for (int fd : events_) {
+    ::close(fd);
+  }
+  rings_.clear();
+  events_.clear();
+}
+
+
+//==============================================
+// OUTPUT
+//==============================================
+
+std::size_t CpuProfiler::write_folded(std::ostream& output) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unordered_map<std::uint64_t, std::string> symbols;
+
+  // Stacks at different addresses of the same functions fold into one line
+  std::map<std::string, std::uint64_t> folded;
+  for (const auto& [stack, count] : stacks_) {
+    std::string line;
+    for (auto frame = stack.rbegin(); frame != stack.rend(); ++frame) {
+      // Outer frames hold return addresses, which may point past the caller
+      std::uint64_t address = frame == std::prev(stack.rend()) ? *frame : *frame - 1;
+      auto symbol = symbols.find(address);
+      if (symbol == symbols.end()) {
+        symbol = symbols.emplace(address, symbolize(address)).first;
+      }
+      if (!line.empty()) {
+        line += ';';
+      }
+      line += symbol->second;
+    }
+    folded[line] += count;
+  }
+
+  for (const auto& [line, count] : folded) {
+    output << line << ' ' << count << '\n';
+  }
+  return folded.size();
+}
+
+} // namespace metrics
+} // namespace dfs
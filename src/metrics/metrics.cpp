@@ -0,0 +1,324 @@
+#include "metrics/metrics.hpp"
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace dfs {
+namespace metrics {
+
+namespace {
+
+// Exposed bucket boundaries are whole powers of two within this range
+struct BucketRange {
+  unsigned min_exponent;
+  unsigned max_exponent;
+  double scale;
+};
+
+BucketRange range_for(HistogramUnit unit) {
+  switch (unit) {
+    case HistogramUnit::Seconds:
+      return {10, 35, 1e-9};
+    case HistogramUnit::Bytes:
+      return {6, 34, 1.0};
+  }
+  return {0, Histogram::MAX_EXPONENT, 1.0};
+}
+
+// Bucket index ignoring the off-by-one shift that makes bounds inclusive
+std::size_t raw_index(std::uint64_t value) {
+  if (value < Histogram::SUB_BUCKETS) {
+    return static_cast<std::size_t>(value);
+  }
+  unsigned exponent = 63 - static_cast<unsigned>(std::countl_zero(value));
+  if (exponent >= Histogram::MAX_EXPONENT) {
+    return Histogram::BUCKET_COUNT - 1;
+  }
+  std::size_t sub = (value >> (exponent - Histogram::SUB_BITS)) & (Histogram::SUB_BUCKETS - 1);
+  return (exponent - Histogram::SUB_BITS + 1) * Histogram::SUB_BUCKETS + sub;
+}
+
+// Smallest value mapped to a raw bucket
+std::uint64_t raw_lower_bound(std::size_t index) {
+  if (index < Histogram::SUB_BUCKETS) {
+    return index;
+  }
+  std::size_t group = index / Histogram::SUB_BUCKETS;
+  std::size_t sub = index % Histogram::SUB_BUCKETS;
+  unsigned shift = static_cast<unsigned>(group - 1);
+  return static_cast<std::uint64_t>(Histogram::SUB_BUCKETS + sub) << shift;
+}
+
+std::string format_number(double value) {
+  std::ostringstream out;
+  out.precision(12);
+  out << value;
+  return out.str();
+}
+
+std::string escape(const std::string& text, bool quote) {
+  std::string escaped;
+  escaped.reserve(text.size());
+  for (char c : text) {
+    if (c == '\\') {
+      escaped += "\\\\";
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else if (quote && c == '"') {
+      escaped += "\\\"";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// Label set without the braces, used as the series key
+std::string label_body(const Labels& labels) {
+  std::string body;
+  for (const auto& [key, value] : labels) {
+    if (!body.empty()) {
+      body += ',';
+    }
+    body += key + "=\"" + escape(value, true) + "\"";
+  }
+  return body;
+}
+
+std::string braces(const std::string& body) {
+  return body.empty() ? std::string() : "{" + body + "}";
+}
+
+} // namespace
+
+
+//==============================================
+// COUNTER
+//==============================================
+
+std::uint64_t Counter::value() const {
+  std::uint64_t total = 0;
+  for (const auto& shard : shards_) {
+    total += shard.value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+
+//==============================================
+// HISTOGRAM
+//==============================================
+
+Histogram::Histogram(HistogramUnit unit)
+  : unit_(unit)
+  , shards_(new Shard[SHARD_COUNT]) {}
+
+void Histogram::observe(std::uint64_t value) {
+  Shard& shard = shards_[thread_shard()];
+  shard.buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Histogram::observe_since(std::chrono::steady_clock::time_point start) {
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  observe(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+  Snapshot snapshot;
+  snapshot.buckets.assign(BUCKET_COUNT, 0);
+  for (std::size_t s = 0; s < SHARD_COUNT; ++s) {
+    const Shard& shard = shards_[s];
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+      snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+    }
+    snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+  }
+  // Count is derived from the buckets so the exposed series stay consistent
+  for (std::uint64_t bucket : snapshot.buckets) {
+    snapshot.count += bucket;
+  }
+  return snapshot;
+}
+
+std::size_t Histogram::bucket_index(std::uint64_t value) {
+  // Shifting by one makes every bucket inclusive of its upper bound, which
+  // is what the Prometheus le label means
+  return value == 0 ? 0 : raw_index(value - 1);
+}
+
+std::uint64_t Histogram::upper_bound(std::size_t index) {
+  if (index + 1 >= BUCKET_COUNT) {
+    return std::numeric_limits<std::uint64_t>::max();
+  }
+  return raw_lower_bound(index + 1);
+}
+
+std::uint64_t Histogram::Snapshot::percentile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  auto target = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(count)));
+  target = std::max<std::uint64_t>(target, 1);
+
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= target) {
+      return upper_bound(i);
+    }
+  }
+  return upper_bound(buckets.size() - 1);
+}
+
+
+//==============================================
+// METRIC LOOKUP
+//==============================================
+
+Registry& Registry::global() {
+  static Registry registry;
+  return registry;
+}
+
+Registry::Family& Registry::family(const std::string& name, const std::string& help, Type type) {
+  auto it = families_.find(name);
+  if (it == families_.end()) {
+    it = families_.emplace(name, Family{type, help, {}, {}, {}}).first;
+  } else if (it->second.type != type) {
+    throw std::invalid_argument("Metrics: " + name + " is already registered with another type");
+  }
+  return it->second;
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help,
+                           const Labels& labels, double scale) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& series = family(name, help, Type::Counter).counters[label_body(labels)];
+  if (!series) {
+    series = std::make_unique<Counter>(scale);
+  }
+  return *series;
+}
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help, const Labels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& series = family(name, help, Type::Gauge).gauges[label_body(labels)];
+  if (!series) {
+    series = std::make_unique<Gauge>();
+  }
+  return *series;
+}
+
+Histogram& Registry::histogram(const std::string& name, const std::string& help,
+                               HistogramUnit unit, const Labels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& series = family(name, help, Type::Histogram).histograms[label_body(labels)];
+  if (!series) {
+    series = std::make_unique<Histogram>(unit);
+  }
+  return *series;
+}
+
+
+//==============================================
+// COLLECTORS
+//==============================================
+
+std::size_t Registry::add_collector(Collector collector) {
+  std::lock_guard<std::mutex> lock(collectors_mutex_);
+  std::size_t id = next_collector_id_++;
+  collectors_.emplace(id, std::move(collector));
+  return id;
+}
+
+void Registry::remove_collector(std::size_t id) {
+  // Waits for a running exposition, so the collector's owner can be destroyed afterwards
+  std::lock_guard<std::mutex> lock(collectors_mutex_);
+  collectors_.erase(id);
+}
+
+
+//==============================================
+// EXPOSITION
+//==============================================
+
+void Registry::write_prometheus(std::ostream& output) {
+  {
+    // Collectors may create metrics, so they run before the registry lock is taken
+    std::lock_guard<std::mutex> lock(collectors_mutex_);
+    for (auto& [id, collector] : collectors_) {
+      collector();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& [name, family] : families_) {
+    output << "# HELP " << name << ' ' << escape(family.help, false) << '\n';
+    switch (family.type) {
+      case Type::Counter:
+        output << "# TYPE " << name << " counter\n";
+        for (const auto& [labels, counter] : family.counters) {
+          output << name << braces(labels) << ' ';
+          if (counter->scale() == 1.0) {
+            output << counter->value();
+          } else {
+            output << format_number(static_cast<double>(counter->value()) * counter->scale());
+          }
+          output << '\n';
+        }
+        break;
+      case Type::Gauge:
+        output << "# TYPE " << name << " gauge\n";
+        for (const auto& [labels, gauge] : family.gauges) {
+          output << name << braces(labels) << ' ' << gauge->value() << '\n';
+        }
+        break;
+      case Type::Histogram:
+        output << "# TYPE " << name << " histogram\n";
+        for (const auto& [labels, histogram] : family.histograms) {
+          write_histogram(output, name, labels, *histogram);
+        }
+        break;
+    }
+  }
+}
+
+std::string Registry::expose() {
+  std::ostringstream output;
+  write_prometheus(output);
+  return output.str();
+}
+
+void Registry::write_histogram(std::ostream& output, const std::string& name,
+                               const std::string& labels, const Histogram& histogram) {
+  BucketRange range = range_for(histogram.unit());
+  Histogram::Snapshot snapshot = histogram.snapshot();
+  std::string prefix = labels.empty() ? std::string() : labels + ",";
+
+  // Fine buckets are folded into one exposed bucket per power of two
+  std::uint64_t cumulative = 0;
+  std::size_t next = 0;
+  for (unsigned exponent = range.min_exponent; exponent <= range.max_exponent; ++exponent) {
+    std::size_t last = Histogram::bucket_index(std::uint64_t{1} << exponent);
+    for (; next <= last; ++next) {
+      cumulative += snapshot.buckets[next];
+    }
+    double bound = static_cast<double>(std::uint64_t{1} << exponent) * range.scale;
+    output << name << "_bucket{" << prefix << "le=\"" << format_number(bound) << "\"} "
+           << cumulative << '\n';
+  }
+  output << name << "_bucket{" << prefix << "le=\"+Inf\"} " << snapshot.count << '\n';
+  output << name << "_sum" << braces(labels) << ' '
+         << format_number(static_cast<double>(snapshot.sum) * range.scale) << '\n';
+  output << name << "_count" << braces(labels) << ' ' << snapshot.count << '\n';
+}
+
+std::string format_labels(const Labels& labels) {
+  return braces(label_body(labels));
+}
+
+} // namespace metrics
+} // namespace dfs
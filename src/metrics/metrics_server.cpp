@@ -0,0 +1,154 @@
+#include "metrics/metrics_server.hpp"
+#include "logger/logger.hpp"
+#include <sstream>
+
+namespace dfs {
+namespace metrics {
+
+namespace {
+
+// Requests larger than this are not scrapes and are dropped
+constexpr std::size_t MAX_REQUEST_SIZE = 8192;
+
+std::string http_response(const std::string& status, const std::string& content_type,
+                          const std::string& body) {
+  std::ostringstream response;
+  response << "HTTP/1.1 " << status << "\r\n"
+           << "Content-Type: " << content_type << "\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << body;
+  return response.str();
+}
+
+} // namespace
+
+//==============================================
+// CONSTRUCTOR AND DESTRUCTOR
+//==============================================
+
+MetricsServer::MetricsServer(Registry& registry, uint16_t port, const std::string& address)
+  : registry_(registry)
+  , port_(port)
+  , address_(address) {}
+
+MetricsServer::~MetricsServer() {
+  shutdown();
+}
+
+
+//==============================================
+// INITIALIZATION AND TEARDOWN
+//==============================================
+
+bool MetricsServer::start() {
+  if (is_running_) {
+    DFS_LOG(warning) << "Metrics server: Already running on port " << port_;
+    return false;
+  }
+
+  try {
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(address_), port_);
+    acceptor_ = std::make_unique<boost::asio::ip::tcp::acceptor>(io_context_, endpoint);
+    port_ = acceptor_->local_endpoint().port();
+    is_running_ = true;
+
+    io_context_.restart();
+    start_accept();
+    io_thread_ = std::make_unique<std::thread>([this]() {
+      try {
+        io_context_.run();
+      } catch (const std::exception& e) {
+        DFS_LOG(error) << "Metrics server: IO context error: " << e.what();
+      }
+    });
+
+    DFS_LOG(info) << "Metrics server: Serving metrics on http://" << address_ << ":" << port_ << "/metrics";
+    return true;
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "Metrics server: Failed to start on " << address_ << ":" << port_ << ": " << e.what();
+    return false;
+  }
+}
+
+void MetricsServer::shutdown() {
+  if (!is_running_.exchange(false)) {
+    return;
+  }
+
+  io_context_.stop();
+  if (io_thread_ && io_thread_->joinable()) {
+    io_thread_->join();
+  }
+  io_thread_.reset();
+
+  boost::system::error_code ec;
+  acceptor_->close(ec);
+  DFS_LOG(info) << "Metrics server: Stopped";
+}
+
+
+//==============================================
+// CONNECTION HANDLING
+//==============================================
+
+void MetricsServer::start_accept() {
+  auto socket = std::make_shared<boost::asio::ip::tcp::socket>(io_context_);
+  acceptor_->async_accept(*socket, [this, socket](const boost::system::error_code& ec) {
+    if (ec) {
+      if (ec != boost::asio::error::operation_aborted) {
+        DFS_LOG(warning) << "Metrics server: Accept error: " << ec.message();
+      }
+    } else {
+      handle_connection(socket);
+    }
+    if (is_running_) {
+      start_accept();
+    }
+  });
+}
+
+void MetricsServer::handle_connection(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
+  auto request = std::make_shared<boost::asio::streambuf>(MAX_REQUEST_SIZE);
+  boost::asio::async_read_until(*socket, *request, "\r\n\r\n",
+    [this, socket, request](const boost::system::error_code& ec, std::size_t) {
+      if (ec) {
+        DFS_LOG(debug) << "Metrics server: Dropped request: " << ec.message();
+        return;
+      }
+
+      std::istream input(request.get());
+      std::string request_line;
+      std::getline(input, request_line);
+      if (!request_line.empty() && request_line.back() == '\r') {
+        request_line.pop_back();
+      }
+
+      auto response = std::make_shared<std::string>(build_response(request_line));
+      boost::asio::async_write(*socket, boost::asio::buffer(*response),
+        [socket, response](const boost::system::error_code&, std::size_t) {
+          boost::system::error_code ignored;
+          socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+        });
+    });
+}
+
+std::string MetricsServer::build_response(const std::string& request_line) {
+  std::istringstream line(request_line);
+  std::string method, target;
+  line >> method >> target;
+
+  if (method != "GET") {
+    return http_response("405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+  }
+  // Query strings are accepted and ignored
+  std::string path = target.substr(0, target.find('?'));
+  if (path != "/metrics" && path != "/") {
+    return http_response("404 Not Found", "text/plain", "Metrics are served at /metrics\n");
+  }
+
+  return http_response("200 OK", "text/plain; version=0.0.4; charset=utf-8", registry_.expose());
+}
+
+} // namespace metrics
+} // namespace dfs
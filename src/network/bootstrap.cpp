@@ -1,5 +1,5 @@
 #include "network/bootstrap.hpp"
-#include <boost/log/trivial.hpp>
+#include "logger/logger.hpp"
 #include <sstream>
 
 namespace dfs {
@@ -14,38 +14,38 @@ Bootstrap::Bootstrap(const std::string& address, uint16_t port,
   , ID_(ID)
   , bootstrap_nodes_(bootstrap_nodes) {
 
-  BOOST_LOG_TRIVIAL(info) << "Initializing Bootstrap with ID: " << static_cast<int>(ID);
+  DFS_LOG(info) << "Initializing Bootstrap with ID: " << static_cast<int>(ID);
 
   try {
     // Create channel first (no dependencies)
     channel_ = std::make_unique<Channel>();
-    BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: Channel created successfully";
+    DFS_LOG(debug) << "Bootstrap program: Channel created successfully";
 
     // Create TCP server without peer manager initially
     tcp_server_ = std::make_unique<TCP_Server>(port_, address_, ID_);
-    BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: TCP Server created successfully";
+    DFS_LOG(debug) << "Bootstrap program: TCP Server created successfully";
 
     // Create peer manager with channel and tcp_server
     peer_manager_ = std::make_unique<PeerManager>(*channel_, *tcp_server_, key_);
-    BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: Peer Manager created successfully";
+    DFS_LOG(debug) << "Bootstrap program: Peer Manager created successfully";
 
     // Set peer manager in TCP server
     tcp_server_->set_peer_manager(*peer_manager_);
 
     // Create file server last as it depends on all other components
     file_server_ = std::make_unique<FileServer>(ID_, key_, *peer_manager_, *channel_, *tcp_server_);
-    BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: File Server created successfully";
+    DFS_LOG(debug) << "Bootstrap program: File Server created successfully";
 
-    BOOST_LOG_TRIVIAL(info) << "Bootstrap program: Successfully created all components";
+    DFS_LOG(info) << "Bootstrap program: Successfully created all components";
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Failed to initialize components: " << e.what();
+    DFS_LOG(error) << "Bootstrap program: Failed to initialize components: " << e.what();
     throw;
   }
 }
 
 bool Bootstrap::connect_to_bootstrap_nodes() {
-  BOOST_LOG_TRIVIAL(info) << "Bootstrap program: Connecting to bootstrap nodes...";
+  DFS_LOG(info) << "Bootstrap program: Connecting to bootstrap nodes...";
 
   bool all_connected = true;
 
@@ -58,7 +58,7 @@ bool Bootstrap::connect_to_bootstrap_nodes() {
 
       // Check if the node string has the correct format (address:port)
       if (delimiter_pos == std::string::npos) {
-        BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Invalid bootstrap node format: " << node;
+        DFS_LOG(error) << "Bootstrap program: Invalid bootstrap node format: " << node;
         all_connected = false;
         continue;
       }
@@ -74,7 +74,7 @@ bool Bootstrap::connect_to_bootstrap_nodes() {
       }
     }
     catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Error connecting to " << node << ": " << e.what();
+      DFS_LOG(error) << "Bootstrap program: Error connecting to " << node << ": " << e.what();
       all_connected = false;
     }
   }
@@ -86,65 +86,65 @@ bool Bootstrap::start() {
   try {
     // Start TCP server
     if (!tcp_server_->start_listener()) {
-      BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Failed to start TCP server";
+      DFS_LOG(error) << "Bootstrap program: Failed to start TCP server";
       return false;
     }
 
     // Connect to bootstrap nodes
     if (!bootstrap_nodes_.empty()) {
       if (!connect_to_bootstrap_nodes()) {
-        BOOST_LOG_TRIVIAL(warning) << "Bootstrap program: Failed to connect to some bootstrap nodes";
+        DFS_LOG(warning) << "Bootstrap program: Failed to connect to some bootstrap nodes";
         // Continue anyway as this might be expected in some cases
       }
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Bootstrap program: Bootstrap successfully started";
+    DFS_LOG(info) << "Bootstrap program: Bootstrap successfully started";
 
     return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Failed to start bootstrap: " << e.what();
+    DFS_LOG(error) << "Bootstrap program: Failed to start bootstrap: " << e.what();
     return false;
   }
 }
 
 bool Bootstrap::shutdown() {
   try {
-    BOOST_LOG_TRIVIAL(info) << "Bootstrap program: Initiating shutdown sequence";
+    DFS_LOG(info) << "Bootstrap program: Initiating shutdown sequence";
 
     // First shutdown file server as it depends on other components
     if (file_server_) {
-      BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: Shutting down File Server";
+      DFS_LOG(debug) << "Bootstrap program: Shutting down File Server";
       // File server cleanup handled by destructor
       file_server_.reset();
     }
 
     // Next shutdown peer manager as it depends on channel and tcp server
     if (peer_manager_) {
-      BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: Shutting down Peer Manager";
+      DFS_LOG(debug) << "Bootstrap program: Shutting down Peer Manager";
       // Peer manager cleanup handled by destructor
       peer_manager_.reset();
     }
 
     // Shutdown TCP server
     if (tcp_server_) {
-      BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: Shutting down TCP Server";
+      DFS_LOG(debug) << "Bootstrap program: Shutting down TCP Server";
       tcp_server_->shutdown();
       tcp_server_.reset();
     }
 
     // Finally shutdown channel as it has no dependencies
     if (channel_) {
-      BOOST_LOG_TRIVIAL(debug) << "Bootstrap program: Shutting down Channel";
+      DFS_LOG(debug) << "Bootstrap program: Shutting down Channel";
       // Channel cleanup handled by destructor
       channel_.reset();
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Bootstrap program: Shutdown complete";
+    DFS_LOG(info) << "Bootstrap program: Shutdown complete";
     return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Error during shutdown: " << e.what();
+    DFS_LOG(error) << "Bootstrap program: Error during shutdown: " << e.what();
     return false;
   }
 }
@@ -152,11 +152,11 @@ bool Bootstrap::shutdown() {
 Bootstrap::~Bootstrap() {
   try {
     if (!this->shutdown()) {
-      BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Failed to shutdown cleanly in destructor";
+      DFS_LOG(error) << "Bootstrap program: Failed to shutdown cleanly in destructor";
     }
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Bootstrap program: Error during destructor shutdown: " << e.what();
+    DFS_LOG(error) << "Bootstrap program: Error during destructor shutdown: " << e.what();
   }
 }
 
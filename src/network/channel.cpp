@@ -1,10 +1,42 @@
 #include "network/channel.hpp"
-#include <boost/log/trivial.hpp>
+#include "logger/logger.hpp"
+#include "metrics/metrics.hpp"
+#include "tracing/tracer.hpp"
 #include <sstream>
 #include <istream>
 
 namespace dfs {
 namespace network {
+
+namespace {
+
+// Depth is summed over every channel in the process
+struct ChannelMetrics {
+  metrics::Counter& produced;
+  metrics::Counter& consumed;
+  metrics::Gauge& depth;
+};
+
+ChannelMetrics& channel_metrics() {
+  auto& registry = metrics::Registry::global();
+  static ChannelMetrics instance{
+    registry.counter("dfs_channel_frames_total", "Frames passed through channels", {{"op", "produce"}}),
+    registry.counter("dfs_channel_frames_total", "Frames passed through channels", {{"op", "consume"}}),
+    registry.gauge("dfs_channel_depth", "Frames waiting in channels")
+  };
+  return instance;
+}
+
+} // namespace
+
+//==============================================
+// CONSTRUCTOR AND DESTRUCTOR
+//==============================================
+
+Channel::~Channel() {
+  channel_metrics().depth.sub(static_cast<std::int64_t>(queue_.size()));
+}
+
   
 //==============================================
 // CHANNEL CONTROL METHODS
@@ -13,7 +45,10 @@ namespace network {
 void Channel::produce(const MessageFrame& frame) {
   std::lock_guard<std::mutex> lock(mutex_);
   queue_.push(frame);
-  BOOST_LOG_TRIVIAL(debug) << "Channel: Added message frame to channel. Channel size: " << queue_.size();
+  queue_.back().enqueued_at = std::chrono::steady_clock::now();
+  channel_metrics().produced.inc();
+  channel_metrics().depth.add();
+  DFS_LOG(debug) << "Channel: Added message frame to channel. Channel size: " << queue_.size();
 }
 
 bool Channel::consume(MessageFrame& frame) {
@@ -24,8 +59,16 @@ bool Channel::consume(MessageFrame& frame) {
   // Get the front message
   frame = queue_.front();
   queue_.pop();
+  channel_metrics().consumed.inc();
+  channel_metrics().depth.sub();
+
+  // Time spent queued belongs to the frame's trace
+  if (frame.trace_id != 0) {
+    tracing::Tracer::record("channel wait", frame.trace_id, tracing::Tracer::new_id(), frame.span_id,
+                            frame.enqueued_at, std::chrono::steady_clock::now());
+  }
   
-  BOOST_LOG_TRIVIAL(debug) << "Channel: Retrieved message frame from channel. Channel size: " << queue_.size();
+  DFS_LOG(debug) << "Channel: Retrieved message frame from channel. Channel size: " << queue_.size();
   return true;
 }
 
@@ -1,12 +1,48 @@
 #include "network/codec.hpp"
 #include "crypto/crypto_stream.hpp"
-#include <boost/log/trivial.hpp>
+#include "logger/logger.hpp"
+#include "metrics/metrics.hpp"
+#include "tracing/tracer.hpp"
 #include <sstream>
 #include <stdexcept>
 
 namespace dfs {
 namespace network {
 
+namespace {
+
+// Metrics for one codec direction, encode or decode
+struct CodecMetrics {
+  metrics::Counter& frames;
+  metrics::Counter& bytes;
+  metrics::Counter& errors;
+  metrics::Histogram& latency;
+};
+
+CodecMetrics make_codec_metrics(const std::string& direction) {
+  auto& registry = metrics::Registry::global();
+  metrics::Labels labels{{"direction", direction}};
+  return CodecMetrics{
+    registry.counter("dfs_codec_frames_total", "Message frames encoded or decoded", labels),
+    registry.counter("dfs_codec_bytes_total", "Serialized frame bytes encoded or decoded", labels),
+    registry.counter("dfs_codec_errors_total", "Frames that failed to encode or decode", labels),
+    registry.histogram("dfs_codec_duration_seconds", "Time to encode or decode a full frame",
+                       metrics::HistogramUnit::Seconds, labels)
+  };
+}
+
+CodecMetrics& encode_metrics() {
+  static CodecMetrics instance = make_codec_metrics("encode");
+  return instance;
+}
+
+CodecMetrics& decode_metrics() {
+  static CodecMetrics instance = make_codec_metrics("decode");
+  return instance;
+}
+
+} // namespace
+
 //==============================================
 // CONSTRUCTOR AND DESTRUCTOR
 //==============================================
@@ -14,7 +50,7 @@ namespace network {
 Codec::Codec(const std::vector<uint8_t>& key, Channel& channel) 
   : key_(key)
   , channel_(channel) {
-  BOOST_LOG_TRIVIAL(info) << "Codec: Initializing Codec with key of size: " << key_.size();
+  DFS_LOG(info) << "Codec: Initializing Codec with key of size: " << key_.size();
 }
 
   
@@ -23,8 +59,38 @@ Codec::Codec(const std::vector<uint8_t>& key, Channel& channel)
 //==============================================
 
 std::size_t Codec::serialize(const MessageFrame& frame, std::ostream& output) {
+  CodecMetrics& stats = encode_metrics();
+  metrics::ScopedTimer timer(stats.latency);
+  tracing::Span span("encode");
+  std::size_t total_bytes = serialize_header(frame, output);
+
+  try {
+    // Encrypt and write payload if present
+    if (frame.payload_size > 0 && frame.payload_stream) {
+      crypto::CryptoStream payload_crypto;
+      payload_crypto.initialize(key_, frame.iv_);
+
+      DFS_LOG(debug) << "Codec: Encrypting and writing payload of size: " << frame.payload_size;
+      frame.payload_stream->seekg(0);
+      payload_crypto.encrypt(*frame.payload_stream, output);
+      total_bytes += get_padded_size(frame.payload_size);
+      stats.bytes.inc(get_padded_size(frame.payload_size));
+    } 
+
+    output.flush();
+    DFS_LOG(info) << "Codec: Encrypted message frame serialization complete. Total bytes written: " << total_bytes;
+    return total_bytes;
+  }
+  catch (const std::exception& e) {
+    DFS_LOG(error) << "Codec: Error during serialization: " << e.what();
+    stats.errors.inc();
+    throw;
+  }
+}
+
+std::size_t Codec::serialize_header(const MessageFrame& frame, std::ostream& output) {
   if (!output.good()) {
-    BOOST_LOG_TRIVIAL(error) << "Codec: Invalid output stream state";
+    DFS_LOG(error) << "Codec: Invalid output stream state";
     throw std::runtime_error("Codec: Invalid output stream");
   }
 
@@ -32,38 +98,42 @@ std::size_t Codec::serialize(const MessageFrame& frame, std::ostream& output) {
 
   // Create and itialize crypto stream with key and IV
   crypto::CryptoStream filename_crypto;
-  crypto::CryptoStream payload_crypto;
-
   filename_crypto.initialize(key_, frame.iv_);
-  payload_crypto.initialize(key_, frame.iv_);
 
-  BOOST_LOG_TRIVIAL(info) << "Codec: Starting message frame serialization";
+  DFS_LOG(info) << "Codec: Starting message frame serialization";
 
   try {
     // Write IV as first header
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Writing IV of size: " << frame.iv_.size();
+    DFS_LOG(debug) << "Codec: Writing IV of size: " << frame.iv_.size();
     write_bytes(output, frame.iv_.data(), frame.iv_.size());
     total_bytes += frame.iv_.size();
 
     // Write message type
     uint8_t msg_type = static_cast<uint8_t>(frame.message_type);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Writing message type: " << static_cast<int>(msg_type);
+    DFS_LOG(debug) << "Codec: Writing message type: " << static_cast<int>(msg_type);
     write_bytes(output, &msg_type, sizeof(msg_type));
     total_bytes += sizeof(msg_type);
 
     // Write source id 
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Writing source id: " << static_cast<int>(frame.source_id);
+    DFS_LOG(debug) << "Codec: Writing source id: " << static_cast<int>(frame.source_id);
     write_bytes(output, &frame.source_id, sizeof(frame.source_id));
     total_bytes += sizeof(frame.source_id);
 
     // Write payload size in network byte order
     uint64_t network_payload_size = boost::endian::native_to_big(frame.payload_size);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Writing payload size: " << frame.payload_size;
+    DFS_LOG(debug) << "Codec: Writing payload size: " << frame.payload_size;
     write_bytes(output, &network_payload_size, sizeof(network_payload_size));
     total_bytes += sizeof(network_payload_size);
 
+    // Write trace context in clear so the receiver can attribute its work before decrypting
+    uint64_t network_trace_id = boost::endian::native_to_big(frame.trace_id);
+    uint64_t network_span_id = boost::endian::native_to_big(frame.span_id);
+    write_bytes(output, &network_trace_id, sizeof(network_trace_id));
+    write_bytes(output, &network_span_id, sizeof(network_span_id));
+    total_bytes += sizeof(network_trace_id) + sizeof(network_span_id);
+
     // Encrypt filename length
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Writing filename length: " << frame.filename_length;
+    DFS_LOG(debug) << "Codec: Writing filename length: " << frame.filename_length;
     // Convert to network byte order
     uint32_t network_filename_length = boost::endian::native_to_big(frame.filename_length);
     // Create stream for raw data
@@ -73,33 +143,41 @@ std::size_t Codec::serialize(const MessageFrame& frame, std::ostream& output) {
     std::stringstream encrypted_filename_length;
     filename_crypto.encrypt(filename_length_stream, encrypted_filename_length);
     // Write filename length
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Writing encrypted filename length";
+    DFS_LOG(debug) << "Codec: Writing encrypted filename length";
     write_bytes(output, encrypted_filename_length.str().data(), encrypted_filename_length.str().size());
     total_bytes += encrypted_filename_length.str().size();
 
-    // Encrypt and write payload if present
-    if (frame.payload_size > 0 && frame.payload_stream) {
-      BOOST_LOG_TRIVIAL(debug) << "Codec: Encrypting and writing payload of size: " << frame.payload_size;
-      frame.payload_stream->seekg(0);
-      payload_crypto.encrypt(*frame.payload_stream, output);
-      total_bytes += get_padded_size(frame.payload_size);
-    } 
-
-    output.flush();
-    BOOST_LOG_TRIVIAL(info) << "Codec: Encrypted message frame serialization complete. Total bytes written: " << total_bytes;
+    // Every outgoing frame starts here, whether the payload follows through serialize() or a pipeline
+    encode_metrics().frames.inc();
+    encode_metrics().bytes.inc(total_bytes);
     return total_bytes;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Codec: Error during serialization: " << e.what();
+    DFS_LOG(error) << "Codec: Error during serialization: " << e.what();
     throw;
   }
 }
 
+std::size_t Codec::get_serialized_size(const MessageFrame& frame) {
+  // IV, message type, source id, payload size, trace and span ids and one
+  // encrypted block holding the filename length
+  std::size_t header_size = crypto::CryptoStream::IV_SIZE + sizeof(uint8_t) + sizeof(uint8_t)
+                          + sizeof(uint64_t) + 2 * sizeof(uint64_t) + crypto::CryptoStream::BLOCK_SIZE;
+  if (frame.payload_size == 0) {
+    return header_size;
+  }
+  return header_size + get_padded_size(frame.payload_size);
+}
+
 MessageFrame Codec::deserialize(std::istream& input) {
+  CodecMetrics& stats = decode_metrics();
   if (!input.good()) {
-    BOOST_LOG_TRIVIAL(error) << "Codec: Invalid input stream state";
+    DFS_LOG(error) << "Codec: Invalid input stream state";
+    stats.errors.inc();
     throw std::runtime_error("Codec: Invalid input stream");
   }
+  metrics::ScopedTimer timer(stats.latency);
+  auto decode_start = tracing::Tracer::Clock::now();
 
   MessageFrame frame;
   std::size_t total_bytes = 0;
@@ -108,12 +186,12 @@ MessageFrame Codec::deserialize(std::istream& input) {
   crypto::CryptoStream filename_crypto;
   crypto::CryptoStream payload_crypto;
 
-  BOOST_LOG_TRIVIAL(info) << "Codec: Starting message frame deserialization";
+  DFS_LOG(info) << "Codec: Starting message frame deserialization";
 
   try {
     // Read IV first
     frame.iv_.resize(crypto::CryptoStream::IV_SIZE);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Reading IV";
+    DFS_LOG(debug) << "Codec: Reading IV";
     read_bytes(input, frame.iv_.data(), frame.iv_.size());
     total_bytes += frame.iv_.size();
 
@@ -126,23 +204,32 @@ MessageFrame Codec::deserialize(std::istream& input) {
     uint8_t msg_type;
     read_bytes(input, &msg_type, sizeof(msg_type));
     frame.message_type = static_cast<MessageType>(msg_type);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Read message type: " << static_cast<int>(msg_type);
+    DFS_LOG(debug) << "Codec: Read message type: " << static_cast<int>(msg_type);
     total_bytes += sizeof(msg_type);
 
     // Read source id
     uint8_t source_id;
     read_bytes(input, &source_id, sizeof(source_id));
     frame.source_id = source_id;
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Read source id: " << static_cast<int>(source_id);
+    DFS_LOG(debug) << "Codec: Read source id: " << static_cast<int>(source_id);
     total_bytes += sizeof(source_id);
 
     // Read payload size
     uint64_t network_payload_size;
     read_bytes(input, &network_payload_size, sizeof(network_payload_size));
     frame.payload_size = boost::endian::big_to_native(network_payload_size);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Read payload size: " << frame.payload_size;
+    DFS_LOG(debug) << "Codec: Read payload size: " << frame.payload_size;
     total_bytes += sizeof(network_payload_size);
 
+    // Read trace context
+    uint64_t network_trace_id;
+    uint64_t network_span_id;
+    read_bytes(input, &network_trace_id, sizeof(network_trace_id));
+    read_bytes(input, &network_span_id, sizeof(network_span_id));
+    frame.trace_id = boost::endian::big_to_native(network_trace_id);
+    frame.span_id = boost::endian::big_to_native(network_span_id);
+    total_bytes += sizeof(network_trace_id) + sizeof(network_span_id);
+
     // Decrypt filename length
     // create buffer and read 1 block of encrypted data into it
     std::vector<char> encrypted_filename_length(crypto::CryptoStream::BLOCK_SIZE);
@@ -158,27 +245,35 @@ MessageFrame Codec::deserialize(std::istream& input) {
     decrypted_filename_length_stream.read(reinterpret_cast<char*>(&network_filename_length), sizeof(network_filename_length));
     // Convert to host byte order
     frame.filename_length = boost::endian::big_to_native(network_filename_length);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: Read decrypted filename length: " << frame.filename_length;
+    DFS_LOG(debug) << "Codec: Read decrypted filename length: " << frame.filename_length;
     total_bytes += encrypted_filename_length.size();
 
     frame.payload_stream = std::make_shared<std::stringstream>(); 
 
     // Decrypt payload if present
     if (frame.payload_size > 0) {
-      BOOST_LOG_TRIVIAL(debug) << "Codec: Decrypting payload of size: " << frame.payload_size;
+      DFS_LOG(debug) << "Codec: Decrypting payload of size: " << frame.payload_size;
       payload_crypto.decrypt(input, *frame.payload_stream);
       total_bytes += frame.payload_size;
       frame.payload_stream->seekg(0);
     }
 
+    stats.frames.inc();
+    stats.bytes.inc(total_bytes);
+    // The span starts before the trace context was known, so it is recorded afterwards
+    if (frame.trace_id != 0) {
+      tracing::Tracer::record("decode", frame.trace_id, tracing::Tracer::new_id(), frame.span_id,
+                              decode_start, tracing::Tracer::Clock::now());
+    }
     channel_.produce(frame);
-    BOOST_LOG_TRIVIAL(debug) << "Codec: New frame added to channel";
+    DFS_LOG(debug) << "Codec: New frame added to channel";
 
-    BOOST_LOG_TRIVIAL(info) << "Codec: Message frame deserialization complete. Total bytes read: " << total_bytes;
+    DFS_LOG(info) << "Codec: Message frame deserialization complete. Total bytes read: " << total_bytes;
     return frame;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Codec: Error during deserialization: " << e.what();
+    DFS_LOG(error) << "Codec: Error during deserialization: " << e.what();
+    stats.errors.inc();
     throw;
   }
 }
@@ -190,14 +285,14 @@ MessageFrame Codec::deserialize(std::istream& input) {
   
 void Codec::write_bytes(std::ostream& output, const void* data, std::size_t size) {
   if (!output.write(static_cast<const char*>(data), size)) {
-    BOOST_LOG_TRIVIAL(error) << "Codec: Failed to write " << size << " bytes to output stream";
+    DFS_LOG(error) << "Codec: Failed to write " << size << " bytes to output stream";
     throw std::runtime_error("Codec: Failed to write to output stream");
   }
 }
 
 void Codec::read_bytes(std::istream& input, void* data, std::size_t size) {
   if (!input.read(static_cast<char*>(data), size)) {
-    BOOST_LOG_TRIVIAL(error) << "Codec: Failed to read " << size << " bytes from input stream";
+    DFS_LOG(error) << "Codec: Failed to read " << size << " bytes from input stream";
     throw std::runtime_error("Codec: Failed to read from input stream");
   }
 }
@@ -208,7 +303,8 @@ void Codec::read_bytes(std::istream& input, void* data, std::size_t size) {
 //==============================================
 
 size_t Codec::get_padded_size(size_t original_size) {
-    return ((original_size + crypto::CryptoStream::BLOCK_SIZE -1) / crypto::CryptoStream::BLOCK_SIZE) * crypto::CryptoStream::BLOCK_SIZE;
+    // PKCS#7 always pads, a block aligned input gains a full extra block
+    return (original_size / crypto::CryptoStream::BLOCK_SIZE + 1) * crypto::CryptoStream::BLOCK_SIZE;
 }
 
 } // namespace network
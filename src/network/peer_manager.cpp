@@ -1,9 +1,41 @@
 #include "network/peer_manager.hpp"
-#include <boost/log/trivial.hpp>
+#include "logger/logger.hpp"
+#include "metrics/metrics.hpp"
+#include "tracing/tracer.hpp"
+#include <algorithm>
+#include <set>
 
 namespace dfs {
 namespace network {
 
+namespace {
+
+struct PeerManagerMetrics {
+  metrics::Gauge& peers;
+  metrics::Histogram& unicast_latency;
+  metrics::Histogram& broadcast_latency;
+  metrics::Counter& unicast_failures;
+  metrics::Counter& broadcast_failures;
+  metrics::Counter& frame_bytes;
+};
+
+PeerManagerMetrics& manager_metrics() {
+  auto& registry = metrics::Registry::global();
+  static PeerManagerMetrics instance{
+    registry.gauge("dfs_peers", "Peers registered with the peer manager"),
+    registry.histogram("dfs_peer_send_duration_seconds", "Time to stream one frame to its targets",
+                       metrics::HistogramUnit::Seconds, {{"op", "unicast"}}),
+    registry.histogram("dfs_peer_send_duration_seconds", "Time to stream one frame to its targets",
+                       metrics::HistogramUnit::Seconds, {{"op", "broadcast"}}),
+    registry.counter("dfs_peer_send_failures_total", "Frames not delivered to every target", {{"op", "unicast"}}),
+    registry.counter("dfs_peer_send_failures_total", "Frames not delivered to every target", {{"op", "broadcast"}}),
+    registry.counter("dfs_peer_frame_bytes_total", "Frame bytes pulled from send pipelines, once per frame")
+  };
+  return instance;
+}
+
+} // namespace
+
 //==============================================
 // CONSTRUCTOR AND DESTRUCTOR
 //==============================================
@@ -14,14 +46,18 @@ PeerManager::PeerManager(Channel& channel, TCP_Server& tcp_server, const std::ve
   , key_(key) {
 
   if (key_.empty() || key_.size() != 32) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Invalid key size: " << key_.size() << " bytes. Expected 32 bytes.";
+    DFS_LOG(error) << "Peer manager: Invalid key size: " << key_.size() << " bytes. Expected 32 bytes.";
     throw std::invalid_argument("Peer manager: Invalid cryptographic key size");
   }
 
-  BOOST_LOG_TRIVIAL(info) << "Peer manager: initialized with key size: " << key_.size() << " bytes";
+  // Kernel socket state is sampled per scrape rather than tracked
+  collector_id_ = metrics::Registry::global().add_collector([this]() { export_link_state(); });
+
+  DFS_LOG(info) << "Peer manager: initialized with key size: " << key_.size() << " bytes";
 }
 
 PeerManager::~PeerManager() {
+  metrics::Registry::global().remove_collector(collector_id_);
   shutdown();
 }
 
@@ -47,20 +83,20 @@ void PeerManager::create_peer(std::shared_ptr<boost::asio::ip::tcp::socket> sock
          try {
            peer->codec_->deserialize(stream);
          } catch (const std::exception& e) {
-           BOOST_LOG_TRIVIAL(error) << "Peer manager: Deserialization error: " << e.what();
+           DFS_LOG(error) << "Peer manager: Deserialization error: " << e.what();
          }
        }
      );
 
     // Start stream processing
     if (!peer->start_stream_processing()) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Failed to start stream processing for peer: " << static_cast<int>(peer_id);
+    DFS_LOG(error) << "Peer manager: Failed to start stream processing for peer: " << static_cast<int>(peer_id);
     return;
     }
 
-    BOOST_LOG_TRIVIAL(info) << "Peer manager: Accepted and initialized new connection from peer: " << static_cast<int>(peer_id);
+    DFS_LOG(info) << "Peer manager: Accepted and initialized new connection from peer: " << static_cast<int>(peer_id);
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Error handling new connection: " << e.what();
+    DFS_LOG(error) << "Peer manager: Error handling new connection: " << e.what();
   }
 
   // Continue accepting new connections if server is still running
@@ -69,7 +105,7 @@ void PeerManager::create_peer(std::shared_ptr<boost::asio::ip::tcp::socket> sock
 
 void PeerManager::add_peer(std::shared_ptr<TCP_Peer> peer) {
   if (!peer) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Attempted to add null peer";
+    DFS_LOG(error) << "Peer manager: Attempted to add null peer";
     return;
   }
 
@@ -77,8 +113,12 @@ void PeerManager::add_peer(std::shared_ptr<TCP_Peer> peer) {
 
   std::lock_guard<std::mutex> lock(mutex_);
 
-  peers_[peer_id] = peer;
-  BOOST_LOG_TRIVIAL(info) << "Peer manager: Added peer with ID: " << static_cast<int>(peer_id);
+  auto& slot = peers_[peer_id];
+  if (!slot) {
+    manager_metrics().peers.add();
+  }
+  slot = peer;
+  DFS_LOG(info) << "Peer manager: Added peer with ID: " << static_cast<int>(peer_id);
 }
 
 void PeerManager::remove_peer(uint8_t peer_id) {
@@ -88,9 +128,10 @@ void PeerManager::remove_peer(uint8_t peer_id) {
   if (it != peers_.end()) {
     disconnect(peer_id);
     peers_.erase(it);
-    BOOST_LOG_TRIVIAL(info) << "Peer manager: Removed peer with ID: " << static_cast<int>(peer_id);
+    manager_metrics().peers.sub();
+    DFS_LOG(info) << "Peer manager: Removed peer with ID: " << static_cast<int>(peer_id);
   } else {
-    BOOST_LOG_TRIVIAL(warning) << "Peer manager: Attempted to remove non-existent peer: " << static_cast<int>(peer_id);
+    DFS_LOG(warning) << "Peer manager: Attempted to remove non-existent peer: " << static_cast<int>(peer_id);
   }
 }
 
@@ -99,6 +140,16 @@ bool PeerManager::has_peer(uint8_t peer_id) {
   return peers_.find(peer_id) != peers_.end();
 }
 
+std::vector<uint8_t> PeerManager::peer_ids() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<uint8_t> ids;
+  ids.reserve(peers_.size());
+  for (const auto& [id, peer] : peers_) {
+    ids.push_back(id);
+  }
+  return ids;
+}
+
 std::shared_ptr<TCP_Peer> PeerManager::get_peer(uint8_t peer_id) {
   std::lock_guard<std::mutex> lock(mutex_);
   
@@ -118,7 +169,7 @@ bool PeerManager::disconnect(uint8_t peer_id) {
 
   auto it = peers_.find(peer_id);
   if (it == peers_.end()) {
-    BOOST_LOG_TRIVIAL(warning) << "Peer manager: Cannot disconnect - peer not found: " << static_cast<int>(peer_id);
+    DFS_LOG(warning) << "Peer manager: Cannot disconnect - peer not found: " << static_cast<int>(peer_id);
     return false;
   }
 
@@ -126,11 +177,11 @@ bool PeerManager::disconnect(uint8_t peer_id) {
     auto& peer = it->second;
     peer->stop_stream_processing();
     peer->cleanup_connection();
-    BOOST_LOG_TRIVIAL(info) << "Peer manager: Successfully disconnected peer: " << static_cast<int>(peer_id);
+    DFS_LOG(info) << "Peer manager: Successfully disconnected peer: " << static_cast<int>(peer_id);
     return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Disconnect error for peer " << static_cast<int>(peer_id) 
+    DFS_LOG(error) << "Peer manager: Disconnect error for peer " << static_cast<int>(peer_id) 
                 << ": " << e.what();
     return false;
   }
@@ -153,18 +204,24 @@ bool PeerManager::is_connected(uint8_t peer_id) {
   
 bool PeerManager::send_to_peer(uint8_t peer_id, dfs::utils::Pipeliner& pipeline) {
   if (!pipeline.good()) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Invalid input stream provided for peer_id: " << static_cast<int>(peer_id);
+    DFS_LOG(error) << "Peer manager: Invalid input stream provided for peer_id: " << static_cast<int>(peer_id);
     return false;
   }
 
-  auto it = peers_.find(peer_id);
-  if (it == peers_.end()) {
-    BOOST_LOG_TRIVIAL(warning) << "Peer manager: Peer not found with ID: " << static_cast<int>(peer_id);
-    return false;
+  // The peer is looked up under the map lock, the transfer runs without it
+  std::shared_ptr<TCP_Peer> peer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = peers_.find(peer_id);
+    if (it == peers_.end()) {
+      DFS_LOG(warning) << "Peer manager: Peer not found with ID: " << static_cast<int>(peer_id);
+      return false;
+    }
+    peer = it->second;
   }
 
-  if (!is_connected(peer_id)) {
-    BOOST_LOG_TRIVIAL(warning) << "Peer manager: Peer is not connected: " << static_cast<int>(peer_id);
+  if (!peer->get_socket().is_open()) {
+    DFS_LOG(warning) << "Peer manager: Peer is not connected: " << static_cast<int>(peer_id);
     return false;
   }
 
@@ -172,29 +229,31 @@ bool PeerManager::send_to_peer(uint8_t peer_id, dfs::utils::Pipeliner& pipeline)
   std::size_t total_size = pipeline.get_total_size();
 
 
+  PeerManagerMetrics& stats = manager_metrics();
+  metrics::ScopedTimer timer(stats.unicast_latency);
   try {
-    bool success = it->second->send_stream(pipeline, total_size);
+    std::vector<std::shared_ptr<TCP_Peer>> targets{peer};
+    std::vector<bool> healthy(1, true);
+    std::unique_lock<std::mutex> send_lock = peer->lock_for_send();
+    bool success = send_chunks(pipeline, targets, healthy) == total_size && healthy[0];
     if (success) {
-      BOOST_LOG_TRIVIAL(debug) << "Peer manager: Successfully sent stream to peer: " << static_cast<int>(peer_id);
+      DFS_LOG(debug) << "Peer manager: Successfully sent stream to peer: " << static_cast<int>(peer_id);
     } else {
-      BOOST_LOG_TRIVIAL(error) << "Peer manager: Failed to send stream to peer: " << static_cast<int>(peer_id);
+      DFS_LOG(error) << "Peer manager: Failed to send stream to peer: " << static_cast<int>(peer_id);
+      stats.unicast_failures.inc();
     }
     return success;
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Exception while sending to peer " << static_cast<int>(peer_id) 
+    DFS_LOG(error) << "Peer manager: Exception while sending to peer " << static_cast<int>(peer_id) 
                 << ": " << e.what();
+    stats.unicast_failures.inc();
     return false;
   }
 }
   
 bool PeerManager::broadcast_stream(dfs::utils::Pipeliner& pipeline) {
   if (!pipeline.good()) {
-    BOOST_LOG_TRIVIAL(error) << "Peer manager: Invalid input stream provided for broadcast";
-    return false;
-  }
-
-  if (peers_.empty()) {
-    BOOST_LOG_TRIVIAL(warning) << "Peer manager: No peers available for broadcast";
+    DFS_LOG(error) << "Peer manager: Invalid input stream provided for broadcast";
     return false;
   }
 
@@ -202,41 +261,156 @@ bool PeerManager::broadcast_stream(dfs::utils::Pipeliner& pipeline) {
   std::size_t total_size = pipeline.get_total_size();
 
   bool all_success = true;
-  size_t success_count = 0;
 
-  for (auto& peer_pair : peers_) {
-    try {
-      if (!is_connected(peer_pair.first)) {
-        BOOST_LOG_TRIVIAL(warning) << "Peer manager: Skipping disconnected peer: " << static_cast<int>(peer_pair.first);
+  // The pipeline can only be read once, so every chunk is fanned out to all
+  // peers as it is pulled. The targets and their send locks are taken under
+  // the map lock, which is released before the transfer so connects,
+  // disconnects and unicasts to other peers are not held up by it. Each
+  // peer's send lock is held for the whole frame.
+  std::vector<std::shared_ptr<TCP_Peer>> targets;
+  std::vector<std::unique_lock<std::mutex>> send_locks;
+  std::size_t peer_count;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (peers_.empty()) {
+      DFS_LOG(warning) << "Peer manager: No peers available for broadcast";
+      return false;
+    }
+
+    peer_count = peers_.size();
+    for (auto& peer_pair : peers_) {
+      if (!peer_pair.second->get_socket().is_open()) {
+        DFS_LOG(warning) << "Peer manager: Skipping disconnected peer: " << static_cast<int>(peer_pair.first);
         all_success = false;
         continue;
       }
+      targets.push_back(peer_pair.second);
+      send_locks.push_back(peer_pair.second->lock_for_send());
+    }
+  }
 
-      std::lock_guard<std::mutex> lock(mutex_);
+  PeerManagerMetrics& stats = manager_metrics();
+  std::vector<bool> healthy(targets.size(), true);
+  std::size_t total_bytes_sent;
+  {
+    metrics::ScopedTimer timer(stats.broadcast_latency);
+    total_bytes_sent = send_chunks(pipeline, targets, healthy);
+  }
 
-      // Reset pipeline position before sending to each peer
-      pipeline.seekg(0);
+  if (total_bytes_sent != total_size) {
+    DFS_LOG(error) << "Peer manager: Pipeline ended after " << total_bytes_sent 
+                             << " of " << total_size << " bytes";
+    stats.broadcast_failures.inc();
+    return false;
+  }
 
-      if (peer_pair.second->send_stream(pipeline, total_size)) {
-        success_count++;
-        BOOST_LOG_TRIVIAL(debug) << "Peer manager: Successfully broadcast to peer: " << static_cast<int>(peer_pair.first);
-      } else {
-        all_success = false;
-        BOOST_LOG_TRIVIAL(error) << "Peer manager: Failed to broadcast to peer: " << static_cast<int>(peer_pair.first);
-      }
-    } catch (const std::exception& e) {
+  size_t success_count = 0;
+  for (std::size_t i = 0; i < targets.size(); ++i) {
+    if (healthy[i]) {
+      success_count++;
+      DFS_LOG(debug) << "Peer manager: Successfully broadcast to peer: " 
+                               << static_cast<int>(targets[i]->get_peer_id());
+    } else {
       all_success = false;
-      BOOST_LOG_TRIVIAL(error) << "Peer manager: Exception while broadcasting to peer " 
-                  << peer_pair.first << ": " << e.what();
     }
   }
 
-  BOOST_LOG_TRIVIAL(info) << "Peer manager: Broadcast completed. Successfully sent to " 
-              << success_count << " out of " << peers_.size() << " peers";
+  DFS_LOG(info) << "Peer manager: Broadcast completed. Successfully sent to " 
+              << success_count << " out of " << peer_count << " peers";
+  if (!all_success) {
+    stats.broadcast_failures.inc();
+  }
 
   return all_success;
 }
 
+std::size_t PeerManager::send_chunks(dfs::utils::Pipeliner& pipeline,
+                                     const std::vector<std::shared_ptr<TCP_Peer>>& targets,
+                                     std::vector<bool>& healthy) {
+  // Covers the whole frame, including time spent waiting on earlier stages
+  tracing::Span span("socket send");
+  std::size_t total_size = pipeline.get_total_size();
+  for (std::size_t i = 0; i < targets.size(); ++i) {
+    targets[i]->begin_frame();
+    if (total_size == 0) {
+      healthy[i] = targets[i]->send_segment(nullptr, 0, true);
+    }
+  }
+
+  // Chunks are taken from the pipeline by ownership and written straight to
+  // the sockets, each as a segment of the frame. Nothing goes out before the
+  // first chunk exists, and the chunk reaching the total size ends the frame
+  dfs::utils::Chunk chunk;
+  std::size_t total_bytes_sent = 0;
+  while (total_bytes_sent < total_size && pipeline.read_chunk(chunk)) {
+    std::size_t bytes = std::min(chunk.size(), total_size - total_bytes_sent);
+    bool last = total_bytes_sent + bytes == total_size;
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+      if (healthy[i] && !targets[i]->send_segment(chunk.data(), bytes, last)) {
+        DFS_LOG(error) << "Peer manager: Failed to send chunk to peer: " 
+                                 << static_cast<int>(targets[i]->get_peer_id());
+        healthy[i] = false;
+      }
+    }
+    total_bytes_sent += bytes;
+  }
+
+  // A pipeline that ended early leaves the receivers with part of a frame,
+  // which they drop on the abort so the next frame is read from its start
+  bool complete = total_bytes_sent == total_size;
+  for (std::size_t i = 0; i < targets.size(); ++i) {
+    if (!complete && healthy[i] && total_bytes_sent > 0) {
+      targets[i]->abort_frame();
+    }
+    targets[i]->end_frame(healthy[i] && complete);
+  }
+  manager_metrics().frame_bytes.inc(total_bytes_sent);
+  return total_bytes_sent;
+}
+
+//==============================================
+// PEER STATISTICS
+//==============================================
+
+std::vector<PeerStats> PeerManager::peer_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<PeerStats> stats;
+  stats.reserve(peers_.size());
+  for (const auto& [peer_id, peer] : peers_) {
+    stats.push_back(peer->stats());
+  }
+  return stats;
+}
+
+void PeerManager::export_link_state() {
+  auto& registry = metrics::Registry::global();
+  auto publish = [&registry](uint8_t peer_id, std::int64_t rtt_us, std::int64_t retransmits,
+                             std::int64_t send_queue) {
+    metrics::Labels labels{{"peer", std::to_string(peer_id)}};
+    registry.gauge("dfs_peer_link_rtt_microseconds", "Smoothed TCP round trip time to one peer", labels)
+      .set(rtt_us);
+    registry.gauge("dfs_peer_link_retransmits", "TCP retransmissions on the current connection to one peer", labels)
+      .set(retransmits);
+    registry.gauge("dfs_peer_link_socket_send_queue_bytes", "Bytes queued in the kernel for one peer", labels)
+      .set(send_queue);
+  };
+
+  std::set<uint8_t> exported;
+  for (const PeerStats& stats : peer_stats()) {
+    publish(stats.peer_id, stats.rtt_us, stats.retransmits, static_cast<std::int64_t>(stats.socket_send_queue));
+    exported.insert(stats.peer_id);
+  }
+  // Peers that went away read zero instead of their last value
+  for (uint8_t peer_id : exported_peers_) {
+    if (!exported.count(peer_id)) {
+      publish(peer_id, 0, 0, 0);
+    }
+  }
+  exported_peers_ = std::move(exported);
+}
+
+
 //==============================================
 // UTILITY METHODS
 //==============================================
@@ -244,20 +418,21 @@ bool PeerManager::broadcast_stream(dfs::utils::Pipeliner& pipeline) {
 void PeerManager::shutdown() {
   std::lock_guard<std::mutex> lock(mutex_);
 
-  BOOST_LOG_TRIVIAL(info) << "Peer manager: Initiating PeerManager shutdown";
+  DFS_LOG(info) << "Peer manager: Initiating PeerManager shutdown";
 
   for (auto& peer_pair : peers_) {
     try {
       disconnect(peer_pair.first);
-      BOOST_LOG_TRIVIAL(debug) << "Peer manager: Disconnected peer: " << peer_pair.first;
+      DFS_LOG(debug) << "Peer manager: Disconnected peer: " << peer_pair.first;
     } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "Peer manager: Error disconnecting peer " << peer_pair.first 
+      DFS_LOG(error) << "Peer manager: Error disconnecting peer " << peer_pair.first 
                   << ": " << e.what();
     }
   }
 
+  manager_metrics().peers.sub(static_cast<std::int64_t>(peers_.size()));
   peers_.clear();
-  BOOST_LOG_TRIVIAL(info) << "Peer manager: shutdown complete";
+  DFS_LOG(info) << "Peer manager: shutdown complete";
 }
 
 std::size_t PeerManager::size() const {
@@ -1,9 +1,68 @@
 #include "network/tcp_peer.hpp"
+#include "logger/logger.hpp"
+#include "metrics/hot_path.hpp"
+#include "metrics/metrics.hpp"
+#include <array>
 #include <stdexcept>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
 
 namespace dfs {
 namespace network {
 
+namespace {
+
+// Socket level traffic summed over every peer
+struct PeerMetrics {
+  metrics::Counter& bytes_sent;
+  metrics::Counter& bytes_received;
+  metrics::Counter& messages_received;
+  metrics::Counter& send_errors;
+  metrics::Counter& receive_errors;
+  metrics::Counter& aborted_frames;
+  metrics::Histogram& message_size;
+};
+
+PeerMetrics& peer_metrics() {
+  auto& registry = metrics::Registry::global();
+  static PeerMetrics instance{
+    registry.counter("dfs_peer_bytes_sent_total", "Bytes written to peer sockets"),
+    registry.counter("dfs_peer_bytes_received_total", "Bytes read from peer sockets"),
+    registry.counter("dfs_peer_messages_received_total", "Size prefixed messages received from peers"),
+    registry.counter("dfs_peer_errors_total", "Socket errors on peer connections", {{"direction", "send"}}),
+    registry.counter("dfs_peer_errors_total", "Socket errors on peer connections", {{"direction", "receive"}}),
+    registry.counter("dfs_peer_aborted_frames_total", "Frames a peer gave up part way, dropped on receipt"),
+    registry.histogram("dfs_peer_message_size_bytes", "Size of messages received from peers",
+                       metrics::HistogramUnit::Bytes)
+  };
+  return instance;
+}
+
+} // namespace
+
+TCP_Peer::LinkMetrics TCP_Peer::link_metrics(uint8_t peer_id) {
+  auto& registry = metrics::Registry::global();
+  const std::string peer = std::to_string(peer_id);
+  return LinkMetrics{
+    registry.counter("dfs_peer_link_bytes_total", "Bytes exchanged with one peer",
+                     {{"peer", peer}, {"direction", "sent"}}),
+    registry.counter("dfs_peer_link_bytes_total", "Bytes exchanged with one peer",
+                     {{"peer", peer}, {"direction", "received"}}),
+    registry.counter("dfs_peer_link_frames_total", "Size prefixed frames exchanged with one peer",
+                     {{"peer", peer}, {"direction", "sent"}}),
+    registry.counter("dfs_peer_link_frames_total", "Size prefixed frames exchanged with one peer",
+                     {{"peer", peer}, {"direction", "received"}}),
+    registry.counter("dfs_peer_link_errors_total", "Socket errors on one peer connection",
+                     {{"peer", peer}, {"direction", "send"}}),
+    registry.counter("dfs_peer_link_errors_total", "Socket errors on one peer connection",
+                     {{"peer", peer}, {"direction", "receive"}}),
+    registry.gauge("dfs_peer_link_in_flight", "Frames being written to one peer", {{"peer", peer}}),
+    registry.gauge("dfs_peer_link_send_waiters", "Senders waiting for one peer's send lock", {{"peer", peer}})
+  };
+}
+
 //==============================================
 // CONSTRUCTOR AND DESTRUCTOR
 //==============================================
@@ -12,17 +71,18 @@ TCP_Peer::TCP_Peer(uint8_t peer_id, Channel& channel, const std::vector<uint8_t>
   : peer_id_(peer_id),  
   socket_(std::make_unique<boost::asio::ip::tcp::socket>(io_context_)),  
   input_buffer_(std::make_unique<boost::asio::streambuf>()),
-  codec_(std::make_unique<Codec>(key, channel)) {  
+  codec_(std::make_unique<Codec>(key, channel)),
+  link_(link_metrics(peer_id)) {
   initialize_streams();
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Constructing TCP_Peer";
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Input stream initialized";
-  BOOST_LOG_TRIVIAL(info) << "TCP peer: TCP_Peer instance created successfully";
+  DFS_LOG(debug) << "TCP peer: Constructing TCP_Peer";
+  DFS_LOG(debug) << "TCP peer: Input stream initialized";
+  DFS_LOG(info) << "TCP peer: TCP_Peer instance created successfully";
 }
 
 // Cleanup connection and resources on destruction
 TCP_Peer::~TCP_Peer() {
   cleanup_connection();
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: TCP_Peer destroyed: " << static_cast<int>(peer_id_);
+  DFS_LOG(debug) << "TCP peer: TCP_Peer destroyed: " << static_cast<int>(peer_id_);
 }
 
 //==============================================
@@ -34,34 +94,34 @@ void TCP_Peer::initialize_streams() {
 }
 
 void TCP_Peer::set_stream_processor(StreamProcessor processor) {
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Setting stream processor";
+  DFS_LOG(debug) << "TCP peer: Setting stream processor";
   stream_processor_ = std::move(processor);
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Stream processor configured";
+  DFS_LOG(debug) << "TCP peer: Stream processor configured";
 }
 
 bool TCP_Peer::start_stream_processing() {
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Attempting to start stream processing";
+  DFS_LOG(debug) << "TCP peer: Attempting to start stream processing";
 
   if (!socket_->is_open() || !stream_processor_) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Cannot start processing - socket not connected or no processor set";
+    DFS_LOG(error) << "TCP peer: Cannot start processing - socket not connected or no processor set";
     return false;
   }
 
   if (processing_active_) {
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Stream processing already active";
+    DFS_LOG(debug) << "TCP peer: Stream processing already active";
     return true;
   }
 
   processing_active_ = true;
   processing_thread_ = std::make_unique<std::thread>(&TCP_Peer::process_stream, this);
-  BOOST_LOG_TRIVIAL(info) << "TCP peer: Stream processing started successfully";
+  DFS_LOG(info) << "TCP peer: Stream processing started successfully";
   return true;
 }
 
 // Gracefully stop stream processing and cleanup resources
 void TCP_Peer::stop_stream_processing() {
   if (processing_active_) {
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Stopping stream processing";
+    DFS_LOG(debug) << "TCP peer: Stopping stream processing";
 
     processing_active_ = false;
 
@@ -70,7 +130,7 @@ void TCP_Peer::stop_stream_processing() {
       boost::system::error_code ec;
       socket_->cancel(ec);
       if (ec) {
-        BOOST_LOG_TRIVIAL(error) << "TCP peer: Error canceling socket operations: " << ec.message();
+        DFS_LOG(error) << "TCP peer: Error canceling socket operations: " << ec.message();
       }
     }
 
@@ -80,12 +140,12 @@ void TCP_Peer::stop_stream_processing() {
     if (processing_thread_ && processing_thread_->joinable()) {
       processing_thread_->join();
       processing_thread_.reset();
-      BOOST_LOG_TRIVIAL(debug) << "TCP peer: Processing thread joined";
+      DFS_LOG(debug) << "TCP peer: Processing thread joined";
     }
 
     io_context_.restart();
 
-    BOOST_LOG_TRIVIAL(info) << "TCP peer: Stream processing stopped";
+    DFS_LOG(info) << "TCP peer: Stream processing stopped";
   }
 }
 
@@ -94,7 +154,7 @@ void TCP_Peer::stop_stream_processing() {
 //==============================================
 
 void TCP_Peer::process_stream() {
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Setting up stream processing";
+  DFS_LOG(debug) << "TCP peer: Setting up stream processing";
 
   try {
     // Keep io_context running while processing is active
@@ -115,10 +175,10 @@ void TCP_Peer::process_stream() {
     while (io_context_.poll_one()) {}
 
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Stream processing error: " << e.what();
+    DFS_LOG(error) << "TCP peer: Stream processing error: " << e.what();
   }
 
-  BOOST_LOG_TRIVIAL(info) << "TCP peer: Stream processing stopped";
+  DFS_LOG(info) << "TCP peer: Stream processing stopped";
 }
 
 void TCP_Peer::async_read_next() {
@@ -126,7 +186,7 @@ void TCP_Peer::async_read_next() {
     return;
   }
 
-  BOOST_LOG_TRIVIAL(trace) << "TCP peer: Setting up next async read";
+  DFS_LOG(trace) << "TCP peer: Setting up next async read";
 
   // First read the size asynchronously
   boost::asio::async_read(
@@ -139,9 +199,20 @@ void TCP_Peer::async_read_next() {
 
 void TCP_Peer::handle_read_size(const boost::system::error_code& ec, std::size_t /*bytes_transferred*/) {
   if (!ec) {
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Expecting " << expected_size_ << " bytes of data";
+    if (expected_size_ == FRAME_ABORTED) {
+      DFS_LOG(warning) << "TCP peer: Peer " << static_cast<int>(peer_id_) << " aborted a frame, dropping "
+                       << frame_size_ << " bytes";
+      peer_metrics().aborted_frames.inc();
+      input_buffer_->consume(frame_size_);
+      frame_size_ = 0;
+      async_read_next();
+      return;
+    }
+    frame_continues_ = (expected_size_ & SEGMENT_CONTINUES) != 0;
+    expected_size_ &= ~SEGMENT_CONTINUES;
+    DFS_LOG(debug) << "TCP peer: Expecting " << expected_size_ << " bytes of data";
 
-    // Now read the actual data asynchronously
+    // Now read the actual data asynchronously, after the frame's earlier segments
     boost::asio::async_read(
       *socket_,
       *input_buffer_,
@@ -151,18 +222,25 @@ void TCP_Peer::handle_read_size(const boost::system::error_code& ec, std::size_t
                 std::placeholders::_2));
   } 
   else if (ec != boost::asio::error::operation_aborted) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Size read error: " << ec.message();
-    if (processing_active_ && socket_->is_open()) {
-      async_read_next();
-    }
+    handle_read_error(ec, "Size read error");
   }
 }
 
 void TCP_Peer::handle_read_data(const boost::system::error_code& ec, std::size_t bytes_transferred) {
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Read callback triggered";
+  DFS_LOG(debug) << "TCP peer: Read callback triggered";
 
   if (!ec && bytes_transferred == expected_size_) {
-    process_received_data();
+    PeerMetrics& stats = peer_metrics();
+    stats.bytes_received.inc(sizeof(expected_size_) + bytes_transferred);
+    link_.bytes_received.inc(sizeof(expected_size_) + bytes_transferred);
+    frame_size_ += bytes_transferred;
+    if (!frame_continues_) {
+      stats.messages_received.inc();
+      stats.message_size.observe(frame_size_);
+      link_.frames_received.inc();
+      process_received_data();
+      frame_size_ = 0;
+    }
 
     // Continue reading if still active
     if (processing_active_ && socket_->is_open()) {
@@ -170,26 +248,43 @@ void TCP_Peer::handle_read_data(const boost::system::error_code& ec, std::size_t
     }
   } 
   else if (ec != boost::asio::error::operation_aborted) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Read error: " << ec.message();
-    if (processing_active_ && socket_->is_open()) {
-      async_read_next();
-    }
+    handle_read_error(ec, "Read error");
+  }
+}
+
+void TCP_Peer::handle_read_error(const boost::system::error_code& ec, const std::string& what) {
+  DFS_LOG(error) << "TCP peer: " << what << ": " << ec.message();
+  peer_metrics().receive_errors.inc();
+  link_.receive_errors.inc();
+
+  if (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset ||
+      ec == boost::asio::error::broken_pipe) {
+    // The other end is gone. A closed socket reports the peer disconnected,
+    // so a new connection from the same peer can take its place
+    DFS_LOG(warning) << "TCP peer: Lost connection to peer " << static_cast<int>(peer_id_);
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    boost::system::error_code close_ec;
+    socket_->close(close_ec);
+    return;
+  }
+  if (processing_active_ && socket_->is_open()) {
+    async_read_next();
   }
 }
 
 void TCP_Peer::process_received_data() {
   std::string data;
   std::istream is(input_buffer_.get());
-  data.resize(expected_size_);
-  is.read(&data[0], expected_size_);
+  data.resize(frame_size_);
+  is.read(data.data(), frame_size_);
 
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Read from buffer - got " << data.length() << " bytes of data";
+  DFS_LOG(debug) << "TCP peer: Read from buffer - got " << data.length() << " bytes of data";
 
   if (data.empty()) {
     return;
   }
 
-  BOOST_LOG_TRIVIAL(debug) << "TCP peer: Receiving data";
+  DFS_LOG(debug) << "TCP peer: Receiving data";
 
   if (stream_processor_) {
     std::istringstream iss(data);
@@ -197,14 +292,14 @@ void TCP_Peer::process_received_data() {
       boost::asio::ip::tcp::endpoint remote_endpoint = socket_->remote_endpoint();
       std::string source_id = remote_endpoint.address().to_string() + ":" + 
                    std::to_string(remote_endpoint.port());
-      BOOST_LOG_TRIVIAL(debug) << "TCP peer: Processing data from " << source_id;
+      DFS_LOG(debug) << "TCP peer: Processing data from " << source_id;
       stream_processor_(iss);
     } catch (const std::exception& e) {
-      BOOST_LOG_TRIVIAL(error) << "TCP peer: Stream processor error: " << e.what();
+      DFS_LOG(error) << "TCP peer: Stream processor error: " << e.what();
     }
   } else {
     input_buffer_->sputn(data.c_str(), data.length());
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Data forwarded to input stream";
+    DFS_LOG(debug) << "TCP peer: Data forwarded to input stream";
   }
 }
 
@@ -217,41 +312,95 @@ bool TCP_Peer::send_message(const std::string& message, std::size_t total_size)
   return send_stream(iss, total_size);
 }
 
-bool TCP_Peer::send_size(std::size_t total_size) {
-  try {
-    // Write total_size as raw bytes to socket
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Starting to send total size";
-    boost::asio::write(*socket_, boost::asio::buffer(&total_size, sizeof(total_size)));
-    BOOST_LOG_TRIVIAL(info) << "TCP peer: Sent total size: " << total_size;
-    return true;
-  }
-  catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Failed to send total size: " << e.what();
+bool TCP_Peer::send_segment(const char* data, std::size_t size, bool last) {
+  DFS_SCOPED_TIMER("peer.send_segment");
+  // Header and data leave in one gathered write
+  std::size_t header = last ? size : size | SEGMENT_CONTINUES;
+  std::array<boost::asio::const_buffer, 2> buffers{
+    boost::asio::buffer(&header, sizeof(header)),
+    boost::asio::buffer(data, size)
+  };
+  boost::system::error_code ec;
+  std::size_t bytes_written = boost::asio::write(*socket_, buffers, ec);
+  return count_write(bytes_written, sizeof(header) + size, ec);
+}
+
+bool TCP_Peer::abort_frame() {
+  DFS_LOG(warning) << "TCP peer: Aborting frame to peer " << static_cast<int>(peer_id_);
+  std::size_t header = FRAME_ABORTED;
+  return send_buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+bool TCP_Peer::send_buffer(const char* data, std::size_t size) {
+  boost::system::error_code ec;
+  std::size_t bytes_written = boost::asio::write(
+    *socket_,
+    boost::asio::buffer(data, size),
+    boost::asio::transfer_exactly(size),
+    ec
+  );
+  return count_write(bytes_written, size, ec);
+}
+
+bool TCP_Peer::count_write(std::size_t bytes_written, std::size_t size, const boost::system::error_code& ec) {
+  peer_metrics().bytes_sent.inc(bytes_written);
+  link_.bytes_sent.inc(bytes_written);
+  if (ec || bytes_written != size) {
+    DFS_LOG(error) << "TCP peer: Stream send error: " << ec.message();
+    peer_metrics().send_errors.inc();
+    link_.send_errors.inc();
     return false;
   }
+  return true;
+}
+
+std::unique_lock<std::mutex> TCP_Peer::lock_for_send() {
+  link_.send_waiters.add();
+  std::unique_lock<std::mutex> lock(io_mutex_);
+  link_.send_waiters.sub();
+  return lock;
+}
+
+void TCP_Peer::begin_frame() {
+  link_.in_flight.add();
+}
+
+void TCP_Peer::end_frame(bool sent) {
+  link_.in_flight.sub();
+  if (sent) {
+    link_.frames_sent.inc();
+  }
 }
 
 bool TCP_Peer::send_stream(std::istream& input_stream, std::size_t total_size, std::size_t buffer_size) {
+  DFS_SCOPED_TIMER("peer.send_stream");
   if (!socket_ || !socket_->is_open()) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Cannot send stream - socket not connected";
+    DFS_LOG(error) << "TCP peer: Cannot send stream - socket not connected";
     return false;
   }
 
   try {
-    std::unique_lock<std::mutex> lock(io_mutex_);
+    std::unique_lock<std::mutex> lock = lock_for_send();
     std::vector<char> buffer(buffer_size);
-    boost::system::error_code ec;
     std::size_t total_bytes_sent = 0;
 
-    // First send the total size
-    if (!send_size(total_size)) {
-      BOOST_LOG_TRIVIAL(error) << "TCP peer: Failed to send total size";
-      return false;
-    }
+    // Ends the frame on every return path, counting it only when complete
+    bool frame_sent = false;
+    begin_frame();
+    struct FrameGuard {
+      TCP_Peer& peer;
+      bool& sent;
+      ~FrameGuard() { peer.end_frame(sent); }
+    } frame_guard{*this, frame_sent};
 
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Peer " << static_cast<int>(peer_id_) 
+    DFS_LOG(debug) << "TCP peer: Peer " << static_cast<int>(peer_id_) 
                             << " starting to send " << total_size << " bytes";
 
+    // An empty frame is a single empty segment
+    if (total_size == 0 && !send_segment(buffer.data(), 0, true)) {
+      return false;
+    }
+
     // Read and send data in chunks until we've sent exactly total_size bytes
     while (input_stream.good() && total_bytes_sent < total_size) {
       // Calculate how many bytes to read in this chunk
@@ -261,40 +410,36 @@ bool TCP_Peer::send_stream(std::istream& input_stream, std::size_t total_size, s
       input_stream.read(buffer.data(), chunk_size);
       std::size_t bytes_read = input_stream.gcount();
 
-      BOOST_LOG_TRIVIAL(debug) << "TCP peer: Peer " << static_cast<int>(peer_id_) 
+      DFS_LOG(debug) << "TCP peer: Peer " << static_cast<int>(peer_id_) 
                               << " read " << bytes_read << " bytes from stream";
 
       if (bytes_read > 0) {
-        // Write exact number of bytes read
-        std::size_t bytes_written = boost::asio::write(
-          *socket_,
-          boost::asio::buffer(buffer.data(), bytes_read),
-          boost::asio::transfer_exactly(bytes_read),
-          ec
-        );
-
-        if (ec || bytes_written != bytes_read) {
-          BOOST_LOG_TRIVIAL(error) << "TCP peer: Stream send error: " << ec.message();
+        // Each chunk is a segment, the one reaching total_size ends the frame
+        bool last = total_bytes_sent + bytes_read == total_size;
+        if (!send_segment(buffer.data(), bytes_read, last)) {
           return false;
         }
 
-        total_bytes_sent += bytes_written;
-        BOOST_LOG_TRIVIAL(debug) << "TCP peer: Sent " << bytes_written 
+        total_bytes_sent += bytes_read;
+        DFS_LOG(debug) << "TCP peer: Sent " << bytes_read 
                                 << " bytes, total sent: " << total_bytes_sent 
                                 << " / " << total_size;
       }
     }
 
     if (total_bytes_sent != total_size) {
-      BOOST_LOG_TRIVIAL(error) << "TCP peer: Failed to send expected amount of data. Sent " 
+      DFS_LOG(error) << "TCP peer: Failed to send expected amount of data. Sent " 
                               << total_bytes_sent << " of " << total_size << " bytes";
+      // The receiver drops what it got, so the next frame is read from its start
+      abort_frame();
       return false;
     }
 
-    BOOST_LOG_TRIVIAL(debug) << "TCP peer: Successfully sent " << total_bytes_sent << " bytes";
+    DFS_LOG(debug) << "TCP peer: Successfully sent " << total_bytes_sent << " bytes";
+    frame_sent = true;
     return true;
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP peer: Stream send error: " << e.what();
+    DFS_LOG(error) << "TCP peer: Stream send error: " << e.what();
     return false;
   }
 }
@@ -317,12 +462,12 @@ bool TCP_Peer::send_stream(std::istream& input_stream, std::size_t total_size, s
     // Shutdown both send and receive operations
     socket_->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
     if (ec) {
-      BOOST_LOG_TRIVIAL(error) << "TCP peer: Socket shutdown error: " << ec.message();
+      DFS_LOG(error) << "TCP peer: Socket shutdown error: " << ec.message();
     }
 
     socket_->close(ec);
     if (ec) {
-      BOOST_LOG_TRIVIAL(error) << "TCP peer: Socket close error: " << ec.message();
+      DFS_LOG(error) << "TCP peer: Socket close error: " << ec.message();
     }
   }
 
@@ -354,5 +499,46 @@ boost::asio::ip::tcp::socket& TCP_Peer::get_socket() {
   return *socket_;
 }
 
+PeerStats TCP_Peer::stats() const {
+  PeerStats stats;
+  stats.peer_id = peer_id_;
+  stats.bytes_sent = link_.bytes_sent.value();
+  stats.bytes_received = link_.bytes_received.value();
+  stats.frames_sent = link_.frames_sent.value();
+  stats.frames_received = link_.frames_received.value();
+  stats.send_errors = link_.send_errors.value();
+  stats.receive_errors = link_.receive_errors.value();
+  stats.in_flight = link_.in_flight.value();
+  stats.send_waiters = link_.send_waiters.value();
+
+  if (!socket_ || !socket_->is_open()) {
+    return stats;
+  }
+  stats.connected = true;
+
+  boost::system::error_code ec;
+  auto endpoint = socket_->remote_endpoint(ec);
+  if (!ec) {
+    stats.remote_endpoint = endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+  }
+
+  // Kernel view of the connection, read without touching the send path
+  int fd = const_cast<boost::asio::ip::tcp::socket&>(*socket_).native_handle();
+  tcp_info info{};
+  socklen_t length = sizeof(info);
+  if (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0) {
+    stats.tcp_info_valid = true;
+    stats.rtt_us = info.tcpi_rtt;
+    stats.rtt_var_us = info.tcpi_rttvar;
+    stats.retransmits = info.tcpi_total_retrans;
+    stats.congestion_window = info.tcpi_snd_cwnd;
+  }
+  int queued = 0;
+  if (::ioctl(fd, SIOCOUTQ, &queued) == 0 && queued > 0) {
+    stats.socket_send_queue = static_cast<std::uint64_t>(queued);
+  }
+  return stats;
+}
+
 } // namespace network
 } // namespace dfs
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "network/tcp_server.hpp"
+#include "logger/logger.hpp"
 #include "network/tcp_peer.hpp"
 #include <boost/bind/bind.hpp>
 #include <thread>
@@ -16,7 +17,7 @@ TCP_Server::TCP_Server(const uint16_t port, const std::string& address, const ui
   , port_(port)
   , address_(address)
   , ID_(ID) {
-  BOOST_LOG_TRIVIAL(info) << "TCP server: Initializing TCP server " << ID << " on " << address << ":" << port;
+  DFS_LOG(info) << "TCP server: Initializing TCP server " << ID << " on " << address << ":" << port;
 }
 
 TCP_Server::~TCP_Server() {
@@ -30,19 +31,19 @@ TCP_Server::~TCP_Server() {
 
 bool TCP_Server::start_listener() {
   if (is_running_) {
-    BOOST_LOG_TRIVIAL(warning) << "TCP server: erver already running";
+    DFS_LOG(warning) << "TCP server: erver already running";
     return false;
   }
 
   try {
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Endpoint created";
+    DFS_LOG(debug) << "TCP server: Endpoint created";
     // Create endpoint
     boost::asio::ip::tcp::endpoint endpoint(
       boost::asio::ip::make_address(address_),
       port_
     );
 
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Acceptor created";
+    DFS_LOG(debug) << "TCP server: Acceptor created";
     // Create acceptor
     acceptor_ = std::make_unique<boost::asio::ip::tcp::acceptor>(
       io_context_,
@@ -52,25 +53,25 @@ bool TCP_Server::start_listener() {
     is_running_ = true;
 
     // Start accepting connections
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Starting to accept connections";
+    DFS_LOG(debug) << "TCP server: Starting to accept connections";
     start_accept();
 
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Starting IO context";
+    DFS_LOG(debug) << "TCP server: Starting IO context";
     // Start io_context in a separate thread
     io_thread_ = std::make_unique<std::thread>([this]() {
       try {
         boost::asio::io_context::work work(io_context_);
         io_context_.run();
       } catch (const std::exception& e) {
-        BOOST_LOG_TRIVIAL(error) << "TCP server: IO context error: " << e.what();
+        DFS_LOG(error) << "TCP server: IO context error: " << e.what();
         is_running_ = false;
       }
     });
 
-    BOOST_LOG_TRIVIAL(info) << "TCP server: Server started successfully on " << address_ << ":" << port_;
+    DFS_LOG(info) << "TCP server: Server started successfully on " << address_ << ":" << port_;
     return true;
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: Failed to start server: " << e.what();
+    DFS_LOG(error) << "TCP server: Failed to start server: " << e.what();
     return false;
   }
 }
@@ -80,7 +81,7 @@ void TCP_Server::start_accept() {
     return;
   }
 
-  BOOST_LOG_TRIVIAL(debug) << "TCP server: Creating new socket for incoming connection";
+  DFS_LOG(debug) << "TCP server: Creating new socket for incoming connection";
 
   // Create new socket for incoming connection
   auto socket = std::make_shared<boost::asio::ip::tcp::socket>(io_context_);
@@ -89,10 +90,10 @@ void TCP_Server::start_accept() {
   acceptor_->async_accept(*socket,
     [this, socket](const boost::system::error_code& error) {
       if (!error) {
-        BOOST_LOG_TRIVIAL(debug) << "TCP server: Calling receive_handshake for incoming connection";
+        DFS_LOG(debug) << "TCP server: Calling receive_handshake for incoming connection";
         receive_handshake(socket);  // Process new connection with handshake
       } else {
-        BOOST_LOG_TRIVIAL(error) << "TCP server: Accept error: " << error.message();
+        DFS_LOG(error) << "TCP server: Accept error: " << error.message();
       }
       start_accept();  // Continue accepting new connections
     });
@@ -103,7 +104,7 @@ void TCP_Server::shutdown() {
     return;
   }
 
-  BOOST_LOG_TRIVIAL(info) << "TCP server: Initiating server shutdown";
+  DFS_LOG(info) << "TCP server: Initiating server shutdown";
 
   is_running_ = false;
 
@@ -112,7 +113,7 @@ void TCP_Server::shutdown() {
     boost::system::error_code ec;
     acceptor_->close(ec);
     if (ec) {
-      BOOST_LOG_TRIVIAL(error) << "TCP server: Error closing acceptor: " << ec.message();
+      DFS_LOG(error) << "TCP server: Error closing acceptor: " << ec.message();
     }
   }
 
@@ -124,7 +125,7 @@ void TCP_Server::shutdown() {
     io_thread_->join();
   }
 
-  BOOST_LOG_TRIVIAL(info) << "TCP server: Server shutdown complete";
+  DFS_LOG(info) << "TCP server: Server shutdown complete";
 }
   
 
@@ -133,7 +134,7 @@ void TCP_Server::shutdown() {
 //==============================================
   
 bool TCP_Server::initiate_handshake(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
-  BOOST_LOG_TRIVIAL(debug) << "TCP server: Initiating handshake request";
+  DFS_LOG(debug) << "TCP server: Initiating handshake request";
   try {
     if (!send_ID(socket)) {
       return false;
@@ -141,15 +142,15 @@ bool TCP_Server::initiate_handshake(std::shared_ptr<boost::asio::ip::tcp::socket
 
     uint8_t peer_id = read_ID(socket);
     // Create peer only after full ID exchange
-    if (peer_manager_ && !peer_manager_->has_peer(peer_id)) {
-      BOOST_LOG_TRIVIAL(debug) << "TCP server: Creating new peer with ID: " << static_cast<int>(peer_id);
+    if (peer_manager_ && admit_peer(peer_id)) {
+      DFS_LOG(debug) << "TCP server: Creating new peer with ID: " << static_cast<int>(peer_id);
       peer_manager_->create_peer(socket, peer_id);
       return true;
     }
-    BOOST_LOG_TRIVIAL(warning) << "TCP server: Peer with ID " << static_cast<int>(peer_id) << " already exists";
+    DFS_LOG(warning) << "TCP server: Peer with ID " << static_cast<int>(peer_id) << " already exists";
     return false;
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: Handshake failed: " << e.what();
+    DFS_LOG(error) << "TCP server: Handshake failed: " << e.what();
     return false;
   }
 }
@@ -157,13 +158,13 @@ bool TCP_Server::initiate_handshake(std::shared_ptr<boost::asio::ip::tcp::socket
 bool TCP_Server::send_ID(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
   try {
     // Write ID_ as raw bytes to socket
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Starting to send ID";
+    DFS_LOG(debug) << "TCP server: Starting to send ID";
     boost::asio::write(*socket, boost::asio::buffer(&ID_, sizeof(ID_)));
-    BOOST_LOG_TRIVIAL(info) << "TCP server: Sent ID: " << static_cast<int>(ID_);
+    DFS_LOG(info) << "TCP server: Sent ID: " << static_cast<int>(ID_);
     return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: Failed to send ID: " << e.what();
+    DFS_LOG(error) << "TCP server: Failed to send ID: " << e.what();
     return false;
   }
 }
@@ -174,51 +175,64 @@ bool TCP_Server::send_ID(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
 //==============================================
 
 void TCP_Server::receive_handshake(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
-  BOOST_LOG_TRIVIAL(debug) << "TCP server: Receiving handshake request";
+  DFS_LOG(debug) << "TCP server: Receiving handshake request";
   if (!peer_manager_) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: No PeerManager set";
+    DFS_LOG(error) << "TCP server: No PeerManager set";
     socket->close();
     return;
   }
 
   try {
     uint8_t peer_id = read_ID(socket);
-    if (peer_manager_->has_peer(peer_id)) {
-      BOOST_LOG_TRIVIAL(warning) << "TCP server: Peer " << static_cast<int>(peer_id) << " already exists";
+    if (!admit_peer(peer_id)) {
+      DFS_LOG(warning) << "TCP server: Peer " << static_cast<int>(peer_id) << " already exists";
       socket->close();
       return;
     }
 
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Preparing to send ID back to peer: " << static_cast<int>(ID_);
+    DFS_LOG(debug) << "TCP server: Preparing to send ID back to peer: " << static_cast<int>(ID_);
     if (!send_ID(socket)) {
-      BOOST_LOG_TRIVIAL(error) << "TCP server: Failed to send ID back to peer";
+      DFS_LOG(error) << "TCP server: Failed to send ID back to peer";
       socket->close();
       return;
     }
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Successfully sent ID back to peer";
+    DFS_LOG(debug) << "TCP server: Successfully sent ID back to peer";
 
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Creating new peer with ID: " << static_cast<int>(peer_id);
+    DFS_LOG(debug) << "TCP server: Creating new peer with ID: " << static_cast<int>(peer_id);
     // Create peer only after full ID exchange
     peer_manager_->create_peer(socket, peer_id);
-    BOOST_LOG_TRIVIAL(debug) << "TCP server: Handshake complete for peer: " << static_cast<int>(peer_id);
+    DFS_LOG(debug) << "TCP server: Handshake complete for peer: " << static_cast<int>(peer_id);
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: Handshake failed: " << e.what();
+    DFS_LOG(error) << "TCP server: Handshake failed: " << e.what();
     socket->close();
   }
 }
 
+bool TCP_Server::admit_peer(uint8_t peer_id) {
+  if (!peer_manager_->has_peer(peer_id)) {
+    return true;
+  }
+  if (peer_manager_->is_connected(peer_id)) {
+    return false;
+  }
+  // The old connection is gone, the peer is reconnecting
+  DFS_LOG(info) << "TCP server: Replacing lost connection to peer " << static_cast<int>(peer_id);
+  peer_manager_->remove_peer(peer_id);
+  return true;
+}
+
 uint8_t TCP_Server::read_ID(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
-  BOOST_LOG_TRIVIAL(debug) << "TCP server: Starting to read ID";
+  DFS_LOG(debug) << "TCP server: Starting to read ID";
   uint8_t peer_id;
   try {
     // Read exact number of bytes for ID
     boost::asio::read(*socket, boost::asio::buffer(&peer_id, sizeof(peer_id)));
-    BOOST_LOG_TRIVIAL(info) << "TCP server: Received ID: " << static_cast<int>(peer_id);
+    DFS_LOG(info) << "TCP server: Received ID: " << static_cast<int>(peer_id);
     return peer_id;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: Failed to read ID: " << e.what();
+    DFS_LOG(error) << "TCP server: Failed to read ID: " << e.what();
     throw;
   }
 }
@@ -231,22 +245,22 @@ uint8_t TCP_Server::read_ID(std::shared_ptr<boost::asio::ip::tcp::socket> socket
 bool TCP_Server::initiate_connection(const std::string& remote_address, uint16_t remote_port,
                                    std::shared_ptr<boost::asio::ip::tcp::socket>& socket) {
   try {
-    BOOST_LOG_TRIVIAL(info) << "TCP server: Resolving address to endpoints";
+    DFS_LOG(info) << "TCP server: Resolving address to endpoints";
 
     // Resolve remote address to endpoints
     boost::asio::ip::tcp::resolver resolver(io_context_);
     auto endpoints = resolver.resolve(remote_address, std::to_string(remote_port));
 
-    BOOST_LOG_TRIVIAL(info) << "TCP server: Attempting to connect to " << remote_address << ":" << remote_port;
+    DFS_LOG(info) << "TCP server: Attempting to connect to " << remote_address << ":" << remote_port;
 
     // Connect to the first available endpoint
     boost::asio::connect(*socket, endpoints);
 
-    BOOST_LOG_TRIVIAL(info) << "TCP server: Successfully connected to " << remote_address << ":" << remote_port;
+    DFS_LOG(info) << "TCP server: Successfully connected to " << remote_address << ":" << remote_port;
     return true;
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "TCP server: Connection failed: " << e.what();
+    DFS_LOG(error) << "TCP server: Connection failed: " << e.what();
     return false;
   }
 }
@@ -268,7 +282,7 @@ bool TCP_Server::connect(const std::string& remote_address, uint16_t remote_port
 
 void TCP_Server::set_peer_manager(PeerManager& peer_manager) {
   peer_manager_ = &peer_manager;
-  BOOST_LOG_TRIVIAL(info) << "TCP server: PeerManager set for TCP server " << ID_;
+  DFS_LOG(info) << "TCP server: PeerManager set for TCP server " << ID_;
 }
 
 } // namespace network
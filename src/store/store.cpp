@@ -1,20 +1,290 @@
 #include "store/store.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
 #include <iomanip>
-#include <boost/log/trivial.hpp>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <boost/endian/conversion.hpp>
+#include "logger/logger.hpp"
+#include "metrics/hot_path.hpp"
+#include "metrics/metrics.hpp"
+#include "tracing/tracer.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <thread>
 
 namespace dfs {
 namespace store {
+
+namespace {
+
+// Process wide store metrics, shared by every Store instance
+struct StoreMetrics {
+  metrics::Histogram& store_latency;
+  metrics::Histogram& get_latency;
+  metrics::Histogram& remove_latency;
+  metrics::Counter& bytes_written;
+  metrics::Counter& bytes_read;
+  metrics::Counter& errors;
+  metrics::Counter& versions_preserved;
+  metrics::Counter& versions_reclaimed;
+  metrics::Counter& promotions;
+  metrics::Counter& demotions;
+  metrics::Gauge& fast_bytes;
+  metrics::Gauge& capacity_bytes;
+};
+
+StoreMetrics& store_metrics() {
+  auto& registry = metrics::Registry::global();
+  static StoreMetrics instance{
+    registry.histogram("dfs_store_op_duration_seconds", "Local store operation latency",
+                       metrics::HistogramUnit::Seconds, {{"op", "store"}}),
+    registry.histogram("dfs_store_op_duration_seconds", "Local store operation latency",
+                       metrics::HistogramUnit::Seconds, {{"op", "get"}}),
+    registry.histogram("dfs_store_op_duration_seconds", "Local store operation latency",
+                       metrics::HistogramUnit::Seconds, {{"op", "remove"}}),
+    registry.counter("dfs_store_bytes_written_total", "Bytes written to the local store"),
+    registry.counter("dfs_store_bytes_read_total", "Bytes read from the local store"),
+    registry.counter("dfs_store_errors_total", "Local store operations that failed"),
+    registry.counter("dfs_store_snapshot_versions_preserved_total",
+                     "Replaced or removed objects kept aside because a snapshot still sees them"),
+    registry.counter("dfs_store_snapshot_versions_reclaimed_total",
+                     "Kept versions deleted after no snapshot saw them any more"),
+    registry.counter("dfs_store_tier_moves_total", "Objects moved between storage tiers",
+                     {{"direction", "promote"}}),
+    registry.counter("dfs_store_tier_moves_total", "Objects moved between storage tiers",
+                     {{"direction", "demote"}}),
+    registry.gauge("dfs_store_tier_bytes", "Object bytes per storage tier after the last mover pass",
+                   {{"tier", "fast"}}),
+    registry.gauge("dfs_store_tier_bytes", "Object bytes per storage tier after the last mover pass",
+                   {{"tier", "capacity"}})
+  };
+  return instance;
+}
+
+// Name of the index log inside the store directory
+constexpr const char* INDEX_LOG = "index.log";
+// Snapshot state inside the store directory: the snapshot log, and the kept
+// versions as versions/<key hash>/<first snapshot id>-<last snapshot id>
+constexpr const char* SNAPSHOT_DIR = ".snapshots";
+constexpr const char* SNAPSHOT_LOG = "snapshots.log";
+constexpr const char* VERSIONS_DIR = "versions";
+constexpr std::size_t MAX_SNAPSHOT_NAME = 64;
+// Holds the capacity tier directory of a tiered store
+constexpr const char* TIER_CONFIG = "capacity_tier";
+// Access records decayed below this many reads are forgotten
+constexpr double FORGOTTEN_READS = 0.01;
+
+// Suffixes the temporary files new objects are written to
+std::atomic<uint64_t> temp_counter{0};
+
+// Incremental SHA-256 over OpenSSL EVP
+class Sha256 {
+public:
+  Sha256() : ctx_(EVP_MD_CTX_new()) {
+    if (!ctx_) {
+      throw StoreError("Store: Failed to create hash context");
+    }
+    if (!EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr)) {
+      EVP_MD_CTX_free(ctx_);
+      throw StoreError("Store: Failed to initialize hash context");
+    }
+  }
+  ~Sha256() { EVP_MD_CTX_free(ctx_); }
+  Sha256(const Sha256&) = delete;
+  Sha256& operator=(const Sha256&) = delete;
+
+  void update(const void* data, std::size_t length) {
+    if (!EVP_DigestUpdate(ctx_, data, length)) {
+      throw StoreError("Store: Failed to update hash");
+    }
+  }
+
+  // Raw digest, the hash cannot be updated afterwards
+  std::vector<unsigned char> finish() {
+    std::vector<unsigned char> digest(EVP_MAX_MD_SIZE);
+    unsigned int length = 0;
+    if (!EVP_DigestFinal_ex(ctx_, digest.data(), &length)) {
+      throw StoreError("Store: Failed to finalize hash");
+    }
+    digest.resize(length);
+    return digest;
+  }
+
+  std::string hex_digest() {
+    std::stringstream ss;
+    for (unsigned char byte : finish()) {
+      ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+    }
+    return ss.str();
+  }
+
+private:
+  EVP_MD_CTX* ctx_;
+};
+
+// Passes what is written to it on to a file, hashing it on the way, for
+// content that is produced into a stream rather than read from one
+class DigestingBuffer : public std::streambuf {
+public:
+  DigestingBuffer(std::ofstream& file, Sha256& content) : file_(file), content_(content) {}
+
+  std::uintmax_t bytes_written() const { return bytes_written_; }
+
+protected:
+  std::streamsize xsputn(const char* data, std::streamsize count) override {
+    if (!file_.write(data, count)) {
+      return 0;
+    }
+    content_.update(data, static_cast<std::size_t>(count));
+    bytes_written_ += static_cast<std::uintmax_t>(count);
+    return count;
+  }
+
+  int_type overflow(int_type ch) override {
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+      return traits_type::not_eof(ch);
+    }
+    char c = traits_type::to_char_type(ch);
+    return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+  }
+
+private:
+  std::ofstream& file_;
+  Sha256& content_;
+  std::uintmax_t bytes_written_{0};
+};
+
+// Merkle tree contribution of key at the given version. The generation is
+// part of it, so replicas that agree on content but not on how often it
+// changed still compare different
+uint64_t entry_value(const std::string& hash, const std::string& digest, uint64_t generation) {
+  unsigned char count[8];
+  boost::endian::store_big_u64(count, generation);
+  Sha256 entry;
+  entry.update(hash.data(), hash.size());
+  entry.update(digest.data(), digest.size());
+  entry.update(count, sizeof(count));
+  return boost::endian::load_big_u64(entry.finish().data());
+}
+
+// A put record, or a tombstone record for an empty digest
+void write_put_record(std::ostream& log, const std::string& key, const std::string& digest, uint64_t generation) {
+  if (digest.empty()) {
+    log << "~ " << generation << ' ' << key.size() << ':' << key << '\n';
+  } else {
+    log << "* " << digest << ' ' << generation << ' ' << key.size() << ':' << key << '\n';
+  }
+}
+
+void write_erase_record(std::ostream& log, const std::string& key) {
+  log << "- " << key.size() << ':' << key << '\n';
+}
+
+// {root}/{hash[0:2]}/{hash[2:4]}/{hash[4:6]}/{remaining_hash}
+std::filesystem::path path_for_hash(const std::filesystem::path& root, const std::string& hash) {
+  std::filesystem::path path = root;
+  for (size_t i = 0; i < 6; i += 2) {
+    path /= hash.substr(i, 2);
+  }
+  return path / hash.substr(6);
+}
+
+// Inverse of path_for_hash for a path relative to the root, empty for
+// anything that is not an object, such as logs and temporary files
+std::string hash_for_path(const std::filesystem::path& relative) {
+  std::string hash;
+  std::size_t parts = 0;
+  for (const auto& part : relative) {
+    hash += part.string();
+    ++parts;
+  }
+  bool hex = std::all_of(hash.begin(), hash.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); });
+  return parts == 4 && hash.size() == 64 && hex ? hash : std::string();
+}
+
+// Snapshot names become log tokens and report labels, so they stay plain
+bool valid_snapshot_name(const std::string& name) {
+  return !name.empty() && name.size() <= MAX_SNAPSHOT_NAME && name[0] != '.' &&
+         std::all_of(name.begin(), name.end(), [](char c) {
+           return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.';
+         });
+}
+
+// Reads the snapshot range of a kept version from its file name
+bool parse_version_name(const std::string& name, uint64_t& first, uint64_t& last) {
+  char dash = 0;
+  std::istringstream iss(name);
+  return (iss >> first >> dash >> last) && dash == '-' && iss.peek() == EOF;
+}
+
+// Calls visit(hash, path) for every object under root
+template <typename Visit>
+void for_each_object(const std::filesystem::path& root, Visit visit) {
+  std::error_code ec;
+  for (auto it = std::filesystem::recursive_directory_iterator(root, ec);
+       !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+    if (it->path().filename() == SNAPSHOT_DIR) {
+      it.disable_recursion_pending();
+    } else if (it->is_regular_file(ec)) {
+      std::string hash = hash_for_path(it->path().lexically_relative(root));
+      if (!hash.empty()) {
+        visit(hash, it->path());
+      }
+    }
+  }
+}
+
+// Identity of a file, changes when another file is renamed over its path
+bool file_identity(const std::filesystem::path& path, dev_t& device, ino_t& inode) {
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+  device = info.st_dev;
+  inode = info.st_ino;
+  return true;
+}
+
+} // namespace
   
 //==============================================
 // CONSTRUCTOR AND DESTRUCTOR
 //==============================================
   
 // Initialize store with base directory path and ensure it exists
-Store::Store(const std::string& base_path) : base_path_(base_path) {
-  BOOST_LOG_TRIVIAL(info) << "Store: Initializing Store with base path: " << base_path;
+Store::Store(const std::string& base_path, IndexFilter index_filter)
+  : base_path_(base_path)
+  , index_filter_(std::move(index_filter))
+  , leaves_(MerkleTree::LEAVES) {
+  DFS_LOG(info) << "Store: Initializing Store with base path: " << base_path;
   check_directory_exists(base_path_); // Create base directory if it doesn't exist
-  BOOST_LOG_TRIVIAL(debug) << "Store: Store directory created/verified at: " << base_path;
+  DFS_LOG(debug) << "Store: Store directory created/verified at: " << base_path;
+
+  load_tier_config();
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  load_index();
+  std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex_);
+  load_snapshots();
+}
+
+Store::~Store() {
+  {
+    std::scoped_lock lock(snapshot_mutex_, tier_mutex_);
+    stopping_ = true;
+  }
+  reclaim_cv_.notify_all();
+  tier_cv_.notify_all();
+  if (reclaim_thread_ && reclaim_thread_->joinable()) {
+    reclaim_thread_->join();
+  }
+  if (tier_thread_ && tier_thread_->joinable()) {
+    tier_thread_->join();
+  }
 }
 
   
@@ -23,69 +293,134 @@ Store::Store(const std::string& base_path) : base_path_(base_path) {
 //==============================================
 
 void Store::store(const std::string& key, std::istream& data) {
-  BOOST_LOG_TRIVIAL(info) << "Store: Storing data with key: " << key;
+  DFS_LOG(info) << "Store: Storing data with key: " << key;
+  StoreMetrics& stats = store_metrics();
+  metrics::ScopedTimer timer(stats.store_latency);
+  tracing::Span span("store write");
 
   if (!data.good()) {
-    BOOST_LOG_TRIVIAL(error) << "Store: Invalid input stream provided for key: " << key;
+    DFS_LOG(error) << "Store: Invalid input stream provided for key: " << key;
+    stats.errors.inc();
     throw StoreError("Store: Invalid input stream");
   }
 
   // Generate path from key and ensure directory structure exists
-  std::filesystem::path file_path = resolve_key_path(key);
+  std::string hash = hash_key(key);
+  std::filesystem::path file_path = get_path_for_hash(hash);
   check_directory_exists(file_path.parent_path());
-  BOOST_LOG_TRIVIAL(debug) << "Store: Calculated file path: " << file_path.string();
+  DFS_LOG(debug) << "Store: Calculated file path: " << file_path.string();
 
-  // Open output file in binary mode for cross-platform consistency
-  std::ofstream file(file_path, std::ios::binary);
+  // The content goes to a temporary file that is renamed over the object
+  // once complete, so readers and snapshots never see a partial version
+  std::filesystem::path temp_path = file_path;
+  temp_path += ".tmp" + std::to_string(temp_counter++);
+  std::ofstream file(temp_path, std::ios::binary);
   if (!file) {
-    throw StoreError("Store: Failed to create file: " + file_path.string());
+    stats.errors.inc();
+    throw StoreError("Store: Failed to create file: " + temp_path.string());
   }
 
   size_t bytes_written = 0;
   char buffer[4096];  
+  // Content digest for the anti-entropy index, computed while the data streams through
+  Sha256 content;
 
   // Check for empty input stream
   data.peek();
   if (data.eof()) {
-    BOOST_LOG_TRIVIAL(debug) << "Store: Storing empty content for key: " << key;
+    DFS_LOG(debug) << "Store: Storing empty content for key: " << key;
     file.close();
-    BOOST_LOG_TRIVIAL(info) << "Store: Successfully stored 0 bytes with key: " << key;
+    install_object(key, hash, temp_path, file_path, content.hex_digest());
+    DFS_LOG(info) << "Store: Successfully stored 0 bytes with key: " << key;
     return;
   }
 
   // Read input stream in chunks and write to file
   while (data.read(buffer, sizeof(buffer))) {
     file.write(buffer, data.gcount());
+    content.update(buffer, data.gcount());
     bytes_written += data.gcount();
   }
 
   // Handle final partial chunk if present
   if (data.gcount() > 0) {
     file.write(buffer, data.gcount());
+    content.update(buffer, data.gcount());
     bytes_written += data.gcount();
   }
 
   file.close();
-  BOOST_LOG_TRIVIAL(info) << "Store: Successfully stored " << bytes_written << " bytes with key: " << key;
+  if (!file) {
+    std::filesystem::remove(temp_path);
+    stats.errors.inc();
+    throw StoreError("Store: Failed to write file: " + temp_path.string());
+  }
+  install_object(key, hash, temp_path, file_path, content.hex_digest());
+  stats.bytes_written.inc(bytes_written);
+  DFS_LOG(info) << "Store: Successfully stored " << bytes_written << " bytes with key: " << key;
 }
 
-void Store::get(const std::string& key, std::stringstream& output) {
-  BOOST_LOG_TRIVIAL(info) << "Store: Retrieving data for key: " << key;
+bool Store::store_output(const std::string& key, const std::function<void(std::ostream&)>& write,
+                         const std::string& expected_digest) {
+  DFS_LOG(info) << "Store: Storing output with key: " << key;
+  StoreMetrics& stats = store_metrics();
+  metrics::ScopedTimer timer(stats.store_latency);
+  tracing::Span span("store write");
 
-  std::filesystem::path file_path = resolve_key_path(key);
-  verify_file_exists(file_path);
+  std::string hash = hash_key(key);
+  std::filesystem::path file_path = get_path_for_hash(hash);
+  check_directory_exists(file_path.parent_path());
 
-  // Handle empty file case
-  if (std::filesystem::file_size(file_path) == 0) {
-    BOOST_LOG_TRIVIAL(debug) << "Store: Retrieved empty content for key: " << key;
-    return;
+  // Written to a temporary file like store, so the object is only replaced
+  // by complete content that passed the digest check
+  std::filesystem::path temp_path = file_path;
+  temp_path += ".tmp" + std::to_string(temp_counter++);
+  std::ofstream file(temp_path, std::ios::binary);
+  if (!file) {
+    stats.errors.inc();
+    throw StoreError("Store: Failed to create file: " + temp_path.string());
   }
 
-  // Open file in binary mode to handle all file types correctly
-  std::ifstream file(file_path, std::ios::binary);
-  if (!file) {
-    throw StoreError("Store: Failed to open file: " + file_path.string());
+  Sha256 content;
+  DigestingBuffer buffer(file, content);
+  std::ostream output(&buffer);
+  std::error_code ec;
+  try {
+    write(output);
+    file.close();
+  } catch (...) {
+    file.close();
+    std::filesystem::remove(temp_path, ec);
+    throw;
+  }
+  if (!output || !file) {
+    std::filesystem::remove(temp_path, ec);
+    stats.errors.inc();
+    throw StoreError("Store: Failed to write file: " + temp_path.string());
+  }
+
+  std::string digest = content.hex_digest();
+  if (!expected_digest.empty() && digest != expected_digest) {
+    std::filesystem::remove(temp_path, ec);
+    DFS_LOG(warning) << "Store: Output for key " << key << " has digest " << digest << " instead of "
+                     << expected_digest << ", keeping the stored version";
+    return false;
   }
+  install_object(key, hash, temp_path, file_path, digest);
+  stats.bytes_written.inc(buffer.bytes_written());
+  DFS_LOG(info) << "Store: Successfully stored " << buffer.bytes_written() << " bytes of output with key: " << key;
+  return true;
+}
+
+void Store::get(const std::string& key, std::stringstream& output) {
+  DFS_LOG(info) << "Store: Retrieving data for key: " << key;
+  StoreMetrics& stats = store_metrics();
+  metrics::ScopedTimer timer(stats.get_latency);
+  tracing::Span span("store read");
+
+  // Open file in binary mode to handle all file types correctly
+  auto opened = open_object(key);
+  std::ifstream& file = *opened;
 
   char buffer[4096];
   size_t total_bytes = 0;
@@ -103,32 +438,65 @@ void Store::get(const std::string& key, std::stringstream& output) {
   }
 
   if (!output.good()) {
+    stats.errors.inc();
     throw StoreError("Store: Failed to write to output stream");
   }
 
-  BOOST_LOG_TRIVIAL(info) << "Store: Successfully streamed " << total_bytes << " bytes for key: " << key;
+  stats.bytes_read.inc(total_bytes);
+  DFS_LOG(info) << "Store: Successfully streamed " << total_bytes << " bytes for key: " << key;
+}
+  
+std::unique_ptr<std::istream> Store::get_stream(const std::string& key) const {
+  DFS_LOG(info) << "Store: Opening stream for key: " << key;
+  return open_object(key);
 }
   
 void Store::remove(const std::string& key) {
-  BOOST_LOG_TRIVIAL(info) << "Store: Removing file with key: " << key;
+  DFS_LOG(info) << "Store: Removing file with key: " << key;
+  StoreMetrics& stats = store_metrics();
+  metrics::ScopedTimer timer(stats.remove_latency);
 
   // Convert the key to its corresponding file path using content-addressing
-  std::filesystem::path file_path = resolve_key_path(key);
+  std::string hash = hash_key(key);
 
-  // Attempt to remove the file, std::filesystem::remove returns true if successful
-  if (std::filesystem::remove(file_path)) {
-    BOOST_LOG_TRIVIAL(info) << "Store: Successfully removed file with key: " << key;
+  // Attempt to remove the file, false when there was none. The index is
+  // updated under the same locks so it never names a file that is gone
+  bool removed;
+  {
+    std::scoped_lock lock(index_mutex_, snapshot_mutex_);
+    removed = retire_object(hash);
+    if (removed) {
+      index_erase(key, hash);
+    }
+  }
+  if (removed) {
+    DFS_LOG(info) << "Store: Successfully removed file with key: " << key;
   } else {
-    BOOST_LOG_TRIVIAL(error) << "Store: Failed to remove file with key: " << key;
+    DFS_LOG(error) << "Store: Failed to remove file with key: " << key;
+    stats.errors.inc();
     throw StoreError("Store: Failed to remove file");
   }
 }
 
 void Store::clear() {
-  BOOST_LOG_TRIVIAL(info) << "Store: Clearing entire store at: " << base_path_;
+  DFS_LOG(info) << "Store: Clearing entire store at: " << base_path_;
+  std::scoped_lock lock(index_mutex_, snapshot_mutex_);
+  index_log_.close();
+  snapshot_log_.close();
   std::filesystem::remove_all(base_path_);
   check_directory_exists(base_path_);
-  BOOST_LOG_TRIVIAL(info) << "Store: Store cleared successfully";
+  if (!tiering_.capacity_path.empty()) {
+    std::filesystem::remove_all(tiering_.capacity_path);
+    check_directory_exists(tiering_.capacity_path);
+    save_tier_config();
+  }
+  {
+    std::lock_guard<std::mutex> access_lock(access_mutex_);
+    access_.clear();
+  }
+  load_index();
+  load_snapshots();
+  DFS_LOG(info) << "Store: Store cleared successfully";
 }
 
   
@@ -137,24 +505,41 @@ void Store::clear() {
 //==============================================
 
 bool Store::has(const std::string& key) const {
-  BOOST_LOG_TRIVIAL(debug) << "Store: Checking existence of key: " << key;
+  DFS_LOG(debug) << "Store: Checking existence of key: " << key;
   
   std::filesystem::path file_path = resolve_key_path(key);
   bool exists = std::filesystem::exists(file_path);
   
-  BOOST_LOG_TRIVIAL(debug) << "Store: Key " << key << (exists ? " exists" : " not found") 
+  DFS_LOG(debug) << "Store: Key " << key << (exists ? " exists" : " not found") 
                            << " at path: " << file_path.string();
   return exists;
 }
 
+void Store::sync(const std::string& key) const {
+  std::filesystem::path file_path = resolve_key_path(key);
+  verify_file_exists(file_path);
+  // The content, then the rename that put it in place
+  for (const auto& path : {file_path, file_path.parent_path()}) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    if (!synced) {
+      store_metrics().errors.inc();
+      throw StoreError("Store: Failed to sync: " + path.string());
+    }
+  }
+}
+
 std::uintmax_t Store::get_file_size(const std::string& key) const {
-  BOOST_LOG_TRIVIAL(debug) << "Store: Getting file size for key: " << key;
+  DFS_LOG(debug) << "Store: Getting file size for key: " << key;
 
   std::filesystem::path file_path = resolve_key_path(key);
   verify_file_exists(file_path);
 
   std::uintmax_t size = std::filesystem::file_size(file_path);
-  BOOST_LOG_TRIVIAL(debug) << "Store: File size for key " << key << ": " << size << " bytes";
+  DFS_LOG(debug) << "Store: File size for key " << key << ": " << size << " bytes";
   return size;
 }
 
@@ -164,27 +549,16 @@ std::uintmax_t Store::get_file_size(const std::string& key) const {
 //==============================================
   
 bool Store::read_file(const std::string& key, size_t lines_per_page) const {
-  BOOST_LOG_TRIVIAL(info) << "Store: Reading file with key: " << key;
+  DFS_LOG(info) << "Store: Reading file with key: " << key;
   try {
-    std::filesystem::path file_path = resolve_key_path(key);
-
-    if (!std::filesystem::exists(file_path)) {
-      BOOST_LOG_TRIVIAL(error) << "Store: File not found: " << file_path.string();
-      return false;
-    }
-    
-    // Open file for reading
-    std::ifstream file(file_path);
-    if (!file) {
-      BOOST_LOG_TRIVIAL(error) << "Store: Failed to open file: " << file_path.string();
-      return false;
-    }
+    // Open file for reading, throws when it is missing
+    auto file = open_object(key);
 
     // Delegate to display function for paginated output
-    return display_file_contents(file, key, lines_per_page);
+    return display_file_contents(*file, key, lines_per_page);
   }
   catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Store: Exception while reading file: " << e.what();
+    DFS_LOG(error) << "Store: Exception while reading file: " << e.what();
     return false;
   }
 }
@@ -204,7 +578,7 @@ bool Store::display_file_contents(std::ifstream& file, const std::string& key,
     #endif
 
     if (clear_result != 0) {
-      BOOST_LOG_TRIVIAL(error) << "Store: Failed to clear screen";
+      DFS_LOG(error) << "Store: Failed to clear screen";
       // Continue execution despite screen clear failure
     }
 
@@ -233,7 +607,7 @@ void Store::print_working_dir() const {
 }
   
   void Store::list() const {
-    BOOST_LOG_TRIVIAL(info) << "Store: Listing contents";
+    DFS_LOG(info) << "Store: Listing contents";
 
     // Display files in the current working directory
     std::cout << "Local Files:" << std::endl;
@@ -253,7 +627,7 @@ void Store::print_working_dir() const {
 }
 
 void Store::move_dir(const std::string& path) {
-  BOOST_LOG_TRIVIAL(info) << "Store: Changing DFS directory to: " << path;
+  DFS_LOG(info) << "Store: Changing DFS directory to: " << path;
 
   std::filesystem::path new_path;
   // Determine if path is absolute or needs to be relative to current base path
@@ -266,47 +640,56 @@ void Store::move_dir(const std::string& path) {
   try {
     // Verify the target directory exists
     if (!std::filesystem::exists(new_path)) {
-      BOOST_LOG_TRIVIAL(error) << "Store: DFS directory does not exist: " << path;
+      DFS_LOG(error) << "Store: DFS directory does not exist: " << path;
       throw StoreError("Store: DFS directory does not exist");
     }
 
     // Ensure the path points to a directory, not a file
     if (!std::filesystem::is_directory(new_path)) {
-      BOOST_LOG_TRIVIAL(error) << "Store: DFS path exists but is not a directory: " << path;
+      DFS_LOG(error) << "Store: DFS path exists but is not a directory: " << path;
       throw StoreError("Store: DFS path is not a directory");
     }
 
-    // Update the base path for the store
+    // Update the base path for the store, the index and snapshots follow the directory
+    std::scoped_lock lock(index_mutex_, snapshot_mutex_);
     base_path_ = new_path;
-    BOOST_LOG_TRIVIAL(info) << "Store: Successfully changed DFS directory to: " << base_path_;
+    load_index();
+    load_snapshots();
+    DFS_LOG(info) << "Store: Successfully changed DFS directory to: " << base_path_;
 
   } catch (const std::filesystem::filesystem_error& e) {
     // Handle filesystem-specific errors (permissions, invalid paths, etc.)
-    BOOST_LOG_TRIVIAL(error) << "Store: Failed to change DFS directory: " << e.what();
+    DFS_LOG(error) << "Store: Failed to change DFS directory: " << e.what();
     throw StoreError("Store: Failed to change DFS directory: " + std::string(e.what()));
   }
 }
 
 void Store::delete_file(const std::string& filename) {
-  BOOST_LOG_TRIVIAL(info) << "Store: Deleting file: " << filename;
+  DFS_LOG(info) << "Store: Deleting file: " << filename;
 
   std::string hash = hash_key(filename);
-  std::filesystem::path file_path = get_path_for_hash(hash);
+  std::filesystem::path file_path;
+  Tier tier = locate(hash, file_path);
 
-  if (!std::filesystem::exists(file_path)) {
-    BOOST_LOG_TRIVIAL(error) << "Store: File not found: " << file_path.string();
+  if (tier == Tier::None) {
+    DFS_LOG(error) << "Store: File not found: " << file_path.string();
     throw StoreError("Store: File not found");
   }
 
-  // Delete the file
-  if (!std::filesystem::remove(file_path)) {
-    BOOST_LOG_TRIVIAL(error) << "Store: Failed to delete file: " << filename;
-    throw StoreError("Store: Failed to delete file");
+  // Delete the file and leave its tombstone under the same locks
+  {
+    std::scoped_lock lock(index_mutex_, snapshot_mutex_);
+    if (!retire_object(hash)) {
+      DFS_LOG(error) << "Store: Failed to delete file: " << filename;
+      throw StoreError("Store: Failed to delete file");
+    }
+    index_delete(filename, hash);
   }
 
-  // Clean up empty parent directories up to base_path_
+  // Clean up empty parent directories up to the root of its tier
+  std::filesystem::path root = root_of(tier);
   auto current = file_path.parent_path();
-  while (current != base_path_) {
+  while (current != root && current.has_relative_path()) {
     if (std::filesystem::is_empty(current)) {
       std::filesystem::remove(current);
       current = current.parent_path();
@@ -315,7 +698,7 @@ void Store::delete_file(const std::string& filename) {
     }
   }
 
-  BOOST_LOG_TRIVIAL(info) << "Store: Successfully deleted file and cleaned up directories: " << filename;
+  DFS_LOG(info) << "Store: Successfully deleted file and cleaned up directories: " << filename;
 }
 
   
@@ -324,62 +707,926 @@ void Store::delete_file(const std::string& filename) {
 //==============================================
 
 std::string Store::hash_key(const std::string& key) const {
-  BOOST_LOG_TRIVIAL(debug) << "Store: Generating hash for key: " << key;
+  DFS_SCOPED_TIMER("store.hash_key");
+  DFS_LOG(debug) << "Store: Generating hash for key: " << key;
+
+  Sha256 sha;
+  sha.update(key.data(), key.size());
+  std::string result = sha.hex_digest();
+  DFS_LOG(debug) << "Store: Generated hash: " << result;
+  return result;
+}
+
+std::filesystem::path Store::get_path_for_hash(const std::string& hash) const {
+  std::filesystem::path path = path_for_hash(base_path_, hash);
+  DFS_LOG(debug) << "Store: Calculated path: " << path.string();
+  return path;
+}
+  
+
+//==============================================
+// ANTI-ENTROPY INDEX
+//==============================================
+
+std::vector<uint64_t> Store::merkle_nodes(const std::vector<std::size_t>& nodes) const {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  std::vector<uint64_t> values;
+  values.reserve(nodes.size());
+  for (std::size_t node : nodes) {
+    if (!MerkleTree::valid_node(node)) {
+      throw StoreError("Store: Invalid Merkle node: " + std::to_string(node));
+    }
+    values.push_back(merkle_.node(node));
+  }
+  return values;
+}
+
+std::vector<Store::IndexEntry> Store::leaf_entries(std::size_t leaf) const {
+  if (leaf >= MerkleTree::LEAVES) {
+    throw StoreError("Store: Invalid Merkle leaf: " + std::to_string(leaf));
+  }
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  std::vector<IndexEntry> entries;
+  entries.reserve(leaves_[leaf].size());
+  for (const auto& [key, record] : leaves_[leaf]) {
+    entries.push_back(IndexEntry{key, record.digest, record.generation});
+  }
+  return entries;
+}
+
+std::string Store::content_digest(const std::string& key) const {
+  std::size_t leaf = MerkleTree::leaf_for_hash(hash_key(key));
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  auto it = leaves_[leaf].find(key);
+  return it == leaves_[leaf].end() ? std::string() : it->second.digest;
+}
+
+Store::ObjectVersion Store::version(const std::string& key) const {
+  std::size_t leaf = MerkleTree::leaf_for_hash(hash_key(key));
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  auto it = leaves_[leaf].find(key);
+  if (it == leaves_[leaf].end() || it->second.digest.empty()) {
+    return ObjectVersion{};
+  }
+  return ObjectVersion{it->second.digest, it->second.generation};
+}
+
+std::string Store::find_by_digest(const std::string& digest) const {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  auto it = keys_by_digest_.find(digest);
+  return it == keys_by_digest_.end() ? std::string() : *it->second.begin();
+}
+
+void Store::record_deletion(const std::string& key, uint64_t generation) {
+  DFS_LOG(info) << "Store: Recording deletion of key: " << key << " at generation " << generation;
+  std::string hash = hash_key(key);
+  std::scoped_lock lock(index_mutex_, snapshot_mutex_);
+  retire_object(hash);
+  index_delete(key, hash, generation);
+}
+
+void Store::raise_generation(const std::string& key, const ObjectVersion& version) {
+  if (!is_indexed(key)) {
+    return;
+  }
+  std::string hash = hash_key(key);
+  std::size_t leaf = MerkleTree::leaf_for_hash(hash);
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  auto it = leaves_[leaf].find(key);
+  if (it == leaves_[leaf].end() || it->second.digest != version.digest ||
+      it->second.generation >= version.generation) {
+    return;
+  }
+  apply_put(key, hash, version.digest, version.generation);
+  append_index_record(key, version.digest, version.generation);
+}
+
+std::size_t Store::indexed_keys() const {
+  std::lock_guard<std::mutex> lock(index_mutex_);
+  return indexed_keys_;
+}
 
-  unsigned char hash[EVP_MAX_MD_SIZE];
-  unsigned int hash_len;
+void Store::load_index() {
+  index_log_.close();
+  merkle_.clear();
+  for (auto& leaf : leaves_) {
+    leaf.clear();
+  }
+  keys_by_digest_.clear();
+  indexed_keys_ = 0;
+
+  // Replay the log, a torn record at the end is what a crash mid-append leaves
+  std::map<std::string, ObjectVersion> live;
+  std::size_t records = 0;
+  std::ifstream log(index_log_path(), std::ios::binary);
+  if (!log) {
+    return;
+  }
+  char op;
+  while (log >> op) {
+    std::string digest;
+    uint64_t generation = 0;
+    std::size_t length = 0;
+    bool put = op == '+' || op == '*';
+    bool tombstone = op == '~';
+    if ((!put && !tombstone && op != '-') || (put && !(log >> digest)) ||
+        ((op == '*' || tombstone) && !(log >> generation)) || !(log >> length) || log.get() != ':') {
+      DFS_LOG(warning) << "Store: Ignoring damaged index log after " << records << " records";
+      break;
+    }
+    std::string key(length, '\0');
+    if (!log.read(key.data(), static_cast<std::streamsize>(length)) || log.get() != '\n') {
+      DFS_LOG(warning) << "Store: Ignoring damaged index log after " << records << " records";
+      break;
+    }
+    if (put || tombstone) {
+      // Older records carry no generation, it counts the digest changes instead
+      auto& version = live[key];
+      if (op != '+') {
+        version.generation = generation;
+      } else if (version.digest != digest) {
+        ++version.generation;
+      }
+      version.digest = digest;
+    } else {
+      live.erase(key);
+    }
+    ++records;
+  }
+  log.close();
+
+  for (const auto& [key, version] : live) {
+    std::string hash = hash_key(key);
+    std::filesystem::path file_path;
+    // Tombstones are kept, or a replica that missed the deletion would bring the key back
+    if (is_indexed(key) && (version.digest.empty() || locate(hash, file_path) != Tier::None)) {
+      apply_put(key, hash, version.digest, version.generation);
+    }
+  }
 
-  // Create a new message digest context for the hashing operation
-  EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-  if (!ctx) {
-    throw StoreError("Store: Failed to create hash context");
+  // Rewrite the log with one record per key, so it stays proportional to the store
+  std::filesystem::path path = index_log_path();
+  std::filesystem::path compacted_path = path;
+  compacted_path += ".tmp";
+  {
+    std::ofstream compacted(compacted_path, std::ios::binary | std::ios::trunc);
+    for (const auto& leaf : leaves_) {
+      for (const auto& [key, record] : leaf) {
+        write_put_record(compacted, key, record.digest, record.generation);
+      }
+    }
+    if (!compacted) {
+      throw StoreError("Store: Failed to compact index log: " + compacted_path.string());
+    }
   }
+  std::filesystem::rename(compacted_path, path);
+  DFS_LOG(info) << "Store: Indexed " << indexed_keys_ << " keys from " << records << " index log records";
+}
 
-  // Initialize the context with SHA-256 algorithm
-  if (!EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr)) {
-    EVP_MD_CTX_free(ctx);
-    throw StoreError("Store: Failed to initialize hash context");
+void Store::index_put(const std::string& key, const std::string& hash, const std::string& digest) {
+  if (!is_indexed(key)) {
+    return;
   }
+  uint64_t generation = apply_put(key, hash, digest);
+  append_index_record(key, digest, generation);
+}
 
-  // Feed the input key data into the hash function
-  if (!EVP_DigestUpdate(ctx, key.c_str(), key.length())) {
-    EVP_MD_CTX_free(ctx);
-    throw StoreError("Store: Failed to update hash");
+void Store::index_delete(const std::string& key, const std::string& hash, uint64_t generation) {
+  if (!is_indexed(key)) {
+    return;
   }
+  generation = apply_put(key, hash, std::string(), generation);
+  append_index_record(key, std::string(), generation);
+}
 
-  // Generate the final hash value
-  if (!EVP_DigestFinal_ex(ctx, hash, &hash_len)) {
-    EVP_MD_CTX_free(ctx);
-    throw StoreError("Store: Failed to finalize hash");
+void Store::index_erase(const std::string& key, const std::string& hash) {
+  if (!is_indexed(key)) {
+    return;
+  }
+  apply_erase(key, hash);
+  if (!index_log_.is_open()) {
+    index_log_.open(index_log_path(), std::ios::binary | std::ios::app);
   }
+  write_erase_record(index_log_, key);
+  index_log_.flush();
+}
 
-  // Clean up the context
-  EVP_MD_CTX_free(ctx);
+void Store::append_index_record(const std::string& key, const std::string& digest, uint64_t generation) {
+  // Opened on first use, so directories that never index a key get no log
+  if (!index_log_.is_open()) {
+    index_log_.open(index_log_path(), std::ios::binary | std::ios::app);
+  }
+  write_put_record(index_log_, key, digest, generation);
+  index_log_.flush();
+}
 
-  // Convert the raw hash bytes to a hexadecimal string
-  std::stringstream ss;
-  for (unsigned int i = 0; i < hash_len; i++) {
-    ss << std::hex << std::setw(2) << std::setfill('0') 
-       << static_cast<int>(hash[i]);
+uint64_t Store::apply_put(const std::string& key, const std::string& hash, const std::string& digest,
+                          uint64_t generation) {
+  std::size_t leaf = MerkleTree::leaf_for_hash(hash);
+  auto it = leaves_[leaf].find(key);
+  if (it != leaves_[leaf].end()) {
+    // Overwrites take the old version's contribution out first. Rewriting
+    // the same content keeps the generation, so cached copies stay valid
+    merkle_.toggle(leaf, it->second.value);
+    forget_digest(key, it->second.digest);
+    if (!it->second.digest.empty()) {
+      --indexed_keys_;
+    }
+    if (generation == 0) {
+      generation = it->second.generation + (it->second.digest == digest ? 0 : 1);
+    }
+  } else if (generation == 0) {
+    generation = 1;
+  }
+  IndexRecord record{digest, entry_value(hash, digest, generation), generation};
+  merkle_.toggle(leaf, record.value);
+  if (!digest.empty()) {
+    keys_by_digest_[digest].insert(key);
+    ++indexed_keys_;
+  }
+  leaves_[leaf].insert_or_assign(key, std::move(record));
+  return generation;
+}
+
+void Store::apply_erase(const std::string& key, const std::string& hash) {
+  std::size_t leaf = MerkleTree::leaf_for_hash(hash);
+  auto it = leaves_[leaf].find(key);
+  if (it == leaves_[leaf].end()) {
+    return;
+  }
+  merkle_.toggle(leaf, it->second.value);
+  forget_digest(key, it->second.digest);
+  if (!it->second.digest.empty()) {
+    --indexed_keys_;
+  }
+  leaves_[leaf].erase(it);
+}
+
+void Store::forget_digest(const std::string& key, const std::string& digest) {
+  auto keys = keys_by_digest_.find(digest);
+  if (keys == keys_by_digest_.end()) {
+    return;
   }
+  keys->second.erase(key);
+  if (keys->second.empty()) {
+    keys_by_digest_.erase(keys);
+  }
+}
+
+bool Store::is_indexed(const std::string& key) const {
+  return !index_filter_ || index_filter_(key);
+}
+
+std::filesystem::path Store::index_log_path() const {
+  return base_path_ / INDEX_LOG;
+}
 
-  std::string result = ss.str();
-  BOOST_LOG_TRIVIAL(debug) << "Store: Generated hash: " << result;
+
+//==============================================
+// SNAPSHOTS
+//==============================================
+
+void Store::create_snapshot(const std::string& name) {
+  if (!valid_snapshot_name(name)) {
+    throw StoreError("Store: Invalid snapshot name: " + name);
+  }
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  if (snapshots_.count(name)) {
+    throw StoreError("Store: Snapshot already exists: " + name);
+  }
+  uint64_t id = ++last_snapshot_id_;
+  snapshots_[name] = id;
+  append_snapshot_record("S " + std::to_string(id) + " " + name);
+  DFS_LOG(info) << "Store: Created snapshot " << name << " with id " << id;
+}
+
+void Store::delete_snapshot(const std::string& name) {
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  uint64_t id = snapshot_id(name);
+  snapshots_.erase(name);
+  append_snapshot_record("D " + std::to_string(id));
+  // With no snapshot left, nothing needs the write history any more
+  if (snapshots_.empty()) {
+    write_epochs_.clear();
+  }
+  schedule_reclaim();
+  DFS_LOG(info) << "Store: Deleted snapshot " << name;
+}
+
+std::vector<Store::SnapshotInfo> Store::list_snapshots() const {
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  std::vector<SnapshotInfo> snapshots;
+  for (const auto& [name, id] : snapshots_) {
+    snapshots.push_back(SnapshotInfo{name, id});
+  }
+  std::sort(snapshots.begin(), snapshots.end(),
+            [](const SnapshotInfo& a, const SnapshotInfo& b) { return a.id < b.id; });
+  return snapshots;
+}
+
+bool Store::has_in_snapshot(const std::string& snapshot, const std::string& key) const {
+  std::string hash = hash_key(key);
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  return !snapshot_object(snapshot_id(snapshot), hash).empty();
+}
+
+std::unique_ptr<std::istream> Store::get_snapshot_stream(const std::string& snapshot, const std::string& key) const {
+  DFS_LOG(info) << "Store: Opening stream for key " << key << " in snapshot " << snapshot;
+  std::string hash = hash_key(key);
+  // Opened under the lock, before a store can move the version aside
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  std::filesystem::path path = snapshot_object(snapshot_id(snapshot), hash);
+  if (path.empty()) {
+    throw StoreError("Store: File not found in snapshot " + snapshot);
+  }
+  auto file = std::make_unique<std::ifstream>(path, std::ios::binary);
+  if (!*file) {
+    throw StoreError("Store: Failed to open file: " + path.string());
+  }
+  return file;
+}
+
+std::size_t Store::export_snapshot(const std::string& snapshot, const std::filesystem::path& directory) const {
+  DFS_LOG(info) << "Store: Exporting snapshot " << snapshot << " to " << directory;
+  uint64_t id;
+  std::vector<std::filesystem::path> roots;
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    id = snapshot_id(snapshot);
+    roots = tier_roots();
+  }
+
+  // Candidates are the current objects and every key with kept versions. The
+  // objects are listed first: one removed after that is found among the versions
+  std::set<std::string> hashes;
+  std::error_code ec;
+  for (const auto& root : roots) {
+    for_each_object(root, [&](const std::string& hash, const std::filesystem::path&) { hashes.insert(hash); });
+  }
+  for (const auto& root : roots) {
+    for (const auto& entry : std::filesystem::directory_iterator(root / SNAPSHOT_DIR / VERSIONS_DIR, ec)) {
+      hashes.insert(entry.path().filename().string());
+    }
+  }
+
+  std::size_t exported = 0;
+  for (const auto& hash : hashes) {
+    std::filesystem::path target = path_for_hash(directory, hash);
+    std::filesystem::create_directories(target.parent_path());
+    std::unique_ptr<std::ifstream> source;
+    {
+      // A hard link pins the version, so it only needs the lock while it is made
+      std::lock_guard<std::mutex> lock(snapshot_mutex_);
+      std::filesystem::path path = snapshot_object(snapshot_id(snapshot), hash);
+      if (path.empty()) {
+        continue;
+      }
+      std::filesystem::remove(target, ec);
+      std::filesystem::create_hard_link(path, target, ec);
+      if (ec) {
+        source = std::make_unique<std::ifstream>(path, std::ios::binary);
+      }
+    }
+    if (source) {
+      std::ofstream output(target, std::ios::binary | std::ios::trunc);
+      output << source->rdbuf();
+      if (!*source || !output) {
+        throw StoreError("Store: Failed to export object: " + target.string());
+      }
+    }
+    ++exported;
+  }
+  DFS_LOG(info) << "Store: Exported " << exported << " objects of snapshot " << snapshot << " (id " << id << ")";
+  return exported;
+}
+
+std::size_t Store::preserved_versions() const {
+  std::vector<std::filesystem::path> roots;
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    roots = tier_roots();
+  }
+  std::size_t count = 0;
+  std::error_code ec;
+  for (const auto& root : roots) {
+    for (auto it = std::filesystem::recursive_directory_iterator(root / SNAPSHOT_DIR / VERSIONS_DIR, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+      count += it->is_regular_file(ec) ? 1 : 0;
+    }
+  }
+  return count;
+}
+
+void Store::load_snapshots() {
+  snapshot_log_.close();
+  snapshots_.clear();
+  write_epochs_.clear();
+  last_snapshot_id_ = 0;
+
+  // Records: "S <id> <name>" creates, "D <id>" deletes, "W <id> <hash>" is a
+  // write while snapshot id was the newest, "N <id>" keeps the id counter
+  std::filesystem::path path = snapshot_dir() / SNAPSHOT_LOG;
+  std::ifstream log(path, std::ios::binary);
+  if (!log) {
+    return;
+  }
+  std::map<uint64_t, std::string> names;
+  std::string line;
+  std::size_t records = 0;
+  while (std::getline(log, line)) {
+    std::istringstream record(line);
+    char op = 0;
+    uint64_t id = 0;
+    std::string value;
+    if (!(record >> op >> id) || ((op == 'S' || op == 'W') && !(record >> value))) {
+      DFS_LOG(warning) << "Store: Ignoring damaged snapshot log after " << records << " records";
+      break;
+    }
+    if (op == 'S') {
+      names[id] = value;
+    } else if (op == 'D') {
+      names.erase(id);
+    } else if (op == 'W') {
+      write_epochs_[value] = id;
+    } else if (op != 'N') {
+      DFS_LOG(warning) << "Store: Ignoring damaged snapshot log after " << records << " records";
+      break;
+    }
+    last_snapshot_id_ = std::max(last_snapshot_id_, id);
+    ++records;
+  }
+  log.close();
+  for (const auto& [id, name] : names) {
+    snapshots_[name] = id;
+  }
+
+  // Writes older than every live snapshot behave like ones before any snapshot
+  uint64_t oldest = names.empty() ? std::numeric_limits<uint64_t>::max() : names.begin()->first;
+  for (auto it = write_epochs_.begin(); it != write_epochs_.end();) {
+    it = it->second < oldest ? write_epochs_.erase(it) : std::next(it);
+  }
+
+  std::filesystem::path compacted_path = path;
+  compacted_path += ".tmp";
+  {
+    std::ofstream compacted(compacted_path, std::ios::binary | std::ios::trunc);
+    compacted << "N " << last_snapshot_id_ << '\n';
+    for (const auto& [id, name] : names) {
+      compacted << "S " << id << ' ' << name << '\n';
+    }
+    for (const auto& [hash, id] : write_epochs_) {
+      compacted << "W " << id << ' ' << hash << '\n';
+    }
+    if (!compacted) {
+      throw StoreError("Store: Failed to compact snapshot log: " + compacted_path.string());
+    }
+  }
+  std::filesystem::rename(compacted_path, path);
+
+  // Versions of snapshots deleted before a restart are still on disk
+  for (const auto& root : tier_roots()) {
+    if (std::filesystem::exists(root / SNAPSHOT_DIR / VERSIONS_DIR)) {
+      schedule_reclaim();
+    }
+  }
+  DFS_LOG(info) << "Store: Loaded " << snapshots_.size() << " snapshots from " << records << " snapshot log records";
+}
+
+void Store::install_object(const std::string& key, const std::string& hash,
+                           const std::filesystem::path& temp_path, const std::filesystem::path& file_path,
+                           const std::string& digest) {
+  // One critical section for the object and its index entry, so concurrent
+  // writers of a key cannot leave the index with the other writer's digest
+  std::scoped_lock lock(index_mutex_, snapshot_mutex_);
+  // New versions start out on the fast tier, an old one on the capacity
+  // tier is kept for snapshots or dropped
+  std::filesystem::path current;
+  Tier tier = locate(hash, current);
+  if (tier != Tier::None && !preserve_version(hash, current, root_of(tier)) && tier == Tier::Capacity) {
+    std::filesystem::remove(current);
+  }
+  std::filesystem::rename(temp_path, file_path);
+  record_write(hash);
+  index_put(key, hash, digest);
+}
+
+bool Store::retire_object(const std::string& hash) {
+  std::filesystem::path file_path;
+  Tier tier = locate(hash, file_path);
+  if (tier == Tier::None) {
+    return false;
+  }
+  return preserve_version(hash, file_path, root_of(tier)) || std::filesystem::remove(file_path);
+}
+
+bool Store::preserve_version(const std::string& hash, const std::filesystem::path& file_path,
+                             const std::filesystem::path& root) {
+  if (snapshots_.empty()) {
+    return false;
+  }
+  uint64_t newest = 0;
+  for (const auto& [name, id] : snapshots_) {
+    newest = std::max(newest, id);
+  }
+  auto written = write_epochs_.find(hash);
+  uint64_t epoch = written == write_epochs_.end() ? 0 : written->second;
+  if (newest <= epoch) {
+    return false;
+  }
+
+  // The version is seen by the snapshots taken after it was written, up to
+  // now. It stays on its tier, where the rename is cheap
+  std::filesystem::path directory = root / SNAPSHOT_DIR / VERSIONS_DIR / hash;
+  std::filesystem::create_directories(directory);
+  std::filesystem::rename(file_path, directory / (std::to_string(epoch + 1) + "-" + std::to_string(last_snapshot_id_)));
+  store_metrics().versions_preserved.inc();
+  return true;
+}
+
+void Store::record_write(const std::string& hash) {
+  if (snapshots_.empty()) {
+    write_epochs_.erase(hash);
+    return;
+  }
+  write_epochs_[hash] = last_snapshot_id_;
+  append_snapshot_record("W " + std::to_string(last_snapshot_id_) + " " + hash);
+}
+
+std::filesystem::path Store::snapshot_object(uint64_t id, const std::string& hash) const {
+  std::error_code ec;
+  for (const auto& root : tier_roots()) {
+    for (const auto& version : std::filesystem::directory_iterator(root / SNAPSHOT_DIR / VERSIONS_DIR / hash, ec)) {
+      uint64_t first = 0, last = 0;
+      if (parse_version_name(version.path().filename().string(), first, last) && first <= id && id <= last) {
+        return version.path();
+      }
+    }
+  }
+
+  // The current object, unless it was written after the snapshot
+  std::filesystem::path current;
+  auto written = write_epochs_.find(hash);
+  if ((written == write_epochs_.end() || written->second < id) && locate(hash, current) != Tier::None) {
+    return current;
+  }
+  return {};
+}
+
+uint64_t Store::snapshot_id(const std::string& name) const {
+  auto it = snapshots_.find(name);
+  if (it == snapshots_.end()) {
+    throw StoreError("Store: Unknown snapshot: " + name);
+  }
+  return it->second;
+}
+
+void Store::append_snapshot_record(const std::string& record) {
+  if (!snapshot_log_.is_open()) {
+    check_directory_exists(snapshot_dir());
+    snapshot_log_.open(snapshot_dir() / SNAPSHOT_LOG, std::ios::binary | std::ios::app);
+  }
+  snapshot_log_ << record << '\n';
+  snapshot_log_.flush();
+}
+
+void Store::schedule_reclaim() {
+  reclaim_pending_ = true;
+  if (!reclaim_thread_) {
+    reclaim_thread_ = std::make_unique<std::thread>(&Store::reclaim_loop, this);
+  }
+  reclaim_cv_.notify_all();
+}
+
+void Store::reclaim_loop() {
+  std::unique_lock<std::mutex> lock(snapshot_mutex_);
+  while (true) {
+    reclaim_cv_.wait(lock, [this] { return reclaim_pending_ || stopping_; });
+    if (stopping_) {
+      return;
+    }
+    reclaim_pending_ = false;
+    lock.unlock();
+    try {
+      reclaim_versions();
+    } catch (const std::exception& e) {
+      DFS_LOG(error) << "Store: Snapshot reclamation failed: " << e.what();
+    }
+    lock.lock();
+  }
+}
+
+void Store::reclaim_versions() {
+  std::vector<std::filesystem::path> roots;
+  std::vector<uint64_t> live;
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    roots = tier_roots();
+    for (const auto& [name, id] : snapshots_) {
+      live.push_back(id);
+    }
+  }
+
+  // Snapshots created from now on have higher ids than any kept version
+  // covers, so a version no live snapshot sees stays unseen
+  std::size_t reclaimed = 0;
+  std::error_code ec;
+  std::vector<std::filesystem::path> directories;
+  for (const auto& root : roots) {
+    for (const auto& entry : std::filesystem::directory_iterator(root / SNAPSHOT_DIR / VERSIONS_DIR, ec)) {
+      directories.push_back(entry.path());
+    }
+  }
+  for (const auto& directory : directories) {
+    std::vector<std::filesystem::path> dead;
+    for (const auto& version : std::filesystem::directory_iterator(directory, ec)) {
+      uint64_t first = 0, last = 0;
+      if (!parse_version_name(version.path().filename().string(), first, last)) {
+        continue;
+      }
+      bool seen = std::any_of(live.begin(), live.end(), [&](uint64_t id) { return first <= id && id <= last; });
+      if (!seen) {
+        dead.push_back(version.path());
+      }
+    }
+    for (const auto& version : dead) {
+      reclaimed += std::filesystem::remove(version, ec) ? 1 : 0;
+    }
+    // Under the lock, so a version being kept does not lose its directory
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    if (std::filesystem::is_empty(directory, ec) && !ec) {
+      std::filesystem::remove(directory, ec);
+    }
+  }
+  store_metrics().versions_reclaimed.inc(reclaimed);
+  if (reclaimed > 0) {
+    DFS_LOG(info) << "Store: Reclaimed " << reclaimed << " snapshot versions";
+  }
+}
+
+std::filesystem::path Store::snapshot_dir() const {
+  return base_path_ / SNAPSHOT_DIR;
+}
+
+
+//==============================================
+// TIERED STORAGE
+//==============================================
+
+void Store::set_tiering(const TierConfig& config) {
+  if (config.capacity_path.empty() || config.fast_tier_bytes == 0) {
+    throw StoreError("Store: Tiering needs a capacity tier directory and a fast tier size");
+  }
+  if (std::filesystem::weakly_canonical(config.capacity_path) == std::filesystem::weakly_canonical(base_path_)) {
+    throw StoreError("Store: The capacity tier must not be the store directory");
+  }
+  DFS_LOG(info) << "Store: Tiering to " << config.capacity_path << " above "
+                << config.fast_tier_bytes << " bytes on the fast tier";
+  check_directory_exists(config.capacity_path);
+
+  std::filesystem::path previous = tiering_.capacity_path;
+  if (!previous.empty() && previous != config.capacity_path) {
+    DFS_LOG(warning) << "Store: Objects left on the previous capacity tier " << previous << " are no longer read";
+  }
+  tiering_ = config;
+  save_tier_config();
+  {
+    // Keys on the capacity tier are only found now
+    std::scoped_lock lock(index_mutex_, snapshot_mutex_);
+    load_index();
+    if (std::filesystem::exists(tiering_.capacity_path / SNAPSHOT_DIR / VERSIONS_DIR)) {
+      schedule_reclaim();
+    }
+  }
+  if (tiering_.interval.count() > 0 && !tier_thread_) {
+    tier_thread_ = std::make_unique<std::thread>(&Store::tier_loop, this);
+  }
+}
+
+Store::TierMigration Store::run_tier_migration() {
+  TierMigration result;
+  if (tiering_.capacity_path.empty() || tiering_.fast_tier_bytes == 0) {
+    return result;
+  }
+  std::lock_guard<std::mutex> migration_lock(migration_mutex_);
+  StoreMetrics& stats = store_metrics();
+
+  struct Object {
+    std::string hash;
+    std::filesystem::path path;
+    std::uintmax_t size;
+    double reads;
+    std::filesystem::file_time_type written;
+  };
+  std::vector<Object> fast;
+  std::vector<Object> capacity;
+  std::vector<std::filesystem::path> roots;
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    roots = tier_roots();
+  }
+  auto collect = [](std::vector<Object>& objects) {
+    return [&objects](const std::string& hash, const std::filesystem::path& path) {
+      std::error_code ec;
+      std::uintmax_t size = std::filesystem::file_size(path, ec);
+      auto written = std::filesystem::last_write_time(path, ec);
+      if (!ec) {
+        objects.push_back(Object{hash, path, size, 0.0, written});
+      }
+    };
+  };
+  for_each_object(roots[0], collect(fast));
+  for_each_object(roots[1], collect(capacity));
+
+  // Decay every access record to now, forgetting the ones that faded away
+  {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(access_mutex_);
+    for (auto it = access_.begin(); it != access_.end();) {
+      it = decayed_reads(it->second, now) < FORGOTTEN_READS ? access_.erase(it) : std::next(it);
+    }
+    for (auto* objects : {&fast, &capacity}) {
+      for (auto& object : *objects) {
+        auto access = access_.find(object.hash);
+        object.reads = access == access_.end() ? 0.0 : decayed_reads(access->second, now);
+      }
+    }
+  }
+  for (const auto& object : fast) {
+    result.fast_bytes += object.size;
+  }
+  for (const auto& object : capacity) {
+    result.capacity_bytes += object.size;
+  }
+
+  // Coldest first, and of equally cold objects the longest unwritten
+  std::sort(fast.begin(), fast.end(), [](const Object& a, const Object& b) {
+    return a.reads != b.reads ? a.reads < b.reads : a.written < b.written;
+  });
+  std::size_t next_cold = 0;
+  auto demote = [&]() {
+    const Object& object = fast[next_cold++];
+    if (move_object(object.hash, object.path, roots[1])) {
+      result.fast_bytes -= object.size;
+      result.capacity_bytes += object.size;
+      ++result.demoted;
+      stats.demotions.inc();
+    }
+  };
+
+  // Over its size, the fast tier is emptied to the low watermark
+  const std::uintmax_t low_watermark = tiering_.fast_tier_bytes / 100 * FAST_TIER_LOW_WATERMARK;
+  if (result.fast_bytes > tiering_.fast_tier_bytes) {
+    while (result.fast_bytes > low_watermark && next_cold < fast.size()) {
+      demote();
+    }
+  }
+
+  // Hot capacity objects come back, hottest first, making room by demoting
+  // objects that are not hot themselves
+  std::vector<Object> hot;
+  std::copy_if(capacity.begin(), capacity.end(), std::back_inserter(hot),
+               [](const Object& object) { return object.reads >= PROMOTE_READS; });
+  std::sort(hot.begin(), hot.end(), [](const Object& a, const Object& b) { return a.reads > b.reads; });
+  for (const auto& object : hot) {
+    if (object.size > low_watermark) {
+      continue;
+    }
+    while (result.fast_bytes + object.size > low_watermark && next_cold < fast.size() &&
+           fast[next_cold].reads < PROMOTE_READS) {
+      demote();
+    }
+    if (result.fast_bytes + object.size <= low_watermark && move_object(object.hash, object.path, roots[0])) {
+      result.fast_bytes += object.size;
+      result.capacity_bytes -= object.size;
+      ++result.promoted;
+      stats.promotions.inc();
+    }
+  }
+
+  stats.fast_bytes.set(static_cast<int64_t>(result.fast_bytes));
+  stats.capacity_bytes.set(static_cast<int64_t>(result.capacity_bytes));
+  if (result.promoted > 0 || result.demoted > 0) {
+    DFS_LOG(info) << "Store: Promoted " << result.promoted << " and demoted " << result.demoted
+                  << " objects, fast tier holds " << result.fast_bytes << " bytes";
+  }
   return result;
 }
 
-std::filesystem::path Store::get_path_for_hash(const std::string& hash) const {
-  std::filesystem::path path = base_path_;
-  
-  for (size_t i = 0; i < 6; i += 2) {
-    path /= hash.substr(i, 2);
+Store::Tier Store::tier_of(const std::string& key) const {
+  std::filesystem::path file_path;
+  return locate(hash_key(key), file_path);
+}
+
+void Store::record_access(const std::string& hash) const {
+  if (tiering_.capacity_path.empty()) {
+    return;
   }
-  
-  path /= hash.substr(6);
-  BOOST_LOG_TRIVIAL(debug) << "Store: Calculated path: " << path.string();
-  return path;
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(access_mutex_);
+  auto [it, inserted] = access_.try_emplace(hash, Access{0.0, now});
+  it->second.reads = decayed_reads(it->second, now) + 1.0;
+  it->second.last = now;
+}
+
+double Store::decayed_reads(const Access& access, std::chrono::steady_clock::time_point now) const {
+  std::chrono::duration<double> age = now - access.last;
+  std::chrono::duration<double> half_life = ACCESS_HALF_LIFE;
+  return access.reads * std::exp2(-age / half_life);
 }
-  
+
+bool Store::move_object(const std::string& hash, const std::filesystem::path& from,
+                        const std::filesystem::path& to_root) {
+  std::filesystem::path to = path_for_hash(to_root, hash);
+  std::error_code ec;
+  std::filesystem::create_directories(to.parent_path(), ec);
+
+  // Within one file system the move is a rename, under the lock so it does
+  // not race a store or removal of the same object
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    if (!std::filesystem::exists(from)) {
+      return false;
+    }
+    std::filesystem::rename(from, to, ec);
+    if (!ec) {
+      return true;
+    }
+    if (ec != std::errc::cross_device_link) {
+      DFS_LOG(error) << "Store: Failed to move " << from << " to " << to << ": " << ec.message();
+      return false;
+    }
+  }
+
+  // Across file systems the object is copied without the lock, and only
+  // installed when nothing replaced the source meanwhile
+  dev_t device = 0, current_device = 0;
+  ino_t inode = 0, current_inode = 0;
+  if (!file_identity(from, device, inode)) {
+    return false;
+  }
+  std::filesystem::path temp_path = to;
+  temp_path += ".tmp" + std::to_string(temp_counter++);
+  if (!std::filesystem::copy_file(from, temp_path, std::filesystem::copy_options::overwrite_existing, ec)) {
+    DFS_LOG(error) << "Store: Failed to copy " << from << " to " << temp_path << ": " << ec.message();
+    std::filesystem::remove(temp_path, ec);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(snapshot_mutex_);
+  if (!file_identity(from, current_device, current_inode) || current_device != device || current_inode != inode) {
+    std::filesystem::remove(temp_path, ec);
+    return false;
+  }
+  std::filesystem::rename(temp_path, to);
+  std::filesystem::remove(from);
+  return true;
+}
+
+void Store::tier_loop() {
+  std::unique_lock<std::mutex> lock(tier_mutex_);
+  while (!stopping_) {
+    tier_cv_.wait_for(lock, tiering_.interval, [this] { return stopping_.load(); });
+    if (stopping_) {
+      return;
+    }
+    lock.unlock();
+    try {
+      run_tier_migration();
+    } catch (const std::exception& e) {
+      DFS_LOG(error) << "Store: Tier migration failed: " << e.what();
+    }
+    lock.lock();
+  }
+}
+
+std::vector<std::filesystem::path> Store::tier_roots() const {
+  std::vector<std::filesystem::path> roots{base_path_};
+  if (!tiering_.capacity_path.empty()) {
+    roots.push_back(tiering_.capacity_path);
+  }
+  return roots;
+}
+
+std::filesystem::path Store::root_of(Tier tier) const {
+  return tier == Tier::Capacity ? tiering_.capacity_path : base_path_;
+}
+
+void Store::load_tier_config() {
+  std::ifstream config(base_path_ / TIER_CONFIG);
+  std::string path;
+  if (config && std::getline(config, path) && !path.empty()) {
+    tiering_.capacity_path = path;
+    DFS_LOG(info) << "Store: Reading objects from capacity tier " << path;
+  }
+}
+
+void Store::save_tier_config() const {
+  std::ofstream config(base_path_ / TIER_CONFIG, std::ios::trunc);
+  config << tiering_.capacity_path.string() << '\n';
+  if (!config) {
+    throw StoreError("Store: Failed to record the capacity tier in " + base_path_.string());
+  }
+}
+
 
 //==============================================
 // UTILITY METHODS 
@@ -393,12 +1640,48 @@ void Store::check_directory_exists(const std::filesystem::path& path) const {
 
 std::filesystem::path Store::resolve_key_path(const std::string& key) const {
   std::string hash = hash_key(key);
-  return get_path_for_hash(hash);
+  std::filesystem::path file_path;
+  locate(hash, file_path);
+  return file_path;
+}
+
+Store::Tier Store::locate(const std::string& hash, std::filesystem::path& file_path) const {
+  file_path = get_path_for_hash(hash);
+  if (std::filesystem::exists(file_path)) {
+    return Tier::Fast;
+  }
+  if (!tiering_.capacity_path.empty()) {
+    std::filesystem::path capacity = path_for_hash(tiering_.capacity_path, hash);
+    if (std::filesystem::exists(capacity)) {
+      file_path = capacity;
+      return Tier::Capacity;
+    }
+  }
+  return Tier::None;
+}
+
+std::unique_ptr<std::ifstream> Store::open_object(const std::string& key) const {
+  std::string hash = hash_key(key);
+  std::filesystem::path file_path;
+  // The mover may take the object to the other tier between finding and
+  // opening it, then it is found there on the second look
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (locate(hash, file_path) == Tier::None) {
+      continue;
+    }
+    auto file = std::make_unique<std::ifstream>(file_path, std::ios::binary);
+    if (*file) {
+      record_access(hash);
+      return file;
+    }
+  }
+  DFS_LOG(error) << "Store: File not found: " << file_path.string();
+  throw StoreError("Store: File not found");
 }
 
 void Store::verify_file_exists(const std::filesystem::path& file_path) const {
   if (!std::filesystem::exists(file_path)) {
-    BOOST_LOG_TRIVIAL(error) << "Store: File not found: " << file_path.string();
+    DFS_LOG(error) << "Store: File not found: " << file_path.string();
     throw StoreError("Store: File not found");
   }
 }
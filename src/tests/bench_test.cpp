@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bench/bench_common.hpp"
+
+using namespace dfs::bench;
+
+TEST(BenchTest, ParseSizeSuffixes) {
+  EXPECT_EQ(parse_size("0"), 0u);
+  EXPECT_EQ(parse_size("512B"), 512u);
+  EXPECT_EQ(parse_size("4K"), 4096u);
+  EXPECT_EQ(parse_size("1.5M"), 1536u * 1024);
+  EXPECT_EQ(parse_size("1G"), 1024ull * 1024 * 1024);
+  EXPECT_THROW(parse_size("4X"), std::invalid_argument);
+  EXPECT_EQ(split_list("1,,4,16"), (std::vector<std::string>{"1", "4", "16"}));
+}
+
+TEST(BenchTest, SizeDistributionsStayInBounds) {
+  std::mt19937_64 rng(7);
+  SizeDistribution uniform("uniform:1K-2K");
+  SizeDistribution lognormal("lognormal:4K:2.0");
+  for (int i = 0; i < 1000; ++i) {
+    auto size = uniform.sample(rng);
+    EXPECT_GE(size, 1024u);
+    EXPECT_LE(size, 2048u);
+    EXPECT_LE(lognormal.sample(rng), lognormal.max_size());
+  }
+  EXPECT_EQ(SizeDistribution("fixed:64K").sample(rng), 65536u);
+  EXPECT_THROW(SizeDistribution("uniform:2K-1K"), std::invalid_argument);
+  EXPECT_THROW(SizeDistribution("pareto:1K"), std::invalid_argument);
+}
+
+TEST(BenchTest, ZipfFavoursLowRanks) {
+  std::mt19937_64 rng(1);
+  ZipfGenerator skewed(100, 1.2);
+  ZipfGenerator uniform(100, 0.0);
+  int skewed_hot = 0, uniform_hot = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto rank = skewed.next(rng);
+    EXPECT_LT(rank, 100u);
+    skewed_hot += rank < 5 ? 1 : 0;
+    uniform_hot += uniform.next(rng) < 5 ? 1 : 0;
+  }
+  // About 57% of draws hit the top 5 ranks with s = 1.2, 5% without skew
+  EXPECT_GT(skewed_hot, 5000);
+  EXPECT_LT(uniform_hot, 800);
+}
+
+TEST(BenchTest, LatencyPercentilesUseNearestRank) {
+  LatencyRecorder recorder;
+  for (int i = 1; i <= 100; ++i) {
+    recorder.record(std::chrono::microseconds(i));
+  }
+  EXPECT_DOUBLE_EQ(recorder.percentile_us(0.5), 50);
+  EXPECT_DOUBLE_EQ(recorder.percentile_us(0.99), 99);
+  EXPECT_DOUBLE_EQ(recorder.percentile_us(0.999), 100);
+  EXPECT_DOUBLE_EQ(recorder.max_us(), 100);
+  EXPECT_DOUBLE_EQ(recorder.mean_us(), 50.5);
+}
+
+TEST(BenchTest, MannWhitneyExactSeparatedSamples) {
+  auto result = mann_whitney_u({1, 2, 3, 4, 5}, {6, 7, 8, 9, 10});
+  EXPECT_TRUE(result.exact);
+  EXPECT_DOUBLE_EQ(result.u, 0);
+  // Only 2 of the C(10, 5) = 252 orderings are this extreme
+  EXPECT_NEAR(result.p_value, 2.0 / 252, 1e-12);
+
+  auto swapped = mann_whitney_u({6, 7, 8, 9, 10}, {1, 2, 3, 4, 5});
+  EXPECT_DOUBLE_EQ(swapped.u, 25);
+  EXPECT_NEAR(swapped.p_value, result.p_value, 1e-12);
+}
+
+TEST(BenchTest, MannWhitneyInterleavedSamplesAreNotSignificant) {
+  auto result = mann_whitney_u({1, 3, 5, 7, 9}, {2, 4, 6, 8, 10});
+  EXPECT_TRUE(result.exact);
+  EXPECT_DOUBLE_EQ(result.u, 10);
+  EXPECT_GT(result.p_value, 0.5);
+
+  auto identical = mann_whitney_u({5, 5, 5}, {5, 5, 5});
+  EXPECT_FALSE(identical.exact);
+  EXPECT_DOUBLE_EQ(identical.p_value, 1);
+}
+
+TEST(BenchTest, MannWhitneyNormalApproximationWithTies) {
+  std::vector<double> a, b;
+  for (int i = 0; i < 30; ++i) {
+    a.push_back(100 + i % 5);
+    b.push_back(104 + i % 5);
+  }
+  auto result = mann_whitney_u(a, b);
+  EXPECT_FALSE(result.exact);
+  EXPECT_LT(result.p_value, 1e-6);
+  EXPECT_GT(mann_whitney_u(a, a).p_value, 0.9);
+}
+
+TEST(BenchTest, JsonReportHasEveryField) {
+  std::vector<OpResult> results{OpResult{.name = "get"}};
+  results[0].ops = 2;
+  results[0].bytes = 2048;
+  results[0].seconds = 1;
+  results[0].latency.record(std::chrono::microseconds(10));
+  results[0].latency.record(std::chrono::microseconds(30));
+  results[0].extra = {{"syscalls_per_op", 3}};
+
+  std::ostringstream output;
+  write_json(output, "unit \"test\"", {{"threads", "4"}}, results);
+  std::string json = output.str();
+  EXPECT_NE(json.find("\"benchmark\": \"unit \\\"test\\\"\""), std::string::npos) << json;
+  EXPECT_NE(json.find("\"threads\": \"4\""), std::string::npos) << json;
+  EXPECT_NE(json.find("\"ops_per_sec\": 2.0"), std::string::npos) << json;
+  EXPECT_NE(json.find("\"p50\": 10.0"), std::string::npos) << json;
+  EXPECT_NE(json.find("\"max\": 30.0"), std::string::npos) << json;
+  EXPECT_NE(json.find("\"syscalls_per_op\": 3.0"), std::string::npos) << json;
+}
@@ -1,10 +1,25 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <future>
 #include <thread>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
 #include <sstream>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include "network/bootstrap.hpp"
+#include "cli/cli.hpp"
+#include "metrics/hot_path.hpp"
+#include "metrics/metrics.hpp"
+#include "tracing/tracer.hpp"
 #include "network/peer_manager.hpp"
 #include "file_server/file_server.hpp"
+#include "utils/pipeliner.hpp"
+#include "erasure/reed_solomon.hpp"
 
 using namespace dfs::network;
 
@@ -206,6 +221,140 @@ TEST_F(BootstrapTest, FileSharing) {
   verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer1, peer2});
 }
 
+TEST_F(BootstrapTest, TracedStoreSpansBothNodes) {
+  auto trace_path = std::filesystem::temp_directory_path() / "bootstrap_trace_test.json";
+  ASSERT_TRUE(dfs::tracing::Tracer::start(trace_path.string()));
+
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+
+  std::stringstream file_content;
+  file_content << TEST_FILE_CONTENT;
+  peer1->bootstrap->get_file_server().store_file(TEST_FILENAME, file_content);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer1, peer2});
+
+  dfs::tracing::Tracer::shutdown();
+  boost::property_tree::ptree root;
+  boost::property_tree::read_json(trace_path.string(), root);
+  std::filesystem::remove(trace_path);
+
+  // Sender and receiver spans all belong to the store_file trace
+  std::string trace_id;
+  std::set<std::string> names;
+  for (const auto& [key, event] : root) {
+    if (event.get<std::string>("name") == "store_file") {
+      trace_id = event.get<std::string>("args.trace_id");
+    }
+  }
+  ASSERT_FALSE(trace_id.empty());
+  for (const auto& [key, event] : root) {
+    if (event.get<std::string>("args.trace_id") == trace_id) {
+      names.insert(event.get<std::string>("name"));
+    }
+  }
+  for (const char* expected : {"store_file", "store write", "send file", "disk read", "encrypt",
+                               "socket send", "decode", "channel wait", "handle_store"}) {
+    EXPECT_TRUE(names.count(expected)) << "Missing span: " << expected;
+  }
+}
+
+TEST_F(BootstrapTest, PeerStatsTrackTraffic) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+
+  auto& sender = peer1->bootstrap->get_peer_manager();
+  auto& receiver = peer2->bootstrap->get_peer_manager();
+  auto before = sender.peer_stats();
+  ASSERT_EQ(before.size(), 1u);
+
+  std::stringstream file_content;
+  file_content << TEST_FILE_CONTENT;
+  peer1->bootstrap->get_file_server().store_file(TEST_FILENAME, file_content);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer1, peer2});
+
+  auto sent = sender.peer_stats();
+  ASSERT_EQ(sent.size(), 1u);
+  EXPECT_EQ(sent[0].peer_id, 2);
+  EXPECT_TRUE(sent[0].connected);
+  EXPECT_FALSE(sent[0].remote_endpoint.empty());
+  EXPECT_EQ(sent[0].frames_sent, before[0].frames_sent + 1);
+  EXPECT_GT(sent[0].bytes_sent, before[0].bytes_sent + TEST_FILE_CONTENT.size());
+  EXPECT_EQ(sent[0].in_flight, 0);
+  EXPECT_EQ(sent[0].send_waiters, 0);
+  EXPECT_TRUE(sent[0].tcp_info_valid);
+  EXPECT_GT(sent[0].rtt_us, 0u);
+
+  auto received = receiver.peer_stats();
+  ASSERT_EQ(received.size(), 1u);
+  EXPECT_EQ(received[0].peer_id, 1);
+  EXPECT_GE(received[0].frames_received, 1u);
+
+  // Socket state is published on every scrape
+  std::string exposition = dfs::metrics::Registry::global().expose();
+  EXPECT_NE(exposition.find("dfs_peer_link_frames_total{peer=\"2\",direction=\"sent\"}"), std::string::npos);
+  EXPECT_NE(exposition.find("dfs_peer_link_rtt_microseconds{peer=\"2\"}"), std::string::npos);
+}
+
+TEST_F(BootstrapTest, AbortedFrameKeepsConnectionInStep) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2});
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  const std::string aborted = "dfs_peer_aborted_frames_total";
+  double aborted_before = counter(aborted);
+
+  // A transform failing on the second of four chunks, after the first is on the wire
+  constexpr std::size_t chunk_size = 8192;
+  std::size_t produced = 0;
+  auto pipeline = dfs::utils::Pipeliner::create([&produced](dfs::utils::Chunk& chunk) {
+    if (produced == 4) {
+      return false;
+    }
+    // Gives the sender time to put the first chunk on the wire
+    if (produced == 1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    chunk.resize(chunk_size);
+    std::fill(chunk.data(), chunk.data() + chunk_size, static_cast<char>('a' + produced++));
+    return true;
+  });
+  std::size_t transformed = 0;
+  pipeline->transform([&transformed](dfs::utils::Chunk& input, dfs::utils::Chunk& output) {
+    if (transformed++ == 1) {
+      return false;
+    }
+    std::swap(input, output);
+    return true;
+  });
+  pipeline->set_buffer_size(chunk_size);
+  pipeline->set_total_size(4 * chunk_size);
+  EXPECT_FALSE(peer1->bootstrap->get_peer_manager().send_to_peer(2, *pipeline));
+  EXPECT_TRUE(pipeline->failed());
+
+  // The receiver drops the partial frame and reads the next one from its start
+  std::stringstream file_content(TEST_FILE_CONTENT);
+  ASSERT_TRUE(peer1->bootstrap->get_file_server().store_file(TEST_FILENAME, file_content));
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer2});
+  EXPECT_EQ(counter(aborted), aborted_before + 1);
+}
+
 TEST_F(BootstrapTest, LargeFileSharing) {
   auto peer1 = create_peer(1, 3001);
   auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
@@ -215,6 +364,16 @@ TEST_F(BootstrapTest, LargeFileSharing) {
   start_peer(peer2);
   std::this_thread::sleep_for(std::chrono::seconds(3));
 
+  // Hot path timers sit on the path files are sent through
+  auto timed = [](const std::string& site) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    std::string series = "dfs_hot_path_duration_seconds_count{site=\"" + site + "\"}";
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  double segments_before = timed("peer.send_segment");
+  double encrypted_before = timed("crypto.update_stream");
+
   // Store file in peer1, which shares it with peer2
   auto file_content = create_large_file();
   peer1->bootstrap->get_file_server().store_file("large_test.txt", file_content);
@@ -223,6 +382,10 @@ TEST_F(BootstrapTest, LargeFileSharing) {
   std::this_thread::sleep_for(std::chrono::seconds(2));
   verify_peer_connections({peer1, peer2});
   verify_file_content("large_test.txt", file_content.str(), {peer1, peer2});
+#if DFS_HOT_PATH_TIMERS
+  EXPECT_GT(timed("peer.send_segment"), segments_before);
+  EXPECT_GT(timed("crypto.update_stream"), encrypted_before);
+#endif
 }
 
 TEST_F(BootstrapTest, BroadcastFileSharing) {
@@ -280,8 +443,10 @@ TEST_F(BootstrapTest, GetFile) {
   peer2->bootstrap->get_file_server().get_file(TEST_FILENAME);
   std::this_thread::sleep_for(std::chrono::seconds(3));
 
+  // Peer 2 keeps what it fetched as a cached copy
   verify_peer_connections({peer1, peer2});
-  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer1, peer2});
+  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer1});
+  verify_file_content(FileServer::cache_key(TEST_FILENAME), TEST_FILE_CONTENT, {peer2});
 }
 
 TEST_F(BootstrapTest, LargeGetFile) {
@@ -300,5 +465,793 @@ TEST_F(BootstrapTest, LargeGetFile) {
   std::this_thread::sleep_for(std::chrono::seconds(5));
 
   verify_peer_connections({peer1, peer2});
-  verify_file_content("large_test.txt", file_content.str(), {peer1, peer2});
-}
\ No newline at end of file
+  verify_file_content("large_test.txt", file_content.str(), {peer1});
+  verify_file_content(FileServer::cache_key("large_test.txt"), file_content.str(), {peer2});
+}
+
+TEST_F(BootstrapTest, BatchModeStoresAndReadsRaw) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  auto& file_server = peer1->bootstrap->get_file_server();
+  dfs::cli::CLI cli(file_server.get_store(), file_server);
+
+  // Binary content must come back byte for byte
+  std::string content("line1\r\n\0binary", 14);
+  std::vector<std::string> names;
+  std::ostringstream script;
+  script << "# store four files on four workers\n\n";
+  for (int i = 0; i < 4; ++i) {
+    names.push_back("batch_" + std::to_string(i) + ".bin");
+    std::ofstream(names.back(), std::ios::binary) << content << i;
+    script << "store " << names.back() << "\n";
+  }
+  std::istringstream store_script(script.str());
+  std::ostringstream output, report;
+  ASSERT_TRUE(cli.run_batch(store_script, output, report, 4)) << report.str();
+  EXPECT_TRUE(output.str().empty());
+  EXPECT_NE(report.str().find("\tstore\tbatch_3.bin\tok\t"), std::string::npos) << report.str();
+  EXPECT_NE(report.str().find("# 4 commands, 0 failed"), std::string::npos) << report.str();
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  verify_file_content(names[3], content + "3", {peer1, peer2});
+
+  std::istringstream read_script("read batch_2.bin\nbogus x\nquit\nread batch_1.bin\n");
+  std::ostringstream read_output, read_report;
+  EXPECT_FALSE(cli.run_batch(read_script, read_output, read_report));
+  EXPECT_EQ(read_output.str(), content + "2");
+  EXPECT_NE(read_report.str().find("1\tread\tbatch_2.bin\tok\t"), std::string::npos) << read_report.str();
+  EXPECT_NE(read_report.str().find("2\tbogus\tx\terror\t"), std::string::npos) << read_report.str();
+  EXPECT_NE(read_report.str().find("unknown command"), std::string::npos);
+  EXPECT_NE(read_report.str().find("# 2 commands, 1 failed"), std::string::npos) << read_report.str();
+
+  for (const auto& name : names) {
+    std::filesystem::remove(name);
+  }
+}
+
+TEST_F(BootstrapTest, RecursiveStoreAndFetch) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+
+  // Small files are preloaded, the large one is streamed from disk
+  const std::filesystem::path source = "tree_src";
+  const std::filesystem::path destination = "tree_dst";
+  std::filesystem::remove_all(source);
+  std::filesystem::remove_all(destination);
+  std::map<std::string, std::string> files{
+    {"a.txt", "alpha"},
+    {"nested/b.bin", std::string("b\0\r\n", 4)},
+    {"nested/deeper/c.txt", "gamma"},
+    {"large.bin", create_large_file().str()}
+  };
+  for (const auto& [relative, content] : files) {
+    std::filesystem::create_directories((source / relative).parent_path());
+    std::ofstream(source / relative, std::ios::binary) << content;
+  }
+
+  dfs::cli::CLI sender(peer1->bootstrap->get_file_server().get_store(), peer1->bootstrap->get_file_server());
+  std::istringstream store_script("store -r tree_src/\n");
+  std::ostringstream output, report;
+  ASSERT_TRUE(sender.run_batch(store_script, output, report, 3)) << report.str();
+  EXPECT_NE(report.str().find("1\tstore\t-r tree_src/\tok\t"), std::string::npos) << report.str();
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_file_content("tree_src/nested/b.bin", files["nested/b.bin"], {peer1, peer2});
+
+  // One file has to come back over the network, the rest are local copies
+  auto& receiver_server = peer2->bootstrap->get_file_server();
+  receiver_server.get_store().remove("tree_src/nested/deeper/c.txt");
+  dfs::cli::CLI receiver(receiver_server.get_store(), receiver_server);
+  std::istringstream fetch_script("fetch -r tree_src tree_dst\nfetch -r missing_tree\n");
+  std::ostringstream fetch_output, fetch_report;
+  EXPECT_FALSE(receiver.run_batch(fetch_script, fetch_output, fetch_report, 3));
+  EXPECT_NE(fetch_report.str().find("1\tfetch\t-r tree_src tree_dst\tok\t"), std::string::npos) << fetch_report.str();
+  EXPECT_NE(fetch_report.str().find("2\tfetch\t-r missing_tree\terror\t"), std::string::npos) << fetch_report.str();
+
+  for (const auto& [relative, content] : files) {
+    std::ifstream fetched(destination / relative, std::ios::binary);
+    ASSERT_TRUE(fetched) << relative;
+    std::stringstream fetched_content;
+    fetched_content << fetched.rdbuf();
+    EXPECT_EQ(fetched_content.str(), content) << relative;
+  }
+
+  std::filesystem::remove_all(source);
+  std::filesystem::remove_all(destination);
+}
+
+TEST_F(BootstrapTest, ErasureCodedStoreAndDegradedRead) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  auto peer3 = create_peer(3, 3003, {ADDRESS + ":3001", ADDRESS + ":3002"});
+  start_peer(peer1);
+  start_peer(peer2);
+  start_peer(peer3);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2, peer3});
+  for (auto* peer : {peer1, peer2, peer3}) {
+    peer->bootstrap->get_file_server().set_erasure_coding(2, 1);
+  }
+
+  const std::string filename = "erasure_test.bin";
+  auto file_content = create_large_file(256 * 1024);
+  ASSERT_TRUE(peer1->bootstrap->get_file_server().store_file(filename, file_content));
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+
+  // Each node holds exactly one of the three fragments and no full copy
+  std::map<std::size_t, Peer*> holders;
+  for (auto* peer : {peer1, peer2, peer3}) {
+    auto& store = peer->bootstrap->get_file_server().get_store();
+    EXPECT_FALSE(store.has(filename));
+    for (std::size_t i = 0; i < 3; ++i) {
+      if (store.has(FileServer::fragment_key(filename, i))) {
+        EXPECT_EQ(holders.count(i), 0u) << "fragment " << i << " stored twice";
+        holders[i] = peer;
+      }
+    }
+  }
+  ASSERT_EQ(holders.size(), 3u);
+
+  std::stringstream fetched;
+  ASSERT_TRUE(peer2->bootstrap->get_file_server().fetch_file(filename, fetched));
+  EXPECT_EQ(fetched.str(), file_content.str());
+  EXPECT_FALSE(peer2->bootstrap->get_file_server().get_store().has(filename));
+
+  // Losing a data fragment leaves the two others, enough to rebuild from parity
+  auto degraded_reads = [] {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    std::string name = "\ndfs_erasure_degraded_reads_total ";
+    auto position = exposition.find(name);
+    return position == std::string::npos ? -1.0 : std::stod(exposition.substr(position + name.size()));
+  };
+  double degraded_before = degraded_reads();
+  holders[0]->bootstrap->get_file_server().get_store().remove(FileServer::fragment_key(filename, 0));
+  Peer* reader = holders[0] == peer3 ? peer1 : peer3;
+  std::stringstream rebuilt;
+  ASSERT_TRUE(reader->bootstrap->get_file_server().fetch_file(filename, rebuilt));
+  EXPECT_EQ(rebuilt.str(), file_content.str());
+  EXPECT_EQ(degraded_reads(), degraded_before + 1);
+  EXPECT_FALSE(reader->bootstrap->get_file_server().get_store().has(filename + "#spool-rebuild"));
+
+  // Input that cannot be measured, like a pipe, is spooled before it is
+  // encoded, and a size that leaves a short last stripe is padded
+  class PipeBuffer : public std::stringbuf {
+  public:
+    using std::stringbuf::stringbuf;
+
+  protected:
+    pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) override { return pos_type(-1); }
+    pos_type seekpos(pos_type, std::ios_base::openmode) override { return pos_type(-1); }
+  };
+  const std::string piped = create_large_file(200 * 1024).str() + "odd end";
+  PipeBuffer buffer(piped);
+  std::istream pipe(&buffer);
+  ASSERT_TRUE(peer1->bootstrap->get_file_server().store_file("piped.bin", pipe));
+  EXPECT_FALSE(peer1->bootstrap->get_file_server().get_store().has("piped.bin#spool-input"));
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  std::stringstream piped_fetched;
+  ASSERT_TRUE(peer3->bootstrap->get_file_server().fetch_file("piped.bin", piped_fetched));
+  EXPECT_EQ(piped_fetched.str(), piped);
+
+  // A lost data fragment whose last stripe is short rebuilds the same way
+  for (auto* peer : {peer1, peer2, peer3}) {
+    auto& store = peer->bootstrap->get_file_server().get_store();
+    if (store.has(FileServer::fragment_key("piped.bin", 0))) {
+      store.remove(FileServer::fragment_key("piped.bin", 0));
+    }
+  }
+  std::stringstream piped_rebuilt;
+  ASSERT_TRUE(peer2->bootstrap->get_file_server().fetch_file("piped.bin", piped_rebuilt));
+  EXPECT_EQ(piped_rebuilt.str(), piped);
+
+  // A rewrite from another node lands on the same placement, replaces every
+  // fragment of the old version and reads back whole
+  auto rewritten = create_large_file(96 * 1024);
+  rewritten.seekp(0);
+  rewritten << "second version";
+  rewritten.seekg(0);
+  ASSERT_TRUE(peer3->bootstrap->get_file_server().store_file(filename, rewritten));
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  for (std::size_t i = 0; i < 3; ++i) {
+    auto& store = holders[i]->bootstrap->get_file_server().get_store();
+    ASSERT_TRUE(store.has(FileServer::fragment_key(filename, i))) << "fragment " << i << " moved";
+    auto stream = store.get_stream(FileServer::fragment_key(filename, i));
+    uint8_t bytes[dfs::erasure::FragmentHeader::SIZE];
+    stream->read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+    auto header = dfs::erasure::FragmentHeader::parse(bytes, static_cast<std::size_t>(stream->gcount()));
+    ASSERT_TRUE(header.has_value());
+    EXPECT_EQ(header->object_size, rewritten.str().size());
+  }
+  std::stringstream refetched;
+  ASSERT_TRUE(peer1->bootstrap->get_file_server().fetch_file(filename, refetched));
+  EXPECT_EQ(refetched.str(), rewritten.str());
+}
+
+TEST_F(BootstrapTest, FailedErasureCodedStoreRollsBack) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  auto peer3 = create_peer(3, 3003, {ADDRESS + ":3001", ADDRESS + ":3002"});
+  start_peer(peer1);
+  start_peer(peer2);
+  start_peer(peer3);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2, peer3});
+  for (auto* peer : {peer1, peer2, peer3}) {
+    peer->bootstrap->get_file_server().set_erasure_coding(2, 1);
+  }
+
+  // Peer 3 stays registered on peer 1 but its connection is gone, so the
+  // fragment placed on it cannot be sent
+  const std::string filename = "rollback_test.bin";
+  ASSERT_TRUE(peer1->bootstrap->get_peer_manager().disconnect(3));
+  auto file_content = create_large_file(128 * 1024);
+  EXPECT_FALSE(peer1->bootstrap->get_file_server().store_file(filename, file_content));
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+
+  // No fragment of the failed store is left, neither on the writer nor on a
+  // peer it reached before the failure
+  for (auto* peer : {peer1, peer2}) {
+    auto& store = peer->bootstrap->get_file_server().get_store();
+    for (std::size_t i = 0; i < 3; ++i) {
+      EXPECT_FALSE(store.has(FileServer::fragment_key(filename, i)))
+        << "fragment " << i << " left on peer " << static_cast<int>(peer->id);
+    }
+  }
+}
+
+TEST_F(BootstrapTest, AntiEntropyRepairsMissedStores) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  verify_peer_connections({peer1, peer2});
+  auto& server1 = peer1->bootstrap->get_file_server();
+  auto& server2 = peer2->bootstrap->get_file_server();
+  auto& store1 = server1.get_store();
+  auto& store2 = server2.get_store();
+  for (auto* server : {&server1, &server2}) {
+    server->set_anti_entropy_interval(std::chrono::milliseconds(0));
+    server->get_store().clear();
+  }
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto put = [](dfs::store::Store& store, const std::string& key, const std::string& content) {
+    std::stringstream input(content);
+    store.store(key, input);
+  };
+  auto root = [](dfs::store::Store& store) {
+    return store.merkle_nodes({dfs::store::MerkleTree::ROOT}).front();
+  };
+
+  // A shared baseline, then each side gains keys the other missed
+  for (int i = 0; i < 50; ++i) {
+    put(store1, "shared_" + std::to_string(i), "content " + std::to_string(i));
+    put(store2, "shared_" + std::to_string(i), "content " + std::to_string(i));
+  }
+  put(store1, "missed_by_2", "stored while peer 2 was away");
+  put(store2, "missed_by_1", "stored while peer 1 was away");
+  put(store1, "conflict", "version one");
+  put(store2, "conflict", "version two");
+
+  double nodes_before = counter("dfs_anti_entropy_tree_nodes_total");
+  double pulls_before = counter("dfs_anti_entropy_repairs_total{direction=\"pull\"}");
+  double pushes_before = counter("dfs_anti_entropy_repairs_total{direction=\"push\"}");
+  double conflicts_before = counter("dfs_anti_entropy_conflicts_total");
+  server1.sync_with_peers();
+  for (int i = 0; i < 50 && !(store1.has("missed_by_1") && store2.has("missed_by_2")); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  ASSERT_TRUE(store2.has("missed_by_2"));
+  ASSERT_TRUE(store1.has("missed_by_1"));
+  std::stringstream repaired;
+  store2.get("missed_by_2", repaired);
+  EXPECT_EQ(repaired.str(), "stored while peer 2 was away");
+  // Both sides changed the conflicting key at generation 1, the higher digest wins
+  const std::string winner = std::max(store1.content_digest("conflict"), store2.content_digest("conflict"));
+  for (int i = 0; i < 50 && store1.content_digest("conflict") != store2.content_digest("conflict"); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(store1.content_digest("conflict"), winner);
+  EXPECT_EQ(store2.content_digest("conflict"), winner);
+  EXPECT_EQ(counter("dfs_anti_entropy_repairs_total{direction=\"pull\"}") +
+            counter("dfs_anti_entropy_repairs_total{direction=\"push\"}"), pulls_before + pushes_before + 3);
+  EXPECT_EQ(counter("dfs_anti_entropy_conflicts_total"), conflicts_before + 1);
+  // Three differing leaves cost at most two hashes per level each, not the whole tree
+  double nodes_sent = counter("dfs_anti_entropy_tree_nodes_total") - nodes_before;
+  EXPECT_LE(nodes_sent, 1 + 3 * 2 * dfs::store::MerkleTree::DEPTH);
+
+  // A deletion and an update on one side replace the other side's older versions
+  double deletes_before = counter("dfs_anti_entropy_repairs_total{direction=\"delete\"}");
+  store1.delete_file("shared_0");
+  put(store2, "shared_1", "changed while peer 1 was away");
+  server2.sync_with_peers();
+  for (int i = 0; i < 50 && (store2.has("shared_0") ||
+                             store1.content_digest("shared_1") != store2.content_digest("shared_1")); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_FALSE(store2.has("shared_0"));
+  EXPECT_EQ(store2.version("shared_0").generation, 0u);
+  std::stringstream updated;
+  ASSERT_NO_THROW(store1.get("shared_1", updated));
+  EXPECT_EQ(updated.str(), "changed while peer 1 was away");
+  EXPECT_EQ(store1.version("shared_1").generation, 2u);
+  EXPECT_EQ(counter("dfs_anti_entropy_repairs_total{direction=\"delete\"}"), deletes_before + 1);
+
+  // The deleted key stays deleted on both sides
+  server1.sync_with_peers();
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  EXPECT_FALSE(store1.has("shared_0"));
+  EXPECT_FALSE(store2.has("shared_0"));
+
+  // Once the replicas agree an exchange is a single root hash
+  store1.remove("conflict");
+  store2.remove("conflict");
+  ASSERT_EQ(root(store1), root(store2));
+  nodes_before = counter("dfs_anti_entropy_tree_nodes_total");
+  server2.sync_with_peers();
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  EXPECT_EQ(counter("dfs_anti_entropy_tree_nodes_total"), nodes_before + 1);
+}
+
+TEST_F(BootstrapTest, HaveQuerySkipsUnchangedContent) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  auto peer3 = create_peer(3, 3003, {ADDRESS + ":3001", ADDRESS + ":3002"});
+  start_peer(peer1);
+  start_peer(peer2);
+  start_peer(peer3);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2, peer3});
+  auto& server1 = peer1->bootstrap->get_file_server();
+  auto& store2 = peer2->bootstrap->get_file_server().get_store();
+  auto& store3 = peer3->bootstrap->get_file_server().get_store();
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto wait_for = [](const std::function<bool()>& condition) {
+    for (int i = 0; i < 50 && !condition(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return condition();
+  };
+  const std::string hits = "dfs_have_queries_total{result=\"have\"}";
+  const std::string misses = "dfs_have_queries_total{result=\"missing\"}";
+  const std::string skipped = "dfs_have_bytes_skipped_total";
+  const std::string copies = "dfs_have_local_copies_total";
+  const std::string content = create_large_file(256 * 1024).str();
+  auto store_content = [&](const std::string& filename) {
+    std::stringstream input(content);
+    return server1.store_file(filename, input) && server1.wait_for_replication(std::chrono::seconds(10));
+  };
+
+  // New content goes to every peer
+  double misses_before = counter(misses);
+  ASSERT_TRUE(store_content("inventory.bin"));
+  ASSERT_TRUE(wait_for([&] { return store2.has("inventory.bin") && store3.has("inventory.bin"); }));
+  EXPECT_EQ(counter(misses), misses_before + 2);
+
+  // Republishing it unchanged only costs the question
+  double hits_before = counter(hits);
+  double skipped_before = counter(skipped);
+  ASSERT_TRUE(store_content("inventory.bin"));
+  EXPECT_EQ(counter(hits), hits_before + 2);
+  EXPECT_EQ(counter(skipped), skipped_before + 2.0 * content.size());
+
+  // The same content under a new name is copied from the peers' own stores
+  double copies_before = counter(copies);
+  hits_before = counter(hits);
+  ASSERT_TRUE(store_content("renamed.bin"));
+  EXPECT_EQ(counter(copies), copies_before + 2);
+  EXPECT_EQ(counter(hits), hits_before + 2);
+  std::stringstream copied;
+  store3.get("renamed.bin", copied);
+  EXPECT_EQ(copied.str(), content);
+
+  // A peer that lost every copy is sent the file, the others are not
+  store3.remove("inventory.bin");
+  store3.remove("renamed.bin");
+  hits_before = counter(hits);
+  misses_before = counter(misses);
+  ASSERT_TRUE(store_content("inventory.bin"));
+  EXPECT_EQ(counter(hits), hits_before + 1);
+  EXPECT_EQ(counter(misses), misses_before + 1);
+  ASSERT_TRUE(wait_for([&] { return store3.has("inventory.bin"); }));
+  std::stringstream resent;
+  store3.get("inventory.bin", resent);
+  EXPECT_EQ(resent.str(), content);
+}
+
+TEST_F(BootstrapTest, DeltaTransferSendsOnlyChanges) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  verify_peer_connections({peer1, peer2});
+  auto& server1 = peer1->bootstrap->get_file_server();
+  auto& store2 = peer2->bootstrap->get_file_server().get_store();
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto wait_for = [](const std::function<bool()>& condition) {
+    for (int i = 0; i < 50 && !condition(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return condition();
+  };
+  auto stored = [&](const std::string& expected) {
+    if (!store2.has("versioned.bin")) {
+      return false;
+    }
+    std::stringstream output;
+    store2.get("versioned.bin", output);
+    return output.str() == expected;
+  };
+  const std::string applied = "dfs_delta_transfers_total{result=\"applied\"}";
+  const std::string saved = "dfs_delta_bytes_saved_total";
+
+  std::string content = create_large_file(1024 * 1024).str();
+  std::stringstream first(content);
+  ASSERT_TRUE(server1.store_file("versioned.bin", first));
+  ASSERT_TRUE(wait_for([&] { return stored(content); }));
+
+  // A few changed bytes and an insertion travel as a delta against peer 2's copy
+  content[1000] ^= 0x5a;
+  content[700000] ^= 0x5a;
+  content.insert(400000, "inserted");
+  double applied_before = counter(applied);
+  double saved_before = counter(saved);
+  std::stringstream second(content);
+  ASSERT_TRUE(server1.store_file("versioned.bin", second));
+  ASSERT_TRUE(wait_for([&] { return stored(content); }));
+  EXPECT_EQ(counter(applied), applied_before + 1);
+  EXPECT_GT(counter(saved) - saved_before, 0.9 * content.size());
+  // The delta was spooled to disk for the send and is gone again, and the
+  // rebuilt file was installed as the key's next version
+  EXPECT_FALSE(server1.get_store().has("versioned.bin#spool-delta2"));
+  EXPECT_EQ(store2.version("versioned.bin").generation, 2u);
+  EXPECT_EQ(store2.content_digest("versioned.bin"), server1.get_store().content_digest("versioned.bin"));
+}
+
+TEST_F(BootstrapTest, HotErasureCodedFilesAreCached) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  auto peer3 = create_peer(3, 3003, {ADDRESS + ":3001", ADDRESS + ":3002"});
+  start_peer(peer1);
+  start_peer(peer2);
+  start_peer(peer3);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2, peer3});
+  for (auto* peer : {peer1, peer2, peer3}) {
+    peer->bootstrap->get_file_server().set_erasure_coding(2, 1);
+  }
+  auto& server2 = peer2->bootstrap->get_file_server();
+  // Reads halve in weight every half second, so the test can wait them out
+  server2.set_hot_key_policy(1.5, std::chrono::milliseconds(500));
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto fetch = [&] {
+    std::stringstream output;
+    EXPECT_TRUE(server2.fetch_file("hot.bin", output));
+    return output.str();
+  };
+  const std::string cache_hits = "dfs_file_get_source_total{source=\"cache\"}";
+  const std::string cached_key = FileServer::cache_key("hot.bin");
+
+  std::string content = create_large_file(128 * 1024).str();
+  std::stringstream first(content);
+  ASSERT_TRUE(peer1->bootstrap->get_file_server().store_file("hot.bin", first));
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  // The first read only counts, the second finds the file hot and keeps it
+  EXPECT_EQ(fetch(), content);
+  EXPECT_FALSE(server2.get_store().has(cached_key));
+  EXPECT_EQ(fetch(), content);
+  EXPECT_TRUE(server2.get_store().has(cached_key));
+  double hits_before = counter(cache_hits);
+  EXPECT_EQ(fetch(), content);
+  EXPECT_EQ(counter(cache_hits), hits_before + 1);
+  // The copy stays out of anti-entropy, like fragments
+  EXPECT_EQ(server2.get_store().content_digest(cached_key), "");
+
+  // A new version sends peer 2 a new fragment, which drops the stale copy
+  std::string updated = create_large_file(64 * 1024).str();
+  std::stringstream second(updated);
+  ASSERT_TRUE(peer1->bootstrap->get_file_server().store_file("hot.bin", second));
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  EXPECT_FALSE(server2.get_store().has(cached_key));
+  EXPECT_EQ(fetch(), updated);
+
+  // Once reads stop, the sweep drops the copy
+  EXPECT_EQ(fetch(), updated);
+  EXPECT_TRUE(server2.get_store().has(cached_key));
+  EXPECT_EQ(server2.sweep_cached_copies(), 0u);
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+  EXPECT_EQ(server2.sweep_cached_copies(), 1u);
+  EXPECT_FALSE(server2.get_store().has(cached_key));
+  EXPECT_EQ(fetch(), updated);
+}
+
+TEST_F(BootstrapTest, CachedCopiesRevalidateWithoutContent) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  start_peer(peer1);
+  start_peer(peer2);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2});
+  auto& server1 = peer1->bootstrap->get_file_server();
+  auto& server2 = peer2->bootstrap->get_file_server();
+  for (auto* server : {&server1, &server2}) {
+    server->set_anti_entropy_interval(std::chrono::milliseconds(0));
+  }
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto fetch = [&] {
+    std::stringstream output;
+    EXPECT_TRUE(server2.fetch_file("remote.bin", output));
+    return output.str();
+  };
+  // Only peer 1 holds the file, as if peer 2 had been away when it was stored
+  auto put = [&](const std::string& content) {
+    std::stringstream input(content);
+    server1.get_store().store("remote.bin", input);
+  };
+  const std::string not_modified = "dfs_cache_revalidations_total{result=\"not_modified\"}";
+  const std::string modified = "dfs_cache_revalidations_total{result=\"modified\"}";
+  const std::string cached_key = FileServer::cache_key("remote.bin");
+
+  std::string content = create_large_file(256 * 1024).str();
+  put(content);
+  EXPECT_EQ(fetch(), content);
+  EXPECT_FALSE(server2.get_store().has("remote.bin"));
+  ASSERT_TRUE(server2.get_store().has(cached_key));
+  EXPECT_EQ(server2.cached_version("remote.bin").digest, server1.get_store().content_digest("remote.bin"));
+  EXPECT_EQ(server2.cached_version("remote.bin").generation, 1u);
+
+  // An unchanged file costs a header, not the content again
+  double not_modified_before = counter(not_modified);
+  auto& sender = peer1->bootstrap->get_peer_manager();
+  uint64_t sent_before = sender.peer_stats().front().bytes_sent;
+  EXPECT_EQ(fetch(), content);
+  EXPECT_EQ(counter(not_modified), not_modified_before + 1);
+  EXPECT_LT(sender.peer_stats().front().bytes_sent - sent_before, 1024u);
+
+  // A new version on the holder replaces the cached copy on the next read
+  std::string updated = create_large_file(64 * 1024).str();
+  double modified_before = counter(modified);
+  put(updated);
+  EXPECT_EQ(fetch(), updated);
+  EXPECT_EQ(counter(modified), modified_before + 1);
+  EXPECT_EQ(server2.cached_version("remote.bin").generation, 2u);
+
+  // Without an answer the cached copy is read as is
+  const std::string stale = "dfs_cache_revalidations_total{result=\"stale\"}";
+  double stale_before = counter(stale);
+  server1.get_store().remove("remote.bin");
+  EXPECT_EQ(fetch(), updated);
+  EXPECT_EQ(counter(stale), stale_before + 1);
+}
+
+TEST_F(BootstrapTest, ConditionalGetsReachOneHolder) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  auto peer3 = create_peer(3, 3003, {ADDRESS + ":3001", ADDRESS + ":3002"});
+  start_peer(peer1);
+  start_peer(peer2);
+  start_peer(peer3);
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2, peer3});
+  for (auto* peer : {peer1, peer2, peer3}) {
+    peer->bootstrap->get_file_server().set_anti_entropy_interval(std::chrono::milliseconds(0));
+  }
+  auto& server1 = peer1->bootstrap->get_file_server();
+  auto& server2 = peer2->bootstrap->get_file_server();
+  auto& server3 = peer3->bootstrap->get_file_server();
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto fetch = [&] {
+    std::stringstream output;
+    EXPECT_TRUE(server3.fetch_file("shared.bin", output));
+    return output.str();
+  };
+  // Peers 1 and 2 hold the file, as if peer 3 had been away when it was stored
+  auto put = [&](FileServer& server, const std::string& content) {
+    std::stringstream input(content);
+    server.get_store().store("shared.bin", input);
+  };
+  // Conditional gets answered by any node, every answer counts
+  const std::string answered = "dfs_file_op_duration_seconds_count{op=\"handle_get\"}";
+  const std::string modified = "dfs_cache_revalidations_total{result=\"modified\"}";
+
+  std::string content = create_large_file(256 * 1024).str();
+  put(server1, content);
+  put(server2, content);
+  double answered_before = counter(answered);
+  EXPECT_EQ(fetch(), content);
+  // A second holder asked as well would answer meanwhile
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  EXPECT_EQ(counter(answered), answered_before + 1);
+
+  // Both holders change the file, and still only one of them sends it
+  std::string updated = create_large_file(192 * 1024).str();
+  put(server1, updated);
+  put(server2, updated);
+  double modified_before = counter(modified);
+  answered_before = counter(answered);
+  EXPECT_EQ(fetch(), updated);
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  EXPECT_EQ(counter(answered), answered_before + 1);
+  EXPECT_EQ(counter(modified), modified_before + 1);
+
+  // A peer without the file passes the read on to the other holder at once
+  std::string latest = create_large_file(128 * 1024).str();
+  server1.get_store().remove("shared.bin");
+  put(server2, latest);
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(fetch(), latest);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+  server1.get_store().store("shared.bin", *server2.get_store().get_stream("shared.bin"));
+  server2.get_store().remove("shared.bin");
+  start = std::chrono::steady_clock::now();
+  EXPECT_EQ(fetch(), latest);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST_F(BootstrapTest, JournaledStoresReachPeersAfterRestart) {
+  // A store whose send to peer 2 was cut short by a restart of peer 1
+  const std::string store_dir = "File server: fileserver_1";
+  {
+    dfs::store::Store store(store_dir);
+    store.clear();
+    std::stringstream input(TEST_FILE_CONTENT);
+    store.store(TEST_FILENAME, input);
+    std::ofstream journal(std::filesystem::path(store_dir) / "replication.log", std::ios::trunc);
+    journal << "A 1 2 " << TEST_FILENAME.size() << ':' << TEST_FILENAME << '\n';
+  }
+
+  auto peer1 = create_peer(1, 3001);
+  auto& server1 = peer1->bootstrap->get_file_server();
+  server1.set_anti_entropy_interval(std::chrono::milliseconds(0));
+  EXPECT_EQ(server1.pending_replications(), 1u);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  peer2->bootstrap->get_file_server().set_anti_entropy_interval(std::chrono::milliseconds(0));
+  auto& store2 = peer2->bootstrap->get_file_server().get_store();
+  start_peer(peer1);
+  start_peer(peer2);
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto wait_for = [](const std::function<bool()>& condition) {
+    for (int i = 0; i < 50 && !condition(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return condition();
+  };
+
+  // The pending send is made once peer 2 connects
+  ASSERT_TRUE(server1.wait_for_replication(std::chrono::seconds(10)));
+  ASSERT_TRUE(wait_for([&] { return store2.has(TEST_FILENAME); }));
+  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer2});
+
+  // New stores return once queued, and the workers send them
+  const std::string sent = "dfs_replication_sends_total{result=\"sent\"}";
+  double queued_before = counter("dfs_replication_queued_total");
+  double sent_before = counter(sent);
+  std::stringstream input("queued content");
+  ASSERT_TRUE(server1.store_file("queued.txt", input));
+  EXPECT_EQ(counter("dfs_replication_queued_total"), queued_before + 1);
+  ASSERT_TRUE(server1.wait_for_replication(std::chrono::seconds(10)));
+  EXPECT_EQ(counter(sent), sent_before + 1);
+  ASSERT_TRUE(wait_for([&] { return store2.has("queued.txt"); }));
+  verify_file_content("queued.txt", "queued content", {peer2});
+}
+
+TEST_F(BootstrapTest, WriteQuorumWaitsForAcknowledgements) {
+  auto peer1 = create_peer(1, 3001);
+  auto peer2 = create_peer(2, 3002, {ADDRESS + ":3001"});
+  auto peer3 = create_peer(3, 3003, {ADDRESS + ":3001", ADDRESS + ":3002"});
+
+  start_peer(peer1);
+  start_peer(peer2);
+  start_peer(peer3);
+
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2, peer3});
+
+  auto counter = [](const std::string& series) {
+    std::string exposition = dfs::metrics::Registry::global().expose();
+    auto position = exposition.find("\n" + series + " ");
+    return position == std::string::npos ? 0.0 : std::stod(exposition.substr(position + series.size() + 2));
+  };
+  auto& server1 = peer1->bootstrap->get_file_server();
+
+  // A quorum larger than the connected peers fails before storing anything
+  server1.set_write_quorum(3);
+  std::stringstream refused("refused content");
+  EXPECT_FALSE(server1.store_file("refused.txt", refused));
+  EXPECT_FALSE(server1.get_store().has("refused.txt"));
+
+  // Both peers acknowledged, so both hold the file once store_file returns
+  const std::string met = "dfs_write_quorum_total{result=\"met\"}";
+  double met_before = counter(met);
+  double acks_before = counter("dfs_store_acks_sent_total");
+  server1.set_write_quorum(2);
+  std::stringstream input(TEST_FILE_CONTENT);
+  ASSERT_TRUE(server1.store_file(TEST_FILENAME, input));
+  EXPECT_EQ(counter(met), met_before + 1);
+  EXPECT_GE(counter("dfs_store_acks_sent_total"), acks_before + 2);
+  verify_file_content(TEST_FILENAME, TEST_FILE_CONTENT, {peer2, peer3});
+
+  // The journal entries left once the peers acknowledged
+  EXPECT_TRUE(server1.wait_for_replication(std::chrono::seconds(10)));
+}
+
+TEST_F(BootstrapTest, QuorumWaitLeavesOtherRequestsRunning) {
+  auto peer1 = create_peer(1, 3001);
+  // A peer with another key cannot read what it is sent, so it never acknowledges
+  peers.push_back(std::make_unique<Peer>(2, 3002, std::vector<std::string>{ADDRESS + ":3001"}));
+  auto peer2 = peers.back().get();
+  peer2->bootstrap = std::make_unique<Bootstrap>(ADDRESS, 3002, std::vector<uint8_t>(32, 0x24), 2,
+                                                 peer2->bootstrap_nodes);
+
+  start_peer(peer1);
+  start_peer(peer2);
+
+  std::this_thread::sleep_for(std::chrono::seconds(3));
+  verify_peer_connections({peer1, peer2});
+
+  auto& server1 = peer1->bootstrap->get_file_server();
+  std::stringstream local(TEST_FILE_CONTENT);
+  ASSERT_TRUE(server1.store_file(TEST_FILENAME, local));
+
+  server1.set_write_quorum(1);
+  auto waiting = std::async(std::launch::async, [&server1] {
+    std::stringstream input("never acknowledged");
+    return server1.store_file("unacknowledged.txt", input);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+  // The store waits for its quorum without holding up reads
+  auto start = std::chrono::steady_clock::now();
+  std::stringstream output;
+  ASSERT_TRUE(server1.fetch_file(TEST_FILENAME, output));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+  EXPECT_EQ(output.str(), TEST_FILE_CONTENT);
+  EXPECT_EQ(waiting.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+  EXPECT_FALSE(waiting.get());
+  EXPECT_TRUE(server1.get_store().has("unacknowledged.txt"));
+  server1.set_write_quorum(0);
+}
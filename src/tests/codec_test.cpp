@@ -84,6 +84,8 @@ protected:
     EXPECT_EQ(output_frame.payload_size, input_frame.payload_size);
     EXPECT_EQ(output_frame.filename_length, input_frame.filename_length);
     EXPECT_EQ(output_frame.iv_, input_frame.iv_);
+    EXPECT_EQ(output_frame.trace_id, input_frame.trace_id);
+    EXPECT_EQ(output_frame.span_id, input_frame.span_id);
 
     if (input_frame.payload_stream && output_frame.payload_stream) {
       input_frame.payload_stream->seekg(0);
@@ -107,6 +109,20 @@ TEST_F(CodecTest, MinimalFrameSerializeDeserialize) {
   verifySerializeDeserialize(frame);
 }
 
+TEST_F(CodecTest, TraceContextSerializeDeserialize) {
+  MessageFrame frame = createBasicFrame(4, 0, 4);
+  frame.trace_id = 0x0123456789abcdefULL;
+  frame.span_id = 0xfedcba9876543210ULL;
+  addPayload(frame, "name");
+  verifySerializeDeserialize(frame);
+
+  // The header size used to frame pipelined sends accounts for the trace fields
+  std::stringstream output;
+  std::size_t written = codec.serialize(frame, output);
+  EXPECT_EQ(written, Codec::get_serialized_size(frame));
+  EXPECT_EQ(output.str().size(), written);
+}
+
 TEST_F(CodecTest, BasicSerializeDeserialize) {
   MessageFrame frame = createBasicFrame(2, 0, 8);
   const std::string test_data = "TestData123";
@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include "delta/delta.hpp"
+
+using namespace dfs::delta;
+
+namespace {
+
+std::string random_bytes(std::size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string bytes(size, '\0');
+  for (auto& byte : bytes) {
+    byte = static_cast<char>(rng());
+  }
+  return bytes;
+}
+
+Signatures signatures_of(const std::string& content) {
+  std::istringstream input(content);
+  return compute_signatures(input, content.size());
+}
+
+// Runs the whole exchange and returns the delta's size
+std::size_t round_trip(const std::string& old_version, const std::string& new_version, DeltaStats* stats = nullptr) {
+  // Signatures go over the wire in between
+  std::string wire;
+  signatures_of(old_version).write(wire);
+  Signatures basis = Signatures::parse(wire);
+
+  std::istringstream input(new_version);
+  std::ostringstream delta;
+  DeltaStats generated = generate(basis, input, delta);
+  EXPECT_EQ(generated.copied_bytes + generated.literal_bytes, new_version.size());
+
+  std::istringstream old_stream(old_version);
+  std::istringstream delta_stream(delta.str());
+  std::ostringstream rebuilt;
+  apply(old_stream, delta_stream, rebuilt);
+  EXPECT_EQ(rebuilt.str(), new_version);
+  if (stats) {
+    *stats = generated;
+  }
+  return delta.str().size();
+}
+
+} // namespace
+
+TEST(DeltaTest, RollingChecksumMatchesRecompute) {
+  auto data = random_bytes(10000, 1);
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  const std::size_t window = 2048;
+
+  RollingChecksum rolling;
+  rolling.reset(bytes, window);
+  for (std::size_t start = 1; start + window <= data.size(); ++start) {
+    rolling.roll(bytes[start - 1], bytes[start + window - 1]);
+    RollingChecksum fresh;
+    fresh.reset(bytes + start, window);
+    ASSERT_EQ(rolling.digest(), fresh.digest()) << "window at " << start;
+  }
+}
+
+TEST(DeltaTest, BlockSizeGrowsWithFile) {
+  EXPECT_EQ(choose_block_size(0), MIN_BLOCK_SIZE);
+  EXPECT_EQ(choose_block_size(1024 * 1024), MIN_BLOCK_SIZE);
+  EXPECT_EQ(choose_block_size(64ull * 1024 * 1024), 8192u);
+  EXPECT_EQ(choose_block_size(1ull << 40), MAX_BLOCK_SIZE);
+}
+
+TEST(DeltaTest, SmallEditsGiveSmallDeltas) {
+  const auto old_version = random_bytes(1024 * 1024, 2);
+
+  // Overwrite a few bytes in place
+  auto edited = old_version;
+  edited[100] ^= 0xff;
+  edited[500000] ^= 0xff;
+  DeltaStats stats;
+  EXPECT_LT(round_trip(old_version, edited, &stats), 16u * 1024);
+  EXPECT_GT(stats.copied_bytes, old_version.size() - 8u * 1024);
+
+  // Insertions and deletions shift everything after them, the rolling
+  // window finds the blocks again at their new offsets
+  auto inserted = old_version;
+  inserted.insert(300001, "some inserted bytes");
+  EXPECT_LT(round_trip(old_version, inserted), 16u * 1024);
+
+  auto removed = old_version;
+  removed.erase(700003, 777);
+  EXPECT_LT(round_trip(old_version, removed), 16u * 1024);
+
+  auto appended = old_version + random_bytes(5000, 3);
+  EXPECT_LT(round_trip(old_version, appended), 16u * 1024);
+
+  // Identical content is nothing but one copy
+  DeltaStats identical;
+  EXPECT_LT(round_trip(old_version, old_version, &identical), 64u);
+  EXPECT_EQ(identical.literal_bytes, 0u);
+}
+
+TEST(DeltaTest, UnrelatedContentIsLiteral) {
+  const auto old_version = random_bytes(300000, 4);
+  const auto new_version = random_bytes(400000, 5);
+  DeltaStats stats;
+  round_trip(old_version, new_version, &stats);
+  EXPECT_EQ(stats.copied_bytes, 0u);
+  EXPECT_EQ(stats.literal_bytes, new_version.size());
+}
+
+TEST(DeltaTest, EdgeCases) {
+  const auto content = random_bytes(10000, 6);
+  round_trip("", "");
+  round_trip("", content);
+  round_trip(content, "");
+  round_trip("short", "shorter");
+  round_trip(content, content.substr(0, 4096));
+
+  // The short last block matches only as the tail of the new version
+  DeltaStats stats;
+  round_trip(content, content.substr(2048), &stats);
+  EXPECT_EQ(stats.literal_bytes, 0u);
+  round_trip(content, content + content);
+}
+
+TEST(DeltaTest, RejectsMalformedInput) {
+  auto content = random_bytes(10000, 7);
+  std::string wire;
+  signatures_of(content).write(wire);
+  EXPECT_THROW(Signatures::parse(wire.substr(0, wire.size() - 1)), std::invalid_argument);
+  EXPECT_THROW(Signatures::parse(wire.substr(0, 10)), std::invalid_argument);
+
+  std::istringstream input(content);
+  std::ostringstream delta;
+  generate(signatures_of(content), input, delta);
+  std::string bytes = delta.str();
+
+  auto apply_bytes = [&](const std::string& delta_bytes, const std::string& basis) {
+    std::istringstream basis_stream(basis);
+    std::istringstream delta_stream(delta_bytes);
+    std::ostringstream output;
+    apply(basis_stream, delta_stream, output);
+  };
+  EXPECT_NO_THROW(apply_bytes(bytes, content));
+  EXPECT_THROW(apply_bytes(bytes.substr(0, bytes.size() - 1), content), std::invalid_argument);
+  // Copies from an old version that is shorter than the signatures said
+  EXPECT_THROW(apply_bytes(bytes, content.substr(0, 5000)), std::invalid_argument);
+  EXPECT_THROW(apply_bytes(bytes, ""), std::invalid_argument);
+}
+
+TEST(DeltaTest, Sha256Hex) {
+  EXPECT_EQ(sha256_hex("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "erasure/gf256.hpp"
+#include "erasure/reed_solomon.hpp"
+
+using namespace dfs::erasure;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(std::size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> bytes(size);
+  for (auto& byte : bytes) {
+    byte = static_cast<uint8_t>(rng());
+  }
+  return bytes;
+}
+
+} // namespace
+
+TEST(ErasureTest, GaloisFieldArithmetic) {
+  for (unsigned a = 1; a < 256; ++a) {
+    EXPECT_EQ(gf256::mul(static_cast<uint8_t>(a), gf256::inv(static_cast<uint8_t>(a))), 1) << a;
+    EXPECT_EQ(gf256::mul(static_cast<uint8_t>(a), 1), a);
+    EXPECT_EQ(gf256::mul(static_cast<uint8_t>(a), 0), 0);
+  }
+  // 2 * 0x80 overflows into the polynomial 0x11d
+  EXPECT_EQ(gf256::mul(2, 0x80), 0x1d);
+  EXPECT_EQ(gf256::div(gf256::mul(0x53, 0xca), 0xca), 0x53);
+  EXPECT_EQ(gf256::mul(7, 3 ^ 5), gf256::mul(7, 3) ^ gf256::mul(7, 5));
+  EXPECT_THROW(gf256::inv(0), std::domain_error);
+}
+
+TEST(ErasureTest, SimdKernelsMatchScalar) {
+  auto src = random_bytes(4099, 1);
+  auto base = random_bytes(4099, 2);
+  for (auto kernel : {gf256::Kernel::Ssse3, gf256::Kernel::Avx2}) {
+    if (!gf256::kernel_supported(kernel)) {
+      continue;
+    }
+    // Lengths around the vector widths exercise the scalar tails
+    for (std::size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 100, 4099}) {
+      for (uint8_t c : {uint8_t{2}, uint8_t{0x1d}, uint8_t{0x80}, uint8_t{0xff}}) {
+        std::vector<uint8_t> expected(base.begin(), base.begin() + length);
+        std::vector<uint8_t> actual = expected;
+        gf256::mul_add_region(c, src.data(), expected.data(), length, gf256::Kernel::Scalar);
+        gf256::mul_add_region(c, src.data(), actual.data(), length, kernel);
+        EXPECT_EQ(actual, expected) << gf256::kernel_name(kernel) << " length " << length << " c " << int(c);
+      }
+    }
+  }
+  EXPECT_TRUE(gf256::kernel_supported(gf256::best_kernel()));
+}
+
+TEST(ErasureTest, DecodeFromAnyKFragments) {
+  ReedSolomon codec(4, 2);
+  const std::size_t length = codec.fragment_size(10000);
+  EXPECT_EQ(length, 2500u);
+  auto data = random_bytes(4 * length, 3);
+  std::vector<uint8_t> parity(2 * length);
+
+  std::vector<const uint8_t*> fragments;
+  for (std::size_t i = 0; i < 4; ++i) {
+    fragments.push_back(data.data() + i * length);
+  }
+  codec.encode(fragments, {parity.data(), parity.data() + length}, length);
+  fragments.push_back(parity.data());
+  fragments.push_back(parity.data() + length);
+
+  // Every way of losing two of the six fragments
+  for (std::size_t lost1 = 0; lost1 < 6; ++lost1) {
+    for (std::size_t lost2 = lost1 + 1; lost2 < 6; ++lost2) {
+      auto present = fragments;
+      present[lost1] = nullptr;
+      present[lost2] = nullptr;
+      std::vector<uint8_t> rebuilt(4 * length);
+      std::vector<uint8_t*> outputs;
+      for (std::size_t i = 0; i < 4; ++i) {
+        outputs.push_back(rebuilt.data() + i * length);
+      }
+      ASSERT_TRUE(codec.decode(present, outputs, length)) << lost1 << "," << lost2;
+      EXPECT_EQ(rebuilt, data) << "lost " << lost1 << " and " << lost2;
+    }
+  }
+
+  // A third loss is more than two parity fragments can cover
+  auto present = fragments;
+  present[0] = present[2] = present[5] = nullptr;
+  std::vector<uint8_t> rebuilt(4 * length);
+  std::vector<uint8_t*> outputs;
+  for (std::size_t i = 0; i < 4; ++i) {
+    outputs.push_back(rebuilt.data() + i * length);
+  }
+  EXPECT_FALSE(codec.decode(present, outputs, length));
+}
+
+TEST(ErasureTest, EncodeByStripes) {
+  ReedSolomon codec(3, 2);
+  const std::size_t length = codec.fragment_size(30000);
+  auto data = random_bytes(3 * length, 4);
+  std::vector<const uint8_t*> fragments;
+  for (std::size_t i = 0; i < 3; ++i) {
+    fragments.push_back(data.data() + i * length);
+  }
+  std::vector<uint8_t> parity(2 * length);
+  codec.encode(fragments, {parity.data(), parity.data() + length}, length);
+
+  // One parity fragment at a time, in stripes that do not divide it evenly
+  const std::size_t stripe = 4096;
+  for (std::size_t index = 0; index < 2; ++index) {
+    std::vector<uint8_t> striped(length);
+    for (std::size_t offset = 0; offset < length; offset += stripe) {
+      std::vector<const uint8_t*> slices;
+      for (const uint8_t* fragment : fragments) {
+        slices.push_back(fragment + offset);
+      }
+      codec.encode_parity(index, slices, striped.data() + offset, std::min(stripe, length - offset));
+    }
+    EXPECT_TRUE(std::equal(striped.begin(), striped.end(), parity.begin() + index * length)) << index;
+  }
+  EXPECT_THROW(codec.encode_parity(2, fragments, parity.data(), length), std::invalid_argument);
+}
+
+TEST(ErasureTest, GeometryLimits) {
+  EXPECT_THROW(ReedSolomon(0, 2), std::invalid_argument);
+  EXPECT_THROW(ReedSolomon(4, 0), std::invalid_argument);
+  EXPECT_THROW(ReedSolomon(200, 57), std::invalid_argument);
+  EXPECT_NO_THROW(ReedSolomon(255, 1));
+  EXPECT_EQ(ReedSolomon(3, 2).fragment_size(0), 0u);
+  EXPECT_EQ(ReedSolomon(3, 2).fragment_size(10), 4u);
+}
+
+TEST(ErasureTest, FragmentHeaderRoundTrip) {
+  FragmentHeader header;
+  header.data_fragments = 4;
+  header.parity_fragments = 2;
+  header.index = 5;
+  header.object_size = 0x123456789aULL;
+  header.generation = 0xfedcba9876543210ULL;
+
+  std::ostringstream output;
+  header.write(output);
+  std::string bytes = output.str();
+  ASSERT_EQ(bytes.size(), FragmentHeader::SIZE);
+
+  auto parsed = FragmentHeader::parse(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+  ASSERT_TRUE(parsed);
+  EXPECT_EQ(parsed->data_fragments, 4);
+  EXPECT_EQ(parsed->parity_fragments, 2);
+  EXPECT_EQ(parsed->index, 5);
+  EXPECT_EQ(parsed->object_size, 0x123456789aULL);
+  EXPECT_EQ(parsed->generation, 0xfedcba9876543210ULL);
+
+  EXPECT_FALSE(FragmentHeader::parse(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size() - 1));
+  std::string corrupt = bytes;
+  corrupt[0] = 'X';
+  EXPECT_FALSE(FragmentHeader::parse(reinterpret_cast<const uint8_t*>(corrupt.data()), corrupt.size()));
+  corrupt = bytes;
+  corrupt[7] = 6;
+  EXPECT_FALSE(FragmentHeader::parse(reinterpret_cast<const uint8_t*>(corrupt.data()), corrupt.size()));
+}
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "logger/async_log_backend.hpp"
+#include "logger/logger.hpp"
+#include "utils/bounded_ring.hpp"
+
+using namespace dfs::crypto;
+using dfs::utils::BoundedRing;
+
+class LoggerTest : public ::testing::Test {
+protected:
+  std::filesystem::path log_path;
+
+  void SetUp() override {
+    log_path = std::filesystem::temp_directory_path() /
+      ("logger_test_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".log");
+  }
+
+  void TearDown() override {
+    Logger::shutdown();
+    std::filesystem::remove(log_path);
+  }
+
+  // Stream buffer whose writes block until the gate is opened, so the
+  // writer thread can be held while the ring fills up
+  class GatedBuffer : public std::stringbuf {
+  public:
+    void open() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      open_ = true;
+      cv_.notify_all();
+    }
+  protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+      wait();
+      return std::stringbuf::xsputn(s, n);
+    }
+    int_type overflow(int_type c) override {
+      wait();
+      return std::stringbuf::overflow(c);
+    }
+  private:
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return open_; });
+    }
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool open_{false};
+  };
+
+  static std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+  }
+
+  static std::size_t count_lines(const std::string& text, const std::string& needle) {
+    std::size_t count = 0;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (line.find(needle) != std::string::npos) {
+        ++count;
+      }
+    }
+    return count;
+  }
+};
+
+TEST_F(LoggerTest, RingRejectsWhenFull) {
+  BoundedRing<std::string> ring(4);
+  ASSERT_EQ(ring.capacity(), 4u);
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.try_push(std::to_string(i)));
+  }
+  EXPECT_FALSE(ring.try_push("overflow"));
+
+  std::string item;
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(ring.try_pop(item));
+    EXPECT_EQ(item, std::to_string(i));
+  }
+  EXPECT_FALSE(ring.try_pop(item));
+  EXPECT_TRUE(ring.try_push("again"));
+}
+
+TEST_F(LoggerTest, RingConcurrentProducers) {
+  BoundedRing<int> ring(1024);
+  const int producers = 4;
+  const int per_producer = 10000;
+  std::atomic<long long> sum{0};
+  std::atomic<int> received{0};
+
+  std::thread consumer([&] {
+    int value;
+    while (received < producers * per_producer) {
+      if (ring.try_pop(value)) {
+        sum += value;
+        ++received;
+      }
+    }
+  });
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&] {
+      for (int i = 1; i <= per_producer; ++i) {
+        int value = i;
+        while (!ring.try_push(std::move(value))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  consumer.join();
+
+  EXPECT_EQ(sum.load(), producers * (static_cast<long long>(per_producer) * (per_producer + 1) / 2));
+}
+
+TEST_F(LoggerTest, BackendDropsAndCountsWhenFull) {
+  auto gate = std::make_shared<GatedBuffer>();
+  auto output = std::make_shared<std::ostream>(gate.get());
+  AsyncLogBackend backend(output, 8);
+
+  // The writer blocks on its first write, so at most one ring's worth is accepted
+  const std::size_t records = 100;
+  for (std::size_t i = 0; i < records; ++i) {
+    backend.consume(boost::log::record_view(), "record " + std::to_string(i));
+  }
+  EXPECT_GT(backend.dropped(), 0u);
+
+  gate->open();
+  backend.flush();
+  backend.stop();
+
+  std::string text = gate->str();
+  EXPECT_EQ(backend.written() + backend.dropped(), records);
+  EXPECT_EQ(count_lines(text, "record "), backend.written());
+  EXPECT_EQ(count_lines(text, "records dropped"), 1u);
+}
+
+TEST_F(LoggerTest, InitWritesFormattedRecords) {
+  Logger::init(log_path.string());
+  for (int i = 0; i < 50; ++i) {
+    DFS_LOG(info) << "Logger test: record " << i;
+  }
+  DFS_LOG(error) << "Logger test: failure";
+  Logger::flush();
+
+  std::string text = read_file(log_path);
+  EXPECT_EQ(count_lines(text, "[info] Logger test: record"), 50u);
+  EXPECT_EQ(count_lines(text, "[error] Logger test: failure"), 1u);
+  EXPECT_EQ(Logger::dropped_records(), 0u);
+}
+
+TEST_F(LoggerTest, ShutdownDrainsPendingRecords) {
+  Logger::init(log_path.string());
+  for (int i = 0; i < 200; ++i) {
+    DFS_LOG(warning) << "Logger test: pending " << i;
+  }
+  Logger::shutdown();
+
+  EXPECT_EQ(count_lines(read_file(log_path), "Logger test: pending"), 200u);
+}
+
+TEST_F(LoggerTest, LevelsBelowMinimumAreElided) {
+  int evaluated = 0;
+  auto side_effect = [&evaluated] { return ++evaluated; };
+
+  DFS_LOG(trace) << "Logger test: " << side_effect();
+  EXPECT_EQ(evaluated, Logger::compiled_in(boost::log::trivial::trace) ? 1 : 0);
+
+  // Fatal is always compiled in
+  EXPECT_TRUE(Logger::compiled_in(boost::log::trivial::fatal));
+}
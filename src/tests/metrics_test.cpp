@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <boost/asio.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "metrics/metrics.hpp"
+#include "metrics/metrics_server.hpp"
+
+using namespace dfs::metrics;
+
+class MetricsTest : public ::testing::Test {
+protected:
+  Registry registry;
+
+  // Returns the value printed for an exact series line prefix, or -1 when absent
+  static double series_value(const std::string& text, const std::string& series) {
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (line.rfind(series + " ", 0) == 0) {
+        return std::stod(line.substr(series.size() + 1));
+      }
+    }
+    return -1;
+  }
+
+  static std::size_t count_occurrences(const std::string& text, const std::string& needle) {
+    std::size_t count = 0;
+    for (auto pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+      ++count;
+    }
+    return count;
+  }
+
+  // Sends one raw HTTP request and returns the whole response
+  static std::string http_request(uint16_t port, const std::string& request) {
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::socket socket(io);
+    socket.connect({boost::asio::ip::make_address("127.0.0.1"), port});
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    std::string response;
+    boost::system::error_code ec;
+    char buffer[4096];
+    while (true) {
+      std::size_t n = socket.read_some(boost::asio::buffer(buffer), ec);
+      response.append(buffer, n);
+      if (ec) {
+        break;
+      }
+    }
+    return response;
+  }
+};
+
+TEST_F(MetricsTest, CounterSumsShardsAcrossThreads) {
+  Counter& counter = registry.counter("test_ops_total", "Test operations");
+  const int threads = 8;
+  const int per_thread = 100000;
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&counter] {
+      for (int i = 0; i < per_thread; ++i) {
+        counter.inc();
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  EXPECT_EQ(counter.value(), static_cast<std::uint64_t>(threads) * per_thread);
+  // The same name and labels return the same series
+  EXPECT_EQ(&registry.counter("test_ops_total", "Test operations"), &counter);
+}
+
+TEST_F(MetricsTest, HistogramBucketsAreInclusiveAndBounded) {
+  EXPECT_EQ(Histogram::bucket_index(0), 0u);
+  EXPECT_EQ(Histogram::upper_bound(Histogram::bucket_index(1)), 1u);
+
+  for (std::uint64_t value : {2ull, 7ull, 8ull, 9ull, 1000ull, 1024ull, 1025ull, 123456789ull, 1ull << 40}) {
+    std::size_t index = Histogram::bucket_index(value);
+    std::uint64_t upper = Histogram::upper_bound(index);
+    // The value is inside its bucket and the bucket is at most 12.5% wide
+    EXPECT_GE(upper, value) << value;
+    EXPECT_LT(Histogram::upper_bound(index - 1), value) << value;
+    EXPECT_LE(upper - value, value / 8 + 1) << value;
+  }
+
+  // Powers of two close a bucket, so they match the exposed le boundaries
+  EXPECT_EQ(Histogram::upper_bound(Histogram::bucket_index(1024)), 1024u);
+  EXPECT_EQ(Histogram::bucket_index(1025), Histogram::bucket_index(1024) + 1);
+
+  // Values past the tracked range collapse into the last bucket
+  EXPECT_EQ(Histogram::bucket_index(~std::uint64_t{0}), Histogram::BUCKET_COUNT - 1);
+}
+
+TEST_F(MetricsTest, HistogramPercentiles) {
+  Histogram& histogram = registry.histogram("test_latency_seconds", "Test latency", HistogramUnit::Seconds);
+  for (std::uint64_t value = 1; value <= 1000; ++value) {
+    histogram.observe(value * 1000);
+  }
+
+  auto snapshot = histogram.snapshot();
+  EXPECT_EQ(snapshot.count, 1000u);
+  EXPECT_EQ(snapshot.sum, 1000u * 1001u / 2u * 1000u);
+
+  std::uint64_t p50 = snapshot.percentile(0.5);
+  std::uint64_t p99 = snapshot.percentile(0.99);
+  EXPECT_GE(p50, 500000u);
+  EXPECT_LE(p50, 500000u * 9 / 8);
+  EXPECT_GE(p99, 990000u);
+  EXPECT_LE(p99, 990000u * 9 / 8);
+}
+
+TEST_F(MetricsTest, PrometheusExposition) {
+  registry.counter("test_requests_total", "Requests served", {{"op", "get"}}).inc(3);
+  registry.counter("test_requests_total", "Requests served", {{"op", "put"}}).inc(2);
+  registry.counter("test_busy_seconds_total", "Busy time", {}, 1e-9).inc(1500000000);
+  registry.gauge("test_depth", "Queue depth").set(-4);
+  registry.gauge("test_label_escape", "Escaping", {{"path", "a\"b\\c"}}).set(1);
+
+  Histogram& histogram = registry.histogram("test_size_bytes", "Sizes", HistogramUnit::Bytes);
+  histogram.observe(64);
+  histogram.observe(65);
+  histogram.observe(100000);
+
+  std::string text = registry.expose();
+
+  EXPECT_EQ(count_occurrences(text, "# TYPE test_requests_total counter\n"), 1u);
+  EXPECT_EQ(count_occurrences(text, "# HELP test_requests_total Requests served\n"), 1u);
+  EXPECT_EQ(series_value(text, "test_requests_total{op=\"get\"}"), 3);
+  EXPECT_EQ(series_value(text, "test_requests_total{op=\"put\"}"), 2);
+  EXPECT_DOUBLE_EQ(series_value(text, "test_busy_seconds_total"), 1.5);
+  EXPECT_NE(text.find("# TYPE test_depth gauge\n"), std::string::npos);
+  EXPECT_EQ(series_value(text, "test_depth"), -4);
+  EXPECT_NE(text.find("test_label_escape{path=\"a\\\"b\\\\c\"} 1\n"), std::string::npos);
+
+  // Buckets are cumulative and inclusive of their bound
+  EXPECT_NE(text.find("# TYPE test_size_bytes histogram\n"), std::string::npos);
+  EXPECT_EQ(series_value(text, "test_size_bytes_bucket{le=\"64\"}"), 1);
+  EXPECT_EQ(series_value(text, "test_size_bytes_bucket{le=\"128\"}"), 2);
+  EXPECT_EQ(series_value(text, "test_size_bytes_bucket{le=\"131072\"}"), 3);
+  EXPECT_EQ(series_value(text, "test_size_bytes_bucket{le=\"+Inf\"}"), 3);
+  EXPECT_EQ(series_value(text, "test_size_bytes_sum"), 64 + 65 + 100000);
+  EXPECT_EQ(series_value(text, "test_size_bytes_count"), 3);
+}
+
+TEST_F(MetricsTest, TypeConflictThrows) {
+  registry.counter("test_conflict", "A counter");
+  EXPECT_THROW(registry.gauge("test_conflict", "Now a gauge"), std::invalid_argument);
+  EXPECT_THROW(registry.histogram("test_conflict", "Now a histogram", HistogramUnit::Bytes),
+               std::invalid_argument);
+}
+
+TEST_F(MetricsTest, CollectorsRunBeforeExposition) {
+  int samples = 0;
+  std::size_t id = registry.add_collector([this, &samples] {
+    registry.gauge("test_sampled", "Sampled on scrape").set(++samples);
+  });
+
+  EXPECT_EQ(series_value(registry.expose(), "test_sampled"), 1);
+  EXPECT_EQ(series_value(registry.expose(), "test_sampled"), 2);
+
+  registry.remove_collector(id);
+  EXPECT_EQ(series_value(registry.expose(), "test_sampled"), 2);
+}
+
+TEST_F(MetricsTest, ServerServesMetricsOverHttp) {
+  registry.counter("test_served_total", "Served through HTTP").inc(7);
+
+  MetricsServer server(registry, 0);
+  ASSERT_TRUE(server.start());
+  ASSERT_NE(server.get_port(), 0);
+
+  std::string response = http_request(server.get_port(), "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_EQ(response.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+  EXPECT_NE(response.find("Content-Type: text/plain; version=0.0.4"), std::string::npos);
+  EXPECT_NE(response.find("\ntest_served_total 7\n"), std::string::npos);
+
+  std::string missing = http_request(server.get_port(), "GET /other HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(missing.rfind("HTTP/1.1 404", 0), 0u);
+
+  std::string post = http_request(server.get_port(), "POST /metrics HTTP/1.1\r\n\r\n");
+  EXPECT_EQ(post.rfind("HTTP/1.1 405", 0), 0u);
+
+  server.shutdown();
+  EXPECT_FALSE(server.is_running());
+}
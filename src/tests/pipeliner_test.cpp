@@ -0,0 +1,296 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "utils/pipeliner.hpp"
+
+using namespace dfs::utils;
+
+class PipelinerTest : public ::testing::Test {
+protected:
+  // Chunk producer emitting `count` chunks of `chunk_size` bytes, counting each call
+  static ProducerFn counting_producer(std::size_t count, std::size_t chunk_size,
+                                      std::shared_ptr<std::atomic<std::size_t>> produced) {
+    return [count, chunk_size, produced](Chunk& out) {
+      if (*produced >= count) {
+        return false;
+      }
+      char fill = static_cast<char>('a' + (*produced % 26));
+      out.append(std::string(chunk_size, fill));
+      ++*produced;
+      return true;
+    };
+  }
+
+  static std::string read_all(Pipeliner& pipeline) {
+    std::stringstream out;
+    out << pipeline.rdbuf();
+    return out.str();
+  }
+};
+
+TEST_F(PipelinerTest, ProducerOnly) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(3, 4, produced));
+
+  EXPECT_EQ(read_all(*pipeline), "aaaabbbbcccc");
+  EXPECT_FALSE(pipeline->failed());
+}
+
+TEST_F(PipelinerTest, TransformsApplyInOrder) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(2, 3, produced))
+    ->transform([](std::stringstream& in, std::stringstream& out) {
+      out << "[" << in.str() << "]";
+      return true;
+    })
+    ->transform([](std::stringstream& in, std::stringstream& out) {
+      out << "<" << in.str() << ">";
+      return true;
+    });
+
+  EXPECT_EQ(read_all(*pipeline), "<[aaa]><[bbb]>");
+}
+
+TEST_F(PipelinerTest, FlushEmitsTrailingBytes) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto seen = std::make_shared<std::size_t>(0);
+  auto pipeline = Pipeliner::create(counting_producer(4, 8, produced))
+    ->transform([seen](std::stringstream& in, std::stringstream& out) {
+      *seen += in.str().size();
+      out << in.rdbuf();
+      return true;
+    }, [seen](std::stringstream& out) {
+      out << "|" << *seen;
+      return true;
+    });
+
+  std::string result = read_all(*pipeline);
+  EXPECT_EQ(result.substr(result.size() - 3), "|32");
+  EXPECT_EQ(result.size(), 35u);
+}
+
+TEST_F(PipelinerTest, BoundedQueuesApplyBackpressure) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(1000, 1024, produced))
+    ->transform([](std::stringstream& in, std::stringstream& out) {
+      out << in.rdbuf();
+      return true;
+    });
+  pipeline->set_queue_capacity(2);
+  pipeline->start();
+
+  // Nothing is read, so the producer may only run ahead by the queued chunks
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_LE(produced->load(), 8u);
+
+  EXPECT_EQ(read_all(*pipeline).size(), 1000u * 1024u);
+  EXPECT_EQ(produced->load(), 1000u);
+}
+
+TEST_F(PipelinerTest, TransformFailureEndsStream) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(100, 16, produced))
+    ->transform([calls = 0](std::stringstream& in, std::stringstream& out) mutable {
+      if (++calls > 3) {
+        return false;
+      }
+      out << in.rdbuf();
+      return true;
+    });
+
+  std::string result = read_all(*pipeline);
+  EXPECT_TRUE(pipeline->failed());
+  EXPECT_LE(result.size(), 3u * 16u);
+}
+
+TEST_F(PipelinerTest, CancelUnblocksStages) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(1000000, 64, produced));
+  pipeline->set_queue_capacity(1);
+  pipeline->start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  pipeline->cancel();
+  EXPECT_LT(produced->load(), 1000000u);
+}
+
+TEST_F(PipelinerTest, ParallelStagePreservesOrder) {
+  const std::size_t chunks = 64;
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto running = std::make_shared<std::atomic<int>>(0);
+  auto peak = std::make_shared<std::atomic<int>>(0);
+
+  auto pipeline = Pipeliner::create(counting_producer(chunks, 32, produced))
+    ->transform_parallel([running, peak](std::stringstream& in, std::stringstream& out) {
+      int now = ++*running;
+      int seen = peak->load();
+      while (now > seen && !peak->compare_exchange_weak(seen, now)) {}
+
+      // Uneven work so later chunks regularly finish before earlier ones
+      std::string data = in.str();
+      std::this_thread::sleep_for(std::chrono::microseconds(200 + (data[0] * 37) % 800));
+      out << data.substr(0, 1);
+      --*running;
+      return true;
+    }, 4);
+
+  std::string expected;
+  for (std::size_t i = 0; i < chunks; ++i) {
+    expected += static_cast<char>('a' + i % 26);
+  }
+  EXPECT_EQ(read_all(*pipeline), expected);
+  EXPECT_FALSE(pipeline->failed());
+  EXPECT_GT(peak->load(), 1);
+  EXPECT_LE(peak->load(), 4);
+}
+
+TEST_F(PipelinerTest, ParallelStageFailureEndsStream) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto calls = std::make_shared<std::atomic<int>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(100, 16, produced))
+    ->transform_parallel([calls](std::stringstream& in, std::stringstream& out) {
+      if (++*calls == 10) {
+        return false;
+      }
+      out << in.rdbuf();
+      return true;
+    }, 3)
+    ->transform([](std::stringstream& in, std::stringstream& out) {
+      out << in.rdbuf();
+      return true;
+    });
+
+  std::string result = read_all(*pipeline);
+  EXPECT_TRUE(pipeline->failed());
+  EXPECT_LT(result.size(), 100u * 16u);
+}
+
+TEST_F(PipelinerTest, ChunkMoveTransfersOwnership) {
+  Chunk chunk(16);
+  chunk.append("payload");
+  const char* data = chunk.data();
+
+  Chunk moved(std::move(chunk));
+  EXPECT_EQ(moved.data(), data);
+  EXPECT_EQ(moved.view(), "payload");
+  EXPECT_TRUE(chunk.empty());
+  EXPECT_EQ(chunk.capacity(), 0u);
+
+  // Clearing keeps the allocation so the slab can be refilled
+  moved.clear();
+  EXPECT_TRUE(moved.empty());
+  EXPECT_EQ(moved.capacity(), 16u);
+}
+
+TEST_F(PipelinerTest, ChunkStagesPassSlabsWithoutCopying) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(8, 1024, produced))
+    ->transform([](Chunk& in, Chunk& out) {
+      // Hand the input slab on unchanged
+      out = std::move(in);
+      return true;
+    })
+    ->transform([](Chunk& in, Chunk& out) {
+      out.append(in.data(), 4);
+      return true;
+    }, [](Chunk& out) {
+      out.append("end");
+      return true;
+    });
+
+  std::string result;
+  Chunk chunk;
+  while (pipeline->read_chunk(chunk)) {
+    result.append(chunk.view());
+  }
+  EXPECT_EQ(result, "aaaabbbbccccddddeeeeffffgggghhhhend");
+  EXPECT_FALSE(pipeline->failed());
+}
+
+TEST_F(PipelinerTest, ProducerRefillsDrainedSlabs) {
+  // Counts slabs reaching the producer with the reader's mark still in them
+  auto refilled = std::make_shared<std::atomic<std::size_t>>(0);
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto producer = counting_producer(64, 1024, produced);
+  auto pipeline = Pipeliner::create([refilled, producer](Chunk& out) {
+    if (out.capacity() > 0 && out.data()[0] == 'R') {
+      ++*refilled;
+    }
+    return producer(out);
+  });
+  pipeline->set_buffer_size(1024);
+  pipeline->set_queue_capacity(2);
+
+  std::size_t bytes = 0;
+  Chunk chunk;
+  while (pipeline->read_chunk(chunk)) {
+    bytes += chunk.size();
+    chunk.data()[0] = 'R';
+  }
+  EXPECT_EQ(bytes, 64u * 1024);
+  // The producer only allocates when it runs ahead of the reader
+  EXPECT_GE(*refilled, 32u);
+}
+
+TEST_F(PipelinerTest, ReadChunkAfterStreamRead) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(3, 4, produced));
+
+  char prefix[2];
+  pipeline->read(prefix, 2);
+  ASSERT_EQ(pipeline->gcount(), 2);
+
+  std::string rest;
+  Chunk chunk;
+  while (pipeline->read_chunk(chunk)) {
+    rest.append(chunk.view());
+  }
+  EXPECT_EQ(std::string(prefix, 2) + rest, "aaaabbbbcccc");
+}
+
+TEST_F(PipelinerTest, StatsNameTheBottleneckStage) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(20, 256, produced))->named("source")
+    ->transform([](Chunk& in, Chunk& out) {
+      out.append(in.data(), in.size());
+      return true;
+    })->named("copy")
+    ->transform([](Chunk& in, Chunk& out) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      out.append(in.data(), in.size() / 2);
+      return true;
+    })->named("slow");
+  pipeline->enable_stats();
+
+  EXPECT_EQ(read_all(*pipeline).size(), 20u * 128u);
+  EXPECT_EQ(pipeline->bottleneck(), "slow");
+
+  auto stats = pipeline->get_stats();
+  ASSERT_EQ(stats.size(), 4u);
+  EXPECT_EQ(stats[0].name, "source");
+  EXPECT_EQ(stats[0].bytes_out, 20u * 256u);
+  EXPECT_EQ(stats[2].name, "slow");
+  EXPECT_EQ(stats[2].chunks, 20u);
+  EXPECT_EQ(stats[2].bytes_in, 20u * 256u);
+  EXPECT_EQ(stats[2].bytes_out, 20u * 128u);
+  EXPECT_GE(stats[2].busy, std::chrono::milliseconds(40));
+  // Stages in front of the slow one spend their time blocked on output
+  EXPECT_GT(stats[1].output_wait, stats[1].busy);
+  EXPECT_EQ(stats[3].name, "reader");
+  EXPECT_EQ(stats[3].bytes_in, 20u * 128u);
+}
+
+TEST_F(PipelinerTest, StatsDisabledRecordNoTime) {
+  auto produced = std::make_shared<std::atomic<std::size_t>>(0);
+  auto pipeline = Pipeliner::create(counting_producer(4, 64, produced));
+
+  read_all(*pipeline);
+  for (const auto& stage : pipeline->get_stats()) {
+    EXPECT_EQ(stage.busy.count(), 0);
+    EXPECT_EQ(stage.input_wait.count(), 0);
+  }
+  EXPECT_EQ(pipeline->get_stats().front().chunks, 4u);
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "metrics/cpu_profiler.hpp"
+#include "metrics/hot_path.hpp"
+
+using namespace dfs::metrics;
+
+// Busy loop with external linkage so it shows up by name in sampled stacks
+__attribute__((noinline)) double profiler_test_spin(std::chrono::milliseconds duration) {
+  volatile double sink = 0;
+  auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 1; i < 1000; ++i) {
+      sink = sink + std::sqrt(static_cast<double>(i));
+    }
+  }
+  return sink;
+}
+
+class ProfilerTest : public ::testing::Test {
+protected:
+  // Sums the trailing counts of folded stack lines
+  static std::uint64_t total_count(const std::string& folded) {
+    std::istringstream lines(folded);
+    std::string line;
+    std::uint64_t total = 0;
+    while (std::getline(lines, line)) {
+      auto space = line.rfind(' ');
+      EXPECT_NE(space, std::string::npos) << line;
+      total += std::stoull(line.substr(space + 1));
+    }
+    return total;
+  }
+};
+
+TEST_F(ProfilerTest, ScopedTimerRecordsSite) {
+  Histogram& histogram = hot_path_histogram("test.scoped_timer");
+  auto before = histogram.snapshot().count;
+  for (int i = 0; i < 3; ++i) {
+    DFS_SCOPED_TIMER("test.scoped_timer");
+  }
+  EXPECT_EQ(histogram.snapshot().count - before, DFS_HOT_PATH_TIMERS ? 3u : 0u);
+}
+
+TEST_F(ProfilerTest, SamplesThreadsStartedDuringSession) {
+  CpuProfiler profiler(999);
+  if (!profiler.start()) {
+    GTEST_SKIP() << "perf events are not available in this environment";
+  }
+  EXPECT_TRUE(profiler.is_running());
+  EXPECT_FALSE(profiler.start());
+
+  // Created after start(), so only sampled through event inheritance
+  std::thread worker([] { profiler_test_spin(std::chrono::milliseconds(300)); });
+  worker.join();
+  profiler.stop();
+  EXPECT_FALSE(profiler.is_running());
+
+  std::ostringstream folded;
+  std::size_t lines = profiler.write_folded(folded);
+  EXPECT_GT(profiler.samples(), 0u);
+  EXPECT_GT(lines, 0u);
+  EXPECT_EQ(total_count(folded.str()), profiler.samples());
+  EXPECT_NE(folded.str().find("profiler_test_spin"), std::string::npos) << folded.str();
+}
+
+TEST_F(ProfilerTest, StopWithoutStartIsHarmless) {
+  CpuProfiler profiler;
+  profiler.stop();
+  std::ostringstream folded;
+  EXPECT_EQ(profiler.write_folded(folded), 0u);
+  EXPECT_EQ(profiler.samples(), 0u);
+}
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include "file_server/replication_journal.hpp"
+
+using namespace dfs::network;
+using namespace std::chrono_literals;
+
+class ReplicationJournalTest : public ::testing::Test {
+protected:
+  std::filesystem::path test_dir;
+  std::filesystem::path log_path;
+  std::unique_ptr<ReplicationJournal> journal;
+  ReplicationJournal::Clock::time_point now = ReplicationJournal::Clock::now();
+
+  void SetUp() override {
+    test_dir = std::filesystem::temp_directory_path() /
+      ("replication_test_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(test_dir);
+    log_path = test_dir / "replication.log";
+    reopen();
+  }
+
+  void TearDown() override {
+    journal.reset();
+    std::filesystem::remove_all(test_dir);
+  }
+
+  void reopen() {
+    journal.reset();
+    journal = std::make_unique<ReplicationJournal>(log_path, 100ms, 1000ms);
+  }
+};
+
+TEST_F(ReplicationJournalTest, PeersAreSentTheirEntriesInOrder) {
+  EXPECT_EQ(journal->append("a", {1, 2}), 2u);
+  EXPECT_EQ(journal->append("b", {1}), 1u);
+  EXPECT_EQ(journal->pending(), 3u);
+
+  // The oldest key goes to every peer it heads the queue of at once
+  auto batch = journal->claim({1, 2}, now);
+  ASSERT_EQ(batch.size(), 2u);
+  EXPECT_EQ(batch[0].key, "a");
+  EXPECT_EQ(batch[1].key, "a");
+  // One send per peer at a time, and a key is not sent twice at once
+  EXPECT_TRUE(journal->claim({1, 2}, now).empty());
+
+  journal->finish(batch[0], true, now);
+  journal->finish(batch[1], true, now);
+  batch = journal->claim({1, 2}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].peer_id, 1);
+  EXPECT_EQ(batch[0].key, "b");
+  journal->finish(batch[0], true, now);
+  EXPECT_EQ(journal->pending(), 0u);
+  EXPECT_TRUE(journal->claim({1, 2}, now).empty());
+}
+
+TEST_F(ReplicationJournalTest, QueuedKeysAreNotQueuedTwice) {
+  EXPECT_EQ(journal->append("a", {1}), 1u);
+  EXPECT_EQ(journal->append("a", {1}), 0u);
+
+  // Once being sent, the content read may be older than the next store
+  auto batch = journal->claim({1}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(journal->append("a", {1}), 1u);
+  journal->finish(batch[0], true, now);
+  EXPECT_EQ(journal->pending(1), 1u);
+}
+
+TEST_F(ReplicationJournalTest, FailedSendsBackOff) {
+  journal->append("a", {1});
+  journal->append("b", {1});
+
+  auto batch = journal->claim({1}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  journal->finish(batch[0], false, now);
+  // The failed entry keeps its place, later ones wait behind it
+  EXPECT_TRUE(journal->claim({1}, now + 50ms).empty());
+  EXPECT_EQ(journal->next_due({1}), now + 100ms);
+
+  batch = journal->claim({1}, now + 100ms);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].key, "a");
+  journal->finish(batch[0], false, now);
+  EXPECT_EQ(journal->next_due({1}), now + 200ms);
+
+  // The backoff doubles up to its cap
+  for (int i = 0; i < 10; ++i) {
+    batch = journal->claim({1}, now + 1h);
+    ASSERT_EQ(batch.size(), 1u);
+    journal->finish(batch[0], false, now);
+  }
+  EXPECT_EQ(journal->next_due({1}), now + 1000ms);
+
+  // A peer that was gone is retried as soon as it is back
+  EXPECT_TRUE(journal->claim({}, now).empty());
+  EXPECT_FALSE(journal->next_due({}).has_value());
+  batch = journal->claim({1}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  journal->finish(batch[0], true, now);
+  batch = journal->claim({1}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].key, "b");
+}
+
+TEST_F(ReplicationJournalTest, PendingEntriesSurviveRestart) {
+  journal->append("first file", {1, 2});
+  journal->append("second", {2});
+  auto batch = journal->claim({1, 2}, now);
+  ASSERT_EQ(batch.size(), 2u);
+  journal->finish(batch[0], true, now);
+  // Claimed but unfinished when the node stops
+  reopen();
+
+  EXPECT_EQ(journal->pending(), 2u);
+  EXPECT_EQ(journal->pending(1), 0u);
+  batch = journal->claim({1, 2}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].peer_id, 2);
+  EXPECT_EQ(batch[0].key, "first file");
+  journal->finish(batch[0], true, now);
+
+  // Opening compacts the log down to the pending entries
+  std::ifstream log(log_path);
+  std::string contents((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(contents, "A 2 2 10:first file\nA 3 2 6:second\nC 2\n");
+
+  // New entries do not reuse sequence numbers from before the restart
+  journal->append("third", {1});
+  reopen();
+  batch = journal->claim({1, 2}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].key, "second");
+  batch = journal->claim({1, 2}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].key, "third");
+  EXPECT_GT(batch[0].seq, 3u);
+}
+
+TEST_F(ReplicationJournalTest, TornRecordIsIgnored) {
+  journal->append("a", {1});
+  journal.reset();
+  {
+    std::ofstream log(log_path, std::ios::app);
+    log << "A 2 1 10:trunc";
+  }
+  reopen();
+  EXPECT_EQ(journal->pending(), 1u);
+  auto batch = journal->claim({1}, now);
+  ASSERT_EQ(batch.size(), 1u);
+  EXPECT_EQ(batch[0].key, "a");
+}
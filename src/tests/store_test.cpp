@@ -5,6 +5,7 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <iomanip>
 #include <set>
 
 using namespace dfs::store;
@@ -97,6 +98,11 @@ TEST_F(StoreTest, ErrorHandling) {
   store_and_verify("temp_key", "temp_data");
   ASSERT_NO_THROW(store->clear());
   expect_retrieval_fails("temp_key");
+
+  // Only stored keys can be synced to disk
+  store_and_verify("synced_key", "synced_data");
+  EXPECT_NO_THROW(store->sync("synced_key"));
+  EXPECT_THROW(store->sync("temp_key"), StoreError);
 }
 
 TEST_F(StoreTest, EdgeCases) {
@@ -161,4 +167,469 @@ TEST_F(StoreTest, ConcurrentAccess) {
   }
 
   EXPECT_EQ(successful_ops, num_threads * ops_per_thread);
-}
\ No newline at end of file
+}
+TEST_F(StoreTest, MerkleIndexTracksContent) {
+  auto root = [](const Store& s) { return s.merkle_nodes({MerkleTree::ROOT}).front(); };
+  EXPECT_EQ(root(*store), 0u);
+
+  store_and_verify("alpha", "first");
+  store_and_verify("beta", "second");
+  EXPECT_EQ(store->indexed_keys(), 2u);
+  EXPECT_EQ(store->content_digest("alpha"), "a7937b64b8caa58f03721bb6bacf5c78cb235febe0e70b1b84cd99541461a08e");
+  EXPECT_EQ(store->content_digest("missing"), "");
+  const uint64_t both = root(*store);
+
+  // Overwrites and removals only take out what they put in. Content that
+  // comes back does so at a later generation, which replicas have to learn
+  store_and_verify("alpha", "changed");
+  EXPECT_NE(root(*store), both);
+  store_and_verify("alpha", "first");
+  EXPECT_NE(root(*store), both);
+  const uint64_t restored = root(*store);
+  store_and_verify("gamma", "third");
+  ASSERT_NO_THROW(store->remove("gamma"));
+  EXPECT_EQ(root(*store), restored);
+  ASSERT_NO_THROW(store->remove("alpha"));
+  store_and_verify("alpha", "first");
+  EXPECT_EQ(root(*store), both);
+
+  // The same entries give the same tree whatever the order
+  std::string other_dir = test_dir + "_other";
+  {
+    Store other(other_dir);
+    auto beta = create_test_stream("second");
+    other.store("beta", *beta);
+    auto alpha = create_test_stream("first");
+    other.store("alpha", *alpha);
+    EXPECT_EQ(root(other), both);
+  }
+  std::filesystem::remove_all(other_dir);
+
+  // Every key sits in exactly one leaf
+  std::size_t listed = 0;
+  for (std::size_t leaf = 0; leaf < MerkleTree::LEAVES; ++leaf) {
+    for (const auto& entry : store->leaf_entries(leaf)) {
+      EXPECT_EQ(entry.digest, store->content_digest(entry.key));
+      ++listed;
+    }
+  }
+  EXPECT_EQ(listed, 2u);
+  EXPECT_THROW(store->leaf_entries(MerkleTree::LEAVES), StoreError);
+  EXPECT_THROW(store->merkle_nodes({0}), StoreError);
+}
+
+TEST_F(StoreTest, MerkleIndexSurvivesReopen) {
+  store_and_verify("kept", "kept data");
+  store_and_verify("removed", "removed data");
+  store_and_verify("vanished", "vanished data");
+  ASSERT_NO_THROW(store->remove("removed"));
+  const uint64_t root = store->merkle_nodes({MerkleTree::ROOT}).front();
+
+  // Reopening replays the log into the same tree
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->indexed_keys(), 2u);
+  EXPECT_EQ(store->merkle_nodes({MerkleTree::ROOT}).front(), root);
+
+  // Entries whose files disappeared behind the store's back are dropped
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  const std::string key = "vanished";
+  ASSERT_TRUE(EVP_Digest(key.data(), key.size(), digest, &length, EVP_sha256(), nullptr));
+  std::stringstream hash;
+  for (unsigned int i = 0; i < length; ++i) {
+    unsigned char byte = digest[i];
+    hash << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+  }
+  std::string h = hash.str();
+  ASSERT_TRUE(std::filesystem::remove(std::filesystem::path(test_dir) / h.substr(0, 2) / h.substr(2, 2) /
+                                      h.substr(4, 2) / h.substr(6)));
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->indexed_keys(), 1u);
+  EXPECT_FALSE(store->content_digest("kept").empty());
+  EXPECT_TRUE(store->content_digest("vanished").empty());
+
+  ASSERT_NO_THROW(store->clear());
+  EXPECT_EQ(store->indexed_keys(), 0u);
+  EXPECT_EQ(store->merkle_nodes({MerkleTree::ROOT}).front(), 0u);
+}
+
+TEST_F(StoreTest, DeletionsLeaveTombstones) {
+  auto root = [](const Store& s) { return s.merkle_nodes({MerkleTree::ROOT}).front(); };
+  store_and_verify("doomed", "deleted soon");
+  store_and_verify("kept", "kept data");
+  ASSERT_EQ(store->version("doomed").generation, 1u);
+  const uint64_t before = root(*store);
+
+  // The deletion is the key's next generation, listed with an empty digest
+  ASSERT_NO_THROW(store->delete_file("doomed"));
+  expect_retrieval_fails("doomed");
+  EXPECT_EQ(store->indexed_keys(), 1u);
+  EXPECT_TRUE(store->content_digest("doomed").empty());
+  EXPECT_TRUE(store->version("doomed").digest.empty());
+  EXPECT_NE(root(*store), before);
+  std::size_t tombstones = 0;
+  for (std::size_t leaf = 0; leaf < MerkleTree::LEAVES; ++leaf) {
+    for (const auto& entry : store->leaf_entries(leaf)) {
+      if (entry.key == "doomed") {
+        EXPECT_TRUE(entry.digest.empty());
+        EXPECT_EQ(entry.generation, 2u);
+        ++tombstones;
+      }
+    }
+  }
+  EXPECT_EQ(tombstones, 1u);
+
+  // Tombstones survive reopening, and storing the key again goes past them
+  const uint64_t deleted = root(*store);
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->indexed_keys(), 1u);
+  EXPECT_EQ(root(*store), deleted);
+  store_and_verify("doomed", "back again");
+  EXPECT_EQ(store->version("doomed").generation, 3u);
+
+  // A replica's deletion takes its generation, and so does matching content
+  ASSERT_NO_THROW(store->record_deletion("doomed", 7));
+  expect_retrieval_fails("doomed");
+  store_and_verify("doomed", "back again");
+  EXPECT_EQ(store->version("doomed").generation, 8u);
+  Store::ObjectVersion version = store->version("kept");
+  version.generation = 5;
+  store->raise_generation("kept", version);
+  EXPECT_EQ(store->version("kept").generation, 5u);
+  version.generation = 4;
+  store->raise_generation("kept", version);
+  version.digest = store->content_digest("doomed");
+  version.generation = 9;
+  store->raise_generation("kept", version);
+  EXPECT_EQ(store->version("kept").generation, 5u);
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->version("kept").generation, 5u);
+  EXPECT_EQ(store->version("doomed").generation, 8u);
+}
+
+TEST_F(StoreTest, MerkleIndexFilter) {
+  store = std::make_unique<Store>(test_dir, [](const std::string& key) { return key.rfind("local/", 0) != 0; });
+  store_and_verify("local/only", "not replicated");
+  EXPECT_EQ(store->indexed_keys(), 0u);
+  EXPECT_EQ(store->merkle_nodes({MerkleTree::ROOT}).front(), 0u);
+  store_and_verify("shared", "replicated");
+  EXPECT_EQ(store->indexed_keys(), 1u);
+}
+
+TEST_F(StoreTest, FindByDigest) {
+  store_and_verify("original", "same content");
+  const std::string digest = store->content_digest("original");
+  EXPECT_EQ(store->find_by_digest(digest), "original");
+  EXPECT_EQ(store->find_by_digest(std::string(64, '0')), "");
+
+  // Any holder of the content will do, and the last one gone clears the entry
+  store_and_verify("copy", "same content");
+  ASSERT_NO_THROW(store->remove("original"));
+  EXPECT_EQ(store->find_by_digest(digest), "copy");
+  store_and_verify("copy", "other content");
+  EXPECT_EQ(store->find_by_digest(digest), "");
+}
+
+TEST_F(StoreTest, ConcurrentWritersKeepIndexConsistent) {
+  // Writers of one key race, the index must describe whichever file won
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([this, i]() {
+      for (int j = 0; j < 100; ++j) {
+        std::stringstream input(std::string(1024 + i, static_cast<char>('a' + i)));
+        store->store("contested", input);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::stringstream stored;
+  store->get("contested", stored);
+  store_and_verify("reference", stored.str());
+  EXPECT_EQ(store->content_digest("contested"), store->content_digest("reference"));
+}
+
+TEST_F(StoreTest, StoreOutputChecksDigest) {
+  auto read = [this](const std::string& key) {
+    std::stringstream output;
+    store->get(key, output);
+    return output.str();
+  };
+  auto write = [](const std::string& content) {
+    return [content](std::ostream& output) {
+      output.write(content.data(), static_cast<std::streamsize>(content.size()));
+      output.put('!');
+    };
+  };
+  // Content written into the stream is stored like a stored stream
+  ASSERT_TRUE(store->store_output("produced", write("made here")));
+  EXPECT_EQ(read("produced"), "made here!");
+  EXPECT_EQ(store->version("produced").generation, 1u);
+  const std::string digest = store->content_digest("produced");
+  store_and_verify("streamed", "made here!");
+  EXPECT_EQ(store->content_digest("streamed"), digest);
+
+  // Only content with the expected digest replaces the stored version
+  EXPECT_FALSE(store->store_output("produced", write("made elsewhere"), digest));
+  EXPECT_EQ(read("produced"), "made here!");
+  EXPECT_EQ(store->version("produced").generation, 1u);
+  ASSERT_TRUE(store->store_output("produced", write("made here"), digest));
+  EXPECT_EQ(store->version("produced").generation, 1u);
+
+  // A failing writer leaves the key as it was and no temporary file behind
+  EXPECT_THROW(store->store_output("produced", [](std::ostream& output) {
+    output << "partial";
+    throw std::invalid_argument("writer failed");
+  }), std::invalid_argument);
+  EXPECT_EQ(read("produced"), "made here!");
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(test_dir)) {
+    EXPECT_EQ(entry.path().string().find(".tmp"), std::string::npos) << entry.path();
+  }
+}
+
+TEST_F(StoreTest, VersionsCountContentChanges) {
+  EXPECT_EQ(store->version("versioned").generation, 0u);
+  EXPECT_TRUE(store->version("versioned").digest.empty());
+
+  store_and_verify("versioned", "first");
+  Store::ObjectVersion first = store->version("versioned");
+  EXPECT_EQ(first.generation, 1u);
+  EXPECT_EQ(first.digest, store->content_digest("versioned"));
+
+  // Writing the same content again is not a new version
+  store_and_verify("versioned", "first");
+  EXPECT_EQ(store->version("versioned").generation, 1u);
+  store_and_verify("versioned", "second");
+  store_and_verify("versioned", "first");
+  Store::ObjectVersion third = store->version("versioned");
+  EXPECT_EQ(third.generation, 3u);
+  EXPECT_EQ(third.digest, first.digest);
+
+  // Generations are logged with the index and survive its compaction
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->version("versioned").generation, 3u);
+  store_and_verify("versioned", "fourth");
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->version("versioned").generation, 4u);
+
+  ASSERT_NO_THROW(store->remove("versioned"));
+  EXPECT_EQ(store->version("versioned").generation, 0u);
+}
+
+TEST_F(StoreTest, SnapshotsSeeContentAtCreation) {
+  auto read_snapshot = [&](const std::string& snapshot, const std::string& key) {
+    std::stringstream output;
+    output << store->get_snapshot_stream(snapshot, key)->rdbuf();
+    return output.str();
+  };
+  store_and_verify("kept", "kept v1");
+  store_and_verify("changed", "changed v1");
+  store_and_verify("removed", "removed v1");
+
+  store->create_snapshot("first");
+  store_and_verify("changed", "changed v2");
+  store->remove("removed");
+  store_and_verify("added", "added v1");
+
+  store->create_snapshot("second");
+  store_and_verify("changed", "changed v3");
+
+  // Each snapshot reads its own point in time, the live store the newest
+  EXPECT_EQ(read_snapshot("first", "kept"), "kept v1");
+  EXPECT_EQ(read_snapshot("first", "changed"), "changed v1");
+  EXPECT_EQ(read_snapshot("first", "removed"), "removed v1");
+  EXPECT_FALSE(store->has_in_snapshot("first", "added"));
+  EXPECT_EQ(read_snapshot("second", "changed"), "changed v2");
+  EXPECT_EQ(read_snapshot("second", "added"), "added v1");
+  EXPECT_FALSE(store->has_in_snapshot("second", "removed"));
+  EXPECT_THROW(store->get_snapshot_stream("second", "removed"), StoreError);
+  std::stringstream current;
+  store->get("changed", current);
+  EXPECT_EQ(current.str(), "changed v3");
+
+  // Only replaced versions a snapshot sees are kept: changed v1, v2 and removed v1
+  EXPECT_EQ(store->preserved_versions(), 3u);
+  ASSERT_EQ(store->list_snapshots().size(), 2u);
+  EXPECT_EQ(store->list_snapshots()[0].name, "first");
+  EXPECT_THROW(store->create_snapshot("first"), StoreError);
+  EXPECT_THROW(store->create_snapshot("../escape"), StoreError);
+  EXPECT_THROW(store->has_in_snapshot("missing", "kept"), StoreError);
+
+  // The export is a store directory holding the snapshot's objects
+  std::filesystem::path exported = std::filesystem::path(test_dir) / "export";
+  EXPECT_EQ(store->export_snapshot("first", exported), 3u);
+  {
+    Store backup(exported.string());
+    std::stringstream output;
+    backup.get("changed", output);
+    EXPECT_EQ(output.str(), "changed v1");
+    EXPECT_FALSE(backup.has("added"));
+  }
+  std::filesystem::remove_all(exported);
+
+  // Deleting the first snapshot reclaims the versions only it saw
+  store->delete_snapshot("first");
+  for (int i = 0; i < 50 && store->preserved_versions() != 1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_EQ(store->preserved_versions(), 1u);
+  EXPECT_EQ(read_snapshot("second", "changed"), "changed v2");
+  EXPECT_THROW(store->delete_snapshot("first"), StoreError);
+}
+
+TEST_F(StoreTest, SnapshotsSurviveReopen) {
+  store_and_verify("key", "v1");
+  store->create_snapshot("before");
+  store->delete_snapshot("before");
+  store->create_snapshot("backup");
+  store_and_verify("key", "v2");
+  store_and_verify("new", "v1");
+
+  store = std::make_unique<Store>(test_dir);
+  auto snapshots = store->list_snapshots();
+  ASSERT_EQ(snapshots.size(), 1u);
+  EXPECT_EQ(snapshots[0].name, "backup");
+  EXPECT_EQ(snapshots[0].id, 2u);
+  std::stringstream output;
+  output << store->get_snapshot_stream("backup", "key")->rdbuf();
+  EXPECT_EQ(output.str(), "v1");
+  EXPECT_FALSE(store->has_in_snapshot("backup", "new"));
+
+  // Ids keep counting up across restarts
+  store->create_snapshot("later");
+  EXPECT_EQ(store->list_snapshots().back().id, 3u);
+  EXPECT_TRUE(store->has_in_snapshot("later", "new"));
+}
+
+TEST_F(StoreTest, TieringMovesObjectsByAccess) {
+  std::filesystem::path capacity = test_dir + "_capacity";
+  Store::TierConfig config;
+  config.capacity_path = capacity;
+  config.fast_tier_bytes = 10000;
+  config.interval = std::chrono::milliseconds(0);
+  store->set_tiering(config);
+
+  auto content = [](int i) { return std::string(2000, static_cast<char>('a' + i)); };
+  for (int i = 0; i < 10; ++i) {
+    store_and_verify("key" + std::to_string(i), content(i));
+  }
+  // store_and_verify read every key once, key0 and key1 are read more
+  for (int i = 0; i < 3; ++i) {
+    std::stringstream output;
+    store->get("key0", output);
+    store->get_stream("key1");
+  }
+
+  // The fast tier is emptied to its low watermark, the hot keys stay
+  auto pass = store->run_tier_migration();
+  EXPECT_EQ(pass.demoted, 6u);
+  EXPECT_EQ(pass.promoted, 0u);
+  EXPECT_EQ(pass.fast_bytes, 8000u);
+  EXPECT_EQ(pass.capacity_bytes, 12000u);
+  EXPECT_EQ(store->tier_of("key0"), Store::Tier::Fast);
+  EXPECT_EQ(store->tier_of("key1"), Store::Tier::Fast);
+  EXPECT_EQ(store->tier_of("missing"), Store::Tier::None);
+
+  std::string demoted;
+  for (int i = 2; i < 10; ++i) {
+    if (store->tier_of("key" + std::to_string(i)) == Store::Tier::Capacity) {
+      demoted = "key" + std::to_string(i);
+    }
+  }
+  ASSERT_FALSE(demoted.empty());
+
+  // A demoted key read often again comes back, pushing out a cold one
+  for (int i = 0; i < 3; ++i) {
+    store->get_stream(demoted);
+  }
+  pass = store->run_tier_migration();
+  EXPECT_EQ(pass.promoted, 1u);
+  EXPECT_EQ(pass.demoted, 1u);
+  EXPECT_EQ(store->tier_of(demoted), Store::Tier::Fast);
+  EXPECT_EQ(store->run_tier_migration().promoted, 0u);
+
+  // Rewriting a key puts it on the fast tier, without a stale capacity copy
+  std::string cold;
+  for (int i = 2; i < 10 && cold.empty(); ++i) {
+    if (store->tier_of("key" + std::to_string(i)) == Store::Tier::Capacity) {
+      cold = "key" + std::to_string(i);
+    }
+  }
+  ASSERT_FALSE(cold.empty());
+  store_and_verify(cold, "rewritten");
+  EXPECT_EQ(store->tier_of(cold), Store::Tier::Fast);
+  EXPECT_EQ(store->run_tier_migration().capacity_bytes, 10000u);
+
+  // Reads do not care where an object is
+  for (int i = 0; i < 10; ++i) {
+    std::string key = "key" + std::to_string(i);
+    std::string expected = key == cold ? "rewritten" : content(i);
+    std::stringstream output;
+    store->get(key, output);
+    EXPECT_EQ(output.str(), expected);
+    EXPECT_EQ(store->get_file_size(key), expected.size());
+  }
+
+  // The capacity tier is remembered, so a restart finds its objects at once
+  store = std::make_unique<Store>(test_dir);
+  EXPECT_EQ(store->indexed_keys(), 10u);
+  std::string remaining;
+  for (int i = 0; i < 10; ++i) {
+    std::string key = "key" + std::to_string(i);
+    EXPECT_TRUE(store->has(key));
+    if (store->tier_of(key) == Store::Tier::Capacity) {
+      remaining = key;
+    }
+  }
+  ASSERT_FALSE(remaining.empty());
+  store->delete_file(remaining);
+  expect_retrieval_fails(remaining);
+
+  store->clear();
+  EXPECT_TRUE(std::filesystem::is_empty(capacity));
+  store.reset();
+  std::filesystem::remove_all(capacity);
+}
+
+TEST_F(StoreTest, SnapshotsSpanTiers) {
+  std::filesystem::path capacity = test_dir + "_capacity";
+  Store::TierConfig config;
+  config.capacity_path = capacity;
+  // Everything is demoted
+  config.fast_tier_bytes = 1;
+  config.interval = std::chrono::milliseconds(0);
+  store->set_tiering(config);
+  EXPECT_THROW(store->set_tiering(Store::TierConfig{test_dir, 1}), StoreError);
+
+  store_and_verify("key", "v1");
+  store_and_verify("other", "other v1");
+  store->create_snapshot("backup");
+  EXPECT_EQ(store->run_tier_migration().demoted, 2u);
+  ASSERT_EQ(store->tier_of("key"), Store::Tier::Capacity);
+
+  // The old version is kept on the capacity tier, the new one is written fast
+  store_and_verify("key", "v2");
+  EXPECT_EQ(store->tier_of("key"), Store::Tier::Fast);
+  store->remove("other");
+  EXPECT_EQ(store->preserved_versions(), 2u);
+  std::stringstream output;
+  output << store->get_snapshot_stream("backup", "key")->rdbuf();
+  EXPECT_EQ(output.str(), "v1");
+  EXPECT_TRUE(store->has_in_snapshot("backup", "other"));
+
+  std::filesystem::path exported = std::filesystem::path(test_dir) / "export";
+  EXPECT_EQ(store->export_snapshot("backup", exported), 2u);
+  std::filesystem::remove_all(exported);
+
+  store->delete_snapshot("backup");
+  for (int i = 0; i < 50 && store->preserved_versions() != 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  EXPECT_EQ(store->preserved_versions(), 0u);
+
+  store->clear();
+  store.reset();
+  std::filesystem::remove_all(capacity);
+}
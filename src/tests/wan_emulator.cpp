@@ -0,0 +1,311 @@
+#include "wan_emulator.hpp"
+#include "logger/logger.hpp"
+#include <algorithm>
+
+namespace dfs {
+namespace test {
+
+//==============================================
+// CONSTRUCTOR AND DESTRUCTOR
+//==============================================
+
+WanEmulator::WanEmulator(const std::string& listen_address, uint16_t listen_port,
+                         const std::string& upstream_address, uint16_t upstream_port,
+                         LinkProfile profile)
+  : listen_address_(listen_address)
+  , listen_port_(listen_port)
+  , upstream_address_(upstream_address)
+  , upstream_port_(upstream_port)
+  , profile_(profile) {
+  DFS_LOG(info) << "WAN emulator: Proxying " << listen_address_ << ":" << listen_port_
+                          << " -> " << upstream_address_ << ":" << upstream_port_;
+}
+
+WanEmulator::~WanEmulator() {
+  stop();
+}
+
+
+//==============================================
+// INITIALIZATION AND TEARDOWN
+//==============================================
+
+bool WanEmulator::start() {
+  if (running_) {
+    return false;
+  }
+
+  try {
+    boost::asio::ip::tcp::endpoint endpoint(
+      boost::asio::ip::make_address(listen_address_), listen_port_);
+    acceptor_ = std::make_unique<boost::asio::ip::tcp::acceptor>(io_context_);
+    acceptor_->open(endpoint.protocol());
+    acceptor_->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    acceptor_->bind(endpoint);
+    acceptor_->listen();
+    // Non-blocking accept lets stop() end the loop without racing a blocked accept()
+    acceptor_->non_blocking(true);
+    listen_port_ = acceptor_->local_endpoint().port();
+  } catch (const std::exception& e) {
+    DFS_LOG(error) << "WAN emulator: Failed to listen on port " << listen_port_ << ": " << e.what();
+    return false;
+  }
+
+  running_ = true;
+  accept_thread_ = std::make_unique<std::thread>(&WanEmulator::accept_loop, this);
+  return true;
+}
+
+void WanEmulator::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+
+  if (accept_thread_ && accept_thread_->joinable()) {
+    accept_thread_->join();
+  }
+
+  boost::system::error_code ec;
+  if (acceptor_) {
+    acceptor_->close(ec);
+  }
+
+  sever_connections();
+  DFS_LOG(info) << "WAN emulator: Stopped after forwarding " << bytes_forwarded_ << " bytes";
+}
+
+
+//==============================================
+// LINK CONTROL
+//==============================================
+
+void WanEmulator::set_profile(const LinkProfile& profile) {
+  std::lock_guard<std::mutex> lock(profile_mutex_);
+  profile_ = profile;
+}
+
+void WanEmulator::set_blackout(bool blackout) {
+  blackout_ = blackout;
+  DFS_LOG(info) << "WAN emulator: Blackout " << (blackout ? "started" : "lifted");
+
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  for (auto& connection : connections_) {
+    connection->to_upstream.cv.notify_all();
+    connection->to_client.cv.notify_all();
+  }
+}
+
+void WanEmulator::sever_connections() {
+  std::list<std::unique_ptr<Connection>> severed;
+  {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    severed.swap(connections_);
+  }
+
+  for (auto& connection : severed) {
+    close_connection(*connection);
+    for (auto& thread : connection->threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+}
+
+std::size_t WanEmulator::connection_count() const {
+  std::lock_guard<std::mutex> lock(connections_mutex_);
+  return connections_.size();
+}
+
+
+//==============================================
+// CONNECTION HANDLING
+//==============================================
+
+void WanEmulator::accept_loop() {
+  while (running_) {
+    auto client = std::make_shared<boost::asio::ip::tcp::socket>(io_context_);
+    boost::system::error_code ec;
+    acceptor_->accept(*client, ec);
+
+    if (ec == boost::asio::error::would_block || ec == boost::asio::error::try_again) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    if (ec) {
+      DFS_LOG(error) << "WAN emulator: Accept error: " << ec.message();
+      continue;
+    }
+
+    // Accepted sockets inherit non-blocking mode from the acceptor
+    client->non_blocking(false, ec);
+    client->set_option(boost::asio::ip::tcp::no_delay(true), ec);
+
+    auto upstream = std::make_shared<boost::asio::ip::tcp::socket>(io_context_);
+    try {
+      boost::asio::ip::tcp::endpoint endpoint(
+        boost::asio::ip::make_address(upstream_address_), upstream_port_);
+      upstream->connect(endpoint);
+      upstream->set_option(boost::asio::ip::tcp::no_delay(true));
+    } catch (const std::exception& e) {
+      DFS_LOG(error) << "WAN emulator: Failed to reach upstream: " << e.what();
+      client->close(ec);
+      continue;
+    }
+
+    auto connection = std::make_unique<Connection>();
+    connection->client = client;
+    connection->upstream = upstream;
+
+    Connection& c = *connection;
+    c.threads.emplace_back(&WanEmulator::reader_loop, this, std::ref(*c.client), std::ref(c.to_upstream));
+    c.threads.emplace_back(&WanEmulator::writer_loop, this, std::ref(*c.upstream), std::ref(c.to_upstream));
+    c.threads.emplace_back(&WanEmulator::reader_loop, this, std::ref(*c.upstream), std::ref(c.to_client));
+    c.threads.emplace_back(&WanEmulator::writer_loop, this, std::ref(*c.client), std::ref(c.to_client));
+
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    connections_.push_back(std::move(connection));
+    DFS_LOG(info) << "WAN emulator: Proxied connection established";
+  }
+}
+
+void WanEmulator::reader_loop(boost::asio::ip::tcp::socket& source, Direction& direction) {
+  std::size_t segment_size;
+  {
+    std::lock_guard<std::mutex> lock(profile_mutex_);
+    segment_size = std::max<std::size_t>(profile_.segment_size, 1);
+  }
+  std::vector<char> buffer(segment_size);
+
+  while (true) {
+    boost::system::error_code ec;
+    std::size_t bytes_read = source.read_some(boost::asio::buffer(buffer), ec);
+
+    std::unique_lock<std::mutex> lock(direction.mutex);
+    if (ec || bytes_read == 0) {
+      direction.source_closed = true;
+      direction.cv.notify_all();
+      return;
+    }
+
+    // Apply backpressure once the link has buffered too much
+    direction.cv.wait(lock, [&] {
+      return direction.aborted || direction.queued_bytes < MAX_QUEUED_BYTES;
+    });
+    if (direction.aborted) {
+      return;
+    }
+
+    Segment segment;
+    segment.data.assign(buffer.begin(), buffer.begin() + bytes_read);
+    segment.deliver_at = schedule(direction, bytes_read);
+    direction.queued_bytes += bytes_read;
+    direction.queue.push_back(std::move(segment));
+    direction.cv.notify_all();
+  }
+}
+
+void WanEmulator::writer_loop(boost::asio::ip::tcp::socket& destination, Direction& direction) {
+  while (true) {
+    std::unique_lock<std::mutex> lock(direction.mutex);
+    direction.cv.wait(lock, [&] {
+      return direction.aborted || direction.source_closed || !direction.queue.empty();
+    });
+
+    if (direction.aborted) {
+      return;
+    }
+
+    if (direction.queue.empty()) {
+      // Source finished and everything was delivered, propagate the half close
+      boost::system::error_code ec;
+      destination.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+      return;
+    }
+
+    // Segments leave in order, so a late segment holds back everything behind it
+    auto deliver_at = std::max(direction.queue.front().deliver_at, direction.last_delivery);
+    if (direction.cv.wait_until(lock, deliver_at, [&] { return direction.aborted; })) {
+      return;
+    }
+    if (blackout_) {
+      direction.cv.wait_for(lock, std::chrono::milliseconds(10));
+      continue;
+    }
+
+    Segment segment = std::move(direction.queue.front());
+    direction.queue.pop_front();
+    direction.queued_bytes -= segment.data.size();
+    direction.last_delivery = deliver_at;
+    direction.cv.notify_all();
+    lock.unlock();
+
+    boost::system::error_code ec;
+    boost::asio::write(destination, boost::asio::buffer(segment.data), ec);
+    if (ec) {
+      DFS_LOG(debug) << "WAN emulator: Write error: " << ec.message();
+      std::lock_guard<std::mutex> relock(direction.mutex);
+      direction.aborted = true;
+      direction.cv.notify_all();
+      return;
+    }
+    bytes_forwarded_ += segment.data.size();
+  }
+}
+
+std::chrono::steady_clock::time_point WanEmulator::schedule(Direction& direction, std::size_t size) {
+  LinkProfile profile;
+  {
+    std::lock_guard<std::mutex> lock(profile_mutex_);
+    profile = profile_;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  auto departure = now;
+
+  // Serialize segments onto the link at the configured bandwidth
+  if (profile.bandwidth_bytes_per_sec > 0) {
+    auto start = std::max(now, direction.link_free_at);
+    auto transmit = std::chrono::microseconds(size * 1000000 / profile.bandwidth_bytes_per_sec);
+    direction.link_free_at = start + transmit;
+    departure = direction.link_free_at;
+  }
+
+  auto one_way = profile.rtt / 2;
+  bool reordered = false;
+  {
+    std::lock_guard<std::mutex> lock(rng_mutex_);
+    if (profile.jitter.count() > 0) {
+      std::uniform_int_distribution<int64_t> jitter(-profile.jitter.count(), profile.jitter.count());
+      one_way += std::chrono::microseconds(jitter(rng_));
+    }
+    if (profile.reorder_probability > 0.0) {
+      std::bernoulli_distribution reorder(profile.reorder_probability);
+      reordered = reorder(rng_);
+    }
+  }
+
+  if (reordered) {
+    one_way += profile.reorder_delay;
+  }
+  if (one_way.count() < 0) {
+    one_way = std::chrono::microseconds(0);
+  }
+
+  return departure + one_way;
+}
+
+void WanEmulator::close_connection(Connection& connection) {
+  boost::system::error_code ec;
+  connection.client->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+  connection.upstream->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+
+  for (Direction* direction : {&connection.to_upstream, &connection.to_client}) {
+    std::lock_guard<std::mutex> lock(direction->mutex);
+    direction->aborted = true;
+    direction->cv.notify_all();
+  }
+}
+
+} // namespace test
+} // namespace dfs
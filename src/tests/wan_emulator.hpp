@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace dfs {
+namespace test {
+
+// Link characteristics applied independently to each direction of a proxied connection
+struct LinkProfile {
+  // Round trip time, half of which is added to every segment in each direction
+  std::chrono::microseconds rtt{0};
+  // Maximum uniform deviation added to or subtracted from the one-way delay
+  std::chrono::microseconds jitter{0};
+  // Bandwidth cap in bytes per second, 0 disables the cap
+  std::size_t bandwidth_bytes_per_sec{0};
+  // Probability that a segment is held back behind later traffic
+  double reorder_probability{0.0};
+  // Extra delay applied to a reordered segment
+  std::chrono::microseconds reorder_delay{0};
+  // Maximum segment size read from the source socket per forwarding step
+  std::size_t segment_size{16 * 1024};
+};
+
+// Local TCP proxy placed between two Bootstrap nodes which delays, throttles and
+// reorders forwarded segments according to a LinkProfile. TCP hands bytes to the
+// application in order, so a reordered segment shows up as head-of-line blocking
+// of everything sent after it, which is what a real reordering WAN path produces.
+class WanEmulator {
+public:
+  // ---- CONSTRUCTOR AND DESTRUCTOR ----
+  WanEmulator(const std::string& listen_address, uint16_t listen_port,
+              const std::string& upstream_address, uint16_t upstream_port,
+              LinkProfile profile = {});
+  ~WanEmulator();
+
+  WanEmulator(const WanEmulator&) = delete;
+  WanEmulator& operator=(const WanEmulator&) = delete;
+
+
+  // ---- INITIALIZATION AND TEARDOWN ----
+  // Binds the listening socket and starts accepting connections
+  bool start();
+  // Closes the listener and all proxied connections
+  void stop();
+
+
+  // ---- LINK CONTROL ----
+  // Replaces the link profile, applies to segments read after the call
+  void set_profile(const LinkProfile& profile);
+  // Holds all traffic in both directions without closing sockets (network partition)
+  void set_blackout(bool blackout);
+  // Hard closes every proxied connection, the listener keeps accepting
+  void sever_connections();
+
+
+  // ---- QUERY METHODS ----
+  uint16_t listen_port() const { return listen_port_; }
+  std::size_t bytes_forwarded() const { return bytes_forwarded_; }
+  std::size_t connection_count() const;
+
+private:
+  // Segment waiting in a direction's queue until its delivery time
+  struct Segment {
+    std::vector<char> data;
+    std::chrono::steady_clock::time_point deliver_at;
+  };
+
+  // One direction of a proxied connection
+  struct Direction {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Segment> queue;
+    std::size_t queued_bytes{0};
+    bool source_closed{false};
+    bool aborted{false};
+    std::chrono::steady_clock::time_point link_free_at{};
+    std::chrono::steady_clock::time_point last_delivery{};
+  };
+
+  // Client socket, upstream socket and the four forwarding threads between them
+  struct Connection {
+    std::shared_ptr<boost::asio::ip::tcp::socket> client;
+    std::shared_ptr<boost::asio::ip::tcp::socket> upstream;
+    Direction to_upstream;
+    Direction to_client;
+    std::vector<std::thread> threads;
+  };
+
+  // ---- PARAMETERS ----
+  const std::string listen_address_;
+  uint16_t listen_port_;
+  const std::string upstream_address_;
+  const uint16_t upstream_port_;
+
+  LinkProfile profile_;
+  mutable std::mutex profile_mutex_;
+  std::atomic<bool> blackout_{false};
+  std::atomic<bool> running_{false};
+  std::atomic<std::size_t> bytes_forwarded_{0};
+
+  boost::asio::io_context io_context_;
+  std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+  std::unique_ptr<std::thread> accept_thread_;
+
+  std::list<std::unique_ptr<Connection>> connections_;
+  mutable std::mutex connections_mutex_;
+
+  std::mt19937 rng_{std::random_device{}()};
+  std::mutex rng_mutex_;
+
+  // Upper bound on bytes buffered per direction before the reader stops pulling
+  static constexpr std::size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+
+  // ---- CONNECTION HANDLING ----
+  // Accepts clients and dials the upstream for each of them
+  void accept_loop();
+  // Reads segments from source and schedules them on the direction's queue
+  void reader_loop(boost::asio::ip::tcp::socket& source, Direction& direction);
+  // Delivers queued segments to destination once their delivery time has passed
+  void writer_loop(boost::asio::ip::tcp::socket& destination, Direction& direction);
+  // Computes delivery time of a segment according to the current profile
+  std::chrono::steady_clock::time_point schedule(Direction& direction, std::size_t size);
+  // Closes both sockets and wakes all forwarding threads of a connection
+  void close_connection(Connection& connection);
+};
+
+} // namespace test
+} // namespace dfs
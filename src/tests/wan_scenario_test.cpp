@@ -0,0 +1,236 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include "network/bootstrap.hpp"
+#include "wan_emulator.hpp"
+
+using namespace dfs::network;
+using dfs::test::LinkProfile;
+using dfs::test::WanEmulator;
+
+class WanScenarioTest : public ::testing::Test {
+protected:
+  const std::string ADDRESS = "127.0.0.1";
+  const std::vector<uint8_t> TEST_KEY = std::vector<uint8_t>(32, 0x42);
+  // Ports are kept apart from the bootstrap tests so both suites can share a host
+  const uint16_t ORIGIN_PORT = 3101;
+  const uint16_t REPLICA_PORT = 3102;
+  const uint16_t PROXY_PORT = 3111;
+
+  std::unique_ptr<Bootstrap> origin;
+  std::unique_ptr<Bootstrap> replica;
+  std::unique_ptr<WanEmulator> link;
+
+  void TearDown() override {
+    for (auto* node : {origin.get(), replica.get()}) {
+      if (node) {
+        node->get_file_server().get_store().clear();
+      }
+    }
+    link.reset();
+    replica.reset();
+    origin.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  // Starts the origin node behind the emulated link
+  void start_origin(const LinkProfile& profile) {
+    origin = std::make_unique<Bootstrap>(ADDRESS, ORIGIN_PORT, TEST_KEY, 1, std::vector<std::string>{});
+    ASSERT_TRUE(origin->start());
+    link = std::make_unique<WanEmulator>(ADDRESS, PROXY_PORT, ADDRESS, ORIGIN_PORT, profile);
+    ASSERT_TRUE(link->start());
+  }
+
+  // Starts the replica node, which reaches the origin only through the emulated link
+  void start_replica() {
+    replica = std::make_unique<Bootstrap>(ADDRESS, REPLICA_PORT, TEST_KEY, 2,
+      std::vector<std::string>{ADDRESS + ":" + std::to_string(PROXY_PORT)});
+    ASSERT_TRUE(replica->start());
+    ASSERT_TRUE(wait_until([&] { return origin->get_peer_manager().has_peer(2); },
+                           std::chrono::seconds(5)));
+  }
+
+  template <typename Predicate>
+  bool wait_until(Predicate predicate, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+      if (predicate()) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return predicate();
+  }
+
+  // True once the replica holds the complete file
+  bool replica_has(const std::string& filename, std::size_t size) {
+    auto& store = replica->get_file_server().get_store();
+    try {
+      return store.has(filename) && store.get_file_size(filename) == size;
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+
+  static std::string make_payload(std::size_t size) {
+    std::string payload(size, '\0');
+    for (std::size_t i = 0; i < size; ++i) {
+      payload[i] = static_cast<char>('a' + (i * 7) % 26);
+    }
+    return payload;
+  }
+
+  static double percentile(std::vector<double> samples, double p) {
+    std::sort(samples.begin(), samples.end());
+    std::size_t rank = static_cast<std::size_t>(p / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+  }
+
+  void report(const std::string& key, double value) {
+    RecordProperty(key, std::to_string(value));
+    std::cout << "[ WAN      ] " << std::left << std::setw(28) << key << value << std::endl;
+  }
+};
+
+TEST_F(WanScenarioTest, ReplicationThroughput) {
+  LinkProfile profile;
+  profile.rtt = std::chrono::milliseconds(40);
+  profile.jitter = std::chrono::milliseconds(5);
+  profile.bandwidth_bytes_per_sec = 4 * 1024 * 1024;
+  profile.reorder_probability = 0.01;
+  profile.reorder_delay = std::chrono::milliseconds(20);
+
+  start_origin(profile);
+  start_replica();
+
+  const std::size_t size = 2 * 1024 * 1024;
+  std::stringstream content(make_payload(size));
+
+  auto start = std::chrono::steady_clock::now();
+  origin->get_file_server().store_file("wan_throughput.bin", content);
+  ASSERT_TRUE(wait_until([&] { return replica_has("wan_throughput.bin", size); },
+                         std::chrono::seconds(30)));
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // The cap must actually have been enforced for the measurement to mean anything
+  EXPECT_GE(seconds, 0.9 * size / profile.bandwidth_bytes_per_sec);
+  report("replication_seconds", seconds);
+  report("replication_mb_per_sec", size / seconds / (1024.0 * 1024.0));
+}
+
+TEST_F(WanScenarioTest, GetLatencyPercentiles) {
+  LinkProfile profile;
+  profile.rtt = std::chrono::milliseconds(50);
+  profile.jitter = std::chrono::milliseconds(10);
+  profile.bandwidth_bytes_per_sec = 8 * 1024 * 1024;
+
+  // Files are stored before the replica joins so every GET has to cross the link
+  start_origin(profile);
+  const int requests = 20;
+  for (int i = 0; i < requests; ++i) {
+    std::stringstream content(make_payload(4096));
+    origin->get_file_server().store_file("wan_get_" + std::to_string(i), content);
+  }
+  start_replica();
+
+  std::vector<double> latencies_ms;
+  for (int i = 0; i < requests; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(replica->get_file_server().get_file("wan_get_" + std::to_string(i)));
+    latencies_ms.push_back(std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count());
+  }
+
+  // A remote GET needs at least one round trip across the link
+  EXPECT_GE(percentile(latencies_ms, 50), 0.8 * profile.rtt.count() / 1000.0);
+  report("get_p50_ms", percentile(latencies_ms, 50));
+  report("get_p90_ms", percentile(latencies_ms, 90));
+  report("get_p99_ms", percentile(latencies_ms, 99));
+}
+
+TEST_F(WanScenarioTest, PartitionRecovery) {
+  LinkProfile profile;
+  profile.rtt = std::chrono::milliseconds(30);
+  profile.jitter = std::chrono::milliseconds(5);
+
+  start_origin(profile);
+  start_replica();
+
+  const std::size_t size = 64 * 1024;
+  std::stringstream content(make_payload(size));
+
+  // Replicate while the link is partitioned, nothing may arrive until it heals
+  link->set_blackout(true);
+  origin->get_file_server().store_file("wan_partition.bin", content);
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  EXPECT_FALSE(replica_has("wan_partition.bin", size));
+
+  auto healed = std::chrono::steady_clock::now();
+  link->set_blackout(false);
+  ASSERT_TRUE(wait_until([&] { return replica_has("wan_partition.bin", size); },
+                         std::chrono::seconds(10)));
+  double recovery_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - healed).count();
+
+  // The partition must not have cost the nodes their connection
+  EXPECT_EQ(link->connection_count(), 1u);
+  EXPECT_TRUE(replica->get_peer_manager().has_peer(1));
+  report("partition_recovery_ms", recovery_ms);
+}
+
+TEST_F(WanScenarioTest, ReconnectAfterSeveredReplication) {
+  LinkProfile profile;
+  profile.rtt = std::chrono::milliseconds(30);
+  profile.jitter = std::chrono::milliseconds(5);
+  profile.bandwidth_bytes_per_sec = 1024 * 1024;
+
+  start_origin(profile);
+  start_replica();
+
+  const std::size_t size = 2 * 1024 * 1024;
+  std::stringstream content(make_payload(size));
+
+  // Cut the link once part of the file has crossed it
+  std::size_t forwarded_before = link->bytes_forwarded();
+  auto stored = std::chrono::steady_clock::now();
+  origin->get_file_server().store_file("wan_severed.bin", content);
+  ASSERT_TRUE(wait_until([&] { return link->bytes_forwarded() >= forwarded_before + size / 4; },
+                         std::chrono::seconds(10)));
+  auto severed = std::chrono::steady_clock::now();
+  link->sever_connections();
+  EXPECT_FALSE(replica_has("wan_severed.bin", size));
+
+  // Both nodes must notice the loss before the old peers make way for new connections
+  ASSERT_TRUE(wait_until([&] {
+    return !origin->get_peer_manager().is_connected(2) && !replica->get_peer_manager().is_connected(1);
+  }, std::chrono::seconds(10)));
+  double detect_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - severed).count();
+
+  // Bootstrap does not redial on its own, the replica dials its bootstrap node again
+  auto dialed = std::chrono::steady_clock::now();
+  ASSERT_TRUE(replica->connect_to_bootstrap_nodes());
+  ASSERT_TRUE(wait_until([&] {
+    return link->connection_count() == 1 && origin->get_peer_manager().is_connected(2) &&
+           replica->get_peer_manager().is_connected(1);
+  }, std::chrono::seconds(10)));
+  double reconnect_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - dialed).count();
+
+  // The origin's journal sends the whole file again over the new connection
+  ASSERT_TRUE(wait_until([&] { return replica_has("wan_severed.bin", size); },
+                         std::chrono::seconds(40)));
+  auto finished = std::chrono::steady_clock::now();
+  double resume_seconds = std::chrono::duration<double>(finished - severed).count();
+
+  std::stringstream replicated;
+  replica->get_file_server().get_store().get("wan_severed.bin", replicated);
+  EXPECT_EQ(replicated.str(), make_payload(size));
+  report("sever_detect_ms", detect_ms);
+  report("sever_reconnect_ms", reconnect_ms);
+  report("sever_resume_seconds", resume_seconds);
+  report("sever_total_seconds", std::chrono::duration<double>(finished - stored).count());
+}
@@ -0,0 +1,257 @@
+#include "tracing/tracer.hpp"
+#include "logger/logger.hpp"
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+namespace dfs {
+namespace tracing {
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace {
+
+// Output file state, guarded by one mutex since spans end on many threads
+struct TraceFile {
+  std::mutex mutex;
+  std::ofstream output;
+  bool first_event{true};
+  std::uint64_t recorded{0};
+  // Added to steady clock readings to get wall clock time
+  std::chrono::system_clock::duration wall_offset{};
+};
+
+TraceFile& trace_file() {
+  static TraceFile file;
+  return file;
+}
+
+std::atomic<unsigned> sample_every{1};
+std::atomic<std::uint64_t> roots_seen{0};
+
+thread_local TraceContext current_context;
+
+void append_escaped(std::string& out, const std::string& text) {
+  for (char c : text) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char code[8];
+          std::snprintf(code, sizeof(code), "\\u%04x", c);
+          out += code;
+        } else {
+          out += c;
+        }
+    }
+  }
+}
+
+std::string hex_id(std::uint64_t id) {
+  char text[17];
+  std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(id));
+  return text;
+}
+
+} // namespace
+
+
+//==============================================
+// INITIALIZATION AND TEARDOWN
+//==============================================
+
+bool Tracer::start(const std::string& path, unsigned every) {
+  shutdown();
+
+  TraceFile& file = trace_file();
+  std::lock_guard<std::mutex> lock(file.mutex);
+  file.output.open(path, std::ios::trunc);
+  if (!file.output) {
+    DFS_LOG(error) << "Tracer: Failed to open trace file: " << path;
+    return false;
+  }
+
+  file.output << "[\n";
+  file.first_event = true;
+  file.recorded = 0;
+  file.wall_offset = std::chrono::system_clock::now().time_since_epoch()
+                   - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                       Clock::now().time_since_epoch());
+  sample_every = every == 0 ? 1 : every;
+  roots_seen = 0;
+  enabled_ = true;
+
+  DFS_LOG(info) << "Tracer: Writing traces to " << path << ", sampling 1 in " << sample_every.load();
+  return true;
+}
+
+void Tracer::flush() {
+  TraceFile& file = trace_file();
+  std::lock_guard<std::mutex> lock(file.mutex);
+  if (file.output.is_open()) {
+    file.output.flush();
+  }
+}
+
+void Tracer::shutdown() {
+  TraceFile& file = trace_file();
+  std::lock_guard<std::mutex> lock(file.mutex);
+  enabled_ = false;
+  if (!file.output.is_open()) {
+    return;
+  }
+  file.output << "\n]\n";
+  file.output.close();
+  DFS_LOG(info) << "Tracer: Trace file closed after " << file.recorded << " events";
+}
+
+
+//==============================================
+// CONTEXT
+//==============================================
+
+TraceContext Tracer::current() {
+  return current_context;
+}
+
+void Tracer::set_current(const TraceContext& context) {
+  current_context = context;
+}
+
+std::uint64_t Tracer::new_id() {
+  thread_local std::mt19937_64 generator(
+    std::random_device{}() ^ std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  std::uint64_t id;
+  do {
+    id = generator();
+  } while (id == 0);
+  return id;
+}
+
+bool Tracer::sample_root() {
+  if (!enabled()) {
+    return false;
+  }
+  return roots_seen.fetch_add(1, std::memory_order_relaxed) % sample_every.load(std::memory_order_relaxed) == 0;
+}
+
+
+//==============================================
+// RECORDING
+//==============================================
+
+void Tracer::record(const char* name, std::uint64_t trace_id, std::uint64_t span_id,
+                    std::uint64_t parent_id, Clock::time_point start, Clock::time_point end,
+                    const std::string& detail) {
+  if (!enabled() || trace_id == 0) {
+    return;
+  }
+
+  static const long pid = static_cast<long>(::getpid());
+  thread_local const std::size_t tid = std::hash<std::thread::id>{}(std::this_thread::get_id()) % 1000000;
+
+  // Formatting happens outside the lock, only the write is serialized
+  TraceFile& file = trace_file();
+  auto wall_start = start.time_since_epoch() + file.wall_offset;
+  double ts = std::chrono::duration<double, std::micro>(wall_start).count();
+  double dur = std::chrono::duration<double, std::micro>(end - start).count();
+
+  std::string event;
+  event.reserve(256);
+  event += "{\"name\":\"";
+  append_escaped(event, name);
+  char numbers[128];
+  std::snprintf(numbers, sizeof(numbers), "\",\"cat\":\"dfs\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%zu",
+                ts, dur, pid, tid);
+  event += numbers;
+  event += ",\"args\":{\"trace_id\":\"" + hex_id(trace_id) + "\",\"span_id\":\"" + hex_id(span_id) + "\"";
+  if (parent_id != 0) {
+    event += ",\"parent_id\":\"" + hex_id(parent_id) + "\"";
+  }
+  if (!detail.empty()) {
+    event += ",\"detail\":\"";
+    append_escaped(event, detail);
+    event += "\"";
+  }
+  event += "}}";
+
+  std::lock_guard<std::mutex> lock(file.mutex);
+  if (!file.output.is_open()) {
+    return;
+  }
+  if (!file.first_event) {
+    file.output << ",\n";
+  }
+  file.output << event;
+  file.first_event = false;
+  ++file.recorded;
+}
+
+std::uint64_t Tracer::recorded() {
+  TraceFile& file = trace_file();
+  std::lock_guard<std::mutex> lock(file.mutex);
+  return file.recorded;
+}
+
+
+//==============================================
+// SPAN
+//==============================================
+
+Span::Span(const char* name, std::string detail)
+  : name_(name)
+  , detail_(std::move(detail)) {
+  begin(Tracer::current());
+}
+
+Span::Span(const char* name, const TraceContext& parent, std::string detail)
+  : name_(name)
+  , detail_(std::move(detail)) {
+  begin(parent);
+}
+
+Span::Span(const char* name, RootTag, std::string detail)
+  : name_(name)
+  , detail_(std::move(detail)) {
+  TraceContext parent;
+  if (Tracer::sample_root()) {
+    parent.trace_id = Tracer::new_id();
+  }
+  begin(parent);
+}
+
+Span Span::root(const char* name, std::string detail) {
+  return Span(name, RootTag{}, std::move(detail));
+}
+
+void Span::begin(const TraceContext& parent) {
+  previous_ = Tracer::current();
+  if (!parent.active() || !Tracer::enabled()) {
+    return;
+  }
+  context_.trace_id = parent.trace_id;
+  context_.span_id = Tracer::new_id();
+  parent_id_ = parent.span_id;
+  start_ = Tracer::Clock::now();
+  Tracer::set_current(context_);
+}
+
+Span::~Span() {
+  if (!context_.active()) {
+    return;
+  }
+  Tracer::record(name_, context_.trace_id, context_.span_id, parent_id_,
+                 start_, Tracer::Clock::now(), detail_);
+  Tracer::set_current(previous_);
+}
+
+} // namespace tracing
+} // namespace dfs
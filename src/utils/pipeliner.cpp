@@ -1,126 +1,504 @@
 #include "utils/pipeliner.hpp"
+#include "logger/logger.hpp"
+#include "metrics/hot_path.hpp"
 
 namespace dfs {
 namespace utils {
 
+//==============================================
+// STREAM ADAPTERS
+//==============================================
+
+ProducerFn adapt_producer(StreamProducerFn producer) {
+  return [producer = std::move(producer)](Chunk& output) {
+    std::stringstream stream;
+    if (!producer(stream)) {
+      return false;
+    }
+    output.append(stream.view());
+    return true;
+  };
+}
+
+TransformFn adapt_transform(StreamTransformFn transform) {
+  return [transform = std::move(transform)](Chunk& input, Chunk& output) {
+    std::stringstream current_stream(std::string(input.view()));
+    std::stringstream next_stream;
+    if (!transform(current_stream, next_stream)) {
+      return false;
+    }
+    output.append(next_stream.view());
+    return true;
+  };
+}
+
+FlushFn adapt_flush(StreamFlushFn flush) {
+  if (!flush) {
+    return nullptr;
+  }
+  return [flush = std::move(flush)](Chunk& output) {
+    std::stringstream stream;
+    if (!flush(stream)) {
+      return false;
+    }
+    output.append(stream.view());
+    return true;
+  };
+}
+
+
 //==============================================
 // CONSTRUCTOR AND DESTRUCTOR
 //==============================================
 
 Pipeliner::Pipeliner(ProducerFn producer)
-  : producer_(producer)
-  , buffer_size_(8192) 
-  , produced_(false)
-  , eof_(false) {}
+  : std::istream(nullptr)
+  , producer_(producer)
+  , buffer_size_(8192)
+  , queue_capacity_(4)
+  , chunk_buffer_(*this) {
+  rdbuf(&chunk_buffer_);
+}
+
+Pipeliner::~Pipeliner() {
+  cancel();
+}
+
 
-  
 //==============================================
-// PIPELINE CONSTRUCTION METHODS 
+// PIPELINE CONSTRUCTION METHODS
 //==============================================
-  
+
 PipelinerPtr Pipeliner::create(ProducerFn producer) {
   return std::make_shared<Pipeliner>(producer);
 }
-  
-PipelinerPtr Pipeliner::transform(TransformFn transform) {
-  transforms_.push_back(transform);
+
+PipelinerPtr Pipeliner::create(StreamProducerFn producer) {
+  return create(adapt_producer(std::move(producer)));
+}
+
+PipelinerPtr Pipeliner::transform(TransformFn transform, FlushFn flush) {
+  stages_.push_back(Stage{.transform = std::move(transform), .flush = std::move(flush)});
   return shared_from_this();
 }
 
-  
+PipelinerPtr Pipeliner::transform(StreamTransformFn transform, StreamFlushFn flush) {
+  return this->transform(adapt_transform(std::move(transform)), adapt_flush(std::move(flush)));
+}
+
+PipelinerPtr Pipeliner::transform_parallel(StreamTransformFn transform, std::size_t workers) {
+  return transform_parallel(adapt_transform(std::move(transform)), workers);
+}
+
+PipelinerPtr Pipeliner::transform_parallel(TransformFn transform, std::size_t workers) {
+  if (workers <= 1) {
+    return this->transform(std::move(transform));
+  }
+
+  Stage stage{.transform = std::move(transform), .workers = workers, .ordering = std::make_unique<Ordering>()};
+  stage.ordering->active_workers = workers;
+  stages_.push_back(std::move(stage));
+  return shared_from_this();
+}
+
+
 //==============================================
-// PIPELINE EXECUTION AND CONTROL METHODS 
+// PIPELINE EXECUTION AND CONTROL METHODS
 //==============================================
 
-void Pipeliner::flush() {
-  if (sync() != 0) { 
-    BOOST_LOG_TRIVIAL(error) << "Flush failed"; 
+void Pipeliner::start() {
+  if (started_.exchange(true)) {
+    return;
+  }
+
+  // One queue in front of every transform plus one feeding the reader
+  for (std::size_t i = 0; i <= stages_.size(); ++i) {
+    queues_.push_back(std::make_unique<BoundedQueue<Chunk>>(queue_capacity_));
   }
+  for (std::size_t i = 0; i < stages_.size(); ++i) {
+    if (!stages_[i].counters) {
+      stages_[i].counters = std::make_unique<StageCounters>("transform " + std::to_string(i + 1));
+    }
+  }
+  reader_returned_ = mark();
+
+  workers_.emplace_back(&Pipeliner::run_producer, this);
+  for (std::size_t i = 0; i < stages_.size(); ++i) {
+    if (stages_[i].ordering) {
+      for (std::size_t w = 0; w < stages_[i].workers; ++w) {
+        workers_.emplace_back(&Pipeliner::run_parallel_worker, this, i);
+      }
+    } else {
+      workers_.emplace_back(&Pipeliner::run_stage, this, i);
+    }
+  }
+
+  DFS_LOG(debug) << "Pipeliner: Started " << stages_.size() << " transform stages with "
+                           << queue_capacity_ << " chunks of " << buffer_size_ << " bytes per queue";
 }
 
-int Pipeliner::sync() {
-  // Only process data once
-  if (!produced_) {
-    produced_ = true;
-    if (!process_pipeline()) {
-      setstate(std::ios::failbit);
-      return -1;
+void Pipeliner::cancel() {
+  for (auto& queue : queues_) {
+    queue->cancel();
+  }
+  wake_ordered_stages();
+  for (auto& worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
     }
   }
-  return 0;
+  workers_.clear();
 }
 
-bool Pipeliner::process_next_chunk() {
+void Pipeliner::run_producer() {
+  auto& output = *queues_.front();
+  auto& counters = producer_counters_;
   try {
-    // Clear current chunk buffer
-    std::stringstream chunk;
-    chunk.str("");
+    while (true) {
+      Chunk chunk = take_chunk();
+      auto produce_start = mark();
+      // Producer returning false marks the end of data
+      bool produced = producer_(chunk) && !chunk.empty();
+      auto produce_end = mark();
+      StageCounters::add(counters.busy_ns, produce_start, produce_end);
+      if (!produced) {
+        break;
+      }
+      counters.bytes_out.fetch_add(chunk.size(), std::memory_order_relaxed);
+      counters.chunks.fetch_add(1, std::memory_order_relaxed);
 
-    // Get next chunk from producer
-    if (!producer_(chunk)) {
-      eof_ = true;
-      return false;
+      bool pushed = output.push(std::move(chunk));
+      StageCounters::add(counters.output_wait_ns, produce_end, mark());
+      if (!pushed) {
+        return;  // Pipeline was cancelled
+      }
     }
+  } catch (const std::exception& e) {
+    fail(std::string("Producer error: ") + e.what());
+    return;
+  }
+  output.close();
+}
 
-    // Check if we got any data
-    std::string chunk_data = chunk.str();
-    if (chunk_data.empty()) {
-      eof_ = true;
-      return false;
-    }
+void Pipeliner::run_stage(std::size_t index) {
+  auto& input = *queues_[index];
+  auto& output = *queues_[index + 1];
+  const Stage& stage = stages_[index];
+  auto& counters = *stage.counters;
 
-    // Process chunk through transforms
-    std::stringstream current_stream(chunk_data);
+  try {
+    Chunk current;
+    Chunk next;
+    while (true) {
+      auto pop_start = mark();
+      bool popped = input.pop(current);
+      auto transform_start = mark();
+      StageCounters::add(counters.input_wait_ns, pop_start, transform_start);
+      if (!popped) {
+        break;
+      }
+
+      next.clear();
+      std::size_t bytes_in = current.size();
+      if (!process_chunk(stage, current, next)) {
+        fail("Transform failed in pipeline");
+        return;
+      }
+      auto transform_end = mark();
+      StageCounters::add(counters.busy_ns, transform_start, transform_end);
+      counters.bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+      counters.bytes_out.fetch_add(next.size(), std::memory_order_relaxed);
+      counters.chunks.fetch_add(1, std::memory_order_relaxed);
 
-    for (const auto& transform : transforms_) {
-      std::stringstream next_stream;
-      if (!transform(current_stream, next_stream)) {
-        BOOST_LOG_TRIVIAL(error) << "Transform failed in pipeline";
-        return false;
+      bool pushed = output.push(std::move(next));
+      StageCounters::add(counters.output_wait_ns, transform_end, mark());
+      if (!pushed) {
+        return;
       }
-      current_stream = std::move(next_stream);
+      // The consumed input slab becomes the next output buffer
+      next = std::move(current);
     }
 
-    // Append transformed chunk to buffer
-    buffer_ << current_stream.rdbuf();
-    return true;
+    if (failed_) {
+      return;
+    }
 
+    // Input is exhausted, let the stage emit any trailing bytes
+    if (stage.flush) {
+      Chunk tail;
+      auto flush_start = mark();
+      if (!stage.flush(tail)) {
+        fail("Flush failed in pipeline");
+        return;
+      }
+      StageCounters::add(counters.busy_ns, flush_start, mark());
+      counters.bytes_out.fetch_add(tail.size(), std::memory_order_relaxed);
+      output.push(std::move(tail));
+    }
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Chunk processing error: " << e.what();
-    return false;
+    fail(std::string("Chunk processing error: ") + e.what());
+    return;
   }
+  output.close();
 }
 
-bool Pipeliner::process_pipeline() {
+void Pipeliner::run_parallel_worker(std::size_t index) {
+  auto& input = *queues_[index];
+  auto& output = *queues_[index + 1];
+  Stage& stage = stages_[index];
+  Ordering& ordering = *stage.ordering;
+  auto& counters = *stage.counters;
+
+  // Emits finished chunks once every earlier chunk has left the stage
+  auto emit_in_order = [&](std::size_t sequence, Chunk data) {
+    std::unique_lock<std::mutex> lock(ordering.mutex);
+    ordering.turn.wait(lock, [&] {
+      return stopping_ || ordering.next_output == sequence;
+    });
+    if (stopping_) {
+      return false;
+    }
+    // Holding the lock keeps later chunks behind this one while it is pushed
+    bool pushed = output.push(std::move(data));
+    ++ordering.next_output;
+    ordering.turn.notify_all();
+    return pushed;
+  };
+
   try {
-    // Process chunks until we have enough data
-    while (buffer_.tellp() < static_cast<std::streampos>(buffer_size_) && !eof_) {
-      if (!process_next_chunk() && !eof_) {
-        return false;
+    Chunk next;
+    while (true) {
+      Chunk current;
+      std::size_t sequence;
+      auto pop_start = mark();
+      {
+        // Popping and numbering together keeps sequence numbers in input order
+        std::lock_guard<std::mutex> lock(ordering.input_mutex);
+        if (!input.pop(current)) {
+          StageCounters::add(counters.input_wait_ns, pop_start, mark());
+          break;
+        }
+        sequence = ordering.next_input++;
       }
-    }
+      auto transform_start = mark();
+      StageCounters::add(counters.input_wait_ns, pop_start, transform_start);
 
-    // Set the processed chunks as our content
-    str(buffer_.str());
-    buffer_.str("");
-    return true;
+      next.clear();
+      std::size_t bytes_in = current.size();
+      if (!process_chunk(stage, current, next)) {
+        fail("Parallel transform failed in pipeline");
+        return;
+      }
+      auto transform_end = mark();
+      StageCounters::add(counters.busy_ns, transform_start, transform_end);
+      counters.bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+      counters.bytes_out.fetch_add(next.size(), std::memory_order_relaxed);
+      counters.chunks.fetch_add(1, std::memory_order_relaxed);
 
+      // Waiting for earlier chunks counts as output wait
+      bool emitted = emit_in_order(sequence, std::move(next));
+      StageCounters::add(counters.output_wait_ns, transform_end, mark());
+      if (!emitted) {
+        return;
+      }
+      next = std::move(current);
+    }
   } catch (const std::exception& e) {
-    BOOST_LOG_TRIVIAL(error) << "Pipeline processing error: " << e.what();
+    fail(std::string("Parallel chunk processing error: ") + e.what());
+    return;
+  }
+
+  // The last worker to finish closes the stage once its input is drained
+  std::lock_guard<std::mutex> lock(ordering.mutex);
+  if (--ordering.active_workers == 0 && !failed_) {
+    output.close();
+  }
+}
+
+bool Pipeliner::process_chunk(const Stage& stage, Chunk& input, Chunk& output) {
+  DFS_SCOPED_TIMER("pipeliner.process_chunk");
+  return stage.transform(input, output);
+}
+
+void Pipeliner::wake_ordered_stages() {
+  stopping_ = true;
+  for (auto& stage : stages_) {
+    if (stage.ordering) {
+      std::lock_guard<std::mutex> lock(stage.ordering->mutex);
+      stage.ordering->turn.notify_all();
+    }
+  }
+}
+
+void Pipeliner::fail(const std::string& reason) {
+  DFS_LOG(error) << "Pipeliner: " << reason;
+  failed_ = true;
+  for (auto& queue : queues_) {
+    queue->cancel();
+  }
+  wake_ordered_stages();
+}
+
+bool Pipeliner::next_chunk(Chunk& chunk) {
+  start();
+  auto& output = *queues_.back();
+  auto& counters = reader_counters_;
+
+  // Time since the last chunk was handed out is spent by the reader itself
+  auto pop_start = mark();
+  StageCounters::add(counters.busy_ns, reader_returned_, pop_start);
+
+  // The chunk the reader hands back has been consumed, its slab goes back to the producer
+  recycle_chunk(chunk);
+
+  bool popped = false;
+  while (output.pop(chunk)) {
+    if (!chunk.empty()) {
+      popped = true;
+      break;
+    }
+  }
+
+  reader_returned_ = mark();
+  StageCounters::add(counters.input_wait_ns, pop_start, reader_returned_);
+  if (popped) {
+    counters.bytes_in.fetch_add(chunk.size(), std::memory_order_relaxed);
+    counters.chunks.fetch_add(1, std::memory_order_relaxed);
+  }
+  return popped;
+}
+
+void Pipeliner::recycle_chunk(Chunk& chunk) {
+  if (chunk.capacity() < buffer_size_) {
+    return;
+  }
+  chunk.clear();
+  std::lock_guard<std::mutex> lock(spare_mutex_);
+  if (spare_chunks_.size() < queue_capacity_) {
+    spare_chunks_.push_back(std::move(chunk));
+  }
+}
+
+Chunk Pipeliner::take_chunk() {
+  {
+    std::lock_guard<std::mutex> lock(spare_mutex_);
+    if (!spare_chunks_.empty()) {
+      Chunk chunk = std::move(spare_chunks_.back());
+      spare_chunks_.pop_back();
+      return chunk;
+    }
+  }
+  return Chunk(buffer_size_);
+}
+
+Pipeliner::ChunkBuffer::int_type Pipeliner::ChunkBuffer::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+  if (!pipeline_.next_chunk(current_)) {
+    return traits_type::eof();
+  }
+  setg(current_.data(), current_.data(), current_.data() + current_.size());
+  return traits_type::to_int_type(*gptr());
+}
+
+bool Pipeliner::read_chunk(Chunk& chunk) {
+  // Hand out whatever an earlier stream read left buffered first
+  if (chunk_buffer_.gptr() < chunk_buffer_.egptr()) {
+    chunk.clear();
+    chunk.append(chunk_buffer_.gptr(), chunk_buffer_.egptr() - chunk_buffer_.gptr());
+    chunk_buffer_.setg(nullptr, nullptr, nullptr);
+    return true;
+  }
+  if (!next_chunk(chunk)) {
+    setstate(std::ios::eofbit);
     return false;
   }
+  return true;
+}
+
+
+//==============================================
+// INSTRUMENTATION
+//==============================================
+
+PipelinerPtr Pipeliner::named(const std::string& name) {
+  if (stages_.empty()) {
+    producer_counters_.name = name;
+  } else {
+    stages_.back().counters = std::make_unique<StageCounters>(name);
+  }
+  return shared_from_this();
+}
+
+StageStats Pipeliner::snapshot(const StageCounters& counters, std::size_t workers) {
+  StageStats stats;
+  stats.name = counters.name;
+  stats.workers = workers;
+  stats.busy = std::chrono::nanoseconds(counters.busy_ns.load(std::memory_order_relaxed));
+  stats.input_wait = std::chrono::nanoseconds(counters.input_wait_ns.load(std::memory_order_relaxed));
+  stats.output_wait = std::chrono::nanoseconds(counters.output_wait_ns.load(std::memory_order_relaxed));
+  stats.bytes_in = counters.bytes_in.load(std::memory_order_relaxed);
+  stats.bytes_out = counters.bytes_out.load(std::memory_order_relaxed);
+  stats.chunks = counters.chunks.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::vector<StageStats> Pipeliner::get_stats() const {
+  std::vector<StageStats> stats;
+  stats.push_back(snapshot(producer_counters_, 1));
+  for (const auto& stage : stages_) {
+    if (stage.counters) {
+      stats.push_back(snapshot(*stage.counters, stage.workers));
+    }
+  }
+  stats.push_back(snapshot(reader_counters_, 1));
+  return stats;
+}
+
+std::string Pipeliner::bottleneck() const {
+  auto stats = get_stats();
+  const StageStats* slowest = &stats.front();
+  for (const auto& stage : stats) {
+    if (stage.busy_per_worker() > slowest->busy_per_worker()) {
+      slowest = &stage;
+    }
+  }
+  return slowest->name;
 }
 
-  
+void Pipeliner::log_stats() const {
+  if (!stats_enabled_) {
+    return;
+  }
+
+  auto to_ms = [](std::chrono::nanoseconds ns) {
+    return std::chrono::duration<double, std::milli>(ns).count();
+  };
+  for (const auto& stage : get_stats()) {
+    DFS_LOG(info) << "Pipeliner: Stage " << stage.name
+                            << " busy " << to_ms(stage.busy) << "ms"
+                            << ", input wait " << to_ms(stage.input_wait) << "ms"
+                            << ", output wait " << to_ms(stage.output_wait) << "ms"
+                            << ", " << stage.chunks << " chunks"
+                            << ", " << stage.bytes_in << " bytes in"
+                            << ", " << stage.bytes_out << " bytes out";
+  }
+  DFS_LOG(info) << "Pipeliner: Bottleneck stage is " << bottleneck();
+}
+
+
 //==============================================
 // GETTERS AND SETTERS
 //==============================================
-  
+
 void Pipeliner::set_buffer_size(size_t size) {
   buffer_size_ = size;
 }
 
+void Pipeliner::set_queue_capacity(size_t chunks) {
+  queue_capacity_ = chunks;
+}
 
-  
 } // namespace utils
-} // namespace dfs
\ No newline at end of file
+} // namespace dfs